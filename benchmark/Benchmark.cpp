@@ -0,0 +1,408 @@
+// C++ includes
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// OpenSceneGraph includes
+#include <osg/Geode>
+#include <osg/Group>
+#include <osg/Image>
+#include <osg/ShapeDrawable>
+#include <osg/StateSet>
+#include <osg/Texture2D>
+#include <osg/Timer>
+
+// Rock includes
+#include <normal_depth_map/FrameCodec.hpp>
+#include <normal_depth_map/ImageViewerCaptureTool.hpp>
+#include <normal_depth_map/NormalDepthMap.hpp>
+#include <normal_depth_map/Tools.hpp>
+
+using namespace normal_depth_map;
+
+/**
+ * Performance benchmarks of the capture and shading pipeline.
+ *
+ * Usage: normal_depth_map_benchmark [--output file.json] [--filter text]
+ *                                   [--iterations n]
+ *
+ * Each scenario is executed a few times to warm up and then timed; the
+ * results are written as JSON (stdout by default) to be compared between
+ * releases on the same machine.
+ */
+
+struct BenchmarkResult {
+    std::string name;
+    std::vector<double> samples;    // milliseconds per iteration
+    double itemsPerIteration;
+};
+
+struct BenchmarkOptions {
+    BenchmarkOptions() : iterations(20), warmup(3) {}
+
+    std::string output;
+    std::string filter;
+    uint iterations;
+    uint warmup;
+};
+
+class Scenario {
+public:
+    virtual ~Scenario() {}
+    virtual void setUp() {}
+    virtual void run() = 0;
+    virtual void tearDown() {}
+
+    // amount of work items processed by one run (e.g. pixels, calls)
+    virtual double items() const { return 0; }
+};
+
+double percentile(std::vector<double> samples, double ratio) {
+    std::sort(samples.begin(), samples.end());
+    double position = ratio * (samples.size() - 1);
+    uint index = (uint) position;
+    if (index + 1 >= samples.size())
+        return samples.back();
+    double fraction = position - index;
+    return samples[index] * (1 - fraction) + samples[index + 1] * fraction;
+}
+
+void runScenario(   const std::string& name, Scenario& scenario,
+                    const BenchmarkOptions& options,
+                    std::vector<BenchmarkResult>& results,
+                    uint iterations = 0) {
+    if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+        return;
+
+    if (!iterations)
+        iterations = options.iterations;
+
+    std::cerr << "running " << name << std::endl;
+    scenario.setUp();
+    for (uint i = 0; i < options.warmup; ++i)
+        scenario.run();
+
+    BenchmarkResult result;
+    result.name = name;
+    result.itemsPerIteration = scenario.items();
+    osg::Timer timer;
+    for (uint i = 0; i < iterations; ++i) {
+        osg::Timer_t start = timer.tick();
+        scenario.run();
+        result.samples.push_back(timer.delta_m(start, timer.tick()));
+    }
+    scenario.tearDown();
+    results.push_back(result);
+}
+
+void writeJson(std::ostream& out, const std::vector<BenchmarkResult>& results) {
+    out << "{\n  \"suite\": \"normal_depth_map\",\n";
+    out << "  \"timestamp\": " << time(0) << ",\n";
+    out << "  \"unit\": \"ms\",\n  \"results\": [";
+    for (uint i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        double mean = 0;
+        for (uint j = 0; j < result.samples.size(); ++j)
+            mean += result.samples[j];
+        mean /= result.samples.size();
+
+        out << (i ? "," : "") << "\n    {";
+        out << "\"name\": \"" << result.name << "\", ";
+        out << "\"iterations\": " << result.samples.size() << ", ";
+        out << "\"min\": " << percentile(result.samples, 0) << ", ";
+        out << "\"median\": " << percentile(result.samples, 0.5) << ", ";
+        out << "\"mean\": " << mean << ", ";
+        out << "\"p95\": " << percentile(result.samples, 0.95) << ", ";
+        out << "\"max\": " << percentile(result.samples, 1);
+        if (result.itemsPerIteration > 0)
+            out << ", \"items_per_second\": " << result.itemsPerIteration * 1000.0 / mean;
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+////////////////////////////////
+////SCENES
+////////////////////////////////
+
+// objects spread on a grid in front of the camera (looking to -z)
+osg::ref_ptr<osg::Group> makeObjectScene(uint numObjects) {
+    osg::ref_ptr<osg::Group> root = new osg::Group();
+    osg::ref_ptr<osg::Geode> geode = new osg::Geode();
+    root->addChild(geode);
+
+    uint side = ceil(sqrt((double) numObjects));
+    double spacing = 40.0 / side;
+    osg::ref_ptr<osg::TessellationHints> hints = new osg::TessellationHints();
+    hints->setDetailRatio(0.5);
+
+    for (uint i = 0; i < numObjects; ++i) {
+        osg::Vec3 center((i % side - side * 0.5) * spacing,
+                         (i / side - side * 0.5) * spacing,
+                         -20 - (i % 7));
+        osg::ref_ptr<osg::Shape> shape;
+        if (i % 2)
+            shape = new osg::Sphere(center, spacing * 0.4);
+        else
+            shape = new osg::Box(center, spacing * 0.6);
+        geode->addDrawable(new osg::ShapeDrawable(shape, hints));
+    }
+    return root;
+}
+
+// procedural bumpy normal texture
+osg::ref_ptr<osg::Image> makeNormalTexture(uint size) {
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(size, size, 1, GL_RGB, GL_UNSIGNED_BYTE);
+    for (uint y = 0; y < size; ++y) {
+        for (uint x = 0; x < size; ++x) {
+            osg::Vec3 normal(sin(x * 0.2) * 0.3, cos(y * 0.2) * 0.3, 1);
+            normal.normalize();
+            unsigned char *pixel = image->data(x, y);
+            pixel[0] = (normal.x() * 0.5 + 0.5) * 255;
+            pixel[1] = (normal.y() * 0.5 + 0.5) * 255;
+            pixel[2] = (normal.z() * 0.5 + 0.5) * 255;
+        }
+    }
+    return image;
+}
+
+osg::ref_ptr<osg::Group> makeNormalMappedScene(uint numObjects) {
+    osg::ref_ptr<osg::Group> root = makeObjectScene(numObjects);
+
+    osg::ref_ptr<osg::Texture2D> texture = new osg::Texture2D(makeNormalTexture(256));
+    texture->setWrap(osg::Texture::WRAP_S, osg::Texture::REPEAT);
+    texture->setWrap(osg::Texture::WRAP_T, osg::Texture::REPEAT);
+
+    osg::ref_ptr<osg::StateSet> stateset = root->getOrCreateStateSet();
+    stateset->setTextureAttributeAndModes(1, texture, osg::StateAttribute::ON);
+    stateset->addUniform(new osg::Uniform("normalTexture", 1));
+    return root;
+}
+
+////////////////////////////////
+////SCENARIOS
+////////////////////////////////
+
+class ContextCreation : public Scenario {
+public:
+    void run() { ImageViewerCaptureTool capture(640, 480); }
+};
+
+class GrabImage : public Scenario {
+public:
+    GrabImage(osg::ref_ptr<osg::Group> scene, uint width, uint height)
+        : _scene(scene), _width(width), _height(height) {}
+
+    void setUp() {
+        _normalDepthMap = new NormalDepthMap(50, M_PI / 6, M_PI / 6);
+        _normalDepthMap->addNodeChild(_scene);
+        _capture = new ImageViewerCaptureTool(_width, _height);
+        _capture->setBackgroundColor(osg::Vec4d(0, 0, 0, 0));
+        _capture->setCameraPosition(osg::Vec3d(0, 0, 0), osg::Vec3d(0, 0, -1), osg::Vec3d(0, 1, 0));
+    }
+
+    void run() { _capture->grabImage(_normalDepthMap->getNormalDepthMapNode()); }
+
+    void tearDown() {
+        delete _capture;
+        delete _normalDepthMap;
+    }
+
+    double items() const { return _width * _height; }
+
+protected:
+    osg::ref_ptr<osg::Group> _scene;
+    uint _width, _height;
+    NormalDepthMap *_normalDepthMap;
+    ImageViewerCaptureTool *_capture;
+};
+
+class GrabIntoBuffer : public GrabImage {
+public:
+    GrabIntoBuffer(osg::ref_ptr<osg::Group> scene, uint width, uint height,
+                   GLenum pixelFormat, GLenum dataType)
+        : GrabImage(scene, width, height), _pixelFormat(pixelFormat),
+          _dataType(dataType) {}
+
+    void setUp() {
+        GrabImage::setUp();
+        osg::ref_ptr<osg::Image> image = _capture->grabImage(_normalDepthMap->getNormalDepthMapNode());
+        CaptureBuffer buffer(0, image->s(), image->t(), _pixelFormat, _dataType);
+        _memory.resize(buffer.requiredSize());
+        buffer.data = &_memory[0];
+        _capture->setCaptureBuffer(buffer);
+    }
+
+    void tearDown() {
+        _capture->releaseCaptureBuffer();
+        GrabImage::tearDown();
+    }
+
+private:
+    GLenum _pixelFormat, _dataType;
+    std::vector<unsigned char> _memory;
+};
+
+class AttenuationThroughput : public Scenario {
+public:
+    AttenuationThroughput() : _calls(1000000), _sum(0) {}
+
+    void run() {
+        for (uint i = 0; i < _calls; ++i)
+            _sum += underwaterSignalAttenuation(100 + i % 900, 20, i % 1000, 35, 8);
+    }
+
+    double items() const { return _calls; }
+
+private:
+    uint _calls;
+    volatile double _sum;
+};
+
+// same inputs as AttenuationThroughput, through the batch version
+class AttenuationBatchThroughput : public Scenario {
+public:
+    AttenuationBatchThroughput() : _calls(1000000) {}
+
+    void setUp() {
+        _frequency.resize(_calls);
+        _temperature.assign(_calls, 20);
+        _depth.resize(_calls);
+        _salinity.assign(_calls, 35);
+        _acidity.assign(_calls, 8);
+        _attenuation.resize(_calls);
+        for (uint i = 0; i < _calls; ++i) {
+            _frequency[i] = 100 + i % 900;
+            _depth[i] = i % 1000;
+        }
+    }
+
+    void run() {
+        underwaterSignalAttenuation(&_frequency[0], &_temperature[0], &_depth[0],
+                                    &_salinity[0], &_acidity[0], &_attenuation[0],
+                                    _calls);
+    }
+
+    double items() const { return _calls; }
+
+private:
+    uint _calls;
+    std::vector<double> _frequency, _temperature, _depth, _salinity, _acidity;
+    std::vector<double> _attenuation;
+};
+
+class CodecEncode : public Scenario {
+public:
+    CodecEncode(float errorBound) : _codec(errorBound) {}
+
+    void setUp() {
+        _image = new osg::Image();
+        _image->allocateImage(640, 480, 1, GL_RGB, GL_FLOAT);
+        memset(_image->data(), 0, _image->getTotalSizeInBytes());
+
+        // synthetic frame, half background and smooth gradients
+        for (uint y = 0; y < 480; ++y) {
+            float *row = (float*) _image->data(0, y);
+            for (uint x = 320; x < 640; ++x) {
+                row[x * 3 + 1] = y / 480.0;
+                row[x * 3 + 2] = x / 640.0;
+            }
+        }
+    }
+
+    void run() { _codec.encode(*_image, _output); }
+
+    double items() const { return 640 * 480; }
+
+private:
+    FrameCodec _codec;
+    osg::ref_ptr<osg::Image> _image;
+    std::vector<unsigned char> _output;
+};
+
+int main(int argc, char **argv) {
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (arg == "--output" && i + 1 < argc)
+            options.output = argv[++i];
+        else if (arg == "--filter" && i + 1 < argc)
+            options.filter = argv[++i];
+        else if (arg == "--iterations" && i + 1 < argc)
+            options.iterations = std::max(1, atoi(argv[++i]));
+        else {
+            std::cerr << "usage: " << argv[0]
+                      << " [--output file.json] [--filter text] [--iterations n]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<BenchmarkResult> results;
+
+    // micro benchmarks
+    ContextCreation contextCreation;
+    runScenario("context_creation", contextCreation, options, results, 5);
+
+    AttenuationThroughput attenuation;
+    runScenario("attenuation_scalar_1M", attenuation, options, results);
+
+    AttenuationBatchThroughput attenuationBatch;
+    runScenario("attenuation_batch_1M", attenuationBatch, options, results);
+
+    CodecEncode lossless(0), lossy(1e-4);
+    runScenario("codec_encode_lossless_640x480", lossless, options, results);
+    runScenario("codec_encode_1e-4_640x480", lossy, options, results);
+
+    // grab at several resolutions
+    osg::ref_ptr<osg::Group> scene = makeObjectScene(100);
+    uint widths[] = {256, 640, 1280, 1920};
+    uint heights[] = {256, 480, 960, 1440};
+    for (uint i = 0; i < 4; ++i) {
+        std::stringstream name;
+        name << "grab_image_" << widths[i] << "x" << heights[i];
+        GrabImage grab(scene, widths[i], heights[i]);
+        runScenario(name.str(), grab, options, results);
+    }
+
+    // readback formats, in a caller buffer
+    GLenum formats[] = {GL_RGB, GL_RGBA, GL_RGB, GL_RGB, GL_RGB};
+    GLenum types[] = {GL_FLOAT, GL_FLOAT, GL_HALF_FLOAT, GL_UNSIGNED_SHORT, GL_UNSIGNED_BYTE};
+    const char *formatNames[] = {"rgb_float", "rgba_float", "rgb_half", "rgb_ushort", "rgb_ubyte"};
+    for (uint i = 0; i < 5; ++i) {
+        GrabIntoBuffer grab(scene, 1280, 960, formats[i], types[i]);
+        runScenario(std::string("readback_") + formatNames[i] + "_1280x960", grab, options, results);
+    }
+
+    // untextured and normal mapped shading
+    GrabImage untextured(makeObjectScene(1000), 1280, 960);
+    runScenario("scene_untextured_1k", untextured, options, results);
+    GrabImage normalMapped(makeNormalMappedScene(1000), 1280, 960);
+    runScenario("scene_normal_mapped_1k", normalMapped, options, results);
+
+    // scene complexity
+    uint numObjects[] = {10, 100, 1000, 10000, 100000};
+    for (uint i = 0; i < 5; ++i) {
+        std::stringstream name;
+        name << "scene_objects_" << numObjects[i];
+        if (!options.filter.empty() && name.str().find(options.filter) == std::string::npos)
+            continue;
+        GrabImage grab(makeObjectScene(numObjects[i]), 640, 480);
+        runScenario(name.str(), grab, options, results, numObjects[i] > 10000 ? 5 : 0);
+    }
+
+    if (options.output.empty()) {
+        writeJson(std::cout, results);
+    } else {
+        std::ofstream file(options.output.c_str());
+        writeJson(file, results);
+    }
+    return 0;
+}
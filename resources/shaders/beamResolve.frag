@@ -0,0 +1,50 @@
+#version 130
+
+// supersampled normal depth map
+uniform sampler2D frame;
+
+// supersampled pixels per beam, in each direction
+uniform int factor;
+
+// filters of the depth and of the normal channels: 0 mean, 1 min, 2 max
+uniform int depthFilter;
+uniform int normalFilter;
+
+out vec4 out_data;
+
+// The mean counts the background as zero (it keeps the echo energy); the
+// min and the max only consider the pixels on objects.
+float resolve(int mode, float sum, float minimum, float maximum, int hits) {
+    if (hits == 0)
+        return 0.0;
+    if (mode == 1)
+        return minimum;
+    if (mode == 2)
+        return maximum;
+    return sum / float(factor * factor);
+}
+
+void main() {
+    ivec2 origin = ivec2(gl_FragCoord.xy) * factor;
+
+    vec2 sum = vec2(0, 0);
+    vec2 minimum = vec2(1e30, 1e30);
+    vec2 maximum = vec2(0, 0);
+    int hits = 0;
+    for (int j = 0; j < factor; ++j) {
+        for (int i = 0; i < factor; ++i) {
+            vec4 texel = texelFetch(frame, origin + ivec2(i, j), 0);
+            if (texel.w > 0) {
+                sum += texel.yz;
+                minimum = min(minimum, texel.yz);
+                maximum = max(maximum, texel.yz);
+                ++hits;
+            }
+        }
+    }
+
+    out_data = vec4(0,
+                    resolve(depthFilter, sum.x, minimum.x, maximum.x, hits),
+                    resolve(normalFilter, sum.y, minimum.y, maximum.y, hits),
+                    1.0);
+}
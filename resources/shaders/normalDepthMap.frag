@@ -3,6 +3,8 @@
 in vec3 pos;
 in vec3 normal;
 in mat3 TBN;
+in vec2 terrainCoord;
+in float terrainValid;
 
 uniform float farPlane;
 uniform bool drawNormal;
@@ -11,10 +13,79 @@ uniform sampler2D normalTexture;
 uniform float reflectance;
 uniform float attenuationCoeff;
 
+// Multi-frequency mode: one attenuated intensity per coefficient, packed
+// four per render target (out_intensity[0].x is the first frequency)
+#define MAX_FREQUENCIES 8
+uniform int numFrequencies;
+uniform float attenuationCoeffs[MAX_FREQUENCIES];
+
+// Ground truth outputs: object id of the node (0 if not set)
+uniform int objectId;
+
+// Heightfield mode: map area drawn by the finer clipmap level (min xy, max xy)
+uniform vec4 clipmapHole;
+
+// Water column mode: cumulative attenuation (red) and attenuation
+// coefficient (green) over the depth below the surface, one row per
+// frequency: the normal channel, then the multi-frequency intensities
+uniform bool waterColumn;
+uniform sampler2D waterColumnTexture;
+uniform int waterColumnFrequencies;  // rows after the normal channel
+uniform float waterColumnMaxDepth;
+uniform float waterSurface;         // world z of the surface
+uniform mat4 viewToWorld;           // inverse view matrix of the camera
+
+// mean attenuation coefficient of a straight path between two depths
+float columnAttenuation(int row, float depth0, float depth1) {
+    ivec2 size = textureSize(waterColumnTexture, 0);
+    float scale = float(size.x - 1) / waterColumnMaxDepth;
+    float y = (float(row) + 0.5) / float(size.y);
+
+    depth0 = clamp(depth0, 0.0, waterColumnMaxDepth);
+    depth1 = clamp(depth1, 0.0, waterColumnMaxDepth);
+    vec2 first = texture(waterColumnTexture, vec2((depth0 * scale + 0.5) / float(size.x), y)).rg;
+    vec2 second = texture(waterColumnTexture, vec2((depth1 * scale + 0.5) / float(size.x), y)).rg;
+
+    // the difference of the cumulative values loses its precision within
+    // one texel, where the coefficient is linear
+    if (abs(depth1 - depth0) * scale < 1.0)
+        return 0.5 * (first.g + second.g);
+    return (second.r - first.r) / (depth1 - depth0);
+}
+
+// Refraction mode: apparent range (red), apparent depression angle (green)
+// and 1 if reachable (blue), over the straight range (columns, from 0 to
+// refractionMaxRange) and depression angle (rows, from -PI/2 to PI/2)
+#define PI 3.1415926535897932384626433832795
+uniform bool refraction;
+uniform sampler2D refractionTexture;
+uniform float refractionMaxRange;
+
+// Beam pattern mode: two-way intensity gain over the horizontal (columns)
+// and vertical (rows) angles, from -limit to +limit
+uniform bool beamPattern;
+uniform sampler2D beamPatternTexture;
+uniform float limitHorizontalAngle;
+uniform float limitVerticalAngle;
+
 out vec4 out_data;
+out vec4 out_intensity[MAX_FREQUENCIES / 4];
+out vec4 out_position;  // view-space position, w = 1 on objects
+out vec4 out_label;     // object id, incidence angle (radians), 0, 1 on objects
 
 void main() {
+    // clipmap triangles without data, or under the finer level
+    if (terrainValid < 0.999
+        || (all(greaterThan(terrainCoord, clipmapHole.xy))
+            && all(lessThan(terrainCoord, clipmapHole.zw))))
+        discard;
+
     out_data = vec4(0, 0, 0, 0);
+    out_position = vec4(0, 0, 0, 0);
+    out_label = vec4(0, 0, 0, 0);
+    vec4 intensities[MAX_FREQUENCIES / 4];
+    intensities[0] = vec4(0, 0, 0, 0);
+    intensities[1] = vec4(0, 0, 0, 0);
 
     vec3 normNormal;
 
@@ -29,27 +100,84 @@ void main() {
     else
         normNormal = normalize(normal);
 
+    vec3 normPosition = normalize(-pos);
+
+    // Angle between the surface normal and the beam, before the reflectivity
+    float incidence = acos(clamp(dot(normPosition, normNormal), -1.0, 1.0));
+
     // Material's reflectivity property
     if (reflectance > 0)
         normNormal = min(normNormal * reflectance, 1.0);
 
-    vec3 normPosition = normalize(-pos);
-
     float linearDepth = sqrt(pos.z * pos.z + pos.x * pos.x + pos.y * pos.y);
 
+    // Intensity before the attenuation, shared by all frequencies
+    float intensity = abs(dot(normPosition, normNormal));
+
     // Attenuation effect of sound in the water
-    normNormal = normNormal * exp(-2 * attenuationCoeff * linearDepth);
+    float sonarDepth = waterSurface - viewToWorld[3].z;
+    float pointDepth = waterSurface - (viewToWorld * vec4(pos, 1.0)).z;
+    float coefficient = waterColumn ? columnAttenuation(0, sonarDepth, pointDepth) : attenuationCoeff;
+    float attenuation = exp(-2 * coefficient * linearDepth);
+
+    float range = linearDepth;
+    float apparentRange = range;
+    vec3 apparentPos = pos;
+    bool reachable = true;
+
+    // Apparent range and position of the curved ray, at the same azimuth
+    if (refraction && range <= refractionMaxRange) {
+        mat3 viewRotation = mat3(viewToWorld);
+        vec3 direction = viewRotation * pos / range;
+        float angle = asin(clamp(-direction.z, -1.0, 1.0));
+
+        ivec2 size = textureSize(refractionTexture, 0);
+        vec2 cell = vec2(range / refractionMaxRange, angle / PI + 0.5) * vec2(size - 1);
+        vec3 apparent = texture(refractionTexture, (cell + 0.5) / vec2(size)).rgb;
+
+        float horizontal = length(direction.xy);
+        if (horizontal > 0.0)
+            direction = vec3(direction.xy / horizontal * cos(apparent.g), -sin(apparent.g));
+        apparentPos = transpose(viewRotation) * direction * apparent.r;
+        apparentRange = apparent.r;
+        reachable = apparent.b > 0.5;
+    }
+
+    // Directivity of the transducer, no echo out of the angle limits
+    if (beamPattern) {
+        vec2 beamAngle = vec2(atan(apparentPos.x, -apparentPos.z),
+                              atan(apparentPos.y, length(apparentPos.xz)));
+        vec2 limits = vec2(limitHorizontalAngle, limitVerticalAngle);
 
+        if (any(greaterThan(abs(beamAngle), limits)))
+            intensity = 0.0;
+        else {
+            ivec2 size = textureSize(beamPatternTexture, 0);
+            vec2 cell = (beamAngle / limits * 0.5 + 0.5) * vec2(size - 1);
+            intensity *= texture(beamPatternTexture, (cell + 0.5) / vec2(size)).r;
+        }
+    }
+
+    float depth = apparentRange / farPlane;
     linearDepth = linearDepth / farPlane;
 
-    if (!(linearDepth > 1)) {
+    if (!(linearDepth > 1) && reachable) {
         if (drawNormal){
-            float value = dot(normPosition, normNormal);
-            out_data.zw = vec2( abs(value), 1.0);
+            out_data.zw = vec2(intensity * attenuation, 1.0);
+
+            for (int i = 0; i < numFrequencies; ++i)
+                intensities[i / 4][i % 4] = intensity * exp(-2 * range
+                    * (waterColumn && i < waterColumnFrequencies
+                       ? columnAttenuation(i + 1, sonarDepth, pointDepth) : attenuationCoeffs[i]));
         }
         if (drawDepth)
-            out_data.yw = vec2(linearDepth, 1.0);
+            out_data.yw = vec2(depth, 1.0);
+
+        out_position = vec4(apparentPos, 1.0);
+        out_label = vec4(float(objectId), incidence, 0, 1.0);
     }
 
+    out_intensity[0] = intensities[0];
+    out_intensity[1] = intensities[1];
     gl_FragDepth = linearDepth;
 }
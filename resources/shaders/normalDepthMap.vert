@@ -3,10 +3,90 @@
 out vec3 pos;
 out vec3 normal;
 out mat3 TBN;
+out vec2 terrainCoord;      // map position of the clipmap vertexes
+out float terrainValid;     // 0 on the clipmap vertexes without data
+
+// Heightfield mode: the vertexes are the integer coordinates of a clipmap
+// level grid, displaced by the height texture (one texel per bathymetry
+// sample, NaN without data)
+uniform bool heightfield;
+uniform sampler2D heightTexture;
+uniform float heightCellSize;
+uniform float clipmapSpacing;       // distance between the level vertexes
+uniform vec2 clipmapCenter;         // map position of the grid center
+uniform float clipmapHalfSize;      // grid half side, in vertexes
+uniform float clipmapMorphWidth;    // border band blended to the next level
+
+// height of a sample, false outside the map or without data
+bool readHeight(ivec2 texel, out float height) {
+    height = 0;
+    ivec2 size = textureSize(heightTexture, 0);
+    if (any(lessThan(texel, ivec2(0))) || any(greaterThanEqual(texel, size)))
+        return false;
+
+    height = texelFetch(heightTexture, texel, 0).r;
+    return !isnan(height);
+}
+
+// same central differences as BathymetrySource::getNormal
+vec3 heightNormal(ivec2 texel, float height) {
+    ivec2 size = textureSize(heightTexture, 0);
+    ivec2 low = max(texel - 1, ivec2(0));
+    ivec2 high = min(texel + 1, size - 1);
+
+    float left, right, bottom, top;
+    if (!readHeight(ivec2(low.x, texel.y), left))
+        left = height;
+    if (!readHeight(ivec2(high.x, texel.y), right))
+        right = height;
+    if (!readHeight(ivec2(texel.x, low.y), bottom))
+        bottom = height;
+    if (!readHeight(ivec2(texel.x, high.y), top))
+        top = height;
+
+    return normalize(vec3(-(right - left) / (float(high.x - low.x) * heightCellSize),
+                          -(top - bottom) / (float(high.y - low.y) * heightCellSize), 1));
+}
+
+ivec2 heightTexel(vec2 mapPosition) {
+    return ivec2(floor(mapPosition / heightCellSize + 0.5));
+}
 
 void main() {
-    pos = (gl_ModelViewMatrix * gl_Vertex).xyz;
-    normal = gl_NormalMatrix * gl_Normal;
+    vec4 vertex = gl_Vertex;
+    vec3 vertexNormal = gl_Normal;
+    terrainCoord = vec2(0, 0);
+    terrainValid = 1.0;
+
+    if (heightfield) {
+        vec2 grid = gl_Vertex.xy;
+        vec2 mapPosition = clipmapCenter + grid * clipmapSpacing;
+        ivec2 texel = heightTexel(mapPosition);
+
+        float height;
+        terrainValid = readHeight(texel, height) ? 1.0 : 0.0;
+        vertexNormal = heightNormal(texel, height);
+
+        // near the border, the vertexes between two vertexes of the next
+        // level move to its edges (triangles split from the lower left to
+        // the upper right corners), to meet it without cracks
+        float border = max(abs(grid.x), abs(grid.y));
+        if (clipmapMorphWidth > 0 && border > clipmapHalfSize - clipmapMorphWidth) {
+            vec2 odd = mod(floor(mapPosition / clipmapSpacing + 0.5), 2.0);
+            float first, second;
+            if (readHeight(heightTexel(mapPosition - odd * clipmapSpacing), first)
+                && readHeight(heightTexel(mapPosition + odd * clipmapSpacing), second)) {
+                float morph = (border - clipmapHalfSize + clipmapMorphWidth) / clipmapMorphWidth;
+                height = mix(height, 0.5 * (first + second), morph);
+            }
+        }
+
+        vertex = vec4(mapPosition, height, 1);
+        terrainCoord = mapPosition;
+    }
+
+    pos = (gl_ModelViewMatrix * vertex).xyz;
+    normal = gl_NormalMatrix * vertexNormal;
 
     // Normal maps are built in tangent space, interpolating the vertex normal and a RGB texture.
     // TBN is the conversion matrix between Tangent Space -> World Space.
@@ -15,6 +95,6 @@ void main() {
     vec3 b = cross(n, t) + cross(t, n);
     TBN = mat3(t, b, n);
 
-    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+    gl_Position = gl_ModelViewProjectionMatrix * vertex;
     gl_TexCoord[0] = gl_MultiTexCoord0;
 }
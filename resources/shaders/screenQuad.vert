@@ -0,0 +1,6 @@
+#version 130
+
+// screen aligned quad, already in normalized device coordinates
+void main() {
+    gl_Position = gl_Vertex;
+}
@@ -0,0 +1,38 @@
+#version 130
+
+// normal depth map slices of both sides
+uniform sampler2D portSlice;
+uniform sampler2D starboardSlice;
+
+// range bins per side
+uniform int numBins;
+
+out vec4 out_data;
+
+// Sums the normal values of the slice pixels whose depth falls in a bin,
+// divided by the number of slice pixels.
+float rangeBin(sampler2D slice, int bin) {
+    ivec2 size = textureSize(slice, 0);
+    float sum = 0;
+    for (int j = 0; j < size.y; ++j) {
+        for (int i = 0; i < size.x; ++i) {
+            vec4 texel = texelFetch(slice, ivec2(i, j), 0);
+            if (texel.w > 0 && min(int(texel.y * numBins), numBins - 1) == bin)
+                sum += texel.z;
+        }
+    }
+    return sum / float(size.x * size.y);
+}
+
+// One waterfall line: port bins from far to near, then starboard bins from
+// near to far.
+void main() {
+    int x = int(gl_FragCoord.x);
+    float value;
+    if (x < numBins)
+        value = rangeBin(portSlice, numBins - 1 - x);
+    else
+        value = rangeBin(starboardSlice, x - numBins);
+
+    out_data = vec4(value, 0, 0, 1);
+}
@@ -0,0 +1,34 @@
+#version 130
+
+// normal depth map faces, one layer per face, side by side in azimuth
+uniform sampler2DArray faces;
+uniform int numFaces;
+
+// total apertures of the output (in radians)
+uniform float fovX;
+uniform float fovY;
+
+// tangent of the half apertures of a face
+uniform vec2 faceTanHalf;
+
+// output size in pixels
+uniform vec2 outputSize;
+
+out vec4 out_data;
+
+// Equiangular layout: each column is one azimuth (from left to right) and
+// each row one elevation (from bottom to top). The depth and normal values
+// do not depend on the camera rotation, so the faces are just resampled.
+void main() {
+    vec2 uv = gl_FragCoord.xy / outputSize;
+    float azimuth = (uv.x - 0.5) * fovX;
+    float elevation = (uv.y - 0.5) * fovY;
+
+    float faceFov = fovX / float(numFaces);
+    int face = clamp(int((azimuth + 0.5 * fovX) / faceFov), 0, numFaces - 1);
+    float localAzimuth = azimuth - (-0.5 * fovX + (float(face) + 0.5) * faceFov);
+
+    // projection of the ray on the face plane
+    vec2 ndc = vec2(tan(localAzimuth), tan(elevation) / cos(localAzimuth)) / faceTanHalf;
+    out_data = texture(faces, vec3(ndc * 0.5 + 0.5, float(face)));
+}
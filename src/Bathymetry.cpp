@@ -0,0 +1,99 @@
+#include "Bathymetry.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <osg/Math>
+
+namespace normal_depth_map {
+
+bool BathymetrySource::sampleElevationRange(uint x0, uint y0, uint x1, uint y1,
+                                            float& min, float& max,
+                                            uint steps) const {
+    min = FLT_MAX;
+    max = -FLT_MAX;
+    steps = std::max(steps, 2u);
+
+    for (uint j = 0; j < steps; ++j) {
+        uint y = y0 + (unsigned long long) (y1 - y0) * j / (steps - 1);
+        for (uint i = 0; i < steps; ++i) {
+            float value = getElevation(x0 + (unsigned long long) (x1 - x0) * i / (steps - 1), y);
+            if (osg::isNaN(value))
+                continue;
+            min = std::min(min, value);
+            max = std::max(max, value);
+        }
+    }
+    return min <= max;
+}
+
+osg::Vec3 BathymetrySource::getNormal(uint x, uint y) const {
+    float z = getElevation(x, y);
+    if (osg::isNaN(z))
+        return osg::Vec3(0, 0, 1);
+
+    uint left = x > 0 ? x - 1 : x, right = std::min(x + 1, getWidth() - 1);
+    uint bottom = y > 0 ? y - 1 : y, top = std::min(y + 1, getHeight() - 1);
+
+    float zl = getElevation(left, y), zr = getElevation(right, y);
+    float zb = getElevation(x, bottom), zt = getElevation(x, top);
+    zl = osg::isNaN(zl) ? z : zl;
+    zr = osg::isNaN(zr) ? z : zr;
+    zb = osg::isNaN(zb) ? z : zb;
+    zt = osg::isNaN(zt) ? z : zt;
+
+    osg::Vec3 normal(   -(zr - zl) / ((right - left) * getCellSize()),
+                        -(zt - zb) / ((top - bottom) * getCellSize()), 1);
+    normal.normalize();
+    return normal;
+}
+
+BathymetryGrid::BathymetryGrid(uint width, uint height, float cellSize, float value)
+    : _width(width), _height(height), _cell_size(cellSize) {
+
+    if (width < 2 || height < 2 || !(cellSize > 0))
+        throw std::invalid_argument("BathymetryGrid: the grid needs 2x2 samples and a positive cell size");
+    _elevations.resize((size_t) width * height, value);
+}
+
+MappedBathymetry::MappedBathymetry(const std::string& path, uint width,
+                                    uint height, float cellSize,
+                                    size_t offset, float noData)
+    : _width(width), _height(height), _cell_size(cellSize), _no_data(noData),
+      _mapping(MAP_FAILED), _mapping_size(0), _samples(0) {
+
+    if (width < 2 || height < 2 || !(cellSize > 0))
+        throw std::invalid_argument("MappedBathymetry: the grid needs 2x2 samples and a positive cell size");
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("MappedBathymetry: can not open " + path);
+
+    struct stat status;
+    if (fstat(fd, &status) < 0
+        || (size_t) status.st_size < offset + (size_t) width * height * sizeof(float)) {
+        close(fd);
+        throw std::runtime_error("MappedBathymetry: " + path + " is smaller than the grid");
+    }
+
+    _mapping_size = status.st_size;
+    _mapping = mmap(0, _mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (_mapping == MAP_FAILED)
+        throw std::runtime_error("MappedBathymetry: can not map " + path);
+
+    _samples = (const float*) ((const char*) _mapping + offset);
+}
+
+MappedBathymetry::~MappedBathymetry() {
+    if (_mapping != MAP_FAILED)
+        munmap(_mapping, _mapping_size);
+}
+
+} /* namespace normal_depth_map */
@@ -0,0 +1,116 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_BATHYMETRY_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_BATHYMETRY_HPP_
+
+#include <limits>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include <osg/Referenced>
+#include <osg/Vec3>
+
+namespace normal_depth_map {
+
+/**
+ * @brief Regular grid of seabed elevations
+ *
+ *  The sample (x, y) is at (x * cellSize, y * cellSize) from the grid
+ *  origin, with the elevation z (negative below the surface). Samples without
+ *  data are NaN. Implementations are read from the loading threads, so
+ *  getElevation must be thread safe.
+ */
+class BathymetrySource : public osg::Referenced {
+public:
+    virtual uint getWidth() const = 0;
+    virtual uint getHeight() const = 0;
+    virtual float getCellSize() const = 0;
+    virtual float getElevation(uint x, uint y) const = 0;
+
+    /**
+     * @brief Elevation range of a block of samples, sampled on a coarse grid
+     *
+     *  @param x0, y0, x1, y1: first and last samples of the block
+     *  @param steps: number of samples read on each axis; from the block
+     *   side plus one, all the samples are read and the range is exact
+     *  @return false if all read samples are NaN
+     */
+    bool sampleElevationRange(  uint x0, uint y0, uint x1, uint y1,
+                                float& min, float& max, uint steps = 9) const;
+
+    /**
+     * @brief Surface normal at a sample, by central differences
+     *
+     *  The neighbours without data are replaced by the sample itself.
+     */
+    osg::Vec3 getNormal(uint x, uint y) const;
+};
+
+/**
+ * @brief Bathymetry in memory
+ */
+class BathymetryGrid : public BathymetrySource {
+public:
+    BathymetryGrid(uint width, uint height, float cellSize, float value = 0);
+
+    uint getWidth() const { return _width; }
+    uint getHeight() const { return _height; }
+    float getCellSize() const { return _cell_size; }
+    float getElevation(uint x, uint y) const { return _elevations[y * _width + x]; }
+
+    void setElevation(uint x, uint y, float value) { _elevations[y * _width + x] = value; }
+
+private:
+    uint _width;
+    uint _height;
+    float _cell_size;
+    std::vector<float> _elevations;
+};
+
+/**
+ * @brief Bathymetry read from a raw float grid mapped in memory
+ *
+ *  The file is mapped read-only, so only the pages of the read regions are
+ *  loaded, and the system can drop them under memory pressure; grids
+ *  larger than the RAM can be used.
+ */
+class MappedBathymetry : public BathymetrySource {
+public:
+
+    /**
+     *  @param path: file of width * height floats in the machine byte
+     *   order, row after row from y = 0
+     *  @param cellSize: distance between two samples
+     *  @param offset: size of the header before the samples, in bytes
+     *  @param noData: elevation of the samples without data (NaN samples
+     *   are always without data)
+     *  It throws std::runtime_error if the file can not be mapped or is
+     *  too small.
+     */
+    MappedBathymetry(   const std::string& path, uint width, uint height,
+                        float cellSize, size_t offset = 0,
+                        float noData = std::numeric_limits<float>::quiet_NaN());
+    ~MappedBathymetry();
+
+    uint getWidth() const { return _width; }
+    uint getHeight() const { return _height; }
+    float getCellSize() const { return _cell_size; }
+
+    float getElevation(uint x, uint y) const {
+        float value = _samples[(size_t) y * _width + x];
+        return value == _no_data ? std::numeric_limits<float>::quiet_NaN() : value;
+    }
+
+private:
+    uint _width;
+    uint _height;
+    float _cell_size;
+    float _no_data;
+
+    void *_mapping;
+    size_t _mapping_size;
+    const float *_samples;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_BATHYMETRY_HPP_ */
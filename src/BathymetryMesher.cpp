@@ -0,0 +1,330 @@
+#include "BathymetryMesher.hpp"
+
+#include <osg/Geode>
+#include <osg/Math>
+#include <osg/MatrixTransform>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace normal_depth_map {
+
+namespace {
+
+/**
+ * Largest vertical distance between the samples inside a triangle and the
+ * triangle, FLT_MAX if a sample has no data. It stops on the first distance
+ * above the limit.
+ */
+float triangleError(const std::vector<float>& elevations, uint size, float limit,
+                    int ax, int ay, int bx, int by, int cx, int cy) {
+    float za = elevations[ay * size + ax];
+    float zb = elevations[by * size + bx];
+    float zc = elevations[cy * size + cx];
+    int area = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+
+    float error = 0;
+    for (int y = std::min(ay, std::min(by, cy)); y <= std::max(ay, std::max(by, cy)); ++y) {
+        for (int x = std::min(ax, std::min(bx, cx)); x <= std::max(ax, std::max(bx, cx)); ++x) {
+            // barycentric coordinates, scaled by the doubled area
+            int wa = (bx - x) * (cy - y) - (by - y) * (cx - x);
+            int wb = (cx - x) * (ay - y) - (cy - y) * (ax - x);
+            int wc = area - wa - wb;
+            if ((area > 0 && (wa < 0 || wb < 0 || wc < 0))
+                || (area < 0 && (wa > 0 || wb > 0 || wc > 0)))
+                continue;
+
+            float z = (wa * za + wb * zb + wc * zc) / area;
+            float difference = fabs(z - elevations[y * size + x]);
+            if (osg::isNaN(difference))
+                return FLT_MAX;
+            if (difference > limit)
+                return difference;
+            error = std::max(error, difference);
+        }
+    }
+    return error;
+}
+
+/**
+ * Splits the triangles of a right-triangulated irregular network, from the
+ * errors of their longest edge middles, and keeps the grid indexes of the
+ * final triangles.
+ */
+struct NetworkSplit {
+    const std::vector<float>& elevations;
+    const std::vector<float>& errors;
+    uint size;
+    float maxError;
+    std::vector<uint> triangles;
+
+    NetworkSplit(   const std::vector<float>& elevations,
+                    const std::vector<float>& errors, uint size, float maxError)
+        : elevations(elevations), errors(errors), size(size), maxError(maxError) {}
+
+    // a, b: ends of the longest edge, c: right angle corner
+    void split(uint ax, uint ay, uint bx, uint by, uint cx, uint cy) {
+        uint mx = (ax + bx) >> 1, my = (ay + by) >> 1;
+        uint legLength = std::max(ax, cx) - std::min(ax, cx) + std::max(ay, cy) - std::min(ay, cy);
+
+        if (legLength > 1 && errors[my * size + mx] > maxError) {
+            split(cx, cy, ax, ay, mx, my);
+            split(bx, by, cx, cy, mx, my);
+            return;
+        }
+
+        uint a = ay * size + ax, b = by * size + bx, c = cy * size + cx;
+        if (osg::isNaN(elevations[a]) || osg::isNaN(elevations[b]) || osg::isNaN(elevations[c]))
+            return;
+
+        // counterclockwise seen from above
+        triangles.push_back(a);
+        triangles.push_back(c);
+        triangles.push_back(b);
+    }
+};
+
+}
+
+/**
+ * Reads the samples of one row of a region, with their normals.
+ */
+class BathymetryMesher::RowTask : public ParallelTask {
+public:
+    RowTask(const BathymetrySource& source, uint x0, uint y0, uint width,
+            osg::Vec3Array *vertexes, osg::Vec3Array *normals,
+            std::vector<float>& elevations)
+        : _source(source), _x0(x0), _y0(y0), _width(width),
+          _vertexes(vertexes), _normals(normals), _elevations(elevations) {}
+
+    void run(uint row) {
+        float cellSize = _source.getCellSize();
+        for (uint i = 0; i < _width; ++i) {
+            uint index = row * _width + i;
+            float z = _source.getElevation(_x0 + i, _y0 + row);
+            _elevations[index] = z;
+            (*_vertexes)[index] = osg::Vec3(i * cellSize, row * cellSize, osg::isNaN(z) ? 0 : z);
+            (*_normals)[index] = _source.getNormal(_x0 + i, _y0 + row);
+        }
+    }
+
+private:
+    const BathymetrySource& _source;
+    uint _x0, _y0, _width;
+    osg::Vec3Array *_vertexes;
+    osg::Vec3Array *_normals;
+    std::vector<float>& _elevations;
+};
+
+/**
+ * Builds the tiles of a scene, each one on a single thread.
+ */
+class BathymetryMesher::TileTask : public ParallelTask {
+public:
+    TileTask(const BathymetryMesher& mesher, uint tileSize, uint tilesX,
+             std::vector<osg::ref_ptr<osg::Geometry> >& geometries)
+        : _mesher(mesher), _tile_size(tileSize), _tiles_x(tilesX),
+          _geometries(geometries) {}
+
+    void run(uint index) {
+        const BathymetrySource& source = *_mesher._source;
+        uint x0 = (index % _tiles_x) * _tile_size, y0 = (index / _tiles_x) * _tile_size;
+        uint x1 = std::min(x0 + _tile_size, source.getWidth() - 1);
+        uint y1 = std::min(y0 + _tile_size, source.getHeight() - 1);
+        _geometries[index] = _mesher.buildGeometry(x0, y0, x1, y1, 0);
+    }
+
+private:
+    const BathymetryMesher& _mesher;
+    uint _tile_size, _tiles_x;
+    std::vector<osg::ref_ptr<osg::Geometry> >& _geometries;
+};
+
+BathymetryMesher::BathymetryMesher(osg::ref_ptr<BathymetrySource> source, ThreadPool *pool)
+    : _source(source), _pool(pool ? pool : &ThreadPool::instance()),
+      _max_error(0) {}
+
+osg::ref_ptr<osg::Geometry> BathymetryMesher::createGeometry(uint x0, uint y0,
+                                                             uint x1, uint y1) const {
+    return buildGeometry(x0, y0, x1, y1, _pool);
+}
+
+osg::ref_ptr<osg::Geometry> BathymetryMesher::buildGeometry(uint x0, uint y0,
+                                                            uint x1, uint y1,
+                                                            ThreadPool *pool) const {
+    uint width = x1 - x0 + 1, height = y1 - y0 + 1;
+    osg::ref_ptr<osg::Vec3Array> vertexes = new osg::Vec3Array(width * height);
+    osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array(width * height);
+    std::vector<float> elevations(width * height);
+
+    RowTask task(*_source, x0, y0, width, vertexes, normals, elevations);
+    if (pool)
+        pool->parallelFor(height, task);
+    else
+        for (uint row = 0; row < height; ++row)
+            task.run(row);
+
+    osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry();
+    geometry->setUseDisplayList(false);
+    geometry->setUseVertexBufferObjects(true);
+    geometry->setVertexArray(vertexes);
+    geometry->setNormalArray(normals);
+    geometry->setNormalBinding(osg::Geometry::BIND_PER_VERTEX);
+
+    uint side = width - 1;
+    if (_max_error > 0 && width == height && (side & (side - 1)) == 0)
+        addNetwork(side, elevations, geometry);
+    else
+        addStrip(width, height, elevations, geometry);
+    return geometry;
+}
+
+void BathymetryMesher::addStrip(uint width, uint height,
+                                const std::vector<float>& elevations,
+                                osg::Geometry *geometry) const {
+    osg::ref_ptr<osg::DrawElementsUInt> strip = new osg::DrawElementsUInt(GL_TRIANGLE_STRIP);
+    strip->reserve(2 * width * (height - 1) + 2 * height);
+
+    for (uint j = 0; j + 1 < height; ++j) {
+        uint i = 0;
+        while (i < width) {
+            // run of columns with data on the two rows
+            uint first = i;
+            while (i < width && !osg::isNaN(elevations[j * width + i])
+                   && !osg::isNaN(elevations[(j + 1) * width + i]))
+                ++i;
+
+            if (i - first > 1) {
+                // degenerate triangles from the previous run, which has an
+                // even length, so the winding is kept
+                if (!strip->empty()) {
+                    strip->push_back(strip->back());
+                    strip->push_back((j + 1) * width + first);
+                }
+
+                for (uint k = first; k < i; ++k) {
+                    strip->push_back((j + 1) * width + k);
+                    strip->push_back(j * width + k);
+                }
+            }
+            ++i;
+        }
+    }
+
+    if (!strip->empty())
+        geometry->addPrimitiveSet(strip);
+}
+
+void BathymetryMesher::addNetwork(  uint side, const std::vector<float>& elevations,
+                                    osg::Geometry *geometry) const {
+    uint size = side + 1;
+    std::vector<float> errors(size * size, 0);
+
+    // errors of the triangles, kept on the middles of their longest edges
+    // (shared by the two triangles to split together), from the smallest
+    // triangles to the largest, each one bounding the errors of its
+    // children. Triangles are numbered as a binary tree under the two halves
+    // of the square.
+    uint numTriangles = side * side * 2 - 2;
+    uint numParents = numTriangles - side * side;
+    for (uint i = numTriangles; i-- > 0;) {
+        uint id = i + 2;
+        uint ax = 0, ay = 0, bx = 0, by = 0, cx = 0, cy = 0;
+        if (id & 1) {
+            bx = by = cx = side;
+        } else {
+            ax = ay = cy = side;
+        }
+
+        while ((id >>= 1) > 1) {
+            uint mx = (ax + bx) >> 1, my = (ay + by) >> 1;
+            if (id & 1) {
+                bx = ax; by = ay;
+                ax = cx; ay = cy;
+            } else {
+                ax = bx; ay = by;
+                bx = cx; by = cy;
+            }
+            cx = mx; cy = my;
+        }
+
+        uint middle = ((ay + by) >> 1) * size + ((ax + bx) >> 1);
+        if (i < numParents) {
+            uint left = ((ay + cy) >> 1) * size + ((ax + cx) >> 1);
+            uint right = ((by + cy) >> 1) * size + ((bx + cx) >> 1);
+            errors[middle] = std::max(errors[middle], std::max(errors[left], errors[right]));
+        }
+
+        // only the comparison with the max error matters, so a triangle
+        // already split is not measured
+        if (errors[middle] > _max_error)
+            continue;
+
+        // the borders and the samples without data keep the full resolution
+        bool border = (ax == bx && (ax == 0 || ax == side))
+                      || (ay == by && (ay == 0 || ay == side));
+        float error = border ? FLT_MAX
+            : triangleError(elevations, size, _max_error, ax, ay, bx, by, cx, cy);
+        errors[middle] = std::max(errors[middle], error);
+    }
+
+    NetworkSplit network(elevations, errors, size, _max_error);
+    network.split(0, 0, side, side, side, 0);
+    network.split(side, side, 0, 0, 0, side);
+    if (network.triangles.empty())
+        return;
+
+    // only the used samples are kept
+    const osg::Vec3Array *vertexes = static_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+    const osg::Vec3Array *normals = static_cast<const osg::Vec3Array*>(geometry->getNormalArray());
+    osg::ref_ptr<osg::Vec3Array> usedVertexes = new osg::Vec3Array();
+    osg::ref_ptr<osg::Vec3Array> usedNormals = new osg::Vec3Array();
+    osg::ref_ptr<osg::DrawElementsUInt> triangles = new osg::DrawElementsUInt(GL_TRIANGLES);
+    triangles->reserve(network.triangles.size());
+
+    std::vector<int> remap(size * size, -1);
+    for (uint i = 0; i < network.triangles.size(); ++i) {
+        uint sample = network.triangles[i];
+        if (remap[sample] < 0) {
+            remap[sample] = usedVertexes->size();
+            usedVertexes->push_back((*vertexes)[sample]);
+            usedNormals->push_back((*normals)[sample]);
+        }
+        triangles->push_back(remap[sample]);
+    }
+
+    geometry->setVertexArray(usedVertexes);
+    geometry->setNormalArray(usedNormals);
+    geometry->setNormalBinding(osg::Geometry::BIND_PER_VERTEX);
+    geometry->addPrimitiveSet(triangles);
+}
+
+osg::ref_ptr<osg::Group> BathymetryMesher::createScene(uint tileSize,
+                                                       const osg::Vec3d& origin) const {
+    uint tilesX = (_source->getWidth() - 2) / tileSize + 1;
+    uint tilesY = (_source->getHeight() - 2) / tileSize + 1;
+
+    std::vector<osg::ref_ptr<osg::Geometry> > geometries(tilesX * tilesY);
+    TileTask task(*this, tileSize, tilesX, geometries);
+    _pool->parallelForStealing(geometries.size(), task);
+
+    float cellSize = _source->getCellSize();
+    osg::ref_ptr<osg::Group> scene = new osg::Group();
+    for (uint i = 0; i < geometries.size(); ++i) {
+        if (!geometries[i]->getNumPrimitiveSets())
+            continue;
+
+        osg::ref_ptr<osg::Geode> geode = new osg::Geode();
+        geode->addDrawable(geometries[i]);
+
+        uint x0 = (i % tilesX) * tileSize, y0 = (i / tilesX) * tileSize;
+        osg::ref_ptr<osg::MatrixTransform> transform = new osg::MatrixTransform(
+            osg::Matrix::translate(origin + osg::Vec3d(x0 * cellSize, y0 * cellSize, 0)));
+        transform->addChild(geode);
+        scene->addChild(transform);
+    }
+    return scene;
+}
+
+} /* namespace normal_depth_map */
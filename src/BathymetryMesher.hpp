@@ -0,0 +1,86 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_BATHYMETRYMESHER_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_BATHYMETRYMESHER_HPP_
+
+#include <vector>
+
+#include <osg/Geometry>
+#include <osg/Group>
+#include <osg/Vec3d>
+#include <osg/ref_ptr>
+
+#include "Bathymetry.hpp"
+#include "ThreadPool.hpp"
+
+namespace normal_depth_map {
+
+/**
+ * @brief Builds the seabed meshes of a bathymetry, for the normal depth map
+ *
+ *  The geometries have per vertex normals (central differences of the full
+ *  grid, so the shading does not depend on the decimation) and vertex buffer
+ *  objects. The samples are read and the normals computed by rows on a
+ *  ThreadPool; with a MappedBathymetry only the pages of the built regions
+ *  are read.
+ *
+ *  With a zero max error, a region is one indexed triangle strip over all
+ *  its samples (rows joined by degenerate triangles). With a positive max
+ *  error, square regions of 2^n cells are decimated as a right-triangulated
+ *  irregular network: a triangle is split in two on the middle of its
+ *  longest edge until the samples inside it are within the max error of
+ *  its plane. The split order keeps the mesh without T-junctions, and the
+ *  samples on the region borders are all kept, so neighbour regions match.
+ *  Other regions are not decimated.
+ *
+ *  The samples without data are left out with the cells around them.
+ */
+class BathymetryMesher {
+public:
+
+    /**
+     *  @param pool: threads of the row passes, the shared pool by default
+     */
+    BathymetryMesher(osg::ref_ptr<BathymetrySource> source, ThreadPool *pool = 0);
+
+    // max vertical error of the decimation, 0 keeps all samples
+    void setMaxError(float maxError) { _max_error = maxError; }
+    float getMaxError() const { return _max_error; }
+
+    /**
+     * @brief Mesh of the samples [x0, x1] x [y0, y1]
+     *
+     *  The vertexes are relative to the sample (x0, y0), to keep the float
+     *  precision far from the map origin.
+     */
+    osg::ref_ptr<osg::Geometry> createGeometry(uint x0, uint y0, uint x1, uint y1) const;
+
+    /**
+     * @brief Mesh of the whole bathymetry, as tiles built in parallel
+     *
+     *  Each tile is a MatrixTransform at its first sample, over a geode of
+     *  its geometry; the tiles without data are left out.
+     *
+     *  @param tileSize: tile side, in cells (a power of two to decimate)
+     *  @param origin: world position of the sample (0, 0)
+     */
+    osg::ref_ptr<osg::Group> createScene(uint tileSize = 256,
+                                         const osg::Vec3d& origin = osg::Vec3d()) const;
+
+private:
+    class RowTask;
+    class TileTask;
+
+    osg::ref_ptr<osg::Geometry> buildGeometry(  uint x0, uint y0, uint x1, uint y1,
+                                                ThreadPool *pool) const;
+    void addStrip(  uint width, uint height, const std::vector<float>& elevations,
+                    osg::Geometry *geometry) const;
+    void addNetwork(uint side, const std::vector<float>& elevations,
+                    osg::Geometry *geometry) const;
+
+    osg::ref_ptr<BathymetrySource> _source;
+    ThreadPool *_pool;
+    float _max_error;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_BATHYMETRYMESHER_HPP_ */
@@ -0,0 +1,135 @@
+#include "BeamResolutionCaptureTool.hpp"
+
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/Program>
+#include <osg/Shader>
+#include <osgDB/FileUtils>
+
+#include <cmath>
+#include <stdexcept>
+
+namespace normal_depth_map {
+
+#define SHADER_PATH_SCREEN_QUAD_VERT "normal_depth_map/shaders/screenQuad.vert"
+#define SHADER_PATH_RESOLVE_FRAG "normal_depth_map/shaders/beamResolve.frag"
+
+BeamResolutionCaptureTool::BeamResolutionCaptureTool(   double fovX,
+                                                        double fovY,
+                                                        uint width,
+                                                        uint height,
+                                                        uint factor)
+    : _factor(factor) {
+
+    if (!width || !height || !factor)
+        throw std::invalid_argument("BeamResolutionCaptureTool: empty output");
+
+    // hidden viewer: the cameras render in textures, the window is not used
+    _viewer = new osgViewer::Viewer;
+    _viewer->setThreadingModel(osgViewer::Viewer::SingleThreaded);
+
+    osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits;
+    traits->width = 1;
+    traits->height = 1;
+    traits->pbuffer = true;
+    traits->readDISPLAY();
+
+    osg::ref_ptr<osg::GraphicsContext> gfxc = osg::GraphicsContext::createGraphicsContext(traits.get());
+    osg::ref_ptr<osg::Camera> camera = _viewer->getCamera();
+    camera->setGraphicsContext(gfxc);
+    camera->setViewport(new osg::Viewport(0, 0, 1, 1));
+    camera->setClearMask(0);
+
+    osg::ref_ptr<osg::Group> root = new osg::Group();
+
+    // supersampled frame, never read back
+    _frame = new osg::Texture2D();
+    _frame->setTextureSize(width * factor, height * factor);
+    _frame->setInternalFormat(GL_RGBA32F_ARB);
+    _frame->setSourceFormat(GL_RGBA);
+    _frame->setSourceType(GL_FLOAT);
+    _frame->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+    _frame->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+
+    _scene_camera = new osg::Camera();
+    _scene_camera->setReferenceFrame(osg::Transform::ABSOLUTE_RF);
+    _scene_camera->setRenderOrder(osg::Camera::PRE_RENDER, 0);
+    _scene_camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+    _scene_camera->attach(osg::Camera::COLOR_BUFFER0, _frame.get());
+    _scene_camera->setViewport(0, 0, width * factor, height * factor);
+    _scene_camera->setClearColor(osg::Vec4(0, 0, 0, 0));
+    _scene_camera->setClearMask(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    _scene_camera->setComputeNearFarMode(osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR);
+
+    double near = 0.1;
+    _scene_camera->setProjectionMatrixAsFrustum(-near * tan(fovX * 0.5),
+                                                near * tan(fovX * 0.5),
+                                                -near * tan(fovY * 0.5),
+                                                near * tan(fovY * 0.5),
+                                                near, 1000);
+    root->addChild(_scene_camera);
+
+    // resolve pass, read back in the output image
+    _image = new osg::Image();
+    _image->allocateImage(width, height, 1, GL_RGB, GL_FLOAT);
+    _image->setInternalTextureFormat(GL_RGB32F_ARB);
+
+    osg::ref_ptr<osg::Camera> resolve = new osg::Camera();
+    resolve->setReferenceFrame(osg::Transform::ABSOLUTE_RF);
+    resolve->setRenderOrder(osg::Camera::PRE_RENDER, 1);
+    resolve->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+    resolve->attach(osg::Camera::COLOR_BUFFER0, _image.get());
+    resolve->setViewport(0, 0, width, height);
+    resolve->setProjectionMatrix(osg::Matrix::identity());
+    resolve->setViewMatrix(osg::Matrix::identity());
+    resolve->setClearMask(0);
+
+    osg::ref_ptr<osg::Geode> quad = new osg::Geode();
+    quad->addDrawable(osg::createTexturedQuadGeometry(  osg::Vec3(-1, -1, 0),
+                                                        osg::Vec3(2, 0, 0),
+                                                        osg::Vec3(0, 2, 0)));
+    resolve->addChild(quad);
+
+    osg::ref_ptr<osg::Program> program = new osg::Program();
+    program->addShader(osg::Shader::readShaderFile(osg::Shader::VERTEX, osgDB::findDataFile(SHADER_PATH_SCREEN_QUAD_VERT)));
+    program->addShader(osg::Shader::readShaderFile(osg::Shader::FRAGMENT, osgDB::findDataFile(SHADER_PATH_RESOLVE_FRAG)));
+
+    _resolve_state = quad->getOrCreateStateSet();
+    _resolve_state->setAttribute(program);
+    _resolve_state->setMode(GL_DEPTH_TEST, osg::StateAttribute::OFF);
+    _resolve_state->setTextureAttribute(0, _frame);
+    _resolve_state->addUniform(new osg::Uniform("frame", 0));
+    _resolve_state->addUniform(new osg::Uniform("factor", (int) factor));
+    _resolve_state->addUniform(new osg::Uniform("depthFilter", (int) MIN_FILTER));
+    _resolve_state->addUniform(new osg::Uniform("normalFilter", (int) MEAN_FILTER));
+    root->addChild(resolve);
+
+    _viewer->setSceneData(root);
+}
+
+BeamResolutionCaptureTool::~BeamResolutionCaptureTool() {}
+
+osg::ref_ptr<osg::Image> BeamResolutionCaptureTool::grabImage(osg::ref_ptr<osg::Node> node) {
+    if (_scene_camera->getNumChildren() != 1 || _scene_camera->getChild(0) != node.get()) {
+        _scene_camera->removeChildren(0, _scene_camera->getNumChildren());
+        _scene_camera->addChild(node);
+    }
+
+    // single threaded: the image is read back when frame returns
+    _viewer->frame();
+    return _image;
+}
+
+void BeamResolutionCaptureTool::setFilters( BeamFilter depthFilter,
+                                            BeamFilter normalFilter) {
+    _resolve_state->getUniform("depthFilter")->set((int) depthFilter);
+    _resolve_state->getUniform("normalFilter")->set((int) normalFilter);
+}
+
+void BeamResolutionCaptureTool::setCameraPosition(  const osg::Vec3d& eye,
+                                                    const osg::Vec3d& center,
+                                                    const osg::Vec3d& up) {
+    _scene_camera->setViewMatrixAsLookAt(eye, center, up);
+}
+
+} /* namespace normal_depth_map */
@@ -0,0 +1,85 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_BEAMRESOLUTIONCAPTURETOOL_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_BEAMRESOLUTIONCAPTURETOOL_HPP_
+
+#include <osg/Camera>
+#include <osg/Image>
+#include <osg/Node>
+#include <osg/Texture2D>
+#include <osg/ref_ptr>
+#include <osgViewer/Viewer>
+
+namespace normal_depth_map {
+
+/**
+ * @brief Filters used to resolve the supersampled pixels of a beam
+ *
+ *  MEAN_FILTER counts the background as zero, so it keeps the echo energy
+ *  of thin objects. MIN_FILTER and MAX_FILTER only consider the pixels on
+ *  objects (e.g. MIN_FILTER on the depth gives the nearest echo).
+ */
+enum BeamFilter {
+    MEAN_FILTER = 0,
+    MIN_FILTER = 1,
+    MAX_FILTER = 2
+};
+
+/**
+ * @brief Captures the normal depth map at the sonar beam resolution,
+ *  anti-aliased on the GPU
+ *
+ *  The scene is rendered in a texture supersampled by a factor in each
+ *  direction, then each block of factor x factor pixels is resolved in one
+ *  beam pixel by a GPU pass. Only the beam resolution image is read back,
+ *  with the same channels as ImageViewerCaptureTool::grabImage (GL_RGB,
+ *  GL_FLOAT). The scene must be a NormalDepthMap node.
+ */
+class BeamResolutionCaptureTool {
+public:
+
+    /**
+     *  @param fovX: horizontal field of view (in radians)
+     *  @param fovY: vertical field of view (in radians)
+     *  @param width: number of beams
+     *  @param height: number of output rows
+     *  @param factor: supersampling factor in each direction
+     */
+    BeamResolutionCaptureTool(  double fovX, double fovY,
+                                uint width, uint height, uint factor = 4);
+    ~BeamResolutionCaptureTool();
+
+    /**
+     * @brief Renders the supersampled frame and returns the resolved image
+     *
+     *  @param node: normal depth map node with the scene
+     */
+    osg::ref_ptr<osg::Image> grabImage(osg::ref_ptr<osg::Node> node);
+
+    /**
+     * @brief Sets the filters of the depth and of the normal channels
+     */
+    void setFilters(BeamFilter depthFilter, BeamFilter normalFilter);
+
+    void setCameraPosition( const osg::Vec3d& eye, const osg::Vec3d& center,
+                            const osg::Vec3d& up);
+
+    void setViewMatrix(const osg::Matrix& matrix)
+      { _scene_camera->setViewMatrix(matrix); };
+
+    osg::Matrix getViewMatrix() const
+      { return _scene_camera->getViewMatrix(); };
+
+    uint getFactor() const { return _factor; };
+
+private:
+    uint _factor;
+
+    osg::ref_ptr<osgViewer::Viewer> _viewer;
+    osg::ref_ptr<osg::Camera> _scene_camera;
+    osg::ref_ptr<osg::Texture2D> _frame;
+    osg::ref_ptr<osg::StateSet> _resolve_state;
+    osg::ref_ptr<osg::Image> _image;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_BEAMRESOLUTIONCAPTURETOOL_HPP_ */
@@ -0,0 +1,116 @@
+#include "CaptureStats.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace normal_depth_map {
+
+FrameTimings::FrameTimings() : frameNumber(0), drawCalls(0), triangles(0) {
+    for (uint i = 0; i < NUM_CAPTURE_STAGES; ++i) {
+        begin[i] = -1;
+        duration[i] = -1;
+    }
+}
+
+CaptureStats::CaptureStats(uint window) : _next(0), _count(0) {
+    if (!window)
+        throw std::invalid_argument("CaptureStats: window must not be empty");
+    _frames.resize(window);
+}
+
+const char* CaptureStats::stageName(CaptureStage stage) {
+    static const char *names[] = {
+        "update", "cull", "draw", "gpu", "readback", "wait", "total"};
+    return stage < NUM_CAPTURE_STAGES ? names[stage] : "unknown";
+}
+
+void CaptureStats::add(const FrameTimings& timings) {
+    _frames[_next] = timings;
+    _next = (_next + 1) % _frames.size();
+    if (_count < _frames.size())
+        ++_count;
+}
+
+void CaptureStats::clear() {
+    _next = 0;
+    _count = 0;
+}
+
+const FrameTimings& CaptureStats::at(uint index) const {
+    return _frames[(_next + _frames.size() - _count + index) % _frames.size()];
+}
+
+const FrameTimings& CaptureStats::last() const {
+    if (!_count)
+        throw std::out_of_range("CaptureStats: no frame recorded");
+    return at(_count - 1);
+}
+
+FrameTimings* CaptureStats::find(unsigned int frameNumber) {
+    for (uint i = 0; i < _count; ++i) {
+        FrameTimings& timings = _frames[(_next + _frames.size() - 1 - i) % _frames.size()];
+        if (timings.frameNumber == frameNumber)
+            return &timings;
+    }
+    return 0;
+}
+
+double CaptureStats::percentile(CaptureStage stage, double ratio) const {
+    std::vector<double> values;
+    values.reserve(_count);
+    for (uint i = 0; i < _count; ++i)
+        if (at(i).duration[stage] >= 0)
+            values.push_back(at(i).duration[stage]);
+
+    if (values.empty())
+        return -1;
+
+    ratio = std::min(1.0, std::max(0.0, ratio));
+    std::vector<double>::iterator nth = values.begin() + (size_t) (ratio * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), nth, values.end());
+    return *nth;
+}
+
+double CaptureStats::mean(CaptureStage stage) const {
+    double sum = 0;
+    uint count = 0;
+    for (uint i = 0; i < _count; ++i) {
+        if (at(i).duration[stage] >= 0) {
+            sum += at(i).duration[stage];
+            ++count;
+        }
+    }
+    return count ? sum / count : -1;
+}
+
+bool CaptureStats::writeChromeTrace(const std::string& path) const {
+    std::ofstream file(path.c_str());
+    if (!file)
+        return false;
+
+    // complete events ("X") in microseconds; the GPU on its own track
+    file << "{\"traceEvents\":[";
+    bool first = true;
+    for (uint i = 0; i < _count; ++i) {
+        const FrameTimings& timings = at(i);
+        for (uint stage = 0; stage < NUM_CAPTURE_STAGES; ++stage) {
+            if (timings.begin[stage] < 0 || timings.duration[stage] < 0)
+                continue;
+
+            file << (first ? "" : ",") << "\n{\"name\":\""
+                 << stageName((CaptureStage) stage) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                 << (stage == GPU_STAGE ? 2 : (stage == TOTAL_STAGE ? 0 : 1))
+                 << ",\"ts\":" << (unsigned long long) (timings.begin[stage] * 1e6)
+                 << ",\"dur\":" << (unsigned long long) (timings.duration[stage] * 1e3)
+                 << ",\"args\":{\"frame\":" << timings.frameNumber
+                 << ",\"drawCalls\":" << timings.drawCalls
+                 << ",\"triangles\":" << timings.triangles << "}}";
+            first = false;
+        }
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return file.good();
+}
+
+} /* namespace normal_depth_map */
@@ -0,0 +1,101 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_CAPTURESTATS_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_CAPTURESTATS_HPP_
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace normal_depth_map {
+
+/**
+ * @brief Stages of one ImageViewerCaptureTool::grabImage call
+ *
+ *  UPDATE, CULL and DRAW are the osgViewer traversals (CPU time), GPU is the
+ *  GL timer query of the draw, READBACK is the glReadPixels in the capture
+ *  callback, WAIT is the time grabImage waits for the captured image and
+ *  TOTAL is the whole grabImage call.
+ */
+enum CaptureStage {
+    UPDATE_STAGE,
+    CULL_STAGE,
+    DRAW_STAGE,
+    GPU_STAGE,
+    READBACK_STAGE,
+    WAIT_STAGE,
+    TOTAL_STAGE,
+    NUM_CAPTURE_STAGES
+};
+
+/**
+ * @brief Timings and counters of one captured frame
+ *
+ *  @param begin: stage start, in seconds since the viewer start (negative
+ *   if unknown)
+ *  @param duration: stage duration in milliseconds (negative if unknown,
+ *   e.g. GL timer queries are not supported)
+ *  @param drawCalls: number of visible drawables
+ *  @param triangles: number of visible triangles
+ */
+struct FrameTimings {
+    FrameTimings();
+
+    unsigned int frameNumber;
+    double begin[NUM_CAPTURE_STAGES];
+    double duration[NUM_CAPTURE_STAGES];
+    unsigned int drawCalls;
+    unsigned int triangles;
+};
+
+/**
+ * @brief Rolling window of frame timings
+ *
+ *  It keeps the last frames in a fixed size ring, to get percentiles per
+ *  stage and to export a Chrome trace (chrome://tracing, Perfetto).
+ */
+class CaptureStats {
+public:
+    CaptureStats(uint window = 256);
+
+    static const char* stageName(CaptureStage stage);
+
+    void add(const FrameTimings& timings);
+    void clear();
+
+    /**
+     * @brief Gets the timings of a frame still in the window
+     *
+     *  @return NULL if the frame is not in the window anymore
+     */
+    FrameTimings* find(unsigned int frameNumber);
+
+    uint size() const { return _count; }
+    uint capacity() const { return _frames.size(); }
+    const FrameTimings& last() const;
+
+    /**
+     * @brief Percentile of a stage duration over the window, in milliseconds
+     *
+     *  @param ratio: between 0 and 1 (e.g. 0.5 for the median)
+     *  @return -1 if there is no known duration of this stage
+     */
+    double percentile(CaptureStage stage, double ratio) const;
+    double mean(CaptureStage stage) const;
+
+    /**
+     * @brief Writes the frames in the window in the Chrome trace format
+     *
+     *  @return false if the file can not be written
+     */
+    bool writeChromeTrace(const std::string& path) const;
+
+private:
+    const FrameTimings& at(uint index) const;
+
+    std::vector<FrameTimings> _frames;
+    uint _next;
+    uint _count;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_CAPTURESTATS_HPP_ */
@@ -0,0 +1,187 @@
+#include "ClipmapTerrain.hpp"
+
+#include <osg/BoundingBox>
+#include <osg/Image>
+#include <osg/Uniform>
+
+#include <cmath>
+#include <stdexcept>
+
+namespace normal_depth_map {
+
+const float ClipmapTerrain::MORPH_FRACTION = 0.25;
+const uint ClipmapTerrain::HEIGHT_TEXTURE_UNIT;
+
+namespace {
+
+// levels beyond the spacing of 2^15 cells are not useful
+const uint MAX_LEVELS = 16;
+
+}
+
+/**
+ * Copies the rows of the bathymetry to the height image.
+ */
+class ClipmapTerrain::RowTask : public ParallelTask {
+public:
+    RowTask(const BathymetrySource& source, osg::Image *image)
+        : _source(source), _image(image) {}
+
+    void run(uint row) {
+        float *samples = (float*) _image->data(0, row);
+        for (uint x = 0; x < _source.getWidth(); ++x)
+            samples[x] = _source.getElevation(x, row);
+    }
+
+private:
+    const BathymetrySource& _source;
+    osg::Image *_image;
+};
+
+ClipmapTerrain::ClipmapTerrain( osg::ref_ptr<BathymetrySource> source,
+                                float maxRange, uint gridSize,
+                                const osg::Vec3d& origin)
+    : _source(source), _max_range(maxRange), _grid_size(gridSize),
+      _origin(origin), _position(origin) {
+
+    if (!source || !(maxRange > 0) || gridSize < 8 || gridSize % 4)
+        throw std::invalid_argument("ClipmapTerrain: needs a source, a max range and a grid size multiple of 4");
+
+    // height texture, the samples are read at their exact texel
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(source->getWidth(), source->getHeight(), 1, GL_RED, GL_FLOAT);
+    image->setInternalTextureFormat(GL_R32F);
+    RowTask task(*source, image.get());
+    ThreadPool::instance().parallelFor(source->getHeight(), task);
+
+    _heights = new osg::Texture2D(image);
+    _heights->setInternalFormat(GL_R32F);
+    _heights->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+    _heights->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+    _heights->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    _heights->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+    _heights->setResizeNonPowerOfTwoHint(false);
+    _heights->setUnRefImageDataAfterApply(true);
+
+    // level grid, in vertex coordinates around the center, as one strip
+    // with its triangles split from the lower left to the upper right
+    // corners (see normalDepthMap.vert)
+    int halfSize = gridSize / 2;
+    uint side = gridSize + 1;
+    osg::ref_ptr<osg::Vec3Array> vertexes = new osg::Vec3Array();
+    vertexes->reserve(side * side);
+    for (int j = -halfSize; j <= halfSize; ++j)
+        for (int i = -halfSize; i <= halfSize; ++i)
+            vertexes->push_back(osg::Vec3(i, j, 0));
+
+    osg::ref_ptr<osg::DrawElementsUInt> strip = new osg::DrawElementsUInt(GL_TRIANGLE_STRIP);
+    for (uint j = 0; j < gridSize; ++j) {
+        if (j > 0) {
+            strip->push_back(strip->back());
+            strip->push_back((j + 1) * side);
+        }
+        for (uint i = 0; i < side; ++i) {
+            strip->push_back((j + 1) * side + i);
+            strip->push_back(j * side + i);
+        }
+    }
+
+    _grid = new osg::Geometry();
+    _grid->setUseDisplayList(false);
+    _grid->setUseVertexBufferObjects(true);
+    _grid->setVertexArray(vertexes);
+    _grid->addPrimitiveSet(strip);
+
+    // the grid vertexes are not at their final place, the culling uses the
+    // bounds of the map
+    float min, max;
+    if (!source->sampleElevationRange(0, 0, source->getWidth() - 1,
+                                      source->getHeight() - 1, min, max))
+        min = max = 0;
+    _grid->setInitialBound(osg::BoundingBox(
+        0, 0, min, (source->getWidth() - 1) * source->getCellSize(),
+        (source->getHeight() - 1) * source->getCellSize(), max));
+
+    _root = new osg::MatrixTransform(osg::Matrix::translate(origin));
+    osg::ref_ptr<osg::StateSet> ss = _root->getOrCreateStateSet();
+    ss->setTextureAttributeAndModes(HEIGHT_TEXTURE_UNIT, _heights, osg::StateAttribute::ON);
+    ss->addUniform(new osg::Uniform("heightfield", true));
+    ss->addUniform(new osg::Uniform("heightTexture", (int) HEIGHT_TEXTURE_UNIT));
+    ss->addUniform(new osg::Uniform("heightCellSize", source->getCellSize()));
+
+    createLevels();
+}
+
+float ClipmapTerrain::getSpacing(uint level) const {
+    return _source->getCellSize() * (1u << level);
+}
+
+void ClipmapTerrain::getLevelExtent(uint level, osg::Vec2d& min, osg::Vec2d& max) const {
+    double halfSide = 0.5 * _grid_size * getSpacing(level);
+    min = _centers[level] - osg::Vec2d(halfSide, halfSide);
+    max = _centers[level] + osg::Vec2d(halfSide, halfSide);
+}
+
+void ClipmapTerrain::setMaxRange(float maxRange) {
+    _max_range = maxRange;
+    createLevels();
+}
+
+void ClipmapTerrain::createLevels() {
+    // the outer level covers the max range from the sonar, with the lag of
+    // its center
+    uint numLevels = 1;
+    while ((0.5 * _grid_size - 3) * getSpacing(numLevels - 1) < _max_range
+           && numLevels < MAX_LEVELS)
+        ++numLevels;
+
+    _root->removeChildren(0, _root->getNumChildren());
+    _levels.clear();
+    _centers.assign(numLevels, osg::Vec2d());
+
+    float halfSize = 0.5 * _grid_size;
+    for (uint i = 0; i < numLevels; ++i) {
+        osg::ref_ptr<osg::Geode> level = new osg::Geode();
+        level->addDrawable(_grid);
+
+        // the last level has no coarser level to meet
+        float morphWidth = i + 1 < numLevels ? MORPH_FRACTION * halfSize : 0;
+
+        osg::ref_ptr<osg::StateSet> ss = level->getOrCreateStateSet();
+        ss->addUniform(new osg::Uniform("clipmapSpacing", getSpacing(i)));
+        ss->addUniform(new osg::Uniform("clipmapCenter", osg::Vec2f()));
+        ss->addUniform(new osg::Uniform("clipmapHalfSize", halfSize));
+        ss->addUniform(new osg::Uniform("clipmapMorphWidth", morphWidth));
+        ss->addUniform(new osg::Uniform("clipmapHole", osg::Vec4f()));
+
+        _root->addChild(level);
+        _levels.push_back(level);
+    }
+
+    setSonarPosition(_position);
+}
+
+void ClipmapTerrain::setSonarPosition(const osg::Vec3d& position) {
+    _position = position;
+    osg::Vec3d local = position - _origin;
+
+    for (uint i = 0; i < _levels.size(); ++i) {
+        // on the vertexes of the next level, so the border meets its edges
+        double step = 2 * getSpacing(i);
+        _centers[i] = osg::Vec2d(floor(local.x() / step + 0.5) * step,
+                                 floor(local.y() / step + 0.5) * step);
+
+        osg::Vec4f hole;
+        if (i > 0) {
+            osg::Vec2d min, max;
+            getLevelExtent(i - 1, min, max);
+            hole = osg::Vec4f(min.x(), min.y(), max.x(), max.y());
+        }
+
+        osg::StateSet *ss = _levels[i]->getStateSet();
+        ss->getUniform("clipmapCenter")->set(osg::Vec2f(_centers[i]));
+        ss->getUniform("clipmapHole")->set(hole);
+    }
+}
+
+} /* namespace normal_depth_map */
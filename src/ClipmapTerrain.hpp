@@ -0,0 +1,108 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_CLIPMAPTERRAIN_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_CLIPMAPTERRAIN_HPP_
+
+#include <vector>
+
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/MatrixTransform>
+#include <osg/Texture2D>
+#include <osg/Vec2d>
+#include <osg/Vec3d>
+#include <osg/ref_ptr>
+
+#include "Bathymetry.hpp"
+#include "ThreadPool.hpp"
+
+namespace normal_depth_map {
+
+/**
+ * @brief Seabed terrain displaced on the GPU, with geometry clipmaps
+ *
+ *  The bathymetry is uploaded once as a float texture, and the heightfield
+ *  mode of normalDepthMap.vert displaces one grid of gridSize x gridSize
+ *  cells, drawn once per level: the level l has vertexes every
+ *  cellSize * 2^l, around the sonar, and the fragments of a level under
+ *  the finer one are discarded. The number of levels covers the max range,
+ *  so the vertex count does not depend on the map size, and the terrain
+ *  memory is the height texture.
+ *
+ *  The normals are the central differences of the height texture, as the
+ *  meshes of BathymetryMesher: on the finest level, the vertexes are the
+ *  samples and the outputs are the ones of the full resolution mesh. Near
+ *  the border of a level, the vertexes blend to the edges of the next
+ *  level to close the cracks between them.
+ *
+ *  The bathymetry must fit in one texture (GL_MAX_TEXTURE_SIZE samples on
+ *  each side, usually 16384). The texture image is released after its
+ *  upload, so the scene is for one viewer.
+ */
+class ClipmapTerrain {
+public:
+
+    // fraction of the level half side blended to the next level
+    static const float MORPH_FRACTION;
+
+    // texture unit of the height texture
+    static const uint HEIGHT_TEXTURE_UNIT = 1;
+
+    /**
+     *  @param source: bathymetry, copied to the height texture
+     *  @param maxRange: sonar max range, covered by the levels
+     *  @param gridSize: level side, in cells (a multiple of 4)
+     *  @param origin: world position of the sample (0, 0)
+     *  It throws std::invalid_argument on other grid sizes.
+     */
+    ClipmapTerrain( osg::ref_ptr<BathymetrySource> source, float maxRange,
+                    uint gridSize = 128, const osg::Vec3d& origin = osg::Vec3d());
+
+    /**
+     * @brief Root of the terrain, to add in NormalDepthMap::addNodeChild
+     */
+    osg::ref_ptr<osg::MatrixTransform> getNode() const { return _root; };
+
+    /**
+     * @brief Centers the levels on the sonar
+     *
+     *  Each level moves by steps of two of its cells, so the vertexes stay on
+     *  the samples. Call it on each tick, before rendering.
+     *
+     *  @param position: sonar position, in world coordinates
+     */
+    void setSonarPosition(const osg::Vec3d& position);
+
+    // changes the number of levels
+    void setMaxRange(float maxRange);
+    float getMaxRange() const { return _max_range; }
+
+    uint getGridSize() const { return _grid_size; }
+    uint getNumLevels() const { return _levels.size(); }
+
+    // distance between the vertexes of a level
+    float getSpacing(uint level) const;
+
+    // map area drawn by a level (before the hole of the finer one), relative
+    // to the origin
+    void getLevelExtent(uint level, osg::Vec2d& min, osg::Vec2d& max) const;
+
+private:
+    class RowTask;
+
+    void createLevels();
+
+    osg::ref_ptr<BathymetrySource> _source;
+    float _max_range;
+    uint _grid_size;
+    osg::Vec3d _origin;
+    osg::Vec3d _position;
+
+    osg::ref_ptr<osg::Geometry> _grid;
+    osg::ref_ptr<osg::Texture2D> _heights;
+    osg::ref_ptr<osg::MatrixTransform> _root;
+    std::vector<osg::ref_ptr<osg::Geode> > _levels;
+    std::vector<osg::Vec2d> _centers;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_CLIPMAPTERRAIN_HPP_ */
@@ -0,0 +1,482 @@
+#include "FrameCodec.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace normal_depth_map {
+
+// "NDMC" tag and version of the encoded frames
+#define FRAME_CODEC_MAGIC 0x434d444e
+#define FRAME_CODEC_VERSION 1
+
+// unary prefixes longer than this are replaced by an explicit value
+#define RICE_ESCAPE 24
+
+namespace {
+
+struct EncodedFrameHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int width;
+    unsigned int height;
+    unsigned int components;
+    unsigned int tileSize;
+    float errorBound;
+    unsigned int numTiles;
+};
+
+class BitWriter {
+public:
+    BitWriter(std::vector<unsigned char>& output)
+        : _output(output), _buffer(0), _bits(0) {}
+
+    void write(unsigned long long value, uint bits) {
+        while (bits > 0) {
+            uint chunk = bits > 32 ? 32 : bits;
+            bits -= chunk;
+            _buffer = (_buffer << chunk) | ((value >> bits) & ((1ull << chunk) - 1));
+            _bits += chunk;
+            while (_bits >= 8) {
+                _bits -= 8;
+                _output.push_back((_buffer >> _bits) & 0xff);
+            }
+        }
+    }
+
+    void writeOnes(uint count) {
+        while (count > 0) {
+            uint chunk = count > 32 ? 32 : count;
+            write((1ull << chunk) - 1, chunk);
+            count -= chunk;
+        }
+    }
+
+    void flush() {
+        if (_bits > 0)
+            write(0, 8 - _bits);
+    }
+
+private:
+    std::vector<unsigned char>& _output;
+    unsigned long long _buffer;
+    uint _bits;
+};
+
+class BitReader {
+public:
+    BitReader(const unsigned char *data, size_t size)
+        : _data(data), _size(size), _position(0), _buffer(0), _bits(0) {}
+
+    unsigned long long read(uint bits) {
+        unsigned long long value = 0;
+        while (bits > 0) {
+            if (_bits == 0) {
+                if (_position >= _size)
+                    throw std::runtime_error("FrameCodec: truncated tile");
+                _buffer = _data[_position++];
+                _bits = 8;
+            }
+            uint chunk = bits < _bits ? bits : _bits;
+            _bits -= chunk;
+            bits -= chunk;
+            value = (value << chunk) | ((_buffer >> _bits) & ((1u << chunk) - 1));
+        }
+        return value;
+    }
+
+    uint readOnes(uint limit) {
+        uint count = 0;
+        while (count < limit && read(1))
+            ++count;
+        return count;
+    }
+
+private:
+    const unsigned char *_data;
+    size_t _size;
+    size_t _position;
+    uint _buffer;
+    uint _bits;
+};
+
+/**
+ * Adaptive Rice coder: the parameter k follows the running mean of the
+ * coded values (as in LOCO-I), so no side information is stored.
+ */
+class RiceModel {
+public:
+    RiceModel() : _sum(4), _count(1) {}
+
+    uint parameter() const {
+        uint k = 0;
+        while ((_count << k) < _sum && k < 56)
+            ++k;
+        return k;
+    }
+
+    void update(unsigned long long value) {
+        _sum += value;
+        if (++_count >= 64) {
+            _sum = (_sum + 1) / 2;
+            _count /= 2;
+        }
+    }
+
+    void encode(BitWriter& writer, unsigned long long value) {
+        uint k = parameter();
+        unsigned long long quotient = value >> k;
+        if (quotient < RICE_ESCAPE) {
+            writer.writeOnes(quotient);
+            writer.write(0, 1);
+            writer.write(value, k);
+        } else {
+            uint bits = 0;
+            while (bits < 64 && (value >> bits))
+                ++bits;
+            writer.writeOnes(RICE_ESCAPE);
+            writer.write(bits, 7);
+            writer.write(value, bits);
+        }
+        update(value);
+    }
+
+    unsigned long long decode(BitReader& reader) {
+        uint k = parameter();
+        unsigned long long value;
+        uint quotient = reader.readOnes(RICE_ESCAPE);
+        if (quotient < RICE_ESCAPE) {
+            value = (((unsigned long long) quotient) << k) | reader.read(k);
+        } else {
+            uint bits = reader.read(7);
+            value = reader.read(bits);
+        }
+        update(value);
+        return value;
+    }
+
+private:
+    unsigned long long _sum;
+    unsigned long long _count;
+};
+
+unsigned long long zigzag(long long value) {
+    return (((unsigned long long) value) << 1) ^ (unsigned long long) (value >> 63);
+}
+
+long long unzigzag(unsigned long long value) {
+    return (long long) (value >> 1) ^ -((long long) (value & 1));
+}
+
+// bijective and monotonic mapping between float bits and integers
+long long floatToOrdered(float value) {
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if (bits & 0x80000000u)
+        return -((long long) (bits & 0x7fffffffu)) - 1;
+    return bits;
+}
+
+float orderedToFloat(long long value) {
+    unsigned int bits;
+    if (value < 0)
+        bits = ((unsigned int) (-(value + 1))) | 0x80000000u;
+    else
+        bits = (unsigned int) value;
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+/**
+ * Geometry of the tile grid, shared by encoder and decoder
+ */
+struct TileGrid {
+    TileGrid(uint width, uint height, uint tileSize)
+        : width(width), height(height), tileSize(tileSize),
+          columns((width + tileSize - 1) / tileSize),
+          rows((height + tileSize - 1) / tileSize) {}
+
+    uint count() const { return columns * rows; }
+    uint x0(uint tile) const { return (tile % columns) * tileSize; }
+    uint y0(uint tile) const { return (tile / columns) * tileSize; }
+    uint w(uint tile) const { return std::min(tileSize, width - x0(tile)); }
+    uint h(uint tile) const { return std::min(tileSize, height - y0(tile)); }
+
+    uint width, height, tileSize, columns, rows;
+};
+
+// predicts the value from the left or upper foreground neighbour
+long long predict(  const std::vector<long long>& values,
+                    const std::vector<unsigned char>& mask,
+                    uint x, uint y, uint w, uint c, uint components,
+                    long long last) {
+    uint i = y * w + x;
+    if (x > 0 && mask[i - 1])
+        return values[(i - 1) * components + c];
+    if (y > 0 && mask[i - w])
+        return values[(i - w) * components + c];
+    return last;
+}
+
+class EncodeTileTask : public ParallelTask {
+public:
+    EncodeTileTask( const osg::Image& image, const TileGrid& grid,
+                    uint components, float errorBound,
+                    std::vector<std::vector<unsigned char> >& tiles)
+        : _image(image), _grid(grid), _components(components),
+          _errorBound(errorBound), _tiles(tiles) {}
+
+    void run(uint tile) {
+        uint x0 = _grid.x0(tile), y0 = _grid.y0(tile);
+        uint w = _grid.w(tile), h = _grid.h(tile);
+        uint components = _components;
+
+        std::vector<unsigned char> mask(w * h);
+        std::vector<long long> values(w * h * components);
+        double step = 2.0 * _errorBound;
+
+        // background mask and quantized values
+        for (uint y = 0; y < h; ++y) {
+            const float *row = (const float*) _image.data(x0, y0 + y);
+            for (uint x = 0; x < w; ++x) {
+                const float *pixel = row + x * components;
+                uint i = y * w + x;
+                mask[i] = 0;
+                for (uint c = 0; c < components; ++c) {
+                    // bitwise test, so -0.0 is kept in lossless mode
+                    if (floatToOrdered(pixel[c]) != 0)
+                        mask[i] = 1;
+                    if (step > 0)
+                        values[i * components + c] = std::isfinite(pixel[c]) ? llround(pixel[c] / step) : 0;
+                    else
+                        values[i * components + c] = floatToOrdered(pixel[c]);
+                }
+            }
+        }
+
+        std::vector<unsigned char>& output = _tiles[tile];
+        output.clear();
+        BitWriter writer(output);
+
+        // run lengths of the mask, starting with background
+        RiceModel runModel;
+        unsigned char state = 0;
+        uint run = 0;
+        for (uint i = 0; i < w * h; ++i) {
+            if (mask[i] == state) {
+                ++run;
+            } else {
+                runModel.encode(writer, run);
+                state = mask[i];
+                run = 1;
+            }
+        }
+        runModel.encode(writer, run);
+
+        // prediction residuals of the foreground values
+        std::vector<RiceModel> models(components);
+        std::vector<long long> last(components, 0);
+        for (uint y = 0; y < h; ++y) {
+            for (uint x = 0; x < w; ++x) {
+                uint i = y * w + x;
+                if (!mask[i])
+                    continue;
+                for (uint c = 0; c < components; ++c) {
+                    long long value = values[i * components + c];
+                    long long prediction = predict(values, mask, x, y, w, c, components, last[c]);
+                    models[c].encode(writer, zigzag(value - prediction));
+                    last[c] = value;
+                }
+            }
+        }
+        writer.flush();
+    }
+
+private:
+    const osg::Image& _image;
+    const TileGrid& _grid;
+    uint _components;
+    float _errorBound;
+    std::vector<std::vector<unsigned char> >& _tiles;
+};
+
+class DecodeTileTask : public ParallelTask {
+public:
+    DecodeTileTask( osg::Image& image, const TileGrid& grid,
+                    uint components, float errorBound,
+                    const std::vector<const unsigned char*>& tiles,
+                    const std::vector<size_t>& sizes)
+        : _image(image), _grid(grid), _components(components),
+          _errorBound(errorBound), _tiles(tiles), _sizes(sizes),
+          _failed(false) {}
+
+    // corrupted tiles are reported after the parallel loop; no error
+    // (e.g. std::bad_alloc) may escape the worker threads
+    void run(uint tile) {
+        try {
+            decodeTile(tile);
+        } catch (...) {
+            _failed = true;
+        }
+    }
+
+    bool failed() const { return _failed; }
+
+private:
+    void decodeTile(uint tile) {
+        uint x0 = _grid.x0(tile), y0 = _grid.y0(tile);
+        uint w = _grid.w(tile), h = _grid.h(tile);
+        uint components = _components;
+        double step = 2.0 * _errorBound;
+
+        BitReader reader(_tiles[tile], _sizes[tile]);
+
+        // background mask
+        std::vector<unsigned char> mask(w * h);
+        RiceModel runModel;
+        unsigned char state = 0;
+        uint i = 0;
+        while (i < w * h) {
+            unsigned long long run = runModel.decode(reader);
+            if (run > w * h - i)
+                throw std::runtime_error("FrameCodec: corrupted tile mask");
+            memset(&mask[i], state, run);
+            i += run;
+            state = !state;
+        }
+
+        // foreground values
+        std::vector<long long> values(w * h * components, 0);
+        std::vector<RiceModel> models(components);
+        std::vector<long long> last(components, 0);
+        for (uint y = 0; y < h; ++y) {
+            float *row = (float*) _image.data(x0, y0 + y);
+            for (uint x = 0; x < w; ++x) {
+                uint i = y * w + x;
+                float *pixel = row + x * components;
+                if (!mask[i]) {
+                    for (uint c = 0; c < components; ++c)
+                        pixel[c] = 0;
+                    continue;
+                }
+                for (uint c = 0; c < components; ++c) {
+                    long long prediction = predict(values, mask, x, y, w, c, components, last[c]);
+                    long long value = prediction + unzigzag(models[c].decode(reader));
+                    values[i * components + c] = value;
+                    last[c] = value;
+                    pixel[c] = step > 0 ? (float) (value * step) : orderedToFloat(value);
+                }
+            }
+        }
+    }
+
+    osg::Image& _image;
+    const TileGrid& _grid;
+    uint _components;
+    float _errorBound;
+    const std::vector<const unsigned char*>& _tiles;
+    const std::vector<size_t>& _sizes;
+    volatile bool _failed;
+};
+
+}
+
+FrameCodec::FrameCodec(float errorBound, uint tileSize, ThreadPool *pool)
+    : _errorBound(errorBound), _tileSize(tileSize), _pool(pool) {
+
+    if (errorBound < 0 || !tileSize)
+        throw std::invalid_argument("FrameCodec: invalid error bound or tile size");
+
+    if (!_pool)
+        _pool = &ThreadPool::instance();
+}
+
+void FrameCodec::encode(const osg::Image& image,
+                        std::vector<unsigned char>& output) const {
+    if (image.getDataType() != GL_FLOAT)
+        throw std::invalid_argument("FrameCodec: only GL_FLOAT images are supported");
+
+    EncodedFrameHeader header;
+    header.magic = FRAME_CODEC_MAGIC;
+    header.version = FRAME_CODEC_VERSION;
+    header.width = image.s();
+    header.height = image.t();
+    header.components = osg::Image::computeNumComponents(image.getPixelFormat());
+    header.tileSize = _tileSize;
+    header.errorBound = _errorBound;
+
+    TileGrid grid(header.width, header.height, _tileSize);
+    header.numTiles = grid.count();
+
+    std::vector<std::vector<unsigned char> > tiles(grid.count());
+    EncodeTileTask task(image, grid, header.components, _errorBound, tiles);
+    _pool->parallelFor(grid.count(), task);
+
+    // header, size of each tile and then the tiles
+    std::vector<unsigned int> sizes(grid.count());
+    size_t total = sizeof(header) + sizes.size() * sizeof(unsigned int);
+    for (uint i = 0; i < tiles.size(); ++i) {
+        sizes[i] = tiles[i].size();
+        total += sizes[i];
+    }
+
+    output.resize(total);
+    unsigned char *position = &output[0];
+    memcpy(position, &header, sizeof(header));
+    position += sizeof(header);
+    if (!sizes.empty()) {
+        memcpy(position, &sizes[0], sizes.size() * sizeof(unsigned int));
+        position += sizes.size() * sizeof(unsigned int);
+    }
+    for (uint i = 0; i < tiles.size(); ++i) {
+        if (!tiles[i].empty())
+            memcpy(position, &tiles[i][0], tiles[i].size());
+        position += tiles[i].size();
+    }
+}
+
+osg::ref_ptr<osg::Image> FrameCodec::decode(const unsigned char *data,
+                                            size_t size,
+                                            GLenum pixelFormat) const {
+    EncodedFrameHeader header;
+    if (size < sizeof(header))
+        throw std::runtime_error("FrameCodec: truncated frame");
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != FRAME_CODEC_MAGIC || header.version != FRAME_CODEC_VERSION
+        || header.components != osg::Image::computeNumComponents(pixelFormat)
+        || !header.tileSize)
+        throw std::runtime_error("FrameCodec: invalid frame header");
+
+    TileGrid grid(header.width, header.height, header.tileSize);
+    if (header.numTiles != grid.count()
+        || size < sizeof(header) + grid.count() * sizeof(unsigned int))
+        throw std::runtime_error("FrameCodec: invalid tile table");
+
+    // locates each tile in the stream
+    const unsigned char *position = data + sizeof(header) + grid.count() * sizeof(unsigned int);
+    std::vector<const unsigned char*> tiles(grid.count());
+    std::vector<size_t> sizes(grid.count());
+    for (uint i = 0; i < grid.count(); ++i) {
+        unsigned int tileSize;
+        memcpy(&tileSize, data + sizeof(header) + i * sizeof(unsigned int), sizeof(tileSize));
+        tiles[i] = position;
+        sizes[i] = tileSize;
+        position += tileSize;
+    }
+    if (position > data + size)
+        throw std::runtime_error("FrameCodec: truncated frame");
+
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(header.width, header.height, 1, pixelFormat, GL_FLOAT);
+
+    DecodeTileTask task(*image, grid, header.components, header.errorBound, tiles, sizes);
+    _pool->parallelFor(grid.count(), task);
+    if (task.failed())
+        throw std::runtime_error("FrameCodec: corrupted frame");
+    return image;
+}
+
+} /* namespace normal_depth_map */
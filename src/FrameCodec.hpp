@@ -0,0 +1,71 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_FRAMECODEC_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_FRAMECODEC_HPP_
+
+#include <vector>
+
+#include <osg/Image>
+#include <osg/ref_ptr>
+
+#include "ThreadPool.hpp"
+
+namespace normal_depth_map {
+
+/**
+ * @brief Compression codec tuned for normal depth map frames
+ *
+ *  These frames are mostly empty background with smooth depth and normal
+ *  values on the objects. The image is split in square tiles, encoded
+ *  independently in parallel. On each tile:
+ *   - the background mask (pixels with all channels equal to zero) is
+ *     stored as run lengths;
+ *   - each channel of the foreground pixels is quantized (or taken bit
+ *     exact in lossless mode) and predicted from its left/upper neighbour;
+ *   - the residuals are entropy coded with adaptive Rice codes.
+ *
+ *  Only GL_FLOAT images are supported.
+ */
+class FrameCodec {
+public:
+
+    /**
+     * @brief Sets the codec parameters
+     *
+     *  @param errorBound: maximum absolute error per value (plus the float
+     *   rounding of the decoded value). 0 means lossless, bit exact.
+     *  @param tileSize: width and height of the tiles in pixels
+     *  @param pool: threads used to encode and decode the tiles.
+     *   NULL uses ThreadPool::instance().
+     */
+    FrameCodec(float errorBound = 0, uint tileSize = 64, ThreadPool *pool = 0);
+
+    /**
+     * @brief Compresses an image
+     *
+     *  @param image: GL_FLOAT image
+     *  @param output: receives the encoded frame
+     */
+    void encode(const osg::Image& image, std::vector<unsigned char>& output) const;
+
+    /**
+     * @brief Decompresses a frame produced by encode
+     *
+     *  @param data: encoded frame
+     *  @param size: size of the encoded frame in bytes
+     *  @param pixelFormat: pixel format of the original image
+     *  @return the decoded image
+     */
+    osg::ref_ptr<osg::Image> decode(const unsigned char *data, size_t size,
+                                    GLenum pixelFormat) const;
+
+    float getErrorBound() const { return _errorBound; }
+    uint getTileSize() const { return _tileSize; }
+
+private:
+    float _errorBound;
+    uint _tileSize;
+    ThreadPool *_pool;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_FRAMECODEC_HPP_ */
@@ -0,0 +1,301 @@
+#include "FrameRecorder.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace normal_depth_map {
+
+// "NDMR", "NDMF" and "NDMI" tags of the file header, records and index
+#define RECORDING_MAGIC 0x524d444e
+#define RECORDED_FRAME_MAGIC 0x464d444e
+#define RECORDING_INDEX_MAGIC 0x494d444e
+#define RECORDING_VERSION 1
+
+// records start on cache line (and page friendly) boundaries
+#define RECORD_ALIGNMENT 64
+
+namespace {
+
+struct RecordingTrailer {
+    unsigned int magic;
+    unsigned int numFrames;
+    unsigned long long indexOffset;
+};
+
+unsigned long long alignOffset(unsigned long long offset) {
+    return (offset + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+}
+
+}
+
+////////////////////////////////
+////FrameRecorder METHODS
+////////////////////////////////
+
+FrameRecorder::FrameRecorder(   const std::string& path,
+                                uint width, uint height,
+                                GLenum pixelFormat, GLenum dataType)
+    : _codec(0), _position(0) {
+
+    _fd = open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (_fd < 0)
+        throw std::runtime_error("FrameRecorder: can not create " + path);
+
+    memset(&_header, 0, sizeof(_header));
+    _header.magic = RECORDING_MAGIC;
+    _header.version = RECORDING_VERSION;
+    _header.width = width;
+    _header.height = height;
+    _header.pixelFormat = pixelFormat;
+    _header.dataType = dataType;
+    _header.rowSize = width * osg::Image::computePixelSizeInBits(pixelFormat, dataType) / 8;
+    write(&_header, sizeof(_header));
+}
+
+FrameRecorder::~FrameRecorder() {
+    // a failed write leaves a recording without index, but must not
+    // terminate the program; call close() to get the error
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+void FrameRecorder::record(const Frame& frame) {
+    const osg::Image *image = frame.image.get();
+    if (!image || image->s() != (int) _header.width
+        || image->t() != (int) _header.height
+        || image->getPixelFormat() != _header.pixelFormat
+        || image->getDataType() != _header.dataType)
+        throw std::invalid_argument("FrameRecorder: frame layout differs from the recording");
+
+    RecordedFrameHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = RECORDED_FRAME_MAGIC;
+    header.encoding = 0;
+    header.sequence = frame.sequence;
+    header.payloadSize = (unsigned long long) _header.rowSize * _header.height;
+    header.timestamp = frame.timestamp;
+    memcpy(header.cameraPose, frame.cameraPose.ptr(), sizeof(header.cameraPose));
+    header.maxRange = frame.parameters.maxRange;
+    header.maxHorizontalAngle = frame.parameters.maxHorizontalAngle;
+    header.maxVerticalAngle = frame.parameters.maxVerticalAngle;
+    header.attenuationCoeff = frame.parameters.attenuationCoeff;
+    header.flags = (frame.parameters.drawNormal ? 1 : 0) | (frame.parameters.drawDepth ? 2 : 0);
+    header.parametersVersion = frame.parameters.version;
+
+    // compressed, packed images at once or padded rows one by one
+    if (_codec && _header.dataType == GL_FLOAT) {
+        _codec->encode(*image, _encoded);
+        header.encoding = 1;
+        header.payloadSize = _encoded.size();
+        writeRecord(header, &_encoded[0]);
+    } else if (image->getRowSizeInBytes() == _header.rowSize) {
+        writeRecord(header, image->data());
+    } else {
+        std::vector<unsigned char> payload(header.payloadSize);
+        for (uint row = 0; row < _header.height; ++row)
+            memcpy(&payload[row * _header.rowSize], image->data(0, row), _header.rowSize);
+        writeRecord(header, &payload[0]);
+    }
+}
+
+void FrameRecorder::writeRecord(const RecordedFrameHeader& header,
+                                const unsigned char *payload) {
+    static const unsigned char padding[RECORD_ALIGNMENT] = {0};
+
+    unsigned long long start = alignOffset(_position);
+    write(padding, start - _position);
+
+    _offsets.push_back(start);
+    write(&header, sizeof(header));
+    write(payload, header.payloadSize);
+}
+
+void FrameRecorder::close() {
+    if (_fd < 0)
+        return;
+
+    static const unsigned char padding[RECORD_ALIGNMENT] = {0};
+    unsigned long long indexOffset = alignOffset(_position);
+
+    // the file is closed even if the index is not written
+    try {
+        write(padding, indexOffset - _position);
+
+        if (!_offsets.empty())
+            write(&_offsets[0], _offsets.size() * sizeof(unsigned long long));
+
+        RecordingTrailer trailer;
+        trailer.magic = RECORDING_INDEX_MAGIC;
+        trailer.numFrames = _offsets.size();
+        trailer.indexOffset = indexOffset;
+        write(&trailer, sizeof(trailer));
+    } catch (...) {
+        ::close(_fd);
+        _fd = -1;
+        throw;
+    }
+
+    ::close(_fd);
+    _fd = -1;
+}
+
+void FrameRecorder::write(const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char*) data;
+    while (size > 0) {
+        ssize_t written = ::write(_fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("FrameRecorder: write failed");
+        }
+        bytes += written;
+        size -= written;
+        _position += written;
+    }
+}
+
+////////////////////////////////
+////FrameRecordReader METHODS
+////////////////////////////////
+
+FrameRecordReader::FrameRecordReader(const std::string& path)
+    : _memory(0), _size(0), _header(0), _index(0), _numFrames(0) {
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("FrameRecordReader: can not open " + path);
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || (size_t) info.st_size < sizeof(RecordingHeader)) {
+        ::close(fd);
+        throw std::runtime_error("FrameRecordReader: invalid recording " + path);
+    }
+    _size = info.st_size;
+
+    void *memory = mmap(0, _size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+        throw std::runtime_error("FrameRecordReader: mmap failed on " + path);
+    _memory = (unsigned char*) memory;
+
+    _header = (const RecordingHeader*) _memory;
+    if (_header->magic != RECORDING_MAGIC || _header->version != RECORDING_VERSION) {
+        munmap(_memory, _size);
+        throw std::runtime_error("FrameRecordReader: unknown format in " + path);
+    }
+
+    // uses the index written on close, or walks the records
+    const RecordingTrailer *trailer = 0;
+    if (_size >= sizeof(RecordingHeader) + sizeof(RecordingTrailer))
+        trailer = (const RecordingTrailer*) (_memory + _size - sizeof(RecordingTrailer));
+
+    if (trailer && trailer->magic == RECORDING_INDEX_MAGIC
+        && trailer->indexOffset <= _size
+        && trailer->indexOffset + trailer->numFrames * sizeof(unsigned long long)
+            + sizeof(RecordingTrailer) == _size) {
+        _index = (const unsigned long long*) (_memory + trailer->indexOffset);
+        _numFrames = trailer->numFrames;
+
+        // the records of the index must lie before it, in full
+        for (uint i = 0; i < _numFrames; ++i) {
+            if (!isValidRecord(_index[i], trailer->indexOffset)) {
+                munmap(_memory, _size);
+                throw std::runtime_error("FrameRecordReader: corrupt index in " + path);
+            }
+        }
+    } else {
+        rebuildIndex();
+    }
+}
+
+FrameRecordReader::~FrameRecordReader() {
+    munmap(_memory, _size);
+}
+
+bool FrameRecordReader::isValidRecord(unsigned long long position,
+                                      unsigned long long end) const {
+    if (position < sizeof(RecordingHeader) || position > end
+        || end - position < sizeof(RecordedFrameHeader))
+        return false;
+
+    const RecordedFrameHeader *header = (const RecordedFrameHeader*) (_memory + position);
+    if (header->magic != RECORDED_FRAME_MAGIC
+        || header->payloadSize > end - position - sizeof(RecordedFrameHeader))
+        return false;
+
+    // the raw images are wrapped without copy
+    return header->encoding != 0
+        || header->payloadSize >= (unsigned long long) _header->rowSize * _header->height;
+}
+
+void FrameRecordReader::rebuildIndex() {
+    unsigned long long position = alignOffset(sizeof(RecordingHeader));
+
+    while (position + sizeof(RecordedFrameHeader) <= _size) {
+        const RecordedFrameHeader *header = (const RecordedFrameHeader*) (_memory + position);
+        if (!isValidRecord(position, _size))
+            break;
+
+        _rebuiltIndex.push_back(position);
+        position = alignOffset(position + sizeof(RecordedFrameHeader) + header->payloadSize);
+    }
+
+    _numFrames = _rebuiltIndex.size();
+    _index = _rebuiltIndex.empty() ? 0 : &_rebuiltIndex[0];
+}
+
+unsigned long long FrameRecordReader::offset(uint index) const {
+    if (index >= _numFrames)
+        throw std::out_of_range("FrameRecordReader: frame index out of range");
+    return _index[index];
+}
+
+const RecordedFrameHeader& FrameRecordReader::getFrameHeader(uint index) const {
+    return *((const RecordedFrameHeader*) (_memory + offset(index)));
+}
+
+const unsigned char* FrameRecordReader::getPayload(uint index) const {
+    return _memory + offset(index) + sizeof(RecordedFrameHeader);
+}
+
+Frame FrameRecordReader::getFrame(uint index) const {
+    const RecordedFrameHeader& header = getFrameHeader(index);
+    if (header.encoding > 1)
+        throw std::runtime_error("FrameRecordReader: unsupported frame encoding");
+
+    Frame frame;
+    frame.sequence = header.sequence;
+    frame.timestamp = header.timestamp;
+    frame.cameraPose.set(header.cameraPose);
+    frame.parameters.maxRange = header.maxRange;
+    frame.parameters.maxHorizontalAngle = header.maxHorizontalAngle;
+    frame.parameters.maxVerticalAngle = header.maxVerticalAngle;
+    frame.parameters.attenuationCoeff = header.attenuationCoeff;
+    frame.parameters.drawNormal = header.flags & 1;
+    frame.parameters.drawDepth = header.flags & 2;
+    frame.parameters.version = header.parametersVersion;
+
+    if (header.encoding == 1) {
+        FrameCodec codec;
+        frame.image = codec.decode(getPayload(index), header.payloadSize, _header->pixelFormat);
+        return frame;
+    }
+
+    // wraps the mapped memory, without copy
+    frame.image = new osg::Image();
+    frame.image->setImage(  _header->width, _header->height, 1,
+                            _header->pixelFormat, _header->pixelFormat,
+                            _header->dataType,
+                            (unsigned char*) getPayload(index),
+                            osg::Image::NO_DELETE, 1);
+    return frame;
+}
+
+} /* namespace normal_depth_map */
@@ -0,0 +1,173 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_FRAMERECORDER_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_FRAMERECORDER_HPP_
+
+#include <string>
+#include <vector>
+
+#include "FrameRing.hpp"
+#include "FrameCodec.hpp"
+
+namespace normal_depth_map {
+
+/**
+ * @brief Fixed-size header at the beginning of a recording file
+ *
+ *  All frames of a recording share the same layout, which can be any
+ *  pixel format and data type produced by the capture tool (e.g. GL_FLOAT,
+ *  GL_HALF_FLOAT or GL_UNSIGNED_SHORT readbacks).
+ */
+struct RecordingHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int width;
+    unsigned int height;
+    unsigned int pixelFormat;
+    unsigned int dataType;
+    unsigned int rowSize;
+    unsigned int reserved[9];
+};
+
+/**
+ * @brief Fixed-size header before each frame payload
+ *
+ *  @param payloadSize: size of the frame data in bytes
+ *  @param encoding: 0 for raw rows, tightly packed; 1 for FrameCodec data
+ */
+struct RecordedFrameHeader {
+    unsigned int magic;
+    unsigned int encoding;
+    unsigned long long sequence;
+    unsigned long long payloadSize;
+    double timestamp;
+    double cameraPose[16];
+    float maxRange;
+    float maxHorizontalAngle;
+    float maxVerticalAngle;
+    float attenuationCoeff;
+    unsigned int flags;
+    unsigned int reserved;
+    unsigned long long parametersVersion;
+};
+
+/**
+ * @brief Writes a stream of frames in an append-only recording file
+ *
+ *  Layout: RecordingHeader, then one RecordedFrameHeader plus payload per
+ *  frame, each record aligned on 64 bytes, and on close() an index with the
+ *  offset of every frame followed by a small trailer. If the recorder is not
+ *  closed (e.g. a crash) the frames are still readable; the reader rebuilds
+ *  the index by walking the record headers.
+ */
+class FrameRecorder {
+public:
+
+    /**
+     * @brief Creates (or replaces) the recording file
+     *
+     *  @param path: file path
+     *  @param width: image width
+     *  @param height: image height
+     *  @param pixelFormat: GL pixel format of the frames
+     *  @param dataType: GL data type of the frames
+     */
+    FrameRecorder(  const std::string& path,
+                    uint width, uint height,
+                    GLenum pixelFormat = GL_RGB,
+                    GLenum dataType = GL_FLOAT);
+    ~FrameRecorder();
+
+    /**
+     * @brief Appends one frame
+     *
+     *  The image must have the layout of the recording.
+     */
+    void record(const Frame& frame);
+
+    /**
+     * @brief Compresses the next GL_FLOAT frames with a codec
+     *
+     *  @param codec: codec used on record, or NULL to store raw frames.
+     *   It must exist while the recorder uses it.
+     */
+    void setCodec(const FrameCodec *codec) { _codec = codec; }
+
+    /**
+     * @brief Writes the index and the trailer, and closes the file
+     *
+     *  It throws std::runtime_error if they cannot be written; the file is
+     *  closed anyway. The destructor calls it and ignores the errors.
+     */
+    void close();
+
+    uint getNumFrames() const { return _offsets.size(); }
+
+protected:
+    void writeRecord(const RecordedFrameHeader& header,
+                     const unsigned char *payload);
+    void write(const void *data, size_t size);
+
+    RecordingHeader _header;
+    const FrameCodec *_codec;
+    std::vector<unsigned char> _encoded;
+    std::vector<unsigned long long> _offsets;
+    unsigned long long _position;
+    int _fd;
+};
+
+/**
+ * @brief Gives random access to the frames of a recording file
+ *
+ *  The file is memory mapped, so getting any frame is O(1) and the image
+ *  data is accessed straight from the page cache, without parsing or copy.
+ */
+class FrameRecordReader {
+public:
+
+    /**
+     *  It throws std::runtime_error if the file cannot be mapped, is not a
+     *  recording, or its index points out of the records.
+     */
+    FrameRecordReader(const std::string& path);
+    ~FrameRecordReader();
+
+    uint getNumFrames() const { return _numFrames; }
+    const RecordingHeader& getHeader() const { return *_header; }
+
+    /**
+     * @brief Gets the header of the frame at a given position
+     */
+    const RecordedFrameHeader& getFrameHeader(uint index) const;
+
+    /**
+     * @brief Gets the raw payload of the frame at a given position
+     *
+     *  For compressed frames it is the FrameCodec data.
+     */
+    const unsigned char* getPayload(uint index) const;
+
+    /**
+     * @brief Gets the frame at a given position
+     *
+     *  The image of a raw frame refers to the mapped file, it is valid
+     *  while this reader exists. Compressed frames are decoded in a new
+     *  image.
+     */
+    Frame getFrame(uint index) const;
+
+private:
+    // a whole frame record at position, before end
+    bool isValidRecord(unsigned long long position, unsigned long long end) const;
+    void rebuildIndex();
+    unsigned long long offset(uint index) const;
+
+    unsigned char *_memory;
+    size_t _size;
+    const RecordingHeader *_header;
+    const unsigned long long *_index;
+    std::vector<unsigned long long> _rebuiltIndex;
+    uint _numFrames;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_FRAMERECORDER_HPP_ */
@@ -0,0 +1,162 @@
+#include "FrameRing.hpp"
+#include <stdexcept>
+
+namespace normal_depth_map {
+
+////////////////////////////////
+////FrameLease METHODS
+////////////////////////////////
+
+FrameLease::FrameLease() : _ring(0), _slot(0) {}
+
+FrameLease::FrameLease(FrameRing *ring, uint slot) : _ring(ring), _slot(slot) {}
+
+FrameLease::FrameLease(const FrameLease& other)
+    : _ring(other._ring), _slot(other._slot) {
+    if (_ring)
+        _ring->addLease(_slot);
+}
+
+FrameLease& FrameLease::operator=(const FrameLease& other) {
+    if (this != &other) {
+        if (other._ring)
+            other._ring->addLease(other._slot);
+        release();
+        _ring = other._ring;
+        _slot = other._slot;
+    }
+    return *this;
+}
+
+FrameLease::~FrameLease() {
+    release();
+}
+
+void FrameLease::release() {
+    if (_ring)
+        _ring->releaseLease(_slot);
+    _ring = 0;
+}
+
+const Frame& FrameLease::operator*() const {
+    return _ring->_slots[_slot]->frame;
+}
+
+const Frame* FrameLease::operator->() const {
+    return &_ring->_slots[_slot]->frame;
+}
+
+////////////////////////////////
+////FrameRing METHODS
+////////////////////////////////
+
+FrameRing::FrameRing(   uint capacity, uint width, uint height,
+                        GLenum pixelFormat, GLenum dataType)
+    : _latest(0), _writing(-1), _next(0), _sequence(0) {
+
+    if (capacity < 2)
+        throw std::invalid_argument("FrameRing: capacity must be at least 2");
+
+    // all the memory is allocated here, never during the capture
+    for (uint i = 0; i < capacity; ++i) {
+        Slot *slot = new Slot();
+        slot->frame.image = new osg::Image();
+        slot->frame.image->allocateImage(width, height, 1, pixelFormat, dataType);
+        _slots.push_back(slot);
+    }
+}
+
+FrameRing::~FrameRing() {
+    for (uint i = 0; i < _slots.size(); ++i)
+        delete _slots[i];
+}
+
+Frame* FrameRing::beginWrite() {
+    if (_writing >= 0)
+        return &_slots[_writing]->frame;
+
+    uint latest = _latest;
+    for (uint i = 0; i < _slots.size(); ++i) {
+        uint index = (_next + i) % _slots.size();
+
+        // the latest frame stays readable for the new consumers
+        if (index + 1 == latest)
+            continue;
+
+        // takes the slot only if there is no lease on it
+        Slot *slot = _slots[index];
+        if (slot->state.OR(WRITING) == 0) {
+            _writing = index;
+            _next = (index + 1) % _slots.size();
+            return &slot->frame;
+        }
+        slot->state.AND(~WRITING);
+    }
+    return 0;
+}
+
+unsigned long long FrameRing::commitWrite() {
+    if (_writing < 0)
+        return 0;
+
+    Slot *slot = _slots[_writing];
+    slot->frame.sequence = _sequence + 1;
+    slot->state.AND(~WRITING);
+    _latest.exchange(_writing + 1);
+    _sequence = slot->frame.sequence;
+    _writing = -1;
+    return _sequence;
+}
+
+void FrameRing::abortWrite() {
+    if (_writing < 0)
+        return;
+
+    Slot *slot = _slots[_writing];
+    slot->frame.sequence = 0;
+    slot->state.AND(~WRITING);
+    _writing = -1;
+}
+
+FrameLease FrameRing::acquireLatest() {
+    for (;;) {
+        uint latest = _latest;
+        if (!latest)
+            return FrameLease();
+
+        // the slot may be recycled between the read and the lease; try again
+        if (tryLease(latest - 1))
+            return FrameLease(this, latest - 1);
+    }
+}
+
+FrameLease FrameRing::acquire(unsigned long long sequence) {
+    for (uint i = 0; i < _slots.size(); ++i) {
+        if (_slots[i]->frame.sequence != sequence || !tryLease(i))
+            continue;
+
+        // checks again, now that the slot can not be recycled
+        if (_slots[i]->frame.sequence == sequence)
+            return FrameLease(this, i);
+        releaseLease(i);
+    }
+    return FrameLease();
+}
+
+bool FrameRing::tryLease(uint slot) {
+    if ((++_slots[slot]->state) & WRITING) {
+        --_slots[slot]->state;
+        return false;
+    }
+    return true;
+}
+
+void FrameRing::addLease(uint slot) {
+    ++_slots[slot]->state;
+}
+
+void FrameRing::releaseLease(uint slot) {
+    --_slots[slot]->state;
+}
+
+} /* namespace normal_depth_map */
@@ -0,0 +1,158 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_FRAMERING_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_FRAMERING_HPP_
+
+#include <vector>
+
+#include <osg/Image>
+#include <osg/Matrixd>
+#include <osg/ref_ptr>
+#include <OpenThreads/Atomic>
+
+#include "NormalDepthMap.hpp"
+
+namespace normal_depth_map {
+
+/**
+ * @brief Captured frame with the information needed to interpret it
+ *
+ *  @param image: pre-allocated image with the normal depth map
+ *  @param timestamp: reference time of the rendered frame (in seconds)
+ *  @param sequence: frame counter, starting on 1
+ *  @param cameraPose: camera to world transformation
+ *  @param parameters: normal depth map parameters used on the render
+ */
+struct Frame {
+    Frame() : timestamp(0), sequence(0) {}
+
+    osg::ref_ptr<osg::Image> image;
+    double timestamp;
+    unsigned long long sequence;
+    osg::Matrixd cameraPose;
+    NormalDepthMapParameters parameters;
+};
+
+class FrameRing;
+
+/**
+ * @brief Read access to a frame stored in a FrameRing
+ *
+ *  While at least one lease of a frame is alive, its slot is not recycled
+ *  by the producer. Copies share the same frame and the slot is released
+ *  when the last lease is destroyed or release() is called.
+ */
+class FrameLease {
+public:
+    FrameLease();
+    FrameLease(const FrameLease& other);
+    FrameLease& operator=(const FrameLease& other);
+    ~FrameLease();
+
+    bool valid() const { return _ring != 0; }
+    void release();
+
+    const Frame& operator*() const;
+    const Frame* operator->() const;
+
+private:
+    friend class FrameRing;
+    FrameLease(FrameRing *ring, uint slot);
+
+    FrameRing *_ring;
+    uint _slot;
+};
+
+/**
+ * @brief Fixed capacity ring of pre-allocated frames
+ *
+ *  It delivers the captured frames from one producer (the render thread)
+ *  to several consumers without locks and without allocation per frame.
+ *  Each slot keeps a lease counter; the producer only writes in slots
+ *  without leases, so a slow consumer never sees its frame overwritten,
+ *  it only makes the producer skip to the next free slot.
+ *
+ *  beginWrite() and commitWrite() must be called from a single thread;
+ *  acquireLatest(), acquire() and the leases are safe from any thread.
+ */
+class FrameRing {
+public:
+
+    /**
+     * @brief Allocates all frames of the ring
+     *
+     *  @param capacity: number of frames (at least 2)
+     *  @param width: image width
+     *  @param height: image height
+     *  @param pixelFormat: GL pixel format of the images
+     *  @param dataType: GL data type of the images
+     */
+    FrameRing(  uint capacity, uint width, uint height,
+                GLenum pixelFormat = GL_RGB, GLenum dataType = GL_FLOAT);
+    ~FrameRing();
+
+    /**
+     * @brief Reserves a free slot to write the next frame
+     *
+     *  @return Frame: the frame to be filled, or NULL if all slots are leased
+     */
+    Frame* beginWrite();
+
+    /**
+     * @brief Publishes the frame reserved by beginWrite
+     *
+     *  It assigns the next sequence number to the frame.
+     *
+     *  @return the sequence number of the published frame
+     */
+    unsigned long long commitWrite();
+
+    /**
+     * @brief Cancels the frame reserved by beginWrite
+     */
+    void abortWrite();
+
+    /**
+     * @brief Gets the most recent published frame
+     *
+     *  @return FrameLease: invalid lease if no frame was published yet
+     */
+    FrameLease acquireLatest();
+
+    /**
+     * @brief Gets the frame with a given sequence number
+     *
+     *  @return FrameLease: invalid lease if the frame was already recycled
+     */
+    FrameLease acquire(unsigned long long sequence);
+
+    uint capacity() const { return _slots.size(); }
+    unsigned long long lastSequence() const { return _sequence; }
+
+private:
+    friend class FrameLease;
+
+    // high bit of the slot state, set while the producer writes on it
+    static const unsigned WRITING = 0x80000000u;
+
+    struct Slot {
+        Frame frame;
+        OpenThreads::Atomic state;
+    };
+
+    bool tryLease(uint slot);
+    void addLease(uint slot);
+    void releaseLease(uint slot);
+
+    std::vector<Slot*> _slots;
+
+    // index + 1 of the latest published slot, 0 when empty
+    OpenThreads::Atomic _latest;
+
+    // producer side only
+    int _writing;
+    uint _next;
+    volatile unsigned long long _sequence;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_FRAMERING_HPP_ */
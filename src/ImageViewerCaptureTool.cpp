@@ -1,16 +1,62 @@
 #include "ImageViewerCaptureTool.hpp"
-#include <iostream>
+#include "SharedFrameTransport.hpp"
+#include <osg/Stats>
+#include <osg/Texture>
+#include <cstring>
+#include <stdexcept>
 #include <unistd.h>
 
 namespace normal_depth_map {
 
-ImageViewerCaptureTool::ImageViewerCaptureTool(uint width, uint height) {
+namespace {
+
+// copies "<name> begin time" and "<name> time taken" of an osg::Stats frame
+bool readStage( const osg::Stats *stats, unsigned int frameNumber,
+                const std::string& name, CaptureStage stage,
+                FrameTimings& timings) {
+
+    double begin, taken;
+    if (!stats
+        || !stats->getAttribute(frameNumber, name + " begin time", begin)
+        || !stats->getAttribute(frameNumber, name + " time taken", taken))
+        return false;
+
+    timings.begin[stage] = begin;
+    timings.duration[stage] = taken * 1000.0;
+    return true;
+}
+
+// float render target format of a pixel format
+GLenum floatInternalFormat(GLenum pixelFormat) {
+    switch (pixelFormat) {
+    case GL_RGB:
+        return GL_RGB32F_ARB;
+    case GL_LUMINANCE:
+        return GL_LUMINANCE32F_ARB;
+    default:
+        return GL_RGBA32F_ARB;
+    }
+}
+
+double readCounter( const osg::Stats *stats, unsigned int frameNumber,
+                    const std::string& name) {
+    double value = 0;
+    if (stats)
+        stats->getAttribute(frameNumber, name, value);
+    return value;
+}
+
+}
+
+ImageViewerCaptureTool::ImageViewerCaptureTool(uint width, uint height)
+    : _stats_enabled(false) {
     // initialize the hide viewer;
     initializeProperties(width, height);
 }
 
 ImageViewerCaptureTool::ImageViewerCaptureTool( double fovY, double fovX,
-                                                uint value, bool isHeight) {
+                                                uint value, bool isHeight)
+    : _stats_enabled(false) {
     uint width, height;
 
     if (isHeight) {
@@ -58,8 +104,173 @@ osg::ref_ptr<osg::Image> ImageViewerCaptureTool::grabImage(osg::ref_ptr<osg::Nod
         camera->setViewMatrix(osg::Matrix::identity());
 
     // grab the current frame
+    if (!_stats_enabled) {
+        _viewer->frame();
+        return _capture->captureImage();
+    }
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
     _viewer->frame();
-    return _capture->captureImage();
+    osg::ref_ptr<osg::Image> image = _capture->captureImage();
+    recordStats(start, osg::Timer::instance()->tick());
+    return image;
+}
+
+void ImageViewerCaptureTool::setStatsEnabled(bool enabled, uint window) {
+    if (enabled && (!_stats_enabled || window != _stats.capacity()))
+        _stats = CaptureStats(window);
+
+    _stats_enabled = enabled;
+    _capture->setTimingEnabled(enabled);
+
+    osg::Stats *viewerStats = _viewer->getViewerStats();
+    if (viewerStats)
+        viewerStats->collectStats("update", enabled);
+
+    osg::Stats *cameraStats = _viewer->getCamera()->getStats();
+    if (cameraStats) {
+        cameraStats->collectStats("rendering", enabled);
+        cameraStats->collectStats("gpu", enabled);
+        cameraStats->collectStats("scene", enabled);
+    }
+}
+
+void ImageViewerCaptureTool::recordStats(osg::Timer_t start, osg::Timer_t end) {
+    const osg::Timer *timer = osg::Timer::instance();
+    const osg::Timer_t origin = _viewer->getStartTick();
+    const osg::Stats *viewerStats = _viewer->getViewerStats();
+    const osg::Stats *cameraStats = _viewer->getCamera()->getStats();
+    const unsigned int frameNumber = _viewer->getFrameStamp()->getFrameNumber();
+
+    FrameTimings timings;
+    timings.frameNumber = frameNumber;
+    readStage(viewerStats, frameNumber, "Update traversal", UPDATE_STAGE, timings);
+    readStage(cameraStats, frameNumber, "Cull traversal", CULL_STAGE, timings);
+    readStage(cameraStats, frameNumber, "Draw traversal", DRAW_STAGE, timings);
+    readStage(cameraStats, frameNumber, "GPU draw", GPU_STAGE, timings);
+
+    timings.begin[READBACK_STAGE] = timer->delta_s(origin, _capture->getReadbackStart());
+    timings.duration[READBACK_STAGE] = timer->delta_m(  _capture->getReadbackStart(),
+                                                        _capture->getReadbackEnd());
+    timings.begin[WAIT_STAGE] = timer->delta_s(origin, _capture->getWaitStart());
+    timings.duration[WAIT_STAGE] = timer->delta_m(  _capture->getWaitStart(),
+                                                    _capture->getWaitEnd());
+    timings.begin[TOTAL_STAGE] = timer->delta_s(origin, start);
+    timings.duration[TOTAL_STAGE] = timer->delta_m(start, end);
+
+    timings.drawCalls = readCounter(cameraStats, frameNumber, "Visible number of drawables");
+    timings.triangles =
+        readCounter(cameraStats, frameNumber, "Visible number of GL_TRIANGLES")
+        + readCounter(cameraStats, frameNumber, "Visible number of GL_TRIANGLE_STRIP")
+        + readCounter(cameraStats, frameNumber, "Visible number of GL_TRIANGLE_FAN")
+        + 2 * readCounter(cameraStats, frameNumber, "Visible number of GL_QUADS");
+    _stats.add(timings);
+
+    // the draw stats of a threaded viewer and the GL timer queries are
+    // written after the capture, so completes the previous frames
+    for (unsigned int i = 1; i <= 3 && i <= frameNumber; ++i) {
+        FrameTimings *previous = _stats.find(frameNumber - i);
+        if (!previous)
+            break;
+        if (previous->duration[DRAW_STAGE] < 0)
+            readStage(cameraStats, frameNumber - i, "Draw traversal", DRAW_STAGE, *previous);
+        if (previous->duration[GPU_STAGE] < 0)
+            readStage(cameraStats, frameNumber - i, "GPU draw", GPU_STAGE, *previous);
+    }
+}
+
+osg::ref_ptr<osg::Image> ImageViewerCaptureTool::attachOutput(uint location,
+                                                            GLenum pixelFormat) {
+    if (location < 1 || location > 7)
+        throw std::invalid_argument("ImageViewerCaptureTool: output location must be between 1 and 7");
+
+    osg::ref_ptr<osg::Camera> camera = _viewer->getCamera();
+
+    // the main image and the depth move to the framebuffer object too
+    if (!_capture->isRenderToImage()) {
+        _capture->setRenderToImage(true);
+
+        osg::ref_ptr<osg::Image> image = _capture->getImage();
+        image->setInternalTextureFormat(floatInternalFormat(image->getPixelFormat()));
+        _capture->getDepthBuffer()->setInternalTextureFormat(GL_DEPTH_COMPONENT24);
+
+        camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+        camera->attach(osg::Camera::COLOR_BUFFER0, image.get());
+        camera->attach(osg::Camera::DEPTH_BUFFER, _capture->getDepthBuffer().get());
+    }
+
+    const osg::Viewport *viewport = camera->getViewport();
+    osg::ref_ptr<osg::Image> output = new osg::Image();
+    output->allocateImage(viewport->width(), viewport->height(), 1, pixelFormat, GL_FLOAT);
+    output->setInternalTextureFormat(floatInternalFormat(pixelFormat));
+
+    camera->attach((osg::Camera::BufferComponent) (osg::Camera::COLOR_BUFFER0 + location), output.get());
+    camera->dirtyAttachmentMap();
+    _outputs[location] = output;
+    return output;
+}
+
+osg::ref_ptr<osg::Image> ImageViewerCaptureTool::getOutput(uint location) {
+    std::map<uint, osg::ref_ptr<osg::Image> >::iterator it = _outputs.find(location);
+    if (it == _outputs.end())
+        return 0;
+    return it->second;
+}
+
+unsigned long long ImageViewerCaptureTool::grabFrame(
+                                osg::ref_ptr<osg::Node> node,
+                                FrameRing& ring,
+                                const NormalDepthMapParameters& parameters) {
+
+    Frame *frame = ring.beginWrite();
+    if (!frame)
+        return 0;
+
+    // renders straight in the frame memory
+    osg::ref_ptr<osg::Image> image = frame->image;
+    try {
+        _capture->setCaptureBuffer(CaptureBuffer(
+                                        image->data(), image->s(), image->t(),
+                                        image->getPixelFormat(),
+                                        image->getDataType(),
+                                        image->getRowSizeInBytes()));
+        grabImage(node);
+    } catch (...) {
+        _capture->releaseCaptureBuffer();
+        ring.abortWrite();
+        throw;
+    }
+    _capture->releaseCaptureBuffer();
+
+    frame->timestamp = _viewer->getFrameStamp()->getReferenceTime();
+    frame->cameraPose = osg::Matrixd::inverse(_viewer->getCamera()->getViewMatrix());
+    frame->parameters = parameters;
+    NormalDepthMap::getRenderedParameters(node, frame->parameters);
+    return ring.commitWrite();
+}
+
+unsigned long long ImageViewerCaptureTool::grabFrame(
+                                osg::ref_ptr<osg::Node> node,
+                                SharedFramePublisher& publisher,
+                                const NormalDepthMapParameters& parameters) {
+
+    // renders straight in the shared memory slot
+    try {
+        _capture->setCaptureBuffer(publisher.beginFrame());
+        grabImage(node);
+    } catch (...) {
+        _capture->releaseCaptureBuffer();
+        publisher.abortFrame();
+        throw;
+    }
+    _capture->releaseCaptureBuffer();
+
+    NormalDepthMapParameters rendered = parameters;
+    NormalDepthMap::getRenderedParameters(node, rendered);
+    return publisher.commitFrame(
+                _viewer->getFrameStamp()->getReferenceTime(),
+                osg::Matrixd::inverse(_viewer->getCamera()->getViewMatrix()),
+                rendered);
 }
 
 osg::ref_ptr<osg::Image> ImageViewerCaptureTool::getDepthBuffer() {
@@ -85,11 +296,42 @@ void ImageViewerCaptureTool::setBackgroundColor(osg::Vec4d color) {
     _viewer->getCamera()->setClearColor(color);
 }
 
+////////////////////////////////
+////CaptureBuffer METHODS
+////////////////////////////////
+
+CaptureBuffer::CaptureBuffer()
+    : data(0), width(0), height(0), pixelFormat(GL_RGB), dataType(GL_FLOAT),
+      rowStride(0) {}
+
+CaptureBuffer::CaptureBuffer(   void *data, uint width, uint height,
+                                GLenum pixelFormat, GLenum dataType,
+                                uint rowStride)
+    : data(data), width(width), height(height), pixelFormat(pixelFormat),
+      dataType(dataType), rowStride(rowStride) {}
+
+uint CaptureBuffer::pixelSize() const {
+    return osg::Image::computePixelSizeInBits(pixelFormat, dataType) / 8;
+}
+
+uint CaptureBuffer::effectiveRowStride() const {
+    return rowStride ? rowStride : width * pixelSize();
+}
+
+size_t CaptureBuffer::requiredSize() const {
+    if (!height)
+        return 0;
+    return (size_t) effectiveRowStride() * (height - 1) + width * pixelSize();
+}
+
 ////////////////////////////////
 ////WindowCaptureScreen METHODS
 ////////////////////////////////
 
-WindowCaptureScreen::WindowCaptureScreen(osg::ref_ptr<osg::GraphicsContext> gc) {
+WindowCaptureScreen::WindowCaptureScreen(osg::ref_ptr<osg::GraphicsContext> gc)
+    : _render_to_image(false),
+      _timing(false), _readback_start(0), _readback_end(0),
+      _wait_start(0), _wait_end(0) {
     _mutex = new OpenThreads::Mutex();
     _condition = new OpenThreads::Condition();
     _image = new osg::Image();
@@ -119,8 +361,78 @@ WindowCaptureScreen::~WindowCaptureScreen() {
 
 osg::ref_ptr<osg::Image> WindowCaptureScreen::captureImage() {
     //wait to finish the capture image in call back
+    if (_timing)
+        _wait_start = osg::Timer::instance()->tick();
     _condition->wait(_mutex);
-    return _image;
+    if (_timing)
+        _wait_end = osg::Timer::instance()->tick();
+
+    _mutex->lock();
+    osg::ref_ptr<osg::Image> image = _external_image.valid() ? _external_image : _image;
+    _mutex->unlock();
+    return image;
+}
+
+void WindowCaptureScreen::setCaptureBuffer(const CaptureBuffer& buffer) {
+    if (!buffer.data)
+        throw std::invalid_argument("CaptureBuffer: null data pointer");
+
+    if ((int) buffer.width != _image->s() || (int) buffer.height != _image->t())
+        throw std::invalid_argument("CaptureBuffer: size differs from the viewport");
+
+    uint pixelSize = buffer.pixelSize();
+    if (!pixelSize || buffer.effectiveRowStride() % pixelSize)
+        throw std::invalid_argument("CaptureBuffer: row stride is not a multiple of the pixel size");
+
+    if (_render_to_image && (buffer.pixelFormat != _image->getPixelFormat()
+                             || buffer.dataType != _image->getDataType()))
+        throw std::invalid_argument("CaptureBuffer: format differs from the render target");
+
+    // the largest pack alignment that keeps the rows at the requested stride
+    uint stride = buffer.effectiveRowStride();
+    size_t address = (size_t) buffer.data;
+    int packing = 8;
+    while (packing > 1 && (stride % packing || address % packing))
+        packing /= 2;
+
+    // wraps the caller memory, without ownership
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->setImage(buffer.width, buffer.height, 1,
+                    buffer.pixelFormat, buffer.pixelFormat, buffer.dataType,
+                    (unsigned char*) buffer.data, osg::Image::NO_DELETE,
+                    packing, stride / pixelSize);
+
+    // waits a readback in progress on the previous buffer
+    _mutex->lock();
+    _external_image = image;
+    _external_buffer = buffer;
+    _mutex->unlock();
+}
+
+void WindowCaptureScreen::setRenderToImage(bool enabled) {
+    _mutex->lock();
+    if (enabled && _external_image.valid()
+        && (_external_buffer.pixelFormat != _image->getPixelFormat()
+            || _external_buffer.dataType != _image->getDataType())) {
+        _mutex->unlock();
+        throw std::invalid_argument("CaptureBuffer: format differs from the render target");
+    }
+    _render_to_image = enabled;
+    _mutex->unlock();
+}
+
+void WindowCaptureScreen::releaseCaptureBuffer() {
+    _mutex->lock();
+    _external_image = 0;
+    _external_buffer = CaptureBuffer();
+    _mutex->unlock();
+}
+
+bool WindowCaptureScreen::hasCaptureBuffer() const {
+    _mutex->lock();
+    bool valid = _external_image.valid();
+    _mutex->unlock();
+    return valid;
 }
 
 osg::ref_ptr<osg::Image> WindowCaptureScreen::getDepthBuffer() {
@@ -132,8 +444,38 @@ void WindowCaptureScreen::operator ()(osg::RenderInfo& renderInfo) const {
     osg::ref_ptr<osg::GraphicsContext> gc = renderInfo.getState()->getGraphicsContext();
     if (gc->getTraits()) {
         _mutex->lock();
-        _image->readPixels( 0, 0, _image->s(), _image->t(), _image->getPixelFormat(), GL_FLOAT);
-        _depth_buffer->readPixels(0, 0, _image->s(), _image->t(), _depth_buffer->getPixelFormat(), GL_FLOAT);
+        if (_timing)
+            _readback_start = osg::Timer::instance()->tick();
+        if (_render_to_image) {
+            // the camera already read the render targets back
+            if (_external_image.valid()) {
+                uint rowSize = _image->getRowSizeInBytes();
+                uint stride = _external_buffer.effectiveRowStride();
+                for (int row = 0; row < _image->t(); ++row)
+                    memcpy( (unsigned char*) _external_buffer.data + (size_t) row * stride,
+                            _image->data(0, row), rowSize);
+            }
+        } else if (_external_image.valid()) {
+            // writes straight in the caller memory, keeping its row stride;
+            // the pack state of the context is restored after
+            GLint alignment, rowLength;
+            glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+            glGetIntegerv(GL_PACK_ROW_LENGTH, &rowLength);
+            glPixelStorei(GL_PACK_ALIGNMENT, _external_image->getPacking());
+            glPixelStorei(GL_PACK_ROW_LENGTH, _external_image->getRowLength());
+            glReadPixels(   0, 0, _external_image->s(), _external_image->t(),
+                            _external_buffer.pixelFormat,
+                            _external_buffer.dataType,
+                            _external_buffer.data);
+            glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+            glPixelStorei(GL_PACK_ROW_LENGTH, rowLength);
+        } else
+            _image->readPixels( 0, 0, _image->s(), _image->t(), _image->getPixelFormat(), GL_FLOAT);
+
+        if (!_render_to_image)
+            _depth_buffer->readPixels(0, 0, _image->s(), _image->t(), _depth_buffer->getPixelFormat(), GL_FLOAT);
+        if (_timing)
+            _readback_end = osg::Timer::instance()->tick();
 
         //grants the access to image
         _condition->signal();
@@ -1,10 +1,56 @@
 #ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_IMAGECAPTURETOOL_HPP_
 #define SIMULATION_NORMAL_DEPTH_MAP_SRC_IMAGECAPTURETOOL_HPP_
 
+#include <map>
+
+#include <osg/Timer>
 #include <osgViewer/Viewer>
+#include "CaptureStats.hpp"
+#include "FrameRing.hpp"
 
 namespace normal_depth_map {
 
+class SharedFramePublisher;
+
+/**
+ * @brief Describes a caller-owned memory region used as readback destination
+ *
+ *  It allows the rendered frame to be written directly in the consumer's
+ *  frame type (e.g. cv::Mat, base::samples::frame::Frame), without an
+ *  intermediate copy from the osg::Image owned by WindowCaptureScreen.
+ *
+ *  The rows are stored bottom-up, as returned by glReadPixels.
+ *
+ *  @param data: pointer to the first byte of the first row
+ *  @param width: image width in pixels, it must be equal to the viewport width
+ *  @param height: image height in pixels, it must be equal to the viewport height
+ *  @param pixelFormat: GL pixel format (e.g. GL_RGB, GL_RGBA, GL_BGR)
+ *  @param dataType: GL data type (e.g. GL_FLOAT, GL_HALF_FLOAT, GL_UNSIGNED_SHORT)
+ *  @param rowStride: distance in bytes between two rows (0 means tightly packed)
+ */
+struct CaptureBuffer {
+    CaptureBuffer();
+    CaptureBuffer(  void *data, uint width, uint height,
+                    GLenum pixelFormat = GL_RGB, GLenum dataType = GL_FLOAT,
+                    uint rowStride = 0);
+
+    // size of one pixel in bytes
+    uint pixelSize() const;
+
+    // distance between rows in bytes, resolving the packed case
+    uint effectiveRowStride() const;
+
+    // amount of memory in bytes that readback writes
+    size_t requiredSize() const;
+
+    void *data;
+    uint width;
+    uint height;
+    GLenum pixelFormat;
+    GLenum dataType;
+    uint rowStride;
+};
+
 /**
  * @brief Capture the osg::Image from a node scene without show the render window
  *
@@ -34,6 +80,54 @@ public:
     osg::ref_ptr<osg::Image> captureImage();
     osg::ref_ptr<osg::Image> getDepthBuffer();
 
+    // internal image, filled when no caller buffer is registered
+    osg::ref_ptr<osg::Image> getImage() { return _image; };
+
+    /**
+     * @brief Tells the camera renders in a framebuffer object that reads
+     *  back the internal image and the depth buffer itself
+     *
+     *  Then the callback only copies the internal image in the caller
+     *  buffer, which must have the same pixel format and data type.
+     */
+    void setRenderToImage(bool enabled);
+    bool isRenderToImage() const { return _render_to_image; };
+
+    /**
+     * @brief Registers an external memory region as readback destination
+     *
+     *  Lifetime contract: the memory must stay valid until
+     *  releaseCaptureBuffer() returns or another buffer is registered. Both
+     *  calls wait for a readback in progress, so after they return the
+     *  library does not touch the previous memory anymore. Between two
+     *  captures the buffer content is stable and owned by the caller.
+     *
+     *  @param buffer: destination descriptor; it throws std::invalid_argument
+     *   if its size does not match the graphic context or the stride is not
+     *   a multiple of the pixel size.
+     */
+    void setCaptureBuffer(const CaptureBuffer& buffer);
+
+    /**
+     * @brief Returns to the internal image as readback destination
+     */
+    void releaseCaptureBuffer();
+
+    bool hasCaptureBuffer() const;
+
+    /**
+     * @brief Enables the readback and wait time measurement
+     *
+     *  When disabled (default) the callback does not read the timer.
+     */
+    void setTimingEnabled(bool enabled) { _timing = enabled; };
+
+    // ticks of the last readback and of the last wait in captureImage
+    osg::Timer_t getReadbackStart() const { return _readback_start; };
+    osg::Timer_t getReadbackEnd() const { return _readback_end; };
+    osg::Timer_t getWaitStart() const { return _wait_start; };
+    osg::Timer_t getWaitEnd() const { return _wait_end; };
+
 private:
 
     /**
@@ -47,6 +141,18 @@ private:
     OpenThreads::Condition *_condition;
     osg::ref_ptr<osg::Image> _image;
     osg::ref_ptr<osg::Image> _depth_buffer;
+
+    // wraps the caller memory registered by setCaptureBuffer (no ownership)
+    osg::ref_ptr<osg::Image> _external_image;
+    CaptureBuffer _external_buffer;
+
+    bool _render_to_image;
+
+    bool _timing;
+    mutable osg::Timer_t _readback_start;
+    mutable osg::Timer_t _readback_end;
+    osg::Timer_t _wait_start;
+    osg::Timer_t _wait_end;
 };
 
 class ImageViewerCaptureTool {
@@ -82,6 +188,39 @@ public:
 
     osg::ref_ptr<osg::Image> grabImage(osg::ref_ptr<osg::Node> node);
 
+    /**
+     * @brief Renders the scene directly in the next free frame of a ring
+     *
+     *  The frame is tagged with the timestamp, the camera pose and the given
+     *  normal depth map parameters (or the ones rendered by the node, once
+     *  it applied a published snapshot or a setter changed it, see
+     *  NormalDepthMap::publishParameters), and then published to the
+     *  consumers.
+     *  The image of the ring must have the same size of the viewport.
+     *
+     *  @param node: node with the main scene
+     *  @param ring: destination ring
+     *  @param parameters: parameters used on the scene shader
+     *  @return the sequence number of the frame, or 0 if all frames are leased
+     */
+    unsigned long long grabFrame(   osg::ref_ptr<osg::Node> node,
+                                    FrameRing& ring,
+                                    const NormalDepthMapParameters& parameters
+                                        = NormalDepthMapParameters());
+
+    /**
+     * @brief Renders the scene directly in the shared memory of a publisher
+     *
+     *  @param node: node with the main scene
+     *  @param publisher: destination shared memory ring
+     *  @param parameters: parameters used on the scene shader
+     *  @return the sequence number of the published frame
+     */
+    unsigned long long grabFrame(   osg::ref_ptr<osg::Node> node,
+                                    SharedFramePublisher& publisher,
+                                    const NormalDepthMapParameters& parameters
+                                        = NormalDepthMapParameters());
+
     /**
      * @brief This function gets the image create by depth buffer
      *
@@ -89,6 +228,67 @@ public:
 
     osg::ref_ptr<osg::Image> getDepthBuffer();
 
+    /**
+     * @brief Renders the next frames directly in a caller-owned buffer
+     *
+     *  After this call, grabImage returns an osg::Image that wraps the given
+     *  memory instead of the internal one. See
+     *  WindowCaptureScreen::setCaptureBuffer for the lifetime contract.
+     *
+     *  @param buffer: destination descriptor
+     */
+    void setCaptureBuffer(const CaptureBuffer& buffer)
+      { _capture->setCaptureBuffer(buffer); };
+
+    void releaseCaptureBuffer()
+      { _capture->releaseCaptureBuffer(); };
+
+    /**
+     * @brief Enables the per stage timing of grabImage
+     *
+     *  Each grabImage call adds the update, cull, draw, GPU, readback and
+     *  wait times, the draw calls and the triangles of the frame in a
+     *  rolling window. It uses the osgViewer statistics, so the draw and
+     *  GPU times of a frame may only be known one or two frames later
+     *  (threaded viewer, asynchronous GL timer queries). Disabled by
+     *  default; then grabImage only tests a flag.
+     *
+     *  @param enabled: turns the instrumentation on or off
+     *  @param window: number of frames kept for the percentiles
+     */
+    void setStatsEnabled(bool enabled, uint window = 256);
+    bool isStatsEnabled() const { return _stats_enabled; };
+
+    /**
+     * @brief Gets the timings of the last frames
+     */
+    const CaptureStats& getStats() const { return _stats; };
+
+    /**
+     * @brief Adds a render target, read back in the same pass of the main
+     *  image
+     *
+     *  The fragment shader output bound to this location (see
+     *  osg::Program::addBindFragDataLocation) is written in a float image,
+     *  overwritten on each grabImage call. The first call moves the camera
+     *  from the window to a framebuffer object with float targets, so the
+     *  main image is no more quantized on 8 bits; then a caller buffer
+     *  must have the pixel format and the data type of the main image.
+     *
+     *  @param location: fragment output location, from 1 to 7 (0 is the
+     *   main image). It throws std::invalid_argument otherwise.
+     *  @param pixelFormat: GL pixel format of the output
+     *  @return the image receiving the output
+     */
+    osg::ref_ptr<osg::Image> attachOutput(uint location, GLenum pixelFormat = GL_RGBA);
+
+    /**
+     * @brief Gets the image of an output added by attachOutput
+     *
+     *  @return NULL if there is no output on this location
+     */
+    osg::ref_ptr<osg::Image> getOutput(uint location);
+
     void setCameraPosition( const osg::Vec3d& eye, const osg::Vec3d& center,
                             const osg::Vec3d& up);
     void getCameraPosition(osg::Vec3d& eye, osg::Vec3d& center, osg::Vec3d& up);
@@ -100,12 +300,28 @@ public:
     osg::Matrix getViewMatrix()
       { return _viewer->getCamera()->getViewMatrix(); };
 
+    void setProjectionMatrix (osg::Matrix matrix)
+      { _viewer->getCamera()->setProjectionMatrix(matrix); };
+
+    osg::Matrix getProjectionMatrix()
+      { return _viewer->getCamera()->getProjectionMatrix(); };
+
+    // hidden viewer, e.g. to set up its database pager
+    osg::ref_ptr<osgViewer::Viewer> getViewer() { return _viewer; };
+
 protected:
 
     void initializeProperties(uint width, uint height);
+    void recordStats(osg::Timer_t start, osg::Timer_t end);
 
     osg::ref_ptr<WindowCaptureScreen> _capture;
     osg::ref_ptr<osgViewer::Viewer> _viewer;
+
+    bool _stats_enabled;
+    CaptureStats _stats;
+
+    // extra render targets by fragment output location
+    std::map<uint, osg::ref_ptr<osg::Image> > _outputs;
 };
 
 } /* namespace normal_depth_map */
@@ -7,34 +7,237 @@
 
 #include "NormalDepthMap.hpp"
 
+#include <osg/Image>
 #include <osg/Node>
+#include <osg/NodeCallback>
+#include <osg/observer_ptr>
 #include <osg/Program>
 #include <osg/ref_ptr>
 #include <osg/Group>
 #include <osg/Shader>
 #include <osg/StateSet>
+#include <osg/Texture2D>
 #include <osg/Uniform>
 #include <osgDB/FileUtils>
+#include <osgUtil/CullVisitor>
+#include <OpenThreads/Atomic>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
 
 namespace normal_depth_map {
 
 #define SHADER_PATH_FRAG "normal_depth_map/shaders/normalDepthMap.frag"
 #define SHADER_PATH_VERT "normal_depth_map/shaders/normalDepthMap.vert"
 
-NormalDepthMap::NormalDepthMap(float maxRange, float maxHorizontalAngle, float maxVerticalAngle) {
+const uint NormalDepthMap::MAX_FREQUENCIES;
+const uint NormalDepthMap::INTENSITY_OUTPUT_LOCATION;
+const uint NormalDepthMap::POSITION_OUTPUT_LOCATION;
+const uint NormalDepthMap::LABEL_OUTPUT_LOCATION;
+const uint NormalDepthMap::WATER_COLUMN_TEXTURE_UNIT;
+const uint NormalDepthMap::WATER_COLUMN_SAMPLES;
+const uint NormalDepthMap::REFRACTION_TEXTURE_UNIT;
+const uint NormalDepthMap::BEAM_PATTERN_TEXTURE_UNIT;
+
+namespace {
+
+/**
+ * Sets the viewToWorld uniform to the inverse model view matrix of the
+ * camera that culls the scene. Each camera (slave, or render to texture
+ * camera of a capture tool) gets its own value, which osg_ViewMatrixInverse
+ * does not give to the nested cameras.
+ */
+class ViewToWorldCallback : public osg::NodeCallback {
+public:
+    void operator()(osg::Node *node, osg::NodeVisitor *nv) {
+        osgUtil::CullVisitor *cv = dynamic_cast<osgUtil::CullVisitor*>(nv);
+        if (!cv) {
+            traverse(node, nv);
+            return;
+        }
+
+        osg::ref_ptr<osg::StateSet> ss;
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+            // the deleted cameras, before their address is reused
+            StateSetMap::iterator it = _state_sets.begin();
+            while (it != _state_sets.end()) {
+                if (it->first.valid())
+                    ++it;
+                else
+                    _state_sets.erase(it++);
+            }
+
+            osg::ref_ptr<osg::StateSet>& cameraStateSet =
+                _state_sets[osg::observer_ptr<osg::Camera>(cv->getCurrentCamera())];
+            if (!cameraStateSet) {
+                osg::ref_ptr<osg::Uniform> viewToWorld = new osg::Uniform("viewToWorld", osg::Matrixf());
+                viewToWorld->setDataVariance(osg::Object::DYNAMIC);
+                cameraStateSet = new osg::StateSet();
+                cameraStateSet->addUniform(viewToWorld);
+            }
+            ss = cameraStateSet;
+        }
+
+        ss->getUniform("viewToWorld")->set(osg::Matrixf(osg::Matrix::inverse(*cv->getModelViewMatrix())));
+        cv->pushStateSet(ss.get());
+        traverse(node, nv);
+        cv->popStateSet();
+    }
+
+private:
+    typedef std::map<osg::observer_ptr<osg::Camera>, osg::ref_ptr<osg::StateSet> > StateSetMap;
+
+    OpenThreads::Mutex _mutex;
+    StateSetMap _state_sets;
+};
+
+// Binds a float table (water column, refraction, beam pattern) to a
+// texture unit and its sampler: linear interpolation, clamped to the
+// borders, in the internal format of the image and without resizing.
+void setTableTexture(   osg::StateSet *ss, osg::ref_ptr<osg::Image> image,
+                        uint unit, const std::string& sampler) {
+    osg::ref_ptr<osg::Texture2D> texture = new osg::Texture2D(image);
+    texture->setInternalFormat(image->getInternalTextureFormat());
+    texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+    texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+    texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+    texture->setResizeNonPowerOfTwoHint(false);
+
+    ss->setTextureAttributeAndModes(unit, texture, osg::StateAttribute::ON);
+    ss->getUniform(sampler)->set((int) unit);
+}
+
+// uniforms of the parameter set, changed together
+void writeParameters(osg::StateSet *ss, const NormalDepthMapParameters& parameters) {
+    ss->getUniform("farPlane")->set(parameters.maxRange);
+    ss->getUniform("limitHorizontalAngle")->set(parameters.maxHorizontalAngle);
+    ss->getUniform("limitVerticalAngle")->set(parameters.maxVerticalAngle);
+    ss->getUniform("attenuationCoeff")->set(parameters.attenuationCoeff);
+    ss->getUniform("drawNormal")->set(parameters.drawNormal);
+    ss->getUniform("drawDepth")->set(parameters.drawDepth);
+}
+
+NormalDepthMapParameters readParameters(osg::StateSet *ss) {
+    NormalDepthMapParameters parameters;
+    ss->getUniform("farPlane")->get(parameters.maxRange);
+    ss->getUniform("limitHorizontalAngle")->get(parameters.maxHorizontalAngle);
+    ss->getUniform("limitVerticalAngle")->get(parameters.maxVerticalAngle);
+    ss->getUniform("attenuationCoeff")->get(parameters.attenuationCoeff);
+    ss->getUniform("drawNormal")->get(parameters.drawNormal);
+    ss->getUniform("drawDepth")->get(parameters.drawDepth);
+    return parameters;
+}
+
+// Triple buffer of the published parameter sets, applied by the update
+// traversal. The publishers write the back slot and swap it with the
+// middle one; the update traversal swaps the middle slot with the front
+// one when it holds a new snapshot. Neither side waits for the other: the
+// version counter and the applied version are 64-bit atomics.
+class ParameterCallback : public osg::NodeCallback {
+public:
+    ParameterCallback()
+        : _middle(1), _front(0), _back(2), _version(0), _applied(0) {}
+
+    unsigned long long publish(const NormalDepthMapParameters& parameters) {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_publish_mutex);
+        unsigned long long version = __sync_add_and_fetch(&_version, 1);
+        _slots[_back] = parameters;
+        _slots[_back].version = version;
+        _back = _middle.exchange(_back | FRESH) & ~FRESH;
+        return version;
+    }
+
+    // a setter changed the render state out of the snapshots
+    void touch() {
+        setApplied(__sync_add_and_fetch(&_version, 1));
+    }
+
+    unsigned long long getApplied() {
+        return __sync_val_compare_and_swap(&_applied, 0, 0);
+    }
+
+    void operator()(osg::Node* node, osg::NodeVisitor* nv) {
+        if (_middle & FRESH) {
+            _front = _middle.exchange(_front) & ~FRESH;
+            writeParameters(node->getOrCreateStateSet(), _slots[_front]);
+
+            // a snapshot older than a setter change gives a new state
+            unsigned long long version = _slots[_front].version;
+            setApplied(version > _applied ? version : __sync_add_and_fetch(&_version, 1));
+        }
+        traverse(node, nv);
+    }
+
+private:
+    // set on the middle slot index while it holds an unread snapshot
+    static const unsigned FRESH = 4;
+
+    // only the render thread writes it (setters and update traversal);
+    // the compare and swap keeps the 64-bit store whole on 32-bit targets
+    void setApplied(unsigned long long version) {
+        unsigned long long current = _applied;
+        while (!__sync_bool_compare_and_swap(&_applied, current, version))
+            current = _applied;
+    }
+
+    NormalDepthMapParameters _slots[3];
+    OpenThreads::Atomic _middle;
+
+    // update traversal side only
+    unsigned _front;
+
+    // publishers side only
+    OpenThreads::Mutex _publish_mutex;
+    unsigned _back;
+
+    // both sides
+    volatile unsigned long long _version;
+    volatile unsigned long long _applied;
+};
+
+// the callback installed by createTheNormalDepthMapShaderNode, among the
+// nested update callbacks of the node
+ParameterCallback* getParameterCallback(osg::Node *node) {
+    if (!node)
+        return 0;
+
+    osg::NodeCallback *callback = dynamic_cast<osg::NodeCallback*>(node->getUpdateCallback());
+    while (callback) {
+        ParameterCallback *parameterCallback = dynamic_cast<ParameterCallback*>(callback);
+        if (parameterCallback)
+            return parameterCallback;
+        callback = dynamic_cast<osg::NodeCallback*>(callback->getNestedCallback());
+    }
+    return 0;
+}
+
+}
+
+NormalDepthMap::NormalDepthMap(float maxRange, float maxHorizontalAngle, float maxVerticalAngle)
+    : _water_column_coeffs(false) {
     _normalDepthMapNode = createTheNormalDepthMapShaderNode(maxRange, maxHorizontalAngle, maxVerticalAngle);
 }
 
-NormalDepthMap::NormalDepthMap(float maxRange, float maxHorizontalAngle, float maxVerticalAngle, float attenuationCoeff) {
+NormalDepthMap::NormalDepthMap(float maxRange, float maxHorizontalAngle, float maxVerticalAngle, float attenuationCoeff)
+    : _water_column_coeffs(false) {
     _normalDepthMapNode = createTheNormalDepthMapShaderNode(maxRange, maxHorizontalAngle, maxVerticalAngle, attenuationCoeff);
 }
 
-NormalDepthMap::NormalDepthMap() {
+NormalDepthMap::NormalDepthMap()
+    : _water_column_coeffs(false) {
     _normalDepthMapNode = createTheNormalDepthMapShaderNode();
 }
 
 void NormalDepthMap::setMaxRange(float maxRange) {
     _normalDepthMapNode->getOrCreateStateSet()->getUniform("farPlane")->set(maxRange);
+    parametersChanged();
 }
 
 float NormalDepthMap::getMaxRange() {
@@ -45,6 +248,7 @@ float NormalDepthMap::getMaxRange() {
 
 void NormalDepthMap::setMaxHorizontalAngle(float maxHorizontalAngle) {
     _normalDepthMapNode->getOrCreateStateSet()->getUniform("limitHorizontalAngle")->set(maxHorizontalAngle);
+    parametersChanged();
 }
 
 float NormalDepthMap::getMaxHorizontalAngle() {
@@ -55,6 +259,7 @@ float NormalDepthMap::getMaxHorizontalAngle() {
 
 void NormalDepthMap::setMaxVerticalAngle(float maxVerticalAngle) {
     _normalDepthMapNode->getOrCreateStateSet()->getUniform("limitVerticalAngle")->set(maxVerticalAngle);
+    parametersChanged();
 }
 
 float NormalDepthMap::getMaxVerticalAngle() {
@@ -65,6 +270,7 @@ float NormalDepthMap::getMaxVerticalAngle() {
 
 void NormalDepthMap::setAttenuationCoefficient(float coefficient) {
     _normalDepthMapNode->getOrCreateStateSet()->getUniform("attenuationCoeff")->set(coefficient);
+    parametersChanged();
 }
 
 float NormalDepthMap::getAttenuationCoefficient() {
@@ -73,8 +279,162 @@ float NormalDepthMap::getAttenuationCoefficient() {
     return coefficient;
 }
 
+void NormalDepthMap::setAttenuationCoefficients(const std::vector<float>& coefficients) {
+    if (coefficients.size() > MAX_FREQUENCIES)
+        throw std::invalid_argument("NormalDepthMap: too many attenuation coefficients");
+
+    // the caller coefficients replace the water column frequencies
+    setCoefficientUniforms(coefficients);
+    _normalDepthMapNode->getOrCreateStateSet()->getUniform("waterColumnFrequencies")->set(0);
+    _water_column_coeffs = false;
+    parametersChanged();
+}
+
+void NormalDepthMap::setCoefficientUniforms(const std::vector<float>& coefficients) {
+    osg::ref_ptr<osg::StateSet> ss = _normalDepthMapNode->getOrCreateStateSet();
+    osg::ref_ptr<osg::Uniform> coefficientsUniform = ss->getUniform("attenuationCoeffs");
+    for (uint i = 0; i < MAX_FREQUENCIES; ++i)
+        coefficientsUniform->setElement(i, i < coefficients.size() ? coefficients[i] : 0.0f);
+    ss->getUniform("numFrequencies")->set((int) coefficients.size());
+}
+
+std::vector<float> NormalDepthMap::getAttenuationCoefficients() {
+    osg::ref_ptr<osg::StateSet> ss = _normalDepthMapNode->getOrCreateStateSet();
+    int numFrequencies = 0;
+    ss->getUniform("numFrequencies")->get(numFrequencies);
+
+    std::vector<float> coefficients(numFrequencies);
+    for (int i = 0; i < numFrequencies; ++i)
+        ss->getUniform("attenuationCoeffs")->getElement(i, coefficients[i]);
+    return coefficients;
+}
+
+uint NormalDepthMap::getNumIntensityOutputs() {
+    int numFrequencies = 0;
+    _normalDepthMapNode->getOrCreateStateSet()->getUniform("numFrequencies")->get(numFrequencies);
+    return (numFrequencies + 3) / 4;
+}
+
+void NormalDepthMap::setWaterColumn(   const WaterColumnProfile& profile,
+                                        double frequency, double maxDepth,
+                                        const std::vector<double>& frequencies,
+                                        float surface) {
+    if (frequencies.size() > MAX_FREQUENCIES)
+        throw std::invalid_argument("NormalDepthMap: too many water column frequencies");
+
+    // one row per frequency: cumulative attenuation (red) and coefficient
+    // (green) over the depth
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(WATER_COLUMN_SAMPLES, frequencies.size() + 1, 1, GL_RG, GL_FLOAT);
+    image->setInternalTextureFormat(GL_RG32F);
+
+    std::vector<float> coefficients;
+    for (uint row = 0; row <= frequencies.size(); ++row) {
+        std::vector<double> attenuation, cumulative;
+        double rowFrequency = row ? frequencies[row - 1] : frequency;
+        profile.sampleAttenuation(rowFrequency, maxDepth, WATER_COLUMN_SAMPLES, attenuation, cumulative);
+
+        float *texels = (float*) image->data(0, row);
+        for (uint i = 0; i < WATER_COLUMN_SAMPLES; ++i) {
+            texels[2 * i] = cumulative[i];
+            texels[2 * i + 1] = attenuation[i];
+        }
+        if (row)
+            coefficients.push_back(attenuation[0]);
+    }
+
+    osg::ref_ptr<osg::StateSet> ss = _normalDepthMapNode->getOrCreateStateSet();
+    setTableTexture(ss, image, WATER_COLUMN_TEXTURE_UNIT, "waterColumnTexture");
+    ss->getUniform("waterColumnMaxDepth")->set((float) maxDepth);
+    ss->getUniform("waterSurface")->set(surface);
+    ss->getUniform("waterColumn")->set(true);
+    ss->getUniform("waterColumnFrequencies")->set((int) frequencies.size());
+
+    // the constant coefficients come back with clearWaterColumn; without
+    // frequencies, the intensities keep them
+    if (!frequencies.empty()) {
+        if (!_water_column_coeffs) {
+            _constant_coeffs = getAttenuationCoefficients();
+            _water_column_coeffs = true;
+        }
+        setCoefficientUniforms(coefficients);
+    }
+    parametersChanged();
+}
+
+void NormalDepthMap::clearWaterColumn() {
+    osg::ref_ptr<osg::StateSet> ss = _normalDepthMapNode->getOrCreateStateSet();
+    ss->removeTextureAttribute(WATER_COLUMN_TEXTURE_UNIT, osg::StateAttribute::TEXTURE);
+    ss->getUniform("waterColumn")->set(false);
+    ss->getUniform("waterColumnFrequencies")->set(0);
+
+    if (_water_column_coeffs) {
+        setCoefficientUniforms(_constant_coeffs);
+        _water_column_coeffs = false;
+    }
+    parametersChanged();
+}
+
+bool NormalDepthMap::hasWaterColumn() {
+    bool waterColumn;
+    _normalDepthMapNode->getOrCreateStateSet()->getUniform("waterColumn")->get(waterColumn);
+    return waterColumn;
+}
+
+void NormalDepthMap::setRefractionTable(const RefractionTable& table) {
+    osg::ref_ptr<osg::StateSet> ss = _normalDepthMapNode->getOrCreateStateSet();
+    setTableTexture(ss, table.createImage(), REFRACTION_TEXTURE_UNIT, "refractionTexture");
+    ss->getUniform("refractionMaxRange")->set((float) table.getMaxRange());
+    ss->getUniform("refraction")->set(true);
+    parametersChanged();
+}
+
+void NormalDepthMap::clearRefractionTable() {
+    osg::ref_ptr<osg::StateSet> ss = _normalDepthMapNode->getOrCreateStateSet();
+    ss->removeTextureAttribute(REFRACTION_TEXTURE_UNIT, osg::StateAttribute::TEXTURE);
+    ss->getUniform("refraction")->set(false);
+    parametersChanged();
+}
+
+bool NormalDepthMap::hasRefractionTable() {
+    bool refraction;
+    _normalDepthMapNode->getOrCreateStateSet()->getUniform("refraction")->get(refraction);
+    return refraction;
+}
+
+void NormalDepthMap::setBeamPattern(const std::vector<float>& gains,
+                                    uint horizontalSamples, uint verticalSamples) {
+    if (horizontalSamples < 2 || verticalSamples < 2
+        || gains.size() != horizontalSamples * verticalSamples)
+        throw std::invalid_argument("NormalDepthMap: the beam pattern needs 2 samples per axis and one gain per sample");
+
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(horizontalSamples, verticalSamples, 1, GL_RED, GL_FLOAT);
+    image->setInternalTextureFormat(GL_R32F);
+    memcpy(image->data(), &gains[0], gains.size() * sizeof(float));
+
+    osg::ref_ptr<osg::StateSet> ss = _normalDepthMapNode->getOrCreateStateSet();
+    setTableTexture(ss, image, BEAM_PATTERN_TEXTURE_UNIT, "beamPatternTexture");
+    ss->getUniform("beamPattern")->set(true);
+    parametersChanged();
+}
+
+void NormalDepthMap::clearBeamPattern() {
+    osg::ref_ptr<osg::StateSet> ss = _normalDepthMapNode->getOrCreateStateSet();
+    ss->removeTextureAttribute(BEAM_PATTERN_TEXTURE_UNIT, osg::StateAttribute::TEXTURE);
+    ss->getUniform("beamPattern")->set(false);
+    parametersChanged();
+}
+
+bool NormalDepthMap::hasBeamPattern() {
+    bool beamPattern;
+    _normalDepthMapNode->getOrCreateStateSet()->getUniform("beamPattern")->get(beamPattern);
+    return beamPattern;
+}
+
 void NormalDepthMap::setDrawNormal(bool drawNormal) {
     _normalDepthMapNode->getOrCreateStateSet()->getUniform("drawNormal")->set(drawNormal);
+    parametersChanged();
 }
 
 bool NormalDepthMap::isDrawNormal() {
@@ -85,6 +445,7 @@ bool NormalDepthMap::isDrawNormal() {
 
 void NormalDepthMap::setDrawDepth(bool drawDepth) {
     _normalDepthMapNode->getOrCreateStateSet()->getUniform("drawDepth")->set(drawDepth);
+    parametersChanged();
 }
 
 bool NormalDepthMap::isDrawDepth() {
@@ -93,6 +454,58 @@ bool NormalDepthMap::isDrawDepth() {
     return drawDepth;
 }
 
+void NormalDepthMap::setObjectId(osg::ref_ptr<osg::Node> node, uint id) {
+    osg::ref_ptr<osg::StateSet> ss = node->getOrCreateStateSet();
+    osg::ref_ptr<osg::Uniform> objectIdUniform = ss->getUniform("objectId");
+    if (objectIdUniform)
+        objectIdUniform->set((int) id);
+    else
+        ss->addUniform(new osg::Uniform("objectId", (int) id));
+}
+
+uint NormalDepthMap::getObjectId(osg::ref_ptr<osg::Node> node) {
+    int id = 0;
+    osg::StateSet *ss = node->getStateSet();
+    if (ss && ss->getUniform("objectId"))
+        ss->getUniform("objectId")->get(id);
+    return id;
+}
+
+NormalDepthMapParameters NormalDepthMap::getParameters() {
+    NormalDepthMapParameters parameters = readParameters(_normalDepthMapNode->getOrCreateStateSet());
+    parameters.version = getAppliedVersion();
+    return parameters;
+}
+
+unsigned long long NormalDepthMap::publishParameters(const NormalDepthMapParameters& parameters) {
+    ParameterCallback *callback = getParameterCallback(_normalDepthMapNode);
+    if (!callback)
+        throw std::runtime_error("NormalDepthMap: the parameter update callback was removed from the node");
+    return callback->publish(parameters);
+}
+
+unsigned long long NormalDepthMap::getAppliedVersion() {
+    ParameterCallback *callback = getParameterCallback(_normalDepthMapNode);
+    return callback ? callback->getApplied() : 0;
+}
+
+void NormalDepthMap::parametersChanged() {
+    ParameterCallback *callback = getParameterCallback(_normalDepthMapNode);
+    if (callback)
+        callback->touch();
+}
+
+bool NormalDepthMap::getRenderedParameters( osg::ref_ptr<osg::Node> node,
+                                            NormalDepthMapParameters& parameters) {
+    ParameterCallback *callback = getParameterCallback(node);
+    if (!callback || !callback->getApplied())
+        return false;
+
+    parameters = readParameters(node->getOrCreateStateSet());
+    parameters.version = callback->getApplied();
+    return true;
+}
+
 void NormalDepthMap::addNodeChild(osg::ref_ptr<osg::Node> node) {
     _normalDepthMapNode->addChild(node);
 }
@@ -113,12 +526,29 @@ osg::ref_ptr<osg::Group> NormalDepthMap::createTheNormalDepthMapShaderNode(
     program->addShader(shaderFragment);
     program->addShader(shaderVertex);
 
+    // fixed locations of the render targets
+    program->addBindFragDataLocation("out_data", 0);
+    program->addBindFragDataLocation("out_intensity", INTENSITY_OUTPUT_LOCATION);
+    program->addBindFragDataLocation("out_position", POSITION_OUTPUT_LOCATION);
+    program->addBindFragDataLocation("out_label", LABEL_OUTPUT_LOCATION);
+
     osg::ref_ptr<osg::StateSet> ss = localRoot->getOrCreateStateSet();
     ss->setAttribute(program);
 
     osg::ref_ptr<osg::Uniform> attenuationCoefficientUniform(new osg::Uniform("attenuationCoeff", attenuationCoefficient));
     ss->addUniform(attenuationCoefficientUniform);
 
+    osg::ref_ptr<osg::Uniform> attenuationCoefficientsUniform(new osg::Uniform(osg::Uniform::FLOAT, "attenuationCoeffs", MAX_FREQUENCIES));
+    for (uint i = 0; i < MAX_FREQUENCIES; ++i)
+        attenuationCoefficientsUniform->setElement(i, 0.0f);
+    ss->addUniform(attenuationCoefficientsUniform);
+
+    osg::ref_ptr<osg::Uniform> numFrequenciesUniform(new osg::Uniform("numFrequencies", 0));
+    ss->addUniform(numFrequenciesUniform);
+
+    osg::ref_ptr<osg::Uniform> objectIdUniform(new osg::Uniform("objectId", 0));
+    ss->addUniform(objectIdUniform);
+
     osg::ref_ptr<osg::Uniform> farPlaneUniform(new osg::Uniform("farPlane", maxRange));
     ss->addUniform(farPlaneUniform);
 
@@ -133,6 +563,43 @@ osg::ref_ptr<osg::Group> NormalDepthMap::createTheNormalDepthMapShaderNode(
     osg::ref_ptr<osg::Uniform> drawDepthUniform(new osg::Uniform("drawDepth", drawDepth));
     ss->addUniform(drawDepthUniform);
 
+    // snapshots applied on the update traversal, see publishParameters; the
+    // draw of the previous frame must not run with them
+    farPlaneUniform->setDataVariance(osg::Object::DYNAMIC);
+    maxHorizontalAngleUniform->setDataVariance(osg::Object::DYNAMIC);
+    maxVerticalAngleUniform->setDataVariance(osg::Object::DYNAMIC);
+    attenuationCoefficientUniform->setDataVariance(osg::Object::DYNAMIC);
+    drawNormalUniform->setDataVariance(osg::Object::DYNAMIC);
+    drawDepthUniform->setDataVariance(osg::Object::DYNAMIC);
+    localRoot->addUpdateCallback(new ParameterCallback());
+
+    // neither for the setters of the uniforms and textures out of the
+    // snapshots, between two frames
+    ss->setDataVariance(osg::Object::DYNAMIC);
+
+    // constant attenuation coefficients, see setWaterColumn
+    ss->addUniform(new osg::Uniform("waterColumn", false));
+    ss->addUniform(new osg::Uniform("waterColumnTexture", (int) WATER_COLUMN_TEXTURE_UNIT));
+    ss->addUniform(new osg::Uniform("waterColumnFrequencies", 0));
+    ss->addUniform(new osg::Uniform("waterColumnMaxDepth", 1.0f));
+    ss->addUniform(new osg::Uniform("waterSurface", 0.0f));
+    localRoot->setCullCallback(new ViewToWorldCallback());
+
+    // straight rays, see setRefractionTable
+    ss->addUniform(new osg::Uniform("refraction", false));
+    ss->addUniform(new osg::Uniform("refractionTexture", (int) REFRACTION_TEXTURE_UNIT));
+    ss->addUniform(new osg::Uniform("refractionMaxRange", 1.0f));
+
+    // no angle limits, see setBeamPattern
+    ss->addUniform(new osg::Uniform("beamPattern", false));
+    ss->addUniform(new osg::Uniform("beamPatternTexture", (int) BEAM_PATTERN_TEXTURE_UNIT));
+
+    // mesh scenes, see ClipmapTerrain for the heightfield mode
+    osg::ref_ptr<osg::Uniform> heightfieldUniform(new osg::Uniform("heightfield", false));
+    ss->addUniform(heightfieldUniform);
+    osg::ref_ptr<osg::Uniform> clipmapHoleUniform(new osg::Uniform("clipmapHole", osg::Vec4f()));
+    ss->addUniform(clipmapHoleUniform);
+
     return localRoot;
 }
 
@@ -8,12 +8,42 @@
 #ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_NORMALDEPTHMAP_HPP_
 #define SIMULATION_NORMAL_DEPTH_MAP_SRC_NORMALDEPTHMAP_HPP_
 
+#include <vector>
+
 #include <osg/Node>
 #include <osg/Group>
 #include <osg/ref_ptr>
 
+#include "RefractionTable.hpp"
+#include "WaterColumn.hpp"
+
 namespace normal_depth_map {
 
+/**
+ * @brief Set of parameters applied in the normal depth map shader
+ *
+ *  It is a plain copy of the shader uniforms, used to tag the captured
+ *  frames with the configuration that produced them, and to publish a new
+ *  configuration (see NormalDepthMap::publishParameters).
+ *
+ *  @param version: version of the published snapshot applied on the
+ *   render, 0 if none was published
+ */
+struct NormalDepthMapParameters {
+    NormalDepthMapParameters()
+        : maxRange(50.0), maxHorizontalAngle(M_PI * 1.0 / 6.0),
+          maxVerticalAngle(M_PI * 1.0 / 6.0), attenuationCoeff(0),
+          drawNormal(true), drawDepth(true), version(0) {}
+
+    float maxRange;
+    float maxHorizontalAngle;
+    float maxVerticalAngle;
+    float attenuationCoeff;
+    bool drawNormal;
+    bool drawDepth;
+    unsigned long long version;
+};
+
 /**
  * @brief Gets the informations of normal and depth from a osg scene, between the objects and the camera.
  *
@@ -25,6 +55,32 @@ namespace normal_depth_map {
  */
 class NormalDepthMap {
 public:
+
+    // maximum number of coefficients of the multi-frequency mode
+    static const uint MAX_FREQUENCIES = 8;
+
+    // fragment output location of the first multi-frequency intensity target
+    static const uint INTENSITY_OUTPUT_LOCATION = 1;
+
+    // fragment output location of the view-space position (xyz, w = 1 on objects)
+    static const uint POSITION_OUTPUT_LOCATION = 3;
+
+    // fragment output location of the labels (object id, incidence angle in
+    // radians, 0, w = 1 on objects)
+    static const uint LABEL_OUTPUT_LOCATION = 4;
+
+    // texture unit of the water column attenuation
+    static const uint WATER_COLUMN_TEXTURE_UNIT = 2;
+
+    // number of depth samples of the water column attenuation
+    static const uint WATER_COLUMN_SAMPLES = 1024;
+
+    // texture unit of the refraction table
+    static const uint REFRACTION_TEXTURE_UNIT = 3;
+
+    // texture unit of the beam pattern
+    static const uint BEAM_PATTERN_TEXTURE_UNIT = 4;
+
     /**
      * @brief Build a map informations from the normal surface and depth from objects to the camera.
      *
@@ -78,14 +134,176 @@ public:
     void setAttenuationCoefficient(float coefficient);
     float getAttenuationCoefficient();
 
+    /**
+     * @brief Enables the multi-frequency mode
+     *
+     *  Besides the normal channel, the shader writes one attenuated
+     *  intensity per coefficient, in the same pass. They are packed four
+     *  per render target, from INTENSITY_OUTPUT_LOCATION: the intensity of
+     *  the coefficient i is the channel i % 4 of the output
+     *  INTENSITY_OUTPUT_LOCATION + i / 4 (see
+     *  ImageViewerCaptureTool::attachOutput). An empty vector disables it.
+     *
+     *  With a water column, the coefficients replace its frequencies (see
+     *  setWaterColumn), and are kept by clearWaterColumn.
+     *
+     *  @param coefficients: attenuation coefficients, up to MAX_FREQUENCIES;
+     *   it throws std::invalid_argument with more values.
+     */
+    void setAttenuationCoefficients(const std::vector<float>& coefficients);
+    std::vector<float> getAttenuationCoefficients();
+
+    // number of render targets used by the multi-frequency intensities
+    uint getNumIntensityOutputs();
+
+    /**
+     * @brief Replaces the constant attenuation coefficients by a water column
+     *
+     *  The attenuation of a pixel is the mean coefficient of the profile
+     *  between the depths of the sonar and of the pixel (below the surface,
+     *  in world coordinates), times the range. The cumulative attenuation
+     *  of each frequency over the depth is precomputed in a texture, so it
+     *  costs one texture fetch per frequency in the shader, and no update
+     *  when the sonar moves.
+     *
+     *  @param profile: water properties over the depth
+     *  @param frequency: frequency of the normal channel, in kHz
+     *  @param maxDepth: deepest point of the scene, below the surface
+     *  @param frequencies: frequencies of the multi-frequency intensities,
+     *   in kHz; they replace the attenuation coefficients (with their values
+     *   at the surface, see setAttenuationCoefficients) until
+     *   clearWaterColumn. Without frequencies, the multi-frequency
+     *   intensities keep the constant coefficients.
+     *  @param surface: world z of the water surface
+     */
+    void setWaterColumn(const WaterColumnProfile& profile, double frequency,
+                        double maxDepth,
+                        const std::vector<double>& frequencies = std::vector<double>(),
+                        float surface = 0);
+
+    // back to the constant attenuation coefficients, restoring the ones
+    // replaced by the water column frequencies
+    void clearWaterColumn();
+    bool hasWaterColumn();
+
+    /**
+     * @brief Bends the acoustic rays through a sound speed profile
+     *
+     *  Each pixel reads its apparent range and angle in the table, from the
+     *  depression angle and range of its straight line: the depth channel
+     *  gets the apparent range and the position output the apparent
+     *  position, at the same azimuth. The pixels out of the reach of the
+     *  direct rays have no echo, but still hide the scene behind them. The
+     *  straight range is kept for the occlusions and the attenuation.
+     *
+     *  The table must be built for the sonar depth; it costs one texture
+     *  fetch per pixel.
+     */
+    void setRefractionTable(const RefractionTable& table);
+
+    // back to straight rays
+    void clearRefractionTable();
+    bool hasRefractionTable();
+
+    /**
+     * @brief Weights the intensities by the directivity of the transducer
+     *
+     *  The gain of each pixel is interpolated in the table at its horizontal
+     *  and vertical angles from the sonar axis (the apparent ones with a
+     *  refraction table), and the pixels out of the angle limits (see
+     *  setMaxHorizontalAngle) get no intensity. Without a pattern, the angle
+     *  limits are not applied.
+     *
+     *  @param gains: two-way intensity gains, one row of horizontalSamples
+     *   per vertical angle; the samples go from -limit to +limit on each
+     *   axis, the rows from the lowest vertical angle
+     *  It throws std::invalid_argument if the table size does not match, or
+     *  on less than 2 samples per axis.
+     */
+    void setBeamPattern(const std::vector<float>& gains, uint horizontalSamples,
+                        uint verticalSamples);
+
+    // back to the unweighted intensities, without angle limits
+    void clearBeamPattern();
+    bool hasBeamPattern();
+
     void setDrawNormal(bool drawNormal);
     bool isDrawNormal();
 
     void setDrawDepth(bool drawDepth);
     bool isDrawDepth();
 
+    /**
+     * @brief Tags a node of the scene with an object id
+     *
+     *  The id is written in the label output of the pixels of this node and
+     *  its children, unless they have their own id. Untagged nodes are 0.
+     *  The ids are exact up to 2^24.
+     *
+     *  @param node: node of the scene
+     *  @param id: object id
+     */
+    static void setObjectId(osg::ref_ptr<osg::Node> node, uint id);
+
+    // id set by setObjectId, or 0
+    static uint getObjectId(osg::ref_ptr<osg::Node> node);
+
+    /**
+     * @brief Get a copy of the current shader parameters
+     */
+    NormalDepthMapParameters getParameters();
+
+    /**
+     * @brief Publishes a parameter set, applied at the next frame boundary
+     *
+     *  The setters change the shader uniforms at once, so they must be
+     *  called from the render thread between two frames. This call copies
+     *  the snapshot in a triple buffer and returns: the update traversal
+     *  of the next frame (e.g. in ImageViewerCaptureTool::grabImage) takes
+     *  the latest published snapshot and applies all its values together,
+     *  without waiting for the publishers. Snapshots published between two
+     *  frames replace each other.
+     *
+     *  It is safe from any thread; concurrent publishers are serialized
+     *  among themselves, never with the render thread.
+     *
+     *  The setters (including the water column, the refraction table and
+     *  the beam pattern) take a new version too, so a version always
+     *  describes one render state. A snapshot published before a setter
+     *  call gets a newer version when it is applied.
+     *
+     *  @param parameters: new values (its version is ignored)
+     *  @return the version of the snapshot, increasing from 1
+     *  It throws std::runtime_error if the update callback of the node was
+     *  replaced (see osg::Node::addUpdateCallback to add one).
+     */
+    unsigned long long publishParameters(const NormalDepthMapParameters& parameters);
+
+    // version of the state rendered on the last frame (at least the one of
+    // the applied snapshot), or changed by a setter since; 0 if none
+    unsigned long long getAppliedVersion();
+
+    /**
+     * @brief Parameters rendered by a normal depth map node, with the
+     *  version of the applied snapshot
+     *
+     *  The capture tools tag their frames with it after the render.
+     *
+     *  @param node: node returned by getNormalDepthMapNode
+     *  @return false if the node did not apply any snapshot nor setter
+     *   change yet
+     */
+    static bool getRenderedParameters(  osg::ref_ptr<osg::Node> node,
+                                        NormalDepthMapParameters& parameters);
+
 private:
 
+    // gives a new version to the state changed by a setter
+    void parametersChanged();
+
+    // multi-frequency uniforms, without the water column bookkeeping
+    void setCoefficientUniforms(const std::vector<float>& coefficients);
+
     osg::ref_ptr<osg::Group> createTheNormalDepthMapShaderNode(
                               float maxRange = 50.0,
                               float maxHorizontalAngle = M_PI * 1.0 / 6.0,
@@ -94,6 +312,10 @@ private:
                               bool drawDepth = true,
                               bool drawNormal = true);
     osg::ref_ptr<osg::Group> _normalDepthMapNode; //main shader node
+
+    // attenuation coefficients replaced by the water column frequencies
+    std::vector<float> _constant_coeffs;
+    bool _water_column_coeffs;
 };
 }
 
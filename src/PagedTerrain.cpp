@@ -0,0 +1,363 @@
+#include "PagedTerrain.hpp"
+
+#include "BathymetryMesher.hpp"
+
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/MatrixTransform>
+#include <osg/PagedLOD>
+#include <osg/Vec2d>
+#include <osg/observer_ptr>
+#include <osgDB/FileNameUtils>
+#include <osgDB/Options>
+#include <osgUtil/IncrementalCompileOperation>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace normal_depth_map {
+
+/**
+ * Builds the quadtree nodes and the tile meshes, on the pager thread, and
+ * keeps the paged nodes to update their ranges.
+ */
+class PagedTerrain::TileFactory : public osg::Referenced {
+public:
+    TileFactory(osg::ref_ptr<BathymetrySource> source, float maxRange,
+                uint tileSize, const osg::Vec3d& origin);
+
+    osg::ref_ptr<osg::PagedLOD> createLOD(uint level, uint x, uint y);
+    osg::ref_ptr<osg::Node> createNode(uint level, uint x, uint y);
+
+    void setVehiclePose(const osg::Vec3d& position, const osg::Vec3d& heading);
+    void setRanges(float maxRange, float prefetchDistance);
+    void setMaxError(float maxError);
+    float getMaxError();
+    uint getNumResidentTiles();
+
+    float getTileSide() const { return tileSize * _source->getCellSize(); }
+
+    float maxRange;
+    float prefetchDistance;
+    uint tileSize;
+    uint numTilesX;
+    uint numTilesY;
+    uint numLevels;
+
+private:
+    class Reader;
+
+    struct PagedNode {
+        osg::observer_ptr<osg::PagedLOD> lod;
+        float halfDiagonal;
+        bool leaf;
+    };
+
+    osg::ref_ptr<osg::Node> createTile(uint x, uint y);
+    void getSamples(uint level, uint x, uint y, uint& x0, uint& y0, uint& x1, uint& y1) const;
+    void updateRange(osg::PagedLOD *lod, const PagedNode& node) const;
+
+    osg::ref_ptr<BathymetrySource> _source;
+    osg::Vec3d _origin;
+    osg::ref_ptr<osgDB::Options> _options;
+
+    OpenThreads::Mutex _mutex;
+    float _max_error;
+    std::vector<PagedNode> _nodes;
+    osg::Vec3d _position;
+    osg::Vec3d _heading;
+};
+
+/**
+ * Reads the node files of the terrain ("level_x_y.ndmtile") from the
+ * factory, instead of the disk.
+ */
+class PagedTerrain::TileFactory::Reader : public osgDB::ReadFileCallback {
+public:
+    Reader(TileFactory *factory) : _factory(factory) {}
+
+    osgDB::ReaderWriter::ReadResult readNode(const std::string& fileName, const osgDB::Options *options);
+
+private:
+    osg::observer_ptr<TileFactory> _factory;
+};
+
+PagedTerrain::TileFactory::TileFactory( osg::ref_ptr<BathymetrySource> source,
+                                        float maxRange, uint tileSize,
+                                        const osg::Vec3d& origin)
+    : maxRange(maxRange), prefetchDistance(maxRange), tileSize(tileSize),
+      _source(source), _origin(origin), _max_error(0) {
+
+    if (!source || !tileSize || !(maxRange > 0))
+        throw std::invalid_argument("PagedTerrain: needs a source, a tile size and a max range");
+
+    numTilesX = (source->getWidth() - 2) / tileSize + 1;
+    numTilesY = (source->getHeight() - 2) / tileSize + 1;
+    numLevels = 0;
+    while ((1u << numLevels) < std::max(numTilesX, numTilesY))
+        ++numLevels;
+
+    _options = new osgDB::Options();
+    _options->setReadFileCallback(new Reader(this));
+}
+
+void PagedTerrain::TileFactory::getSamples( uint level, uint x, uint y,
+                                            uint& x0, uint& y0,
+                                            uint& x1, uint& y1) const {
+    uint span = 1u << (numLevels - level);
+    x0 = std::min(x * span, numTilesX) * tileSize;
+    y0 = std::min(y * span, numTilesY) * tileSize;
+    x1 = std::min(std::min((x + 1) * span, numTilesX) * tileSize, _source->getWidth() - 1);
+    y1 = std::min(std::min((y + 1) * span, numTilesY) * tileSize, _source->getHeight() - 1);
+}
+
+void PagedTerrain::TileFactory::updateRange(osg::PagedLOD *lod, const PagedNode& node) const {
+    // tiles ahead get the prefetch distance and a higher pager priority
+    float bias = 1, priority = 0;
+    osg::Vec3d heading(_heading.x(), _heading.y(), 0);
+    osg::Vec3d direction = osg::Vec3d(lod->getCenter()) - _position;
+    double height = direction.z();
+    direction.z() = 0;
+
+    if (node.leaf && heading.normalize() > 0) {
+        priority = direction.normalize() > 0 ? direction * heading : 1;
+        bias = std::max(0.0f, priority);
+    }
+
+    // the load distance is horizontal, so it does not depend on the relief
+    // of the tile and a node always loads before its children; the pager
+    // compares the range with the distance to the center, height included
+    double distance = maxRange + node.halfDiagonal + prefetchDistance * bias;
+    lod->setRange(0, 0, sqrt(distance * distance + height * height));
+    lod->setPriorityOffset(0, priority);
+}
+
+osg::ref_ptr<osg::PagedLOD> PagedTerrain::TileFactory::createLOD(uint level, uint x, uint y) {
+    uint x0, y0, x1, y1;
+    getSamples(level, x, y, x0, y0, x1, y1);
+
+    // the bound of a tile holds all its samples, so it is not culled while
+    // a peak is in view; the quadtree nodes above are only sampled, and are
+    // not culled
+    bool leaf = level == numLevels;
+    uint steps = leaf ? std::max(x1 - x0, y1 - y0) + 1 : 9;
+    float min, max;
+    if (!_source->sampleElevationRange(x0, y0, x1, y1, min, max, steps))
+        min = max = 0;
+
+    float cellSize = _source->getCellSize();
+    osg::Vec3d halfSize(0.5 * (x1 - x0) * cellSize, 0.5 * (y1 - y0) * cellSize, 0.5 * (max - min));
+
+    std::ostringstream fileName;
+    fileName << level << "_" << x << "_" << y << ".ndmtile";
+
+    osg::ref_ptr<osg::PagedLOD> lod = new osg::PagedLOD();
+    lod->setCenterMode(osg::LOD::USER_DEFINED_CENTER);
+    lod->setCenter(_origin + osg::Vec3d(x0 * cellSize + halfSize.x(),
+                                        y0 * cellSize + halfSize.y(),
+                                        min + halfSize.z()));
+    lod->setRadius(halfSize.length());
+    lod->setFileName(0, fileName.str());
+    lod->setDatabaseOptions(_options.get());
+    lod->setCullingActive(leaf);
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+    PagedNode node;
+    node.lod = lod;
+    node.halfDiagonal = osg::Vec2d(halfSize.x(), halfSize.y()).length();
+    node.leaf = leaf;
+    _nodes.push_back(node);
+    updateRange(lod, node);
+    return lod;
+}
+
+osg::ref_ptr<osg::Node> PagedTerrain::TileFactory::createNode(uint level, uint x, uint y) {
+    if (level >= numLevels)
+        return createTile(x, y);
+
+    // the children of the quadtree node inside the map
+    osg::ref_ptr<osg::Group> group = new osg::Group();
+    group->setCullingActive(false);
+    uint span = 1u << (numLevels - level - 1);
+    for (uint j = 2 * y; j < 2 * y + 2; ++j)
+        for (uint i = 2 * x; i < 2 * x + 2; ++i)
+            if (i * span < numTilesX && j * span < numTilesY)
+                group->addChild(createLOD(level + 1, i, j));
+    return group;
+}
+
+osg::ref_ptr<osg::Node> PagedTerrain::TileFactory::createTile(uint x, uint y) {
+    uint x0, y0, x1, y1;
+    getSamples(numLevels, x, y, x0, y0, x1, y1);
+    float cellSize = _source->getCellSize();
+
+    BathymetryMesher mesher(_source);
+    mesher.setMaxError(getMaxError());
+
+    osg::ref_ptr<osg::Geode> geode = new osg::Geode();
+    geode->addDrawable(mesher.createGeometry(x0, y0, x1, y1));
+
+    // local coordinates keep the float precision far from the origin
+    osg::ref_ptr<osg::MatrixTransform> transform = new osg::MatrixTransform(
+        osg::Matrix::translate(_origin + osg::Vec3d(x0 * cellSize, y0 * cellSize, 0)));
+    transform->addChild(geode);
+    return transform;
+}
+
+void PagedTerrain::TileFactory::setVehiclePose( const osg::Vec3d& position,
+                                                const osg::Vec3d& heading) {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+    _position = position;
+    _heading = heading;
+
+    // the unloaded quadtree branches are forgotten
+    std::vector<PagedNode> nodes;
+    nodes.reserve(_nodes.size());
+    for (uint i = 0; i < _nodes.size(); ++i) {
+        osg::ref_ptr<osg::PagedLOD> lod;
+        if (!_nodes[i].lod.lock(lod))
+            continue;
+
+        updateRange(lod, _nodes[i]);
+        nodes.push_back(_nodes[i]);
+    }
+    _nodes.swap(nodes);
+}
+
+void PagedTerrain::TileFactory::setRanges(float maxRange, float prefetchDistance) {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+    this->maxRange = maxRange;
+    this->prefetchDistance = prefetchDistance;
+
+    for (uint i = 0; i < _nodes.size(); ++i) {
+        osg::ref_ptr<osg::PagedLOD> lod;
+        if (_nodes[i].lod.lock(lod))
+            updateRange(lod, _nodes[i]);
+    }
+}
+
+void PagedTerrain::TileFactory::setMaxError(float maxError) {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+    _max_error = maxError;
+}
+
+float PagedTerrain::TileFactory::getMaxError() {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+    return _max_error;
+}
+
+uint PagedTerrain::TileFactory::getNumResidentTiles() {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+    uint count = 0;
+    for (uint i = 0; i < _nodes.size(); ++i) {
+        osg::ref_ptr<osg::PagedLOD> lod;
+        if (_nodes[i].leaf && _nodes[i].lod.lock(lod) && lod->getNumChildren())
+            ++count;
+    }
+    return count;
+}
+
+osgDB::ReaderWriter::ReadResult PagedTerrain::TileFactory::Reader::readNode(
+    const std::string& fileName, const osgDB::Options *options) {
+    uint level, x, y;
+    char extension[16];
+    if (sscanf(osgDB::getSimpleFileName(fileName).c_str(), "%u_%u_%u.%15s", &level, &x, &y, extension) != 4
+        || std::string(extension) != "ndmtile")
+        return osgDB::ReadFileCallback::readNode(fileName, options);
+
+    // the terrain can be destroyed while the pager still reads
+    osg::ref_ptr<TileFactory> factory;
+    if (!_factory.lock(factory))
+        return osgDB::ReaderWriter::ReadResult::FILE_NOT_HANDLED;
+
+    osg::ref_ptr<osg::Node> node = factory->createNode(level, x, y);
+    return osgDB::ReaderWriter::ReadResult(node.get());
+}
+
+////////////////////////////////
+////PagedTerrain METHODS
+////////////////////////////////
+
+PagedTerrain::PagedTerrain( osg::ref_ptr<BathymetrySource> source,
+                            float maxRange, uint tileSize,
+                            const osg::Vec3d& origin)
+    : _factory(new TileFactory(source, maxRange, tileSize, origin)) {
+
+    _root = new osg::Group();
+    _root->setCullingActive(false);
+    _root->addChild(_factory->createLOD(0, 0, 0));
+}
+
+PagedTerrain::~PagedTerrain() {}
+
+void PagedTerrain::setVehiclePose(const osg::Vec3d& position, const osg::Vec3d& heading) {
+    _factory->setVehiclePose(position, heading);
+}
+
+void PagedTerrain::setMaxRange(float maxRange) {
+    _factory->setRanges(maxRange, _factory->prefetchDistance);
+}
+
+float PagedTerrain::getMaxRange() const {
+    return _factory->maxRange;
+}
+
+void PagedTerrain::setPrefetchDistance(float distance) {
+    _factory->setRanges(_factory->maxRange, distance);
+}
+
+float PagedTerrain::getPrefetchDistance() const {
+    return _factory->prefetchDistance;
+}
+
+void PagedTerrain::setMaxError(float maxError) {
+    _factory->setMaxError(maxError);
+}
+
+float PagedTerrain::getMaxError() const {
+    return _factory->getMaxError();
+}
+
+uint PagedTerrain::getMaxResidentTiles() const {
+    // the load distances are horizontal (see updateRange): the resident
+    // tiles have their centers in a disc around the vehicle
+    float tileSide = _factory->getTileSide();
+    float radius = _factory->maxRange + _factory->prefetchDistance + tileSide * M_SQRT1_2;
+    uint side = ceil(2 * radius / tileSide) + 1;
+    return std::min(side * side, getNumTilesX() * getNumTilesY());
+}
+
+void PagedTerrain::configureViewer(osgViewer::Viewer& viewer) const {
+    if (!viewer.getIncrementalCompileOperation())
+        viewer.setIncrementalCompileOperation(new osgUtil::IncrementalCompileOperation());
+
+    osgDB::DatabasePager *pager = viewer.getDatabasePager();
+    pager->setDoPreCompile(true);
+
+    // resident tiles and their quadtree ancestors
+    pager->setTargetMaximumNumberOfPageLOD(2 * getMaxResidentTiles() + 4 * getNumLevels());
+}
+
+uint PagedTerrain::getNumResidentTiles() const {
+    return _factory->getNumResidentTiles();
+}
+
+uint PagedTerrain::getNumTilesX() const {
+    return _factory->numTilesX;
+}
+
+uint PagedTerrain::getNumTilesY() const {
+    return _factory->numTilesY;
+}
+
+uint PagedTerrain::getNumLevels() const {
+    return _factory->numLevels;
+}
+
+} /* namespace normal_depth_map */
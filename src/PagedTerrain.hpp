@@ -0,0 +1,108 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_PAGEDTERRAIN_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_PAGEDTERRAIN_HPP_
+
+#include <osg/Group>
+#include <osg/Vec3d>
+#include <osg/ref_ptr>
+#include <osgViewer/Viewer>
+
+#include "Bathymetry.hpp"
+
+namespace normal_depth_map {
+
+/**
+ * @brief Seabed terrain streamed by tiles around the sonar
+ *
+ *  The bathymetry is split in square tiles, arranged in a quadtree of
+ *  osg::PagedLOD nodes. The osgDB::DatabasePager of the viewer loads a
+ *  node when the sonar comes within its range, on its own thread (where
+ *  the tile meshes are built by a BathymetryMesher), and unloads the nodes out of
+ *  range past its target number of nodes, so the memory depends on the
+ *  sonar range and not on the map size.
+ *
+ *  A tile loads when its horizontal distance to the sonar is under the
+ *  sonar max range, plus the half diagonal of the tile, plus a prefetch
+ *  distance scaled by the cosine between the heading and the direction of
+ *  the tile, so the tiles ahead of the vehicle load first and earlier. The
+ *  inner quadtree nodes always take the full prefetch distance. The tiles
+ *  are culled by the bound of all their samples; the inner nodes are not
+ *  culled.
+ *
+ *  The scene is for one viewer: the one of the capture tool that renders
+ *  it (see configureViewer).
+ */
+class PagedTerrain {
+public:
+
+    /**
+     *  @param source: bathymetry of the whole map
+     *  @param maxRange: sonar max range
+     *  @param tileSize: tile side, in cells
+     *  @param origin: world position of the sample (0, 0) (z is added to
+     *   the elevations)
+     */
+    PagedTerrain(   osg::ref_ptr<BathymetrySource> source, float maxRange,
+                    uint tileSize = 128, const osg::Vec3d& origin = osg::Vec3d());
+    ~PagedTerrain();
+
+    /**
+     * @brief Root of the terrain, to add in NormalDepthMap::addNodeChild
+     */
+    osg::ref_ptr<osg::Group> getNode() const { return _root; };
+
+    /**
+     * @brief Updates the load ranges of the tiles for the vehicle position
+     *
+     *  Call it on each tick, before rendering, from the rendering thread.
+     *
+     *  @param position: sonar position, in world coordinates
+     *  @param heading: horizontal motion direction (zero disables the
+     *   prefetch bias)
+     */
+    void setVehiclePose(const osg::Vec3d& position, const osg::Vec3d& heading);
+
+    void setMaxRange(float maxRange);
+    float getMaxRange() const;
+
+    // distance added ahead of the vehicle (default the max range)
+    void setPrefetchDistance(float distance);
+    float getPrefetchDistance() const;
+
+    // decimation error of the tiles loaded next (see BathymetryMesher);
+    // the pager thread reads it, so it can be set at any time
+    void setMaxError(float maxError);
+    float getMaxError() const;
+
+    /**
+     * @brief Sets the pager of the viewer that renders the terrain
+     *
+     *  It compiles the GL objects of the loaded tiles incrementally, within
+     *  the frame time left, before they are merged in the scene, and sets
+     *  the target number of paged nodes from getMaxResidentTiles.
+     *
+     *  @param viewer: e.g. ImageViewerCaptureTool::getViewer
+     */
+    void configureViewer(osgViewer::Viewer& viewer) const;
+
+    /**
+     * @brief Bound of the number of tiles within the load range
+     */
+    uint getMaxResidentTiles() const;
+
+    // number of tiles currently loaded
+    uint getNumResidentTiles() const;
+
+    uint getNumTilesX() const;
+    uint getNumTilesY() const;
+    uint getNumLevels() const;
+
+private:
+    class TileFactory;
+
+    osg::ref_ptr<TileFactory> _factory;
+    osg::ref_ptr<osg::Group> _root;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_PAGEDTERRAIN_HPP_ */
@@ -0,0 +1,225 @@
+#include "RayCastCaptureTool.hpp"
+
+#include "SceneTriangles.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace normal_depth_map {
+
+/**
+ * Casts the rays of one tile, by packets of 4x2 pixels.
+ */
+class RayCastCaptureTool::TileTask : public ParallelTask {
+public:
+    TileTask(   const TriangleBVH& bvh, const osg::Matrix& view,
+                const osg::Matrix& projection,
+                const NormalDepthMapParameters& parameters,
+                const std::vector<float>& attenuationCoeffs,
+                const std::map<uint, osg::ref_ptr<osg::Image> >& outputs,
+                osg::Image *image)
+        : _bvh(bvh), _view(view), _inverseView(osg::Matrix::inverse(view)),
+          _inverseProjection(osg::Matrix::inverse(projection)),
+          _parameters(parameters), _attenuationCoeffs(attenuationCoeffs),
+          _image(image), _tilesX((image->s() + TILE_SIZE - 1) / TILE_SIZE) {
+
+        for (uint i = 0; i < NUM_OUTPUTS; ++i) {
+            std::map<uint, osg::ref_ptr<osg::Image> >::const_iterator it = outputs.find(i);
+            _outputs[i] = it == outputs.end() ? 0 : it->second.get();
+        }
+    }
+
+    void run(uint index) {
+        uint x0 = (index % _tilesX) * TILE_SIZE, y0 = (index / _tilesX) * TILE_SIZE;
+        uint x1 = std::min(x0 + TILE_SIZE, (uint) _image->s());
+        uint y1 = std::min(y0 + TILE_SIZE, (uint) _image->t());
+
+        for (uint y = y0; y < y1; y += 2) {
+            for (uint x = x0; x < x1; x += 4) {
+                RayPacket packet;
+                for (uint lane = 0; lane < RayPacket::SIZE; ++lane) {
+                    uint px = x + lane % 4, py = y + lane / 4;
+                    if (px >= x1 || py >= y1)
+                        continue;
+
+                    // segment between the near and far planes, in view space
+                    double ndcX = (px + 0.5) * 2 / _image->s() - 1;
+                    double ndcY = (py + 0.5) * 2 / _image->t() - 1;
+                    osg::Vec3d nearView = osg::Vec3d(ndcX, ndcY, -1) * _inverseProjection;
+                    osg::Vec3d farView = osg::Vec3d(ndcX, ndcY, 1) * _inverseProjection;
+
+                    osg::Vec3d origin = nearView * _inverseView;
+                    packet.setRay(lane, origin, farView * _inverseView - origin, 1);
+                }
+
+                _bvh.intersect(packet);
+
+                for (uint lane = 0; lane < RayPacket::SIZE; ++lane) {
+                    uint px = x + lane % 4, py = y + lane / 4;
+                    if (px >= x1 || py >= y1)
+                        continue;
+
+                    float *pixel = (float*) _image->data(px, py);
+                    pixel[0] = pixel[1] = pixel[2] = 0;
+
+                    float *outputs[NUM_OUTPUTS];
+                    for (uint i = 0; i < NUM_OUTPUTS; ++i) {
+                        outputs[i] = _outputs[i] ? (float*) _outputs[i]->data(px, py) : 0;
+                        if (outputs[i])
+                            std::fill(outputs[i], outputs[i] + 4, 0.0f);
+                    }
+
+                    if (packet.triangle[lane] >= 0)
+                        shade(packet, lane, pixel, outputs);
+                }
+            }
+        }
+    }
+
+private:
+    // locations of the shader outputs, the main image excluded
+    static const uint NUM_OUTPUTS = NormalDepthMap::LABEL_OUTPUT_LOCATION + 1;
+
+    // same expressions as normalDepthMap.frag
+    void shade(const RayPacket& packet, uint lane, float *pixel, float **outputs) const {
+        const TriangleBVH::Triangle& triangle = _bvh.getTriangle(packet.triangle[lane]);
+
+        osg::Vec3 origin(packet.ox[lane], packet.oy[lane], packet.oz[lane]);
+        osg::Vec3 direction(packet.dx[lane], packet.dy[lane], packet.dz[lane]);
+        osg::Vec3 position = (origin + direction * packet.t[lane]) * _view;
+
+        float range = position.length();
+        float linearDepth = range / _parameters.maxRange;
+        if (linearDepth > 1)
+            return;
+
+        osg::Vec3 normal = osg::Matrix::transform3x3(_inverseView,
+            _bvh.getNormal(packet.triangle[lane], packet.u[lane], packet.v[lane]));
+        normal.normalize();
+
+        osg::Vec3 normPosition = -position;
+        normPosition.normalize();
+        float incidence = acos(std::min(std::max(normPosition * normal, -1.0f), 1.0f));
+
+        if (triangle.reflectance > 0)
+            for (uint i = 0; i < 3; ++i)
+                normal[i] = std::min(normal[i] * triangle.reflectance, 1.0f);
+
+        float intensity = fabs(normPosition * normal);
+        float attenuation = exp(-2 * _parameters.attenuationCoeff * range);
+
+        if (_parameters.drawNormal) {
+            pixel[2] = intensity * attenuation;
+
+            for (uint i = 0; i < _attenuationCoeffs.size(); ++i) {
+                float *intensities = outputs[NormalDepthMap::INTENSITY_OUTPUT_LOCATION + i / 4];
+                if (intensities)
+                    intensities[i % 4] = intensity * exp(-2 * range * _attenuationCoeffs[i]);
+            }
+        }
+        if (_parameters.drawDepth)
+            pixel[1] = linearDepth;
+
+        float *positionOutput = outputs[NormalDepthMap::POSITION_OUTPUT_LOCATION];
+        if (positionOutput) {
+            positionOutput[0] = position.x();
+            positionOutput[1] = position.y();
+            positionOutput[2] = position.z();
+            positionOutput[3] = 1;
+        }
+
+        float *label = outputs[NormalDepthMap::LABEL_OUTPUT_LOCATION];
+        if (label) {
+            label[0] = triangle.objectId;
+            label[1] = incidence;
+            label[3] = 1;
+        }
+    }
+
+    const TriangleBVH& _bvh;
+    osg::Matrix _view;
+    osg::Matrix _inverseView;
+    osg::Matrix _inverseProjection;
+    NormalDepthMapParameters _parameters;
+    std::vector<float> _attenuationCoeffs;
+    osg::Image *_outputs[NUM_OUTPUTS];
+    osg::Image *_image;
+    uint _tilesX;
+};
+
+RayCastCaptureTool::RayCastCaptureTool(uint width, uint height, ThreadPool *pool)
+    : _width(width), _height(height),
+      _pool(pool ? pool : &ThreadPool::instance()) {
+
+    setProjectionMatrixAsPerspective(30, (double) width / height);
+}
+
+void RayCastCaptureTool::setProjectionMatrixAsPerspective(  double fovY,
+                                                            double aspectRatio,
+                                                            double near,
+                                                            double far) {
+    _projection = osg::Matrix::perspective(fovY, aspectRatio, near, far);
+}
+
+void RayCastCaptureTool::setAttenuationCoefficients(const std::vector<float>& coefficients) {
+    if (coefficients.size() > NormalDepthMap::MAX_FREQUENCIES)
+        throw std::invalid_argument("RayCastCaptureTool: too many attenuation coefficients");
+    _attenuation_coeffs = coefficients;
+}
+
+void RayCastCaptureTool::setNormalDepthMap(NormalDepthMap& normalDepthMap) {
+    if (normalDepthMap.hasWaterColumn() || normalDepthMap.hasRefractionTable()
+        || normalDepthMap.hasBeamPattern())
+        throw std::invalid_argument("RayCastCaptureTool: the water column, refraction and beam pattern are not supported");
+
+    _parameters = normalDepthMap.getParameters();
+    _attenuation_coeffs = normalDepthMap.getAttenuationCoefficients();
+}
+
+osg::ref_ptr<osg::Image> RayCastCaptureTool::attachOutput(uint location) {
+    if (location < NormalDepthMap::INTENSITY_OUTPUT_LOCATION
+        || location > NormalDepthMap::LABEL_OUTPUT_LOCATION)
+        throw std::invalid_argument("RayCastCaptureTool: not a location of the shader outputs");
+
+    osg::ref_ptr<osg::Image> output = new osg::Image();
+    output->allocateImage(_width, _height, 1, GL_RGBA, GL_FLOAT);
+    _outputs[location] = output;
+    return output;
+}
+
+osg::ref_ptr<osg::Image> RayCastCaptureTool::getOutput(uint location) {
+    std::map<uint, osg::ref_ptr<osg::Image> >::iterator it = _outputs.find(location);
+    if (it == _outputs.end())
+        return 0;
+    return it->second;
+}
+
+void RayCastCaptureTool::setScene(osg::ref_ptr<osg::Node> node) {
+    _scene = node;
+    _bvh.clear();
+
+    SceneTriangles triangles;
+    triangles.collect(node);
+    triangles.addTo(_bvh);
+    _bvh.build();
+}
+
+osg::ref_ptr<osg::Image> RayCastCaptureTool::grabImage(osg::ref_ptr<osg::Node> node) {
+    if (node != _scene)
+        setScene(node);
+    return grabImage();
+}
+
+osg::ref_ptr<osg::Image> RayCastCaptureTool::grabImage() {
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(_width, _height, 1, GL_RGB, GL_FLOAT);
+
+    TileTask task(_bvh, _view, _projection, _parameters, _attenuation_coeffs,
+                  _outputs, image.get());
+    uint tiles = ((_width + TILE_SIZE - 1) / TILE_SIZE) * ((_height + TILE_SIZE - 1) / TILE_SIZE);
+    _pool->parallelForStealing(tiles, task);
+    return image;
+}
+
+} /* namespace normal_depth_map */
@@ -0,0 +1,153 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_RAYCASTCAPTURETOOL_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_RAYCASTCAPTURETOOL_HPP_
+
+#include <map>
+#include <vector>
+
+#include <osg/Image>
+#include <osg/Matrix>
+#include <osg/Node>
+#include <osg/ref_ptr>
+
+#include "NormalDepthMap.hpp"
+#include "ThreadPool.hpp"
+#include "TriangleBVH.hpp"
+
+namespace normal_depth_map {
+
+/**
+ * @brief Computes the normal depth map on the CPU, without OpenGL
+ *
+ *  The triangles of the scene are collected in world coordinates, with the
+ *  reflectance and objectId uniforms of their state sets, in a TriangleBVH.
+ *  One ray per pixel center is cast through it, by packets of 4x2 pixels
+ *  and by tiles spread on a ThreadPool with work stealing. The channels are
+ *  those of normalDepthMap.frag: red is 0, green the distance divided by
+ *  the max range, blue the normal intensity with reflectance and
+ *  attenuation, zero where there is no object in the range. The
+ *  multi-frequency intensities, the view-space positions and the labels
+ *  are written in the outputs added by attachOutput, at the locations of
+ *  the shader outputs.
+ *
+ *  The water column, the refraction table and the beam pattern of the
+ *  shader are not implemented: setNormalDepthMap rejects a map using them.
+ *
+ *  Agreement with the GL path (ImageViewerCaptureTool): inside the objects
+ *  both compute the same expressions at the pixel centers, so they differ
+ *  by float rounding (below 1e-4) plus the readback quantization of the
+ *  GL path (1/255 with the default window target). On the silhouettes the
+ *  rasterization rules and the ray hit can choose different objects, which
+ *  touches about one pixel per silhouette pixel row. Normal mapping
+ *  textures are not applied; drawables without per vertex normals
+ *  (e.g. ShapeDrawable before OSG 3.6) use their face normals.
+ */
+class RayCastCaptureTool {
+public:
+
+    // width and height of the tiles of one parallel task
+    static const uint TILE_SIZE = 16;
+
+    /**
+     *  @param width, height: image size
+     *  @param pool: threads of the ray casting (NULL uses the shared pool)
+     */
+    RayCastCaptureTool(uint width = 640, uint height = 480, ThreadPool *pool = 0);
+
+    /**
+     * @brief Collects the triangles of a scene and builds the hierarchy
+     *
+     *  It must be called again after the scene changes.
+     *
+     *  @param node: the node given to NormalDepthMap::addNodeChild
+     */
+    void setScene(osg::ref_ptr<osg::Node> node);
+
+    /**
+     * @brief Casts the rays of all pixels in the current scene
+     */
+    osg::ref_ptr<osg::Image> grabImage();
+
+    /**
+     * @brief Same as grabImage(), setting the scene if it is another node
+     */
+    osg::ref_ptr<osg::Image> grabImage(osg::ref_ptr<osg::Node> node);
+
+    // shader parameters (e.g. NormalDepthMap::getParameters)
+    void setParameters(const NormalDepthMapParameters& parameters)
+      { _parameters = parameters; };
+    NormalDepthMapParameters getParameters() const { return _parameters; };
+
+    /**
+     * @brief Coefficients of the multi-frequency intensities
+     *
+     *  @param coefficients: up to NormalDepthMap::MAX_FREQUENCIES values;
+     *   it throws std::invalid_argument with more values.
+     */
+    void setAttenuationCoefficients(const std::vector<float>& coefficients);
+    std::vector<float> getAttenuationCoefficients() const
+      { return _attenuation_coeffs; };
+
+    /**
+     * @brief Copies the parameters and the attenuation coefficients of a
+     *  normal depth map
+     *
+     *  It throws std::invalid_argument if the map has a water column, a
+     *  refraction table or a beam pattern, which are not cast on the CPU.
+     */
+    void setNormalDepthMap(NormalDepthMap& normalDepthMap);
+
+    /**
+     * @brief Adds an output filled in the same ray pass of the main image
+     *
+     *  The outputs are float RGBA images with the same contents of the
+     *  shader outputs: the multi-frequency intensities from
+     *  NormalDepthMap::INTENSITY_OUTPUT_LOCATION, the view-space position
+     *  (NormalDepthMap::POSITION_OUTPUT_LOCATION) and the labels
+     *  (NormalDepthMap::LABEL_OUTPUT_LOCATION). They are overwritten on
+     *  each grabImage call.
+     *
+     *  @param location: one of these locations; it throws
+     *   std::invalid_argument otherwise.
+     *  @return the image receiving the output
+     */
+    osg::ref_ptr<osg::Image> attachOutput(uint location);
+
+    // image of an output added by attachOutput, NULL if none
+    osg::ref_ptr<osg::Image> getOutput(uint location);
+
+    void setCameraPosition( const osg::Vec3d& eye, const osg::Vec3d& center,
+                            const osg::Vec3d& up)
+      { _view = osg::Matrix::lookAt(eye, center, up); };
+
+    void setViewMatrix(const osg::Matrix& matrix) { _view = matrix; };
+    osg::Matrix getViewMatrix() const { return _view; };
+
+    void setProjectionMatrix(const osg::Matrix& matrix) { _projection = matrix; };
+    osg::Matrix getProjectionMatrix() const { return _projection; };
+
+    void setProjectionMatrixAsPerspective(  double fovY, double aspectRatio,
+                                            double near = 0.1,
+                                            double far = 1000);
+
+    const TriangleBVH& getBVH() const { return _bvh; };
+
+private:
+    class TileTask;
+
+    uint _width;
+    uint _height;
+    ThreadPool *_pool;
+
+    osg::Matrix _view;
+    osg::Matrix _projection;
+    NormalDepthMapParameters _parameters;
+    std::vector<float> _attenuation_coeffs;
+    std::map<uint, osg::ref_ptr<osg::Image> > _outputs;
+
+    osg::ref_ptr<osg::Node> _scene;
+    TriangleBVH _bvh;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_RAYCASTCAPTURETOOL_HPP_ */
@@ -0,0 +1,138 @@
+#include "RayQuery.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace normal_depth_map {
+
+namespace {
+
+// refit hierarchies more costly than this ratio of the built one are rebuilt
+const double REBUILD_RATIO = 2.0;
+
+}
+
+SensorRay::SensorRay() : direction(0, 0, -1), maxRange(50) {}
+
+SensorRay::SensorRay(   const osg::Vec3f& origin, const osg::Vec3f& direction,
+                        float maxRange)
+    : origin(origin), direction(direction), maxRange(maxRange) {}
+
+RayHit::RayHit() : range(-1), incidence(0), reflectance(0), objectId(0) {}
+
+/**
+ * Queries the rays of one batch.
+ */
+class RayQuery::BatchTask : public ParallelTask {
+public:
+    BatchTask(const RayQuery& query, const SensorRay *rays, RayHit *hits, uint count)
+        : _query(query), _rays(rays), _hits(hits), _count(count) {}
+
+    void run(uint index) {
+        uint first = index * BATCH_SIZE;
+        _query.queryBatch(_rays + first, _hits + first, std::min(BATCH_SIZE, _count - first));
+    }
+
+private:
+    const RayQuery& _query;
+    const SensorRay *_rays;
+    RayHit *_hits;
+    uint _count;
+};
+
+RayQuery::RayQuery(ThreadPool *pool)
+    : _pool(pool ? pool : &ThreadPool::instance()), _built_area(0), _num_builds(0) {}
+
+void RayQuery::setScene(osg::ref_ptr<osg::Node> node) {
+    _triangles.collect(node);
+    build();
+}
+
+void RayQuery::build() {
+    _bvh.clear();
+    _triangles.addTo(_bvh);
+    _bvh.build();
+
+    _bvh_indexes.resize(_bvh.getNumTriangles());
+    for (uint i = 0; i < _bvh.getNumTriangles(); ++i)
+        _bvh_indexes[_bvh.getSourceIndex(i)] = i;
+
+    _built_area = _bvh.getTotalArea();
+    ++_num_builds;
+}
+
+bool RayQuery::update() {
+    if (!_triangles.update())
+        return false;
+
+    const std::vector<SceneTriangles::Instance>& instances = _triangles.getInstances();
+    for (uint i = 0; i < instances.size(); ++i) {
+        if (!_triangles.isMoved(i))
+            continue;
+
+        for (uint j = instances[i].first; j < instances[i].first + instances[i].count; ++j)
+            _bvh.setTriangle(_bvh_indexes[j], _triangles.getVertexes(j), _triangles.getNormals(j));
+    }
+
+    _bvh.refit();
+    if (_bvh.getTotalArea() > REBUILD_RATIO * _built_area)
+        build();
+    return true;
+}
+
+void RayQuery::query(const std::vector<SensorRay>& rays, std::vector<RayHit>& hits) const {
+    hits.resize(rays.size());
+    if (!rays.empty())
+        query(&rays[0], &hits[0], rays.size());
+}
+
+RayHit RayQuery::query(const SensorRay& ray) const {
+    RayHit hit;
+    queryBatch(&ray, &hit, 1);
+    return hit;
+}
+
+void RayQuery::query(const SensorRay *rays, RayHit *hits, uint count) const {
+    if (count <= BATCH_SIZE) {
+        queryBatch(rays, hits, count);
+        return;
+    }
+
+    BatchTask task(*this, rays, hits, count);
+    _pool->parallelFor((count + BATCH_SIZE - 1) / BATCH_SIZE, task);
+}
+
+void RayQuery::queryBatch(const SensorRay *rays, RayHit *hits, uint count) const {
+    for (uint first = 0; first < count; first += RayPacket::SIZE) {
+        uint size = std::min(RayPacket::SIZE, count - first);
+
+        // normalized directions, so the distances are ranges
+        RayPacket packet;
+        osg::Vec3f directions[RayPacket::SIZE];
+        for (uint lane = 0; lane < size; ++lane) {
+            directions[lane] = rays[first + lane].direction;
+            directions[lane].normalize();
+            packet.setRay(lane, rays[first + lane].origin, directions[lane],
+                          rays[first + lane].maxRange);
+        }
+
+        _bvh.intersect(packet);
+
+        for (uint lane = 0; lane < size; ++lane) {
+            RayHit& hit = hits[first + lane];
+            hit = RayHit();
+            if (packet.triangle[lane] < 0)
+                continue;
+
+            const TriangleBVH::Triangle& triangle = _bvh.getTriangle(packet.triangle[lane]);
+            osg::Vec3f normal = _bvh.getNormal(packet.triangle[lane], packet.u[lane], packet.v[lane]);
+
+            hit.range = packet.t[lane];
+            hit.incidence = acos(std::max(-1.0f, std::min(1.0f, -(directions[lane] * normal))));
+            hit.reflectance = triangle.reflectance;
+            hit.objectId = triangle.objectId;
+        }
+    }
+}
+
+} /* namespace normal_depth_map */
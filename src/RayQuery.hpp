@@ -0,0 +1,125 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_RAYQUERY_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_RAYQUERY_HPP_
+
+#include <vector>
+
+#include <osg/Node>
+#include <osg/Vec3f>
+#include <osg/ref_ptr>
+
+#include "SceneTriangles.hpp"
+#include "ThreadPool.hpp"
+#include "TriangleBVH.hpp"
+
+namespace normal_depth_map {
+
+/**
+ * @brief Beam of a single beam sensor (altimeter, DVL, echo sounder)
+ *
+ *  @param origin, direction: in world coordinates, the direction does not
+ *   need to be normalized
+ *  @param maxRange: distance limit of the beam
+ */
+struct SensorRay {
+    SensorRay();
+    SensorRay(const osg::Vec3f& origin, const osg::Vec3f& direction, float maxRange);
+
+    osg::Vec3f origin;
+    osg::Vec3f direction;
+    float maxRange;
+};
+
+/**
+ * @brief First surface seen by a SensorRay
+ *
+ *  @param range: distance to the surface, negative if there is none before
+ *   the max range
+ *  @param incidence: angle between the beam and the surface normal, in
+ *   radians, as in the label output of the shader
+ *  @param reflectance: reflectance uniform of the surface (0 if not set)
+ *  @param objectId: object id of the surface (see NormalDepthMap::setObjectId)
+ */
+struct RayHit {
+    RayHit();
+
+    float range;
+    float incidence;
+    float reflectance;
+    uint objectId;
+};
+
+/**
+ * @brief Batched ray queries over the normal depth map scene
+ *
+ *  For sensors that need a few ranges per tick, instead of a full image.
+ *  The triangles of the scene are kept in a persistent TriangleBVH; update()
+ *  follows the transforms of the scene by moving the triangles of the
+ *  moved drawables and refitting the hierarchy, which is rebuilt only when
+ *  the refit degrades it too much. The rays are traced by packets of
+ *  RayPacket::SIZE consecutive rays, so the rays of one sensor should be
+ *  given side by side; large batches are split on a ThreadPool.
+ */
+class RayQuery {
+public:
+
+    // number of rays of one parallel task
+    static const uint BATCH_SIZE = 256;
+
+    /**
+     *  @param pool: threads of the large batches (NULL uses the shared pool)
+     */
+    RayQuery(ThreadPool *pool = 0);
+
+    /**
+     * @brief Collects the triangles of a scene and builds the hierarchy
+     *
+     *  @param node: the node given to NormalDepthMap::addNodeChild
+     */
+    void setScene(osg::ref_ptr<osg::Node> node);
+
+    /**
+     * @brief Follows the changes of the transforms of the scene
+     *
+     *  Call it once per tick, before the queries. A change of the scene
+     *  structure needs setScene.
+     *
+     *  @return true if something moved
+     */
+    bool update();
+
+    /**
+     * @brief Finds the first surface of each ray
+     *
+     *  @param rays: beams, in world coordinates
+     *  @param hits: receives one hit per ray
+     */
+    void query(const std::vector<SensorRay>& rays, std::vector<RayHit>& hits) const;
+    void query(const SensorRay *rays, RayHit *hits, uint count) const;
+    RayHit query(const SensorRay& ray) const;
+
+    // number of hierarchy builds since the construction
+    uint getNumBuilds() const { return _num_builds; };
+
+    const TriangleBVH& getBVH() const { return _bvh; };
+
+private:
+    class BatchTask;
+
+    void build();
+    void queryBatch(const SensorRay *rays, RayHit *hits, uint count) const;
+
+    ThreadPool *_pool;
+    SceneTriangles _triangles;
+    TriangleBVH _bvh;
+
+    // index in the hierarchy of each scene triangle
+    std::vector<uint> _bvh_indexes;
+
+    // total node area after the last build
+    double _built_area;
+    uint _num_builds;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_RAYQUERY_HPP_ */
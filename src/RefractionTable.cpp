@@ -0,0 +1,209 @@
+#include "RefractionTable.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <osg/Math>
+
+namespace normal_depth_map {
+
+const uint RefractionTable::RAYS_PER_ANGLE;
+const uint RefractionTable::STEPS_PER_RANGE;
+
+namespace {
+
+// sound speed samples over the depths reached by the rays
+const uint SPEED_SAMPLES = 4096;
+
+}
+
+class RefractionTable::RayTask : public ParallelTask {
+public:
+    RayTask(const RefractionTable& table, uint numRays,
+            std::vector<float>& angles, std::vector<float>& times)
+        : _table(table), _num_rays(numRays), _angles(angles), _times(times) {}
+
+    void run(uint ray) {
+        uint offset = ray * _table._range_samples;
+        _table.traceRay(-M_PI_2 + ray * M_PI / (_num_rays - 1),
+                        &_angles[offset], &_times[offset]);
+    }
+
+private:
+    const RefractionTable& _table;
+    uint _num_rays;
+    std::vector<float>& _angles;
+    std::vector<float>& _times;
+};
+
+class RefractionTable::RowTask : public ParallelTask {
+public:
+    RowTask(RefractionTable& table, uint numRays,
+            const std::vector<float>& angles, const std::vector<float>& times)
+        : _table(table), _num_rays(numRays), _angles(angles), _times(times) {}
+
+    void run(uint row) {
+        uint samples = _table._range_samples;
+        double angle = -M_PI_2 + row * M_PI / (_table._angle_samples - 1);
+        double rangeStep = _table._max_range / (samples - 1);
+        double rayStep = M_PI / (_num_rays - 1);
+
+        float *cells = &_table._table[3 * row * samples];
+        cells[0] = 0;
+        cells[1] = angle;
+        cells[2] = 1;
+
+        for (uint k = 1; k < samples; ++k) {
+            float *cell = cells + 3 * k;
+            cell[0] = k * rangeStep;
+            cell[1] = angle;
+            cell[2] = 0;
+
+            // the two neighbour rays around the point, with the shortest
+            // travel time if several pairs reach it
+            double bestTime = std::numeric_limits<double>::max();
+            for (uint ray = 0; ray + 1 < _num_rays; ++ray) {
+                float angle0 = _angles[ray * samples + k];
+                float angle1 = _angles[(ray + 1) * samples + k];
+                if (osg::isNaN(angle0) || osg::isNaN(angle1) || angle0 == angle1
+                    || (angle0 - angle) * (angle1 - angle) > 0)
+                    continue;
+
+                double weight = (angle - angle0) / (angle1 - angle0);
+                double time = _times[ray * samples + k]
+                    + weight * (_times[(ray + 1) * samples + k] - _times[ray * samples + k]);
+                if (time < bestTime) {
+                    bestTime = time;
+                    cell[0] = time * _table._reference_speed;
+                    cell[1] = -M_PI_2 + (ray + weight) * rayStep;
+                    cell[2] = 1;
+                }
+            }
+        }
+    }
+
+private:
+    RefractionTable& _table;
+    uint _num_rays;
+    const std::vector<float>& _angles;
+    const std::vector<float>& _times;
+};
+
+RefractionTable::RefractionTable(   const WaterColumnProfile& profile,
+                                    double sonarDepth, double maxRange,
+                                    uint angleSamples, uint rangeSamples,
+                                    ThreadPool *pool)
+    : _sonar_depth(sonarDepth), _max_range(maxRange),
+      _angle_samples(angleSamples), _range_samples(rangeSamples) {
+
+    if (!(sonarDepth >= 0) || !(maxRange > 0) || angleSamples < 2 || rangeSamples < 2)
+        throw std::invalid_argument("RefractionTable: needs a sonar depth, a max range and 2 samples per axis");
+    if (!pool)
+        pool = &ThreadPool::instance();
+
+    // the rays do not go deeper than the max range below the sonar
+    _depth_step = (sonarDepth + maxRange) / (SPEED_SAMPLES - 1);
+    _speeds.resize(SPEED_SAMPLES);
+    for (uint i = 0; i < SPEED_SAMPLES; ++i)
+        _speeds[i] = profile.getSoundSpeed(i * _depth_step);
+    _reference_speed = profile.getSoundSpeed(sonarDepth);
+
+    uint numRays = RAYS_PER_ANGLE * (angleSamples - 1) + 1;
+    std::vector<float> angles(numRays * rangeSamples), times(numRays * rangeSamples);
+    RayTask rayTask(*this, numRays, angles, times);
+    pool->parallelFor(numRays, rayTask);
+
+    _table.resize(3 * angleSamples * rangeSamples);
+    RowTask rowTask(*this, numRays, angles, times);
+    pool->parallelFor(angleSamples, rowTask);
+}
+
+void RefractionTable::getSpeed(double depth, double& speed, double& gradient) const {
+    double position = std::min(std::max(depth / _depth_step, 0.0), SPEED_SAMPLES - 1.0);
+    uint i = std::min((uint) position, SPEED_SAMPLES - 2);
+    gradient = (_speeds[i + 1] - _speeds[i]) / _depth_step;
+    speed = _speeds[i] + (position - i) * (_speeds[i + 1] - _speeds[i]);
+}
+
+void RefractionTable::traceRay(double launch, float *angles, float *times) const {
+    double rangeStep = _max_range / (_range_samples - 1);
+    double step = rangeStep / STEPS_PER_RANGE;
+
+    // horizontal distance, depth and travel time; the depression angle
+    // turns toward the slower water: d(angle)/ds = -cos(angle) c'(z) / c(z)
+    double x = 0, z = _sonar_depth, time = 0, angle = launch, distance = 0;
+    angles[0] = launch;
+    times[0] = 0;
+
+    uint k = 1;
+    uint maxSteps = 2 * STEPS_PER_RANGE * _range_samples;
+    for (uint i = 0; i < maxSteps && k < _range_samples; ++i) {
+        double speed, gradient;
+        getSpeed(z, speed, gradient);
+        double middleAngle = angle - 0.5 * step * cos(angle) * gradient / speed;
+        getSpeed(z + 0.5 * step * sin(angle), speed, gradient);
+
+        double nextX = x + step * cos(middleAngle);
+        double nextZ = z + step * sin(middleAngle);
+        double nextTime = time + step / speed;
+        angle = std::min(std::max(angle - step * cos(middleAngle) * gradient / speed, -M_PI_2), M_PI_2);
+        if (nextZ < 0)
+            break;
+
+        double nextDistance = sqrt(nextX * nextX + (nextZ - _sonar_depth) * (nextZ - _sonar_depth));
+        for (; k < _range_samples && nextDistance >= k * rangeStep; ++k) {
+            double weight = (k * rangeStep - distance) / (nextDistance - distance);
+            angles[k] = atan2(z + weight * (nextZ - z) - _sonar_depth, x + weight * (nextX - x));
+            times[k] = time + weight * (nextTime - time);
+        }
+
+        x = nextX;
+        z = nextZ;
+        time = nextTime;
+        distance = nextDistance;
+    }
+
+    for (; k < _range_samples; ++k) {
+        angles[k] = std::numeric_limits<float>::quiet_NaN();
+        times[k] = 0;
+    }
+}
+
+bool RefractionTable::correct(  double angle, double range,
+                                double& apparentRange, double& apparentAngle) const {
+    if (!(range >= 0 && range <= _max_range && fabs(angle) <= M_PI_2))
+        return false;
+
+    double u = range / _max_range * (_range_samples - 1);
+    double v = (angle + M_PI_2) / M_PI * (_angle_samples - 1);
+    uint i = std::min((uint) u, _range_samples - 2);
+    uint j = std::min((uint) v, _angle_samples - 2);
+    u -= i;
+    v -= j;
+
+    double values[3];
+    for (uint c = 0; c < 3; ++c) {
+        const float *row0 = &_table[3 * j * _range_samples];
+        const float *row1 = row0 + 3 * _range_samples;
+        double first = row0[3 * i + c] + u * (row0[3 * (i + 1) + c] - row0[3 * i + c]);
+        double second = row1[3 * i + c] + u * (row1[3 * (i + 1) + c] - row1[3 * i + c]);
+        values[c] = first + v * (second - first);
+    }
+
+    apparentRange = values[0];
+    apparentAngle = values[1];
+    return values[2] >= 0.5;
+}
+
+osg::ref_ptr<osg::Image> RefractionTable::createImage() const {
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(_range_samples, _angle_samples, 1, GL_RGB, GL_FLOAT);
+    image->setInternalTextureFormat(GL_RGB32F_ARB);
+    memcpy(image->data(), &_table[0], _table.size() * sizeof(float));
+    return image;
+}
+
+} /* namespace normal_depth_map */
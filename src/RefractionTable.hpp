@@ -0,0 +1,106 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_REFRACTIONTABLE_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_REFRACTIONTABLE_HPP_
+
+#include <vector>
+#include <sys/types.h>
+
+#include <osg/Image>
+#include <osg/ref_ptr>
+
+#include "ThreadPool.hpp"
+#include "WaterColumn.hpp"
+
+namespace normal_depth_map {
+
+/**
+ * @brief Apparent range and angle of the points around a sonar, in water
+ *  with a sound speed varying with the depth
+ *
+ *  The acoustic rays bend toward the slower water, so a point seen by the
+ *  camera in a straight line is reached by a curved ray: the sonar measures
+ *  its travel time (converted to a range with the sound speed at the
+ *  sonar), and its launch angle. The table gives them for each depression
+ *  angle (below the horizontal, in radians, from -PI/2 to PI/2) and
+ *  straight range of a point: a fan of rays is traced once through the
+ *  profile, and each cell interpolates the two rays around its point.
+ *
+ *  The water is horizontally stratified, so the azimuth does not change.
+ *  The rays stop at the surface (no multipath): the points out of the
+ *  reach of the direct rays (shadow zones) are not reachable.
+ *
+ *  The table is for one sonar depth; build a new one when the sonar depth
+ *  changes enough to move the rays (see NormalDepthMap::setRefractionTable).
+ */
+class RefractionTable {
+public:
+
+    // launched rays for each angle sample
+    static const uint RAYS_PER_ANGLE = 4;
+
+    // integration steps of the rays for each range sample
+    static const uint STEPS_PER_RANGE = 4;
+
+    /**
+     *  @param profile: water properties over the depth
+     *  @param sonarDepth: sonar depth below the surface
+     *  @param maxRange: farthest straight range of the table
+     *  @param angleSamples, rangeSamples: table size (at least 2 each)
+     *  @param pool: threads building the table; 0 uses ThreadPool::instance
+     *  It throws std::invalid_argument on a negative depth, a null range or
+     *  a table size under 2.
+     */
+    RefractionTable(const WaterColumnProfile& profile, double sonarDepth,
+                    double maxRange, uint angleSamples = 256, uint rangeSamples = 256,
+                    ThreadPool *pool = 0);
+
+    /**
+     * @brief Apparent range and angle of a point, interpolated in the table
+     *
+     *  @param angle: depression angle of the straight line to the point
+     *  @param range: straight range to the point
+     *  @return false if the point is out of the table or not reachable
+     */
+    bool correct(double angle, double range, double& apparentRange,
+                 double& apparentAngle) const;
+
+    /**
+     * @brief Table as a float image: apparent range (red), apparent angle
+     *  (green) and 1 if reachable (blue), one column per range sample and
+     *  one row per angle sample
+     */
+    osg::ref_ptr<osg::Image> createImage() const;
+
+    double getSonarDepth() const { return _sonar_depth; }
+    double getMaxRange() const { return _max_range; }
+    uint getAngleSamples() const { return _angle_samples; }
+    uint getRangeSamples() const { return _range_samples; }
+
+    // sound speed at the sonar, converting the travel times to ranges
+    double getReferenceSpeed() const { return _reference_speed; }
+
+private:
+    class RayTask;
+    class RowTask;
+
+    // sound speed and its vertical gradient at a depth
+    void getSpeed(double depth, double& speed, double& gradient) const;
+
+    // depression angle and travel time of a ray at each range sample
+    void traceRay(double launch, float *angles, float *times) const;
+
+    double _sonar_depth;
+    double _max_range;
+    uint _angle_samples;
+    uint _range_samples;
+    double _reference_speed;
+
+    double _depth_step;
+    std::vector<double> _speeds;
+
+    // 3 values per cell, see createImage
+    std::vector<float> _table;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_REFRACTIONTABLE_HPP_ */
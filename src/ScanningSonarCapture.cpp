@@ -0,0 +1,97 @@
+#include "ScanningSonarCapture.hpp"
+
+#include <osg/Quat>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace normal_depth_map {
+
+namespace {
+
+// rendered columns of a beam, keeping square pixels
+uint beamColumns(double beamWidth, double beamHeight, uint beamRows) {
+    double columns = beamRows * tan(beamWidth * 0.5) / tan(beamHeight * 0.5);
+    return std::max(1u, (uint) (columns + 0.5));
+}
+
+}
+
+ScanningSonarCapture::ScanningSonarCapture( double beamWidth,
+                                            double beamHeight,
+                                            uint numSteps, uint numBins,
+                                            uint beamRows)
+    : _numSteps(numSteps), _numBins(numBins),
+      _eye(0, 0, 0), _forward(0, 0, -1), _up(0, 1, 0),
+      _capture(beamColumns(beamWidth, beamHeight, beamRows), beamRows) {
+
+    if (!numSteps || !numBins || !beamRows)
+        throw std::invalid_argument("ScanningSonarCapture: empty polar image or beam");
+
+    // exact beam frustum, even if the columns were rounded
+    double near = 0.1;
+    _capture.setProjectionMatrix(osg::Matrix::frustum(  -near * tan(beamWidth * 0.5),
+                                                        near * tan(beamWidth * 0.5),
+                                                        -near * tan(beamHeight * 0.5),
+                                                        near * tan(beamHeight * 0.5),
+                                                        near, 1000));
+    _capture.setBackgroundColor(osg::Vec4d(0, 0, 0, 0));
+
+    _polar = new osg::Image();
+    _polar->allocateImage(numBins, numSteps, 1, GL_LUMINANCE, GL_FLOAT);
+    clear();
+}
+
+void ScanningSonarCapture::setSonarPose(const osg::Vec3d& eye,
+                                        const osg::Vec3d& forward,
+                                        const osg::Vec3d& up) {
+    _eye = eye;
+    _forward = forward;
+    _up = up;
+}
+
+uint ScanningSonarCapture::getStep(double headAngle) const {
+    double turns = headAngle / (2 * M_PI);
+    turns -= floor(turns);
+    return (uint) (turns * _numSteps + 0.5) % _numSteps;
+}
+
+uint ScanningSonarCapture::scan(osg::ref_ptr<osg::Node> node, double headAngle) {
+    // the head turns around the up axis
+    osg::Vec3d direction = osg::Quat(headAngle, _up) * _forward;
+    _capture.setCameraPosition(_eye, _eye + direction, _up);
+    osg::ref_ptr<osg::Image> image = _capture.grabImage(node);
+
+    uint step = getStep(headAngle);
+    float *bins = (float*) _polar->data(0, step);
+    memset(bins, 0, _numBins * sizeof(float));
+
+    // depth (green) and normal (blue) channels to range bins
+    uint components = osg::Image::computeNumComponents(image->getPixelFormat());
+    uint numPixels = image->s() * image->t();
+    float weight = 1.0f / numPixels;
+    const float *pixel = (const float*) image->data();
+    for (uint i = 0; i < numPixels; ++i, pixel += components) {
+        if (pixel[1] <= 0 || pixel[1] > 1)
+            continue;
+        uint bin = std::min((uint) (pixel[1] * _numBins), _numBins - 1);
+        bins[bin] += pixel[2] * weight;
+    }
+
+    _polar->dirty();
+    return step;
+}
+
+const float* ScanningSonarCapture::getBeam(uint step) const {
+    if (step >= _numSteps)
+        throw std::out_of_range("ScanningSonarCapture: invalid head step");
+    return (const float*) _polar->data(0, step);
+}
+
+void ScanningSonarCapture::clear() {
+    memset(_polar->data(), 0, _polar->getTotalSizeInBytes());
+    _polar->dirty();
+}
+
+} /* namespace normal_depth_map */
@@ -0,0 +1,91 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_SCANNINGSONARCAPTURE_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_SCANNINGSONARCAPTURE_HPP_
+
+#include <osg/Image>
+#include <osg/Node>
+#include <osg/ref_ptr>
+
+#include "ImageViewerCaptureTool.hpp"
+
+namespace normal_depth_map {
+
+/**
+ * @brief Simulates a mechanically scanning sonar, one beam per step
+ *
+ *  Each step renders only the narrow sector of the beam at the current head
+ *  angle (narrow viewport and frustum), so the cost of a step follows the
+ *  beam width instead of the full field of view. The beam is converted in
+ *  range bins and stored in a polar image covering the full turn, where
+ *  each row is a head step and each column a range bin.
+ *
+ *  The scene must be a NormalDepthMap node: the bins come from its depth
+ *  channel (normalized by the max range) and its normal channel.
+ */
+class ScanningSonarCapture {
+public:
+
+    /**
+     * @brief Creates the beam renderer and an empty polar image
+     *
+     *  @param beamWidth: horizontal aperture of the beam (in radians)
+     *  @param beamHeight: vertical aperture of the beam (in radians)
+     *  @param numSteps: number of head steps in a full turn
+     *  @param numBins: number of range bins of a beam
+     *  @param beamRows: rendered rows; the columns follow the beam aspect
+     *   ratio (at least one)
+     */
+    ScanningSonarCapture(   double beamWidth, double beamHeight,
+                            uint numSteps, uint numBins, uint beamRows = 64);
+
+    /**
+     * @brief Sets the sonar head pose
+     *
+     *  @param eye: position of the head
+     *  @param forward: beam direction at head angle 0
+     *  @param up: rotation axis of the head
+     */
+    void setSonarPose(  const osg::Vec3d& eye, const osg::Vec3d& forward,
+                        const osg::Vec3d& up);
+
+    /**
+     * @brief Renders the beam at a head angle and stores its bins
+     *
+     *  The intensity of a bin is the sum of the normal values of the beam
+     *  pixels at its range, divided by the number of beam pixels.
+     *
+     *  @param node: normal depth map node with the scene
+     *  @param headAngle: head angle in radians, counterclockwise around up
+     *  @return the head step updated in the polar image
+     */
+    uint scan(osg::ref_ptr<osg::Node> node, double headAngle);
+
+    // head step of an angle
+    uint getStep(double headAngle) const;
+
+    // polar image (GL_LUMINANCE, GL_FLOAT): numBins columns, numSteps rows
+    osg::ref_ptr<osg::Image> getPolarImage() const { return _polar; }
+
+    // bins of a head step (numBins values)
+    const float* getBeam(uint step) const;
+
+    // clears the polar image
+    void clear();
+
+    uint getNumSteps() const { return _numSteps; }
+    uint getNumBins() const { return _numBins; }
+
+    // renderer of the beam
+    ImageViewerCaptureTool& getCaptureTool() { return _capture; }
+
+private:
+    uint _numSteps;
+    uint _numBins;
+    osg::Vec3d _eye, _forward, _up;
+
+    ImageViewerCaptureTool _capture;
+    osg::ref_ptr<osg::Image> _polar;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_SCANNINGSONARCAPTURE_HPP_ */
@@ -0,0 +1,206 @@
+#include "SceneTriangles.hpp"
+
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/NodeVisitor>
+#include <osg/StateSet>
+#include <osg/Transform>
+#include <osg/TriangleFunctor>
+#include <osg/TriangleIndexFunctor>
+#include <osg/Uniform>
+#include <osg/Version>
+
+namespace normal_depth_map {
+
+namespace {
+
+// vertexes of the triangles of any drawable
+struct FaceCollector {
+    std::vector<osg::Vec3> *vertexes;
+
+    void operator()(const osg::Vec3& v0, const osg::Vec3& v1, const osg::Vec3& v2) {
+        vertexes->push_back(v0);
+        vertexes->push_back(v1);
+        vertexes->push_back(v2);
+    }
+
+    // signature of the OSG versions before 3.5.6
+    void operator()(const osg::Vec3& v0, const osg::Vec3& v1, const osg::Vec3& v2, bool) {
+        (*this)(v0, v1, v2);
+    }
+};
+
+// vertex indexes of the triangles of a geometry
+struct IndexCollector {
+    std::vector<uint> *indexes;
+
+    void operator()(uint i0, uint i1, uint i2) {
+        indexes->push_back(i0);
+        indexes->push_back(i1);
+        indexes->push_back(i2);
+    }
+};
+
+void readMaterial(const osg::StateSet *stateSet, float& reflectance, uint& objectId) {
+    if (!stateSet)
+        return;
+
+    const osg::Uniform *uniform = stateSet->getUniform("reflectance");
+    if (uniform)
+        uniform->get(reflectance);
+
+    uniform = stateSet->getUniform("objectId");
+    int id;
+    if (uniform && uniform->get(id))
+        objectId = id;
+}
+
+}
+
+/**
+ * Finds the drawables of the scene, with the material uniforms of their
+ * paths.
+ */
+class TriangleCollector : public osg::NodeVisitor {
+public:
+    TriangleCollector(SceneTriangles& triangles)
+        : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ACTIVE_CHILDREN),
+          _triangles(triangles) {}
+
+#if OSG_VERSION_LESS_THAN(3, 4, 0)
+    void apply(osg::Geode& geode) {
+        float reflectance = 0;
+        uint objectId = 0;
+        readPathMaterial(reflectance, objectId);
+
+        for (uint i = 0; i < geode.getNumDrawables(); ++i) {
+            float drawableReflectance = reflectance;
+            uint drawableId = objectId;
+            readMaterial(geode.getDrawable(i)->getStateSet(), drawableReflectance, drawableId);
+            _triangles.addInstance(getNodePath(), geode.getDrawable(i), drawableReflectance, drawableId);
+        }
+    }
+#else
+    void apply(osg::Drawable& drawable) {
+        float reflectance = 0;
+        uint objectId = 0;
+        readPathMaterial(reflectance, objectId);
+        _triangles.addInstance(getNodePath(), &drawable, reflectance, objectId);
+    }
+#endif
+
+private:
+    void readPathMaterial(float& reflectance, uint& objectId) {
+        const osg::NodePath& path = getNodePath();
+        for (uint i = 0; i < path.size(); ++i)
+            readMaterial(path[i]->getStateSet(), reflectance, objectId);
+    }
+
+    SceneTriangles& _triangles;
+};
+
+void SceneTriangles::collect(osg::ref_ptr<osg::Node> node) {
+    _root = node;
+    _instances.clear();
+    _moved.clear();
+    _localVertexes.clear();
+    _localNormals.clear();
+    _vertexes.clear();
+    _normals.clear();
+    _reflectances.clear();
+    _objectIds.clear();
+
+    TriangleCollector collector(*this);
+    node->accept(collector);
+}
+
+void SceneTriangles::addInstance(   const osg::NodePath& path,
+                                    osg::Drawable *drawable,
+                                    float reflectance, uint objectId) {
+    Instance instance;
+    instance.path = path;
+    instance.matrix = osg::computeLocalToWorld(path);
+    instance.first = getNumTriangles();
+
+    // interpolated vertex normals, as the shader
+    osg::Geometry *geometry = drawable->asGeometry();
+    const osg::Vec3Array *vertexes = geometry ? dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray()) : 0;
+    const osg::Vec3Array *normals = geometry ? dynamic_cast<const osg::Vec3Array*>(geometry->getNormalArray()) : 0;
+
+    if (vertexes && normals && normals->size() == vertexes->size()
+        && geometry->getNormalBinding() == osg::Geometry::BIND_PER_VERTEX) {
+
+        std::vector<uint> indexes;
+        osg::TriangleIndexFunctor<IndexCollector> functor;
+        functor.indexes = &indexes;
+        geometry->accept(functor);
+
+        for (uint i = 0; i + 2 < indexes.size(); i += 3) {
+            for (uint j = 0; j < 3; ++j) {
+                _localVertexes.push_back((*vertexes)[indexes[i + j]]);
+                _localNormals.push_back((*normals)[indexes[i + j]]);
+            }
+        }
+    }
+
+    // face normals otherwise
+    else {
+        std::vector<osg::Vec3> faces;
+        osg::TriangleFunctor<FaceCollector> functor;
+        functor.vertexes = &faces;
+        drawable->accept(functor);
+
+        for (uint i = 0; i + 2 < faces.size(); i += 3) {
+            osg::Vec3 normal = (faces[i + 1] - faces[i]) ^ (faces[i + 2] - faces[i]);
+            normal.normalize();
+            for (uint j = 0; j < 3; ++j) {
+                _localVertexes.push_back(faces[i + j]);
+                _localNormals.push_back(normal);
+            }
+        }
+    }
+
+    instance.count = _localVertexes.size() / 3 - instance.first;
+    _reflectances.resize(_localVertexes.size() / 3, reflectance);
+    _objectIds.resize(_localVertexes.size() / 3, objectId);
+    _vertexes.resize(_localVertexes.size());
+    _normals.resize(_localNormals.size());
+
+    _instances.push_back(instance);
+    _moved.push_back(false);
+    transformInstance(_instances.size() - 1);
+}
+
+void SceneTriangles::transformInstance(uint index) {
+    const Instance& instance = _instances[index];
+    osg::Matrix inverse = osg::Matrix::inverse(instance.matrix);
+
+    for (uint i = 3 * instance.first; i < 3 * (instance.first + instance.count); ++i) {
+        _vertexes[i] = _localVertexes[i] * instance.matrix;
+        _normals[i] = osg::Matrix::transform3x3(inverse, _localNormals[i]);
+    }
+}
+
+uint SceneTriangles::update() {
+    uint moved = 0;
+    for (uint i = 0; i < _instances.size(); ++i) {
+        osg::Matrix matrix = osg::computeLocalToWorld(_instances[i].path);
+        _moved[i] = matrix != _instances[i].matrix;
+        if (!_moved[i])
+            continue;
+
+        _instances[i].matrix = matrix;
+        transformInstance(i);
+        ++moved;
+    }
+    return moved;
+}
+
+void SceneTriangles::addTo(TriangleBVH& bvh) const {
+    for (uint i = 0; i < getNumTriangles(); ++i) {
+        const osg::Vec3f *v = getVertexes(i), *n = getNormals(i);
+        bvh.addTriangle(v[0], v[1], v[2], n[0], n[1], n[2], _reflectances[i], _objectIds[i]);
+    }
+}
+
+} /* namespace normal_depth_map */
@@ -0,0 +1,86 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_SCENETRIANGLES_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_SCENETRIANGLES_HPP_
+
+#include <vector>
+
+#include <osg/Drawable>
+#include <osg/Matrix>
+#include <osg/Node>
+#include <osg/ref_ptr>
+
+#include "TriangleBVH.hpp"
+
+namespace normal_depth_map {
+
+/**
+ * @brief Triangles of the drawables of a scene, in world coordinates
+ *
+ *  The triangles are kept by drawable instance (a drawable under a given
+ *  path of transforms), with the reflectance and objectId uniforms of the
+ *  nearest state set, as the shader sees them. Drawables with per vertex
+ *  normals keep them; the others get their face normals.
+ */
+class SceneTriangles {
+public:
+
+    struct Instance {
+        osg::NodePath path;     // from the scene root to the drawable
+        osg::Matrix matrix;     // local to world of the last collect or update
+        uint first;             // first triangle
+        uint count;             // number of triangles
+    };
+
+    /**
+     * @brief Collects the triangles of a scene
+     *
+     *  The scene is kept referenced; after a change of its structure (not
+     *  only of its transforms) it must be collected again.
+     */
+    void collect(osg::ref_ptr<osg::Node> node);
+
+    /**
+     * @brief Moves the triangles of the instances whose transforms changed
+     *
+     *  @return the number of moved instances (see isMoved)
+     */
+    uint update();
+
+    // adds all triangles to a hierarchy, in the order of their indexes
+    void addTo(TriangleBVH& bvh) const;
+
+    // world vertexes and normals (not normalized) of a triangle
+    const osg::Vec3f* getVertexes(uint triangle) const { return &_vertexes[3 * triangle]; }
+    const osg::Vec3f* getNormals(uint triangle) const { return &_normals[3 * triangle]; }
+
+    uint getNumTriangles() const { return _reflectances.size(); }
+
+    const std::vector<Instance>& getInstances() const { return _instances; }
+
+    // if the instance moved on the last update
+    bool isMoved(uint instance) const { return _moved[instance]; }
+
+private:
+    friend class TriangleCollector;
+
+    void addInstance(const osg::NodePath& path, osg::Drawable *drawable,
+                     float reflectance, uint objectId);
+    void transformInstance(uint instance);
+
+    osg::ref_ptr<osg::Node> _root;
+    std::vector<Instance> _instances;
+    std::vector<bool> _moved;
+
+    // three per triangle
+    std::vector<osg::Vec3f> _localVertexes;
+    std::vector<osg::Vec3f> _localNormals;
+    std::vector<osg::Vec3f> _vertexes;
+    std::vector<osg::Vec3f> _normals;
+
+    // one per triangle
+    std::vector<float> _reflectances;
+    std::vector<uint> _objectIds;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_SCENETRIANGLES_HPP_ */
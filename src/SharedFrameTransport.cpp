@@ -0,0 +1,304 @@
+#include "SharedFrameTransport.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace normal_depth_map {
+
+// identifies the memory layout below ("NDMS" + version)
+#define SHARED_FRAME_MAGIC 0x534d444e
+#define SHARED_FRAME_VERSION 2
+
+// slot headers and image data start on cache line boundaries
+#define SHARED_FRAME_ALIGNMENT 64
+
+namespace {
+
+struct SharedRingHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int slots;
+    unsigned int width;
+    unsigned int height;
+    unsigned int pixelFormat;
+    unsigned int dataType;
+    unsigned int rowStride;
+    unsigned long long slotSize;
+    volatile unsigned long long lastSequence;
+    volatile unsigned int lastSlot;
+};
+
+size_t alignSize(size_t size) {
+    return (size + SHARED_FRAME_ALIGNMENT - 1) / SHARED_FRAME_ALIGNMENT * SHARED_FRAME_ALIGNMENT;
+}
+
+size_t ringHeaderSize() {
+    return alignSize(sizeof(SharedRingHeader));
+}
+
+size_t slotHeaderSize() {
+    return alignSize(sizeof(SharedFrameHeader));
+}
+
+SharedRingHeader* ringHeader(unsigned char *memory) {
+    return (SharedRingHeader*) memory;
+}
+
+SharedFrameHeader* slotHeader(unsigned char *memory, uint slot) {
+    return (SharedFrameHeader*) (memory + ringHeaderSize() + slot * ringHeader(memory)->slotSize);
+}
+
+unsigned char* slotData(unsigned char *memory, uint slot) {
+    return ((unsigned char*) slotHeader(memory, slot)) + slotHeaderSize();
+}
+
+}
+
+////////////////////////////////
+////SharedFramePublisher METHODS
+////////////////////////////////
+
+SharedFramePublisher::SharedFramePublisher( const std::string& name,
+                                            uint width, uint height, uint slots,
+                                            GLenum pixelFormat, GLenum dataType)
+    : _name(name), _memory(0), _size(0), _next(0), _writing(false) {
+
+    if (slots < 2)
+        throw std::invalid_argument("SharedFramePublisher: at least 2 slots are needed");
+
+    uint rowStride = width * osg::Image::computePixelSizeInBits(pixelFormat, dataType) / 8;
+    size_t slotSize = slotHeaderSize() + alignSize((size_t) rowStride * height);
+    _size = ringHeaderSize() + slotSize * slots;
+
+    // never re-initializes a ring mapped by the subscribers of another
+    // publisher
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd < 0 && errno == EEXIST)
+        throw std::runtime_error("SharedFramePublisher: shared memory already exists: " + name);
+    if (fd < 0)
+        throw std::runtime_error("SharedFramePublisher: shm_open failed on " + name);
+
+    if (ftruncate(fd, _size) < 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        throw std::runtime_error("SharedFramePublisher: ftruncate failed on " + name);
+    }
+
+    void *memory = mmap(0, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw std::runtime_error("SharedFramePublisher: mmap failed on " + name);
+    }
+    _memory = (unsigned char*) memory;
+
+    // the magic number is written last, so readers never see a partial header
+    SharedRingHeader *header = ringHeader(_memory);
+    header->magic = 0;
+    header->version = SHARED_FRAME_VERSION;
+    header->slots = slots;
+    header->width = width;
+    header->height = height;
+    header->pixelFormat = pixelFormat;
+    header->dataType = dataType;
+    header->rowStride = rowStride;
+    header->slotSize = slotSize;
+    header->lastSequence = 0;
+    header->lastSlot = 0;
+    for (uint i = 0; i < slots; ++i)
+        memset(slotHeader(_memory, i), 0, sizeof(SharedFrameHeader));
+    __sync_synchronize();
+    header->magic = SHARED_FRAME_MAGIC;
+}
+
+SharedFramePublisher::~SharedFramePublisher() {
+    munmap(_memory, _size);
+    shm_unlink(_name.c_str());
+}
+
+CaptureBuffer SharedFramePublisher::beginFrame() {
+    SharedRingHeader *header = ringHeader(_memory);
+    SharedFrameHeader *slot = slotHeader(_memory, _next);
+
+    // odd lock: the slot is being written
+    if (!_writing) {
+        __sync_fetch_and_add(&slot->lock, 1);
+        _writing = true;
+    }
+
+    return CaptureBuffer(   slotData(_memory, _next),
+                            header->width, header->height,
+                            header->pixelFormat, header->dataType,
+                            header->rowStride);
+}
+
+unsigned long long SharedFramePublisher::commitFrame(
+                                double timestamp,
+                                const osg::Matrixd& cameraPose,
+                                const NormalDepthMapParameters& parameters) {
+    if (!_writing)
+        return 0;
+
+    SharedRingHeader *header = ringHeader(_memory);
+    SharedFrameHeader *slot = slotHeader(_memory, _next);
+
+    slot->sequence = header->lastSequence + 1;
+    slot->timestamp = timestamp;
+    memcpy(slot->cameraPose, cameraPose.ptr(), sizeof(slot->cameraPose));
+    slot->maxRange = parameters.maxRange;
+    slot->maxHorizontalAngle = parameters.maxHorizontalAngle;
+    slot->maxVerticalAngle = parameters.maxVerticalAngle;
+    slot->attenuationCoeff = parameters.attenuationCoeff;
+    slot->width = header->width;
+    slot->height = header->height;
+    slot->pixelFormat = header->pixelFormat;
+    slot->dataType = header->dataType;
+    slot->rowStride = header->rowStride;
+    slot->flags = (parameters.drawNormal ? 1 : 0) | (parameters.drawDepth ? 2 : 0);
+    slot->parametersVersion = parameters.version;
+
+    // even lock: the slot is complete
+    __sync_fetch_and_add(&slot->lock, 1);
+
+    header->lastSlot = _next;
+    __sync_synchronize();
+    header->lastSequence = slot->sequence;
+
+    _next = (_next + 1) % header->slots;
+    _writing = false;
+    return slot->sequence;
+}
+
+void SharedFramePublisher::abortFrame() {
+    if (!_writing)
+        return;
+
+    // even lock on a slot without frame
+    SharedFrameHeader *slot = slotHeader(_memory, _next);
+    slot->sequence = 0;
+    __sync_fetch_and_add(&slot->lock, 1);
+    _writing = false;
+}
+
+unsigned long long SharedFramePublisher::publish(const Frame& frame) {
+    CaptureBuffer buffer = beginFrame();
+    const osg::Image *image = frame.image.get();
+
+    if (!image || image->s() != (int) buffer.width || image->t() != (int) buffer.height
+        || image->getPixelFormat() != buffer.pixelFormat
+        || image->getDataType() != buffer.dataType)
+        throw std::invalid_argument("SharedFramePublisher: frame layout differs from the shared memory");
+
+    uint rowSize = buffer.width * buffer.pixelSize();
+    for (uint row = 0; row < buffer.height; ++row)
+        memcpy( (unsigned char*) buffer.data + row * buffer.rowStride,
+                image->data(0, row), rowSize);
+
+    return commitFrame(frame.timestamp, frame.cameraPose, frame.parameters);
+}
+
+////////////////////////////////
+////SharedFrameSubscriber METHODS
+////////////////////////////////
+
+SharedFrameSubscriber::SharedFrameSubscriber(const std::string& name)
+    : _memory(0), _size(0) {
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        throw std::runtime_error("SharedFrameSubscriber: no shared memory named " + name);
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || (size_t) info.st_size < ringHeaderSize()) {
+        close(fd);
+        throw std::runtime_error("SharedFrameSubscriber: invalid shared memory " + name);
+    }
+    _size = info.st_size;
+
+    void *memory = mmap(0, _size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+        throw std::runtime_error("SharedFrameSubscriber: mmap failed on " + name);
+    _memory = (unsigned char*) memory;
+
+    SharedRingHeader *header = ringHeader(_memory);
+    if (header->magic != SHARED_FRAME_MAGIC || header->version != SHARED_FRAME_VERSION) {
+        munmap(_memory, _size);
+        throw std::runtime_error("SharedFrameSubscriber: unknown layout in " + name);
+    }
+
+    // the slots must fit in the object before any slot header is read
+    unsigned long long imageSize = (unsigned long long) header->rowStride * header->height;
+    unsigned long long slotsSize = (unsigned long long) header->slots * header->slotSize;
+    if (!header->slots || header->slotSize < slotHeaderSize() + imageSize
+        || slotsSize / header->slots != header->slotSize
+        || slotsSize > _size - ringHeaderSize()) {
+        munmap(_memory, _size);
+        throw std::runtime_error("SharedFrameSubscriber: slots out of the shared memory " + name);
+    }
+}
+
+SharedFrameSubscriber::~SharedFrameSubscriber() {
+    munmap(_memory, _size);
+}
+
+bool SharedFrameSubscriber::latest(SharedFrameView& view) const {
+    SharedRingHeader *header = ringHeader(_memory);
+
+    for (;;) {
+        unsigned long long sequence = header->lastSequence;
+        if (!sequence)
+            return false;
+
+        __sync_synchronize();
+        if (take(header->lastSlot, view) && view.header->sequence >= sequence)
+            return true;
+    }
+}
+
+bool SharedFrameSubscriber::get(unsigned long long sequence,
+                                SharedFrameView& view) const {
+    SharedRingHeader *header = ringHeader(_memory);
+    for (uint i = 0; i < header->slots; ++i) {
+        if (take(i, view) && view.header->sequence == sequence && isValid(view))
+            return true;
+    }
+    return false;
+}
+
+bool SharedFrameSubscriber::isValid(const SharedFrameView& view) const {
+    if (!view.header)
+        return false;
+
+    __sync_synchronize();
+    return view.header->lock == view.lock;
+}
+
+bool SharedFrameSubscriber::take(uint slot, SharedFrameView& view) const {
+    view.header = slotHeader(_memory, slot);
+    view.data = slotData(_memory, slot);
+    view.lock = view.header->lock;
+    __sync_synchronize();
+
+    // odd lock: the publisher is writing on it
+    return !(view.lock & 1);
+}
+
+unsigned long long SharedFrameSubscriber::lastSequence() const {
+    return ringHeader(_memory)->lastSequence;
+}
+
+uint SharedFrameSubscriber::width() const {
+    return ringHeader(_memory)->width;
+}
+
+uint SharedFrameSubscriber::height() const {
+    return ringHeader(_memory)->height;
+}
+
+} /* namespace normal_depth_map */
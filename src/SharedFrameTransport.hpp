@@ -0,0 +1,170 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_SHAREDFRAMETRANSPORT_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_SHAREDFRAMETRANSPORT_HPP_
+
+#include <string>
+
+#include "ImageViewerCaptureTool.hpp"
+#include "FrameRing.hpp"
+
+namespace normal_depth_map {
+
+/**
+ * @brief Header of each frame stored in the shared memory ring
+ *
+ *  The lock field works as a sequence lock: it is odd while the publisher
+ *  writes the slot, and it changes every time the slot is rewritten.
+ */
+struct SharedFrameHeader {
+    volatile unsigned long long lock;
+    unsigned long long sequence;
+    double timestamp;
+    double cameraPose[16];
+    float maxRange;
+    float maxHorizontalAngle;
+    float maxVerticalAngle;
+    float attenuationCoeff;
+    unsigned int width;
+    unsigned int height;
+    unsigned int pixelFormat;
+    unsigned int dataType;
+    unsigned int rowStride;
+    unsigned int flags;
+    unsigned long long parametersVersion;
+};
+
+/**
+ * @brief Read-only view of a frame inside the shared memory
+ *
+ *  The data pointer refers straight to the mapped memory, without copies.
+ *  The publisher may reuse the slot at any time, so the reader must call
+ *  SharedFrameSubscriber::isValid after consuming the data; if it returns
+ *  false the frame was overwritten meanwhile and must be discarded.
+ */
+struct SharedFrameView {
+    SharedFrameView() : header(0), data(0), lock(0) {}
+
+    const SharedFrameHeader *header;
+    const unsigned char *data;
+    unsigned long long lock;
+};
+
+/**
+ * @brief Publishes frames in a POSIX shared memory ring
+ *
+ *  The memory is a small global header followed by a fixed number of
+ *  slots, each one with a SharedFrameHeader and the image data. There is
+ *  no broker: any number of SharedFrameSubscriber in other processes map
+ *  the same object by name. The object is removed on destruction.
+ */
+class SharedFramePublisher {
+public:
+
+    /**
+     * @brief Creates the shared memory object
+     *
+     *  @param name: POSIX shared memory name (e.g. "/normal_depth_map")
+     *  @param width: image width
+     *  @param height: image height
+     *  @param slots: number of frames in the ring
+     *  @param pixelFormat: GL pixel format of the frames
+     *  @param dataType: GL data type of the frames
+     *  It throws std::runtime_error if an object of the same name already
+     *  exists (e.g. another publisher); shm_unlink removes a stale one.
+     */
+    SharedFramePublisher(   const std::string& name,
+                            uint width, uint height, uint slots = 4,
+                            GLenum pixelFormat = GL_RGB,
+                            GLenum dataType = GL_FLOAT);
+    ~SharedFramePublisher();
+
+    /**
+     * @brief Reserves the next slot and gives its memory as capture buffer
+     *
+     *  The returned buffer can be used in ImageViewerCaptureTool
+     *  setCaptureBuffer, so the frame is rendered in the shared memory.
+     */
+    CaptureBuffer beginFrame();
+
+    /**
+     * @brief Publishes the slot reserved by beginFrame
+     *
+     *  @return the sequence number of the published frame
+     */
+    unsigned long long commitFrame( double timestamp,
+                                    const osg::Matrixd& cameraPose,
+                                    const NormalDepthMapParameters& parameters);
+
+    /**
+     * @brief Cancels the slot reserved by beginFrame
+     *
+     *  The slot is unlocked without a frame (the subscribers do not find
+     *  its previous frame anymore), and reserved again by the next
+     *  beginFrame.
+     */
+    void abortFrame();
+
+    /**
+     * @brief Copies and publishes a frame from a FrameRing
+     */
+    unsigned long long publish(const Frame& frame);
+
+    const std::string& getName() const { return _name; }
+
+private:
+    std::string _name;
+    unsigned char *_memory;
+    size_t _size;
+    uint _next;
+    bool _writing;
+};
+
+/**
+ * @brief Reads frames published by a SharedFramePublisher
+ */
+class SharedFrameSubscriber {
+public:
+
+    /**
+     * @brief Maps an existing shared memory object (read only)
+     *
+     *  It throws std::runtime_error if the object does not exist, it was
+     *  not created by a SharedFramePublisher or it is smaller than its
+     *  slots.
+     */
+    SharedFrameSubscriber(const std::string& name);
+    ~SharedFrameSubscriber();
+
+    /**
+     * @brief Gets the most recent frame
+     *
+     *  @param view: receives the frame
+     *  @return false if there is no frame published yet
+     */
+    bool latest(SharedFrameView& view) const;
+
+    /**
+     * @brief Gets a frame with a given sequence number
+     *
+     *  @return false if the frame is not in the ring anymore
+     */
+    bool get(unsigned long long sequence, SharedFrameView& view) const;
+
+    /**
+     * @brief Checks that a frame was not overwritten since it was taken
+     */
+    bool isValid(const SharedFrameView& view) const;
+
+    unsigned long long lastSequence() const;
+    uint width() const;
+    uint height() const;
+
+private:
+    bool take(uint slot, SharedFrameView& view) const;
+
+    unsigned char *_memory;
+    size_t _size;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_SHAREDFRAMETRANSPORT_HPP_ */
@@ -0,0 +1,281 @@
+#include "SideScanWaterfall.hpp"
+
+#include <osg/FrameBufferObject>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/Program>
+#include <osg/Shader>
+#include <osg/Version>
+#include <osgDB/FileUtils>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace normal_depth_map {
+
+#define SHADER_PATH_WATERFALL_FRAG "normal_depth_map/shaders/sideScanWaterfall.frag"
+#define SHADER_PATH_SCREEN_QUAD_VERT "normal_depth_map/shaders/screenQuad.vert"
+
+/**
+ * @brief Reads rows of the waterfall texture at the end of a frame
+ *
+ *  The texture is bound as read framebuffer, so only the requested rows
+ *  are transferred.
+ */
+class SideScanWaterfall::Readback : public osg::Camera::DrawCallback {
+public:
+    struct Request {
+        uint first;
+        uint count;
+        osg::ref_ptr<osg::Image> image;
+        uint row;
+    };
+
+    Readback(osg::ref_ptr<osg::Texture2D> texture) {
+        _fbo = new osg::FrameBufferObject();
+        _fbo->setAttachment(osg::Camera::COLOR_BUFFER0,
+                            osg::FrameBufferAttachment(texture.get()));
+    }
+
+    void operator ()(osg::RenderInfo& renderInfo) const {
+        if (_requests.empty())
+            return;
+
+        osg::State& state = *renderInfo.getState();
+        _fbo->apply(state, osg::FrameBufferObject::READ_FRAMEBUFFER);
+        glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+
+        // the pack state of the context is restored after
+        GLint alignment;
+        glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+        for (uint i = 0; i < _requests.size(); ++i) {
+            const Request& request = _requests[i];
+            glReadPixels(   0, request.first, request.image->s(), request.count,
+                            GL_RED, GL_FLOAT, request.image->data(0, request.row));
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+
+        // back to the default framebuffer
+        GLuint defaultFbo = state.getGraphicsContext() ? state.getGraphicsContext()->getDefaultFboId() : 0;
+#if OSG_VERSION_LESS_THAN(3, 3, 0)
+        osg::FBOExtensions::instance(state.getContextID(), true)->glBindFramebuffer(GL_READ_FRAMEBUFFER_EXT, defaultFbo);
+#else
+        state.get<osg::GLExtensions>()->glBindFramebuffer(GL_READ_FRAMEBUFFER_EXT, defaultFbo);
+#endif
+        _requests.clear();
+    }
+
+    mutable std::vector<Request> _requests;
+
+private:
+    osg::ref_ptr<osg::FrameBufferObject> _fbo;
+};
+
+SideScanWaterfall::SideScanWaterfall(   double acrossTrackAngle,
+                                        double alongTrackAngle,
+                                        double tilt, uint numBins,
+                                        uint numLines, uint sliceWidth,
+                                        uint sliceHeight)
+    : _num_bins(numBins), _num_lines(numLines), _num_pings(0), _num_read(0) {
+
+    if (!numBins || !numLines || !sliceWidth || !sliceHeight)
+        throw std::invalid_argument("SideScanWaterfall: empty waterfall or slice");
+    if (!(acrossTrackAngle > 0 && acrossTrackAngle < M_PI))
+        throw std::invalid_argument("SideScanWaterfall: across track angle must be in ]0, PI[");
+
+    _directions[0] = osg::Vec3d(0, cos(tilt), -sin(tilt));
+    _directions[1] = osg::Vec3d(0, -cos(tilt), -sin(tilt));
+
+    // hidden viewer: the cameras render in textures, the window is not used
+    _viewer = new osgViewer::Viewer;
+    _viewer->setThreadingModel(osgViewer::Viewer::SingleThreaded);
+
+    osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits;
+    traits->width = 1;
+    traits->height = 1;
+    traits->pbuffer = true;
+    traits->readDISPLAY();
+
+    osg::ref_ptr<osg::GraphicsContext> gfxc = osg::GraphicsContext::createGraphicsContext(traits.get());
+    osg::ref_ptr<osg::Camera> camera = _viewer->getCamera();
+    camera->setGraphicsContext(gfxc);
+    camera->setViewport(new osg::Viewport(0, 0, 1, 1));
+    camera->setClearMask(0);
+
+    _scene = new osg::Group();
+    osg::ref_ptr<osg::Group> root = new osg::Group();
+
+    // across-track slices of the normal depth map
+    for (uint i = 0; i < 2; ++i) {
+        _slice_textures[i] = new osg::Texture2D();
+        _slice_textures[i]->setTextureSize(sliceWidth, sliceHeight);
+        _slice_textures[i]->setInternalFormat(GL_RGBA32F_ARB);
+        _slice_textures[i]->setSourceFormat(GL_RGBA);
+        _slice_textures[i]->setSourceType(GL_FLOAT);
+        _slice_textures[i]->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+        _slice_textures[i]->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+
+        _slice_cameras[i] = createSliceCamera(_slice_textures[i], acrossTrackAngle, alongTrackAngle);
+        _slice_cameras[i]->setViewport(0, 0, sliceWidth, sliceHeight);
+        _slice_cameras[i]->addChild(_scene);
+        root->addChild(_slice_cameras[i]);
+    }
+
+    // waterfall ring
+    _waterfall = new osg::Texture2D();
+    _waterfall->setTextureSize(2 * numBins, numLines);
+    _waterfall->setInternalFormat(GL_R32F);
+    _waterfall->setSourceFormat(GL_RED);
+    _waterfall->setSourceType(GL_FLOAT);
+    _waterfall->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+    _waterfall->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+
+    // full screen quad writing the line of the ping: the viewport covers the
+    // whole texture and the scissor selects the row, so the other lines are
+    // kept (no clear)
+    _accumulate_camera = new osg::Camera();
+    _accumulate_camera->setReferenceFrame(osg::Transform::ABSOLUTE_RF);
+    _accumulate_camera->setRenderOrder(osg::Camera::PRE_RENDER, 1);
+    _accumulate_camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+    _accumulate_camera->attach(osg::Camera::COLOR_BUFFER0, _waterfall.get());
+    _accumulate_camera->setViewport(0, 0, 2 * numBins, numLines);
+    _accumulate_camera->setProjectionMatrix(osg::Matrix::identity());
+    _accumulate_camera->setViewMatrix(osg::Matrix::identity());
+    _accumulate_camera->setClearMask(0);
+
+    osg::ref_ptr<osg::Geode> quad = new osg::Geode();
+    quad->addDrawable(osg::createTexturedQuadGeometry(  osg::Vec3(-1, -1, 0),
+                                                        osg::Vec3(2, 0, 0),
+                                                        osg::Vec3(0, 2, 0)));
+    _accumulate_camera->addChild(quad);
+
+    osg::ref_ptr<osg::Program> program = new osg::Program();
+    program->addShader(osg::Shader::readShaderFile(osg::Shader::VERTEX, osgDB::findDataFile(SHADER_PATH_SCREEN_QUAD_VERT)));
+    program->addShader(osg::Shader::readShaderFile(osg::Shader::FRAGMENT, osgDB::findDataFile(SHADER_PATH_WATERFALL_FRAG)));
+
+    _line_scissor = new osg::Scissor(0, 0, 2 * numBins, 1);
+    osg::ref_ptr<osg::StateSet> ss = quad->getOrCreateStateSet();
+    ss->setAttribute(program);
+    ss->setAttributeAndModes(_line_scissor, osg::StateAttribute::ON);
+    ss->setMode(GL_DEPTH_TEST, osg::StateAttribute::OFF);
+    ss->setTextureAttribute(0, _slice_textures[0]);
+    ss->setTextureAttribute(1, _slice_textures[1]);
+    ss->addUniform(new osg::Uniform("portSlice", 0));
+    ss->addUniform(new osg::Uniform("starboardSlice", 1));
+    ss->addUniform(new osg::Uniform("numBins", (int) numBins));
+    root->addChild(_accumulate_camera);
+
+    _readback = new Readback(_waterfall);
+    camera->setFinalDrawCallback(_readback);
+    _viewer->setSceneData(root);
+
+    // clears the waterfall and the slices once, with an empty scene
+    _accumulate_camera->setClearMask(GL_COLOR_BUFFER_BIT);
+    _accumulate_camera->setClearColor(osg::Vec4(0, 0, 0, 0));
+    setRenderEnabled(true);
+    _viewer->frame();
+    _accumulate_camera->setClearMask(0);
+}
+
+SideScanWaterfall::~SideScanWaterfall() {}
+
+osg::ref_ptr<osg::Camera> SideScanWaterfall::createSliceCamera(
+                                        osg::ref_ptr<osg::Texture2D> texture,
+                                        double acrossTrackAngle,
+                                        double alongTrackAngle) {
+
+    osg::ref_ptr<osg::Camera> camera = new osg::Camera();
+    camera->setReferenceFrame(osg::Transform::ABSOLUTE_RF);
+    camera->setRenderOrder(osg::Camera::PRE_RENDER, 0);
+    camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+    camera->attach(osg::Camera::COLOR_BUFFER0, texture.get());
+    camera->setClearColor(osg::Vec4(0, 0, 0, 0));
+    camera->setClearMask(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    camera->setComputeNearFarMode(osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR);
+
+    // wide across the track, narrow along it
+    double near = 0.1;
+    camera->setProjectionMatrixAsFrustum(   -near * tan(acrossTrackAngle * 0.5),
+                                            near * tan(acrossTrackAngle * 0.5),
+                                            -near * tan(alongTrackAngle * 0.5),
+                                            near * tan(alongTrackAngle * 0.5),
+                                            near, 1000);
+    return camera;
+}
+
+void SideScanWaterfall::setRenderEnabled(bool enabled) {
+    osg::Node::NodeMask mask = enabled ? ~0u : 0;
+    _slice_cameras[0]->setNodeMask(mask);
+    _slice_cameras[1]->setNodeMask(mask);
+    _accumulate_camera->setNodeMask(mask);
+}
+
+unsigned long long SideScanWaterfall::ping( osg::ref_ptr<osg::Node> node,
+                                            const osg::Vec3d& position,
+                                            const osg::Quat& attitude) {
+
+    if (_scene->getNumChildren() != 1 || _scene->getChild(0) != node.get()) {
+        _scene->removeChildren(0, _scene->getNumChildren());
+        _scene->addChild(node);
+    }
+
+    // the horizontal axis of the slices lies in the across-track plane
+    osg::Vec3d forward = attitude * osg::Vec3d(1, 0, 0);
+    for (uint i = 0; i < 2; ++i)
+        _slice_cameras[i]->setViewMatrixAsLookAt(   position,
+                                                    position + attitude * _directions[i],
+                                                    forward);
+
+    uint line = _num_pings % _num_lines;
+    _line_scissor->setScissor(0, line, 2 * _num_bins, 1);
+
+    setRenderEnabled(true);
+    _viewer->frame();
+    return _num_pings++;
+}
+
+void SideScanWaterfall::read(uint first, uint count,
+                             osg::ref_ptr<osg::Image> image, uint row) {
+    Readback::Request request;
+    request.first = first;
+    request.count = count;
+    request.image = image;
+    request.row = row;
+    _readback->_requests.push_back(request);
+}
+
+osg::ref_ptr<osg::Image> SideScanWaterfall::readNewLines() {
+    unsigned long long count = std::min(_num_pings - _num_read, (unsigned long long) _num_lines);
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(2 * _num_bins, count, 1, GL_RED, GL_FLOAT);
+    _num_read = _num_pings;
+    if (!count)
+        return image;
+
+    // the lines may wrap around the end of the ring
+    uint first = (_num_pings - count) % _num_lines;
+    uint tail = std::min((unsigned long long) (_num_lines - first), count);
+    read(first, tail, image, 0);
+    if (tail < count)
+        read(0, count - tail, image, tail);
+
+    setRenderEnabled(false);
+    _viewer->frame();
+    return image;
+}
+
+osg::ref_ptr<osg::Image> SideScanWaterfall::readWaterfall() {
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(2 * _num_bins, _num_lines, 1, GL_RED, GL_FLOAT);
+    read(0, _num_lines, image, 0);
+
+    setRenderEnabled(false);
+    _viewer->frame();
+    return image;
+}
+
+} /* namespace normal_depth_map */
@@ -0,0 +1,117 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_SIDESCANWATERFALL_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_SIDESCANWATERFALL_HPP_
+
+#include <osg/Camera>
+#include <osg/Image>
+#include <osg/Node>
+#include <osg/Quat>
+#include <osg/Scissor>
+#include <osg/Texture2D>
+#include <osg/ref_ptr>
+#include <osgViewer/Viewer>
+
+namespace normal_depth_map {
+
+/**
+ * @brief Simulates a side-scan sonar, building the waterfall on the GPU
+ *
+ *  Each ping renders a thin across-track slice on each side of the
+ *  vehicle, converts the slices in range bins on the GPU and writes them as
+ *  one line of a waterfall texture used as a ring buffer: the ping n is the
+ *  row n % numLines. Nothing is read back while pinging; the new lines or
+ *  the whole waterfall are read on demand.
+ *
+ *  A line has 2 * numBins values: the port bins from far to near, then the
+ *  starboard bins from near to far. The scene must be a NormalDepthMap node
+ *  (the range is its normalized depth).
+ *
+ *  The vehicle frame is x forward, y port and z up.
+ */
+class SideScanWaterfall {
+public:
+
+    /**
+     * @brief Creates the slice cameras and an empty waterfall
+     *
+     *  @param acrossTrackAngle: aperture of each side in the across-track
+     *   plane (in radians, below PI)
+     *  @param alongTrackAngle: aperture along the track (in radians)
+     *  @param tilt: depression angle of the center of each side, below
+     *   the horizon (in radians)
+     *  @param numBins: range bins per side
+     *  @param numLines: lines kept in the waterfall
+     *  @param sliceWidth: rendered pixels across the track
+     *  @param sliceHeight: rendered pixels along the track
+     */
+    SideScanWaterfall(  double acrossTrackAngle, double alongTrackAngle,
+                        double tilt, uint numBins, uint numLines,
+                        uint sliceWidth = 256, uint sliceHeight = 4);
+    ~SideScanWaterfall();
+
+    /**
+     * @brief Renders one ping and writes its line in the waterfall
+     *
+     *  @param node: normal depth map node with the scene
+     *  @param position: vehicle position
+     *  @param attitude: vehicle orientation
+     *  @return the ping number (its line is this number % numLines)
+     */
+    unsigned long long ping(osg::ref_ptr<osg::Node> node,
+                            const osg::Vec3d& position,
+                            const osg::Quat& attitude);
+
+    /**
+     * @brief Reads back the lines written since the last call
+     *
+     *  At most numLines lines (the oldest are lost when the ring wraps).
+     *
+     *  @return GL_RED float image, 2 * numBins columns, one row per line
+     *   from the oldest to the newest
+     */
+    osg::ref_ptr<osg::Image> readNewLines();
+
+    /**
+     * @brief Reads back the whole waterfall texture
+     *
+     *  @return GL_RED float image, 2 * numBins columns and numLines rows,
+     *   in ring order (the ping n is the row n % numLines)
+     */
+    osg::ref_ptr<osg::Image> readWaterfall();
+
+    // waterfall texture, to display it without readback
+    osg::ref_ptr<osg::Texture2D> getWaterfallTexture() const { return _waterfall; }
+
+    unsigned long long getNumPings() const { return _num_pings; }
+    uint getNumBins() const { return _num_bins; }
+    uint getNumLines() const { return _num_lines; }
+
+private:
+    class Readback;
+
+    osg::ref_ptr<osg::Camera> createSliceCamera(osg::ref_ptr<osg::Texture2D> texture,
+                                                double acrossTrackAngle,
+                                                double alongTrackAngle);
+    void setRenderEnabled(bool enabled);
+    void read(uint first, uint count, osg::ref_ptr<osg::Image> image, uint row);
+
+    uint _num_bins;
+    uint _num_lines;
+    unsigned long long _num_pings;
+    unsigned long long _num_read;
+
+    // slice directions in the vehicle frame (port and starboard)
+    osg::Vec3d _directions[2];
+
+    osg::ref_ptr<osgViewer::Viewer> _viewer;
+    osg::ref_ptr<osg::Group> _scene;
+    osg::ref_ptr<osg::Camera> _slice_cameras[2];
+    osg::ref_ptr<osg::Texture2D> _slice_textures[2];
+    osg::ref_ptr<osg::Camera> _accumulate_camera;
+    osg::ref_ptr<osg::Scissor> _line_scissor;
+    osg::ref_ptr<osg::Texture2D> _waterfall;
+    osg::ref_ptr<Readback> _readback;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_SIDESCANWATERFALL_HPP_ */
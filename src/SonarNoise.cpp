@@ -0,0 +1,138 @@
+#include "SonarNoise.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace normal_depth_map {
+
+const uint SonarNoise::NOISE_LANES;
+
+namespace {
+
+const uint32_t PHILOX_M0 = 0xD2511F53;
+const uint32_t PHILOX_M1 = 0xCD9E8D57;
+const uint32_t PHILOX_W0 = 0x9E3779B9;
+const uint32_t PHILOX_W1 = 0xBB67AE85;
+
+// ten rounds on lanes independent blocks, in place
+inline void philoxRounds(   uint32_t *c0, uint32_t *c1, uint32_t *c2, uint32_t *c3,
+                            uint lanes, uint32_t k0, uint32_t k1) {
+    for (uint round = 0; round < 10; ++round) {
+        for (uint i = 0; i < lanes; ++i) {
+            uint64_t product0 = (uint64_t) PHILOX_M0 * c0[i];
+            uint64_t product1 = (uint64_t) PHILOX_M1 * c2[i];
+            uint32_t next0 = (uint32_t) (product1 >> 32) ^ c1[i] ^ k0;
+            uint32_t next2 = (uint32_t) (product0 >> 32) ^ c3[i] ^ k1;
+            c1[i] = (uint32_t) product1;
+            c3[i] = (uint32_t) product0;
+            c0[i] = next0;
+            c2[i] = next2;
+        }
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+}
+
+// uniform value in (0, 1), from the 24 high bits of a word
+inline float toUniform(uint32_t word) {
+    return ((word >> 8) + 0.5f) * (1.0f / 16777216.0f);
+}
+
+}
+
+class SonarNoise::RowTask : public ParallelTask {
+public:
+    RowTask(const SonarNoise& noise, osg::Image& image, uint components,
+            unsigned long long sequence)
+        : _noise(noise), _image(image), _components(components),
+          _sequence(sequence) {}
+
+    void run(uint row) {
+        uint width = _image.s();
+        float *pixels = (float*) _image.data(0, row);
+        uint32_t k0 = (uint32_t) _noise._seed;
+        uint32_t k1 = (uint32_t) (_noise._seed >> 32);
+        float speckle = _noise._speckle;
+        float gainNoise = _noise._gain_noise;
+
+        // unit mean Rayleigh amplitude: sqrt(-4 / PI * log(u))
+        const float rayleighScale = 4.0f / M_PI;
+
+        for (uint x0 = 0; x0 < width; x0 += NOISE_LANES) {
+            uint lanes = std::min(width - x0, NOISE_LANES);
+            uint32_t c0[NOISE_LANES], c1[NOISE_LANES], c2[NOISE_LANES], c3[NOISE_LANES];
+            for (uint i = 0; i < NOISE_LANES; ++i) {
+                unsigned long long index = (unsigned long long) row * width + x0 + i;
+                c0[i] = (uint32_t) index;
+                c1[i] = (uint32_t) (index >> 32);
+                c2[i] = (uint32_t) _sequence;
+                c3[i] = (uint32_t) (_sequence >> 32);
+            }
+            philoxRounds(c0, c1, c2, c3, NOISE_LANES, k0, k1);
+
+            for (uint i = 0; i < lanes; ++i) {
+                float *pixel = pixels + (x0 + i) * _components;
+                if (pixel[0] == 0 && pixel[1] == 0 && pixel[2] == 0
+                    && (_components < 4 || pixel[3] == 0))
+                    continue;
+
+                // the logarithms cost more than the generator, so the
+                // disabled terms are skipped
+                float intensity = pixel[2];
+                if (speckle > 0) {
+                    float rayleigh = sqrtf(-rayleighScale * logf(toUniform(c0[i])));
+                    intensity *= 1 - speckle + speckle * rayleigh;
+                }
+                if (gainNoise > 0) {
+                    float gaussian = sqrtf(-2.0f * logf(toUniform(c1[i])))
+                        * cosf(2.0f * M_PI * toUniform(c2[i]));
+                    intensity += gainNoise * powf(pixel[1], _noise._gain_exponent) * gaussian;
+                }
+                pixel[2] = std::min(std::max(intensity, 0.0f), 1.0f);
+            }
+        }
+    }
+
+private:
+    const SonarNoise& _noise;
+    osg::Image& _image;
+    uint _components;
+    unsigned long long _sequence;
+};
+
+SonarNoise::SonarNoise(unsigned long long seed, ThreadPool *pool)
+    : _seed(seed), _pool(pool), _speckle(1), _gain_noise(0), _gain_exponent(2) {
+
+    if (!_pool)
+        _pool = &ThreadPool::instance();
+}
+
+void SonarNoise::setSpeckle(float speckle) {
+    if (!(speckle >= 0 && speckle <= 1))
+        throw std::invalid_argument("SonarNoise: the speckle weight must be in [0, 1]");
+    _speckle = speckle;
+}
+
+void SonarNoise::setGainNoise(float gainNoise) {
+    if (!(gainNoise >= 0))
+        throw std::invalid_argument("SonarNoise: the gain noise must be positive");
+    _gain_noise = gainNoise;
+}
+
+void SonarNoise::apply(osg::Image& image, unsigned long long sequence) const {
+    uint components = osg::Image::computeNumComponents(image.getPixelFormat());
+    if (image.getDataType() != GL_FLOAT || components < 3)
+        throw std::invalid_argument("SonarNoise: only GL_FLOAT RGB and RGBA images are supported");
+
+    RowTask task(*this, image, components, sequence);
+    _pool->parallelFor(image.t(), task);
+}
+
+void SonarNoise::philox(const uint32_t counter[4], const uint32_t key[2], uint32_t output[4]) {
+    for (uint i = 0; i < 4; ++i)
+        output[i] = counter[i];
+    philoxRounds(output, output + 1, output + 2, output + 3, 1, key[0], key[1]);
+}
+
+} /* namespace normal_depth_map */
@@ -0,0 +1,89 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_SONARNOISE_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_SONARNOISE_HPP_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <osg/Image>
+
+#include "ThreadPool.hpp"
+
+namespace normal_depth_map {
+
+/**
+ * @brief Speckle and receiver noise of the normal depth map frames
+ *
+ *  The intensity (blue channel) of each object pixel becomes
+ *      I * (1 - speckle + speckle * R) + gainNoise * depth^gainExponent * G
+ *  clamped to [0, 1], where R is a Rayleigh amplitude of mean 1, G a
+ *  standard normal value and depth the normalized range (green channel).
+ *  The range term models the noise floor raised by the time varied gain of
+ *  the receiver. The background pixels (all channels equal to zero) are
+ *  not changed.
+ *
+ *  The random numbers come from a counter based generator (Philox-4x32-10)
+ *  keyed by the seed and counted by the frame sequence and the pixel
+ *  index: a frame gets the same noise on any number of threads, and the
+ *  rows are independent tasks. The generator runs on blocks of
+ *  NOISE_LANES pixels, in independent lanes that the compiler may
+ *  vectorize (depending on its version and options); the noise terms of
+ *  each pixel are scalar.
+ *
+ *  Only GL_FLOAT images are supported.
+ */
+class SonarNoise {
+public:
+
+    // pixels generated together, one Philox block per pixel
+    static const uint NOISE_LANES = 8;
+
+    /**
+     *  @param seed: key of the random numbers
+     *  @param pool: threads processing the rows. NULL uses
+     *   ThreadPool::instance().
+     */
+    SonarNoise(unsigned long long seed = 0, ThreadPool *pool = 0);
+
+    // weight of the Rayleigh speckle, from 0 (none) to 1 (fully
+    // multiplicative, the default)
+    void setSpeckle(float speckle);
+    float getSpeckle() const { return _speckle; }
+
+    // standard deviation of the additive noise at the max range (0 by default)
+    void setGainNoise(float gainNoise);
+    float getGainNoise() const { return _gain_noise; }
+
+    // growth of the additive noise with the range (2 by default)
+    void setGainExponent(float gainExponent) { _gain_exponent = gainExponent; }
+    float getGainExponent() const { return _gain_exponent; }
+
+    unsigned long long getSeed() const { return _seed; }
+
+    /**
+     * @brief Adds the noise to a frame, in place
+     *
+     *  @param image: GL_FLOAT RGB or RGBA normal depth map
+     *  @param sequence: frame counter (e.g. Frame::sequence); the same
+     *   sequence gives the same noise
+     *  It throws std::invalid_argument on other images.
+     */
+    void apply(osg::Image& image, unsigned long long sequence) const;
+
+    /**
+     * @brief Philox-4x32-10 block: four random words of a counter
+     */
+    static void philox(const uint32_t counter[4], const uint32_t key[2], uint32_t output[4]);
+
+private:
+    class RowTask;
+
+    unsigned long long _seed;
+    ThreadPool *_pool;
+    float _speckle;
+    float _gain_noise;
+    float _gain_exponent;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_SONARNOISE_HPP_ */
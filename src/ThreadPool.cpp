@@ -0,0 +1,153 @@
+#include "ThreadPool.hpp"
+
+namespace normal_depth_map {
+
+namespace {
+
+// pool running a task on the current thread, to find the nested calls
+__thread ThreadPool *runningPool = 0;
+
+}
+
+class ThreadPool::Worker : public OpenThreads::Thread {
+public:
+    Worker(ThreadPool *pool, uint id) : _pool(pool), _id(id) {}
+    void run() { _pool->work(_id); }
+
+private:
+    ThreadPool *_pool;
+    uint _id;
+};
+
+ThreadPool::ThreadPool(uint numThreads)
+    : _task(0), _count(0), _next(0), _stealing(false),
+      _generation(0), _pending(0), _quit(false) {
+
+    if (!numThreads)
+        numThreads = OpenThreads::GetNumberOfProcessors();
+
+    _blocks = new Block[numThreads];
+    for (uint i = 1; i < numThreads; ++i) {
+        _workers.push_back(new Worker(this, i));
+        _workers.back()->start();
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    _mutex.lock();
+    _quit = true;
+    _startCondition.broadcast();
+    _mutex.unlock();
+
+    for (uint i = 0; i < _workers.size(); ++i) {
+        _workers[i]->join();
+        delete _workers[i];
+    }
+    delete[] _blocks;
+}
+
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::parallelFor(uint count, ParallelTask& task) {
+    dispatch(count, task, false);
+}
+
+void ThreadPool::parallelForStealing(uint count, ParallelTask& task) {
+    dispatch(count, task, true);
+}
+
+void ThreadPool::dispatch(uint count, ParallelTask& task, bool stealing) {
+    if (!count)
+        return;
+
+    // small loops, single thread pools and calls from a task of this pool
+    // (which would wait for the loop that runs them) run in the caller
+    if (_workers.empty() || count == 1 || runningPool == this) {
+        for (uint i = 0; i < count; ++i)
+            task.run(i);
+        return;
+    }
+
+    _callMutex.lock();
+
+    _mutex.lock();
+    _task = &task;
+    _count = count;
+    _stealing = stealing;
+    if (stealing) {
+        uint numBlocks = getNumThreads();
+        for (uint i = 0; i < numBlocks; ++i) {
+            _blocks[i].next.exchange((unsigned long long) count * i / numBlocks);
+            _blocks[i].end = (unsigned long long) count * (i + 1) / numBlocks;
+        }
+    } else
+        _next.exchange(0);
+    _pending = _workers.size();
+    ++_generation;
+    _startCondition.broadcast();
+    _mutex.unlock();
+
+    // the caller works as well
+    ThreadPool *callerPool = runningPool;
+    runningPool = this;
+    runIndexes(0, task, count, stealing);
+    runningPool = callerPool;
+
+    _mutex.lock();
+    while (_pending > 0)
+        _doneCondition.wait(&_mutex);
+    _task = 0;
+    _mutex.unlock();
+
+    _callMutex.unlock();
+}
+
+void ThreadPool::runIndexes(uint id, ParallelTask& task, uint count, bool stealing) {
+    if (!stealing) {
+        // takes the next index until the loop is over
+        for (uint i = ++_next - 1; i < count; i = ++_next - 1)
+            task.run(i);
+        return;
+    }
+
+    // own block first, then the blocks of the other threads
+    uint numBlocks = getNumThreads();
+    for (uint k = 0; k < numBlocks; ++k) {
+        Block& block = _blocks[(id + k) % numBlocks];
+        for (uint i = ++block.next - 1; i < block.end; i = ++block.next - 1)
+            task.run(i);
+    }
+}
+
+void ThreadPool::work(uint id) {
+    uint generation = 0;
+    runningPool = this;
+
+    for (;;) {
+        _mutex.lock();
+        while (!_quit && generation == _generation)
+            _startCondition.wait(&_mutex);
+
+        if (_quit) {
+            _mutex.unlock();
+            return;
+        }
+        generation = _generation;
+        ParallelTask *task = _task;
+        uint count = _count;
+        bool stealing = _stealing;
+        _mutex.unlock();
+
+        runIndexes(id, *task, count, stealing);
+
+        _mutex.lock();
+        if (--_pending == 0)
+            _doneCondition.signal();
+        _mutex.unlock();
+    }
+}
+
+} /* namespace normal_depth_map */
@@ -0,0 +1,106 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_THREADPOOL_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_THREADPOOL_HPP_
+
+#include <vector>
+#include <sys/types.h>
+
+#include <OpenThreads/Atomic>
+#include <OpenThreads/Condition>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/Thread>
+
+namespace normal_depth_map {
+
+/**
+ * @brief Work item executed by ThreadPool::parallelFor
+ *
+ *  run() is called once for each index, from several threads at the same
+ *  time; each index must be independent from the others. It must not
+ *  throw: an exception leaving a worker thread terminates the program.
+ */
+class ParallelTask {
+public:
+    virtual ~ParallelTask() {}
+    virtual void run(uint index) = 0;
+};
+
+/**
+ * @brief Fixed set of worker threads to split loops across the cores
+ *
+ *  The threads are created once and sleep between the calls, so the pool
+ *  can be used every frame without thread creation cost.
+ */
+class ThreadPool {
+public:
+
+    /**
+     * @brief Starts the worker threads
+     *
+     *  @param numThreads: number of threads, including the caller thread.
+     *   0 uses the number of processors.
+     */
+    ThreadPool(uint numThreads = 0);
+    ~ThreadPool();
+
+    /**
+     * @brief Runs task.run(i) for each i in [0, count), and waits the end
+     *
+     *  The caller thread also executes indexes. Calls from different
+     *  threads are serialized. A task may call the pool again: the
+     *  nested loop runs in the thread of the task, one index after the
+     *  other.
+     */
+    void parallelFor(uint count, ParallelTask& task);
+
+    /**
+     * @brief Runs task.run(i) for each i in [0, count) with work stealing
+     *
+     *  Each thread starts on its own contiguous block of indexes, so
+     *  neighbour indexes (e.g. image tiles) stay on the same core; a thread
+     *  that ends its block takes the next indexes of the other blocks. It
+     *  suits tasks of uneven cost.
+     */
+    void parallelForStealing(uint count, ParallelTask& task);
+
+    uint getNumThreads() const { return _workers.size() + 1; }
+
+    /**
+     * @brief Shared pool, with one thread per processor
+     */
+    static ThreadPool& instance();
+
+private:
+    class Worker;
+
+    // block of indexes of one thread, taken from the front by the owner
+    // and the thieves, on its own cache line
+    struct Block {
+        OpenThreads::Atomic next;
+        uint end;
+        char padding[64];
+    };
+
+    void dispatch(uint count, ParallelTask& task, bool stealing);
+    void runIndexes(uint id, ParallelTask& task, uint count, bool stealing);
+    void work(uint id);
+
+    std::vector<Worker*> _workers;
+
+    OpenThreads::Mutex _callMutex;
+    OpenThreads::Mutex _mutex;
+    OpenThreads::Condition _startCondition;
+    OpenThreads::Condition _doneCondition;
+
+    ParallelTask *_task;
+    uint _count;
+    OpenThreads::Atomic _next;
+    Block *_blocks;
+    bool _stealing;
+    uint _generation;
+    uint _pending;
+    bool _quit;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_THREADPOOL_HPP_ */
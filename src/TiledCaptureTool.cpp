@@ -0,0 +1,140 @@
+#include "TiledCaptureTool.hpp"
+
+#include <cerrno>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace normal_depth_map {
+
+////////////////////////////////
+////ImageTileConsumer METHODS
+////////////////////////////////
+
+void ImageTileConsumer::begin(  uint width, uint height,
+                                GLenum pixelFormat, GLenum dataType) {
+    _image = new osg::Image();
+    _image->allocateImage(width, height, 1, pixelFormat, dataType);
+}
+
+void ImageTileConsumer::consumeTile(uint x, uint y, const osg::Image& tile) {
+    uint pixelSize = tile.getPixelSizeInBits() / 8;
+    for (int row = 0; row < tile.t(); ++row)
+        memcpy(_image->data(x, y + row), tile.data(0, row), tile.s() * pixelSize);
+}
+
+////////////////////////////////
+////RawFileTileConsumer METHODS
+////////////////////////////////
+
+RawFileTileConsumer::RawFileTileConsumer(const std::string& path)
+    : _path(path), _fd(-1), _row_size(0), _pixel_size(0) {}
+
+RawFileTileConsumer::~RawFileTileConsumer() {
+    end();
+}
+
+void RawFileTileConsumer::begin(uint width, uint height,
+                                GLenum pixelFormat, GLenum dataType) {
+    end();
+    _fd = open(_path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (_fd < 0)
+        throw std::runtime_error("RawFileTileConsumer: can not create " + _path);
+
+    _pixel_size = osg::Image::computePixelSizeInBits(pixelFormat, dataType) / 8;
+    _row_size = (size_t) width * _pixel_size;
+    if (ftruncate(_fd, (off_t) (_row_size * height)) < 0)
+        throw std::runtime_error("RawFileTileConsumer: can not allocate " + _path);
+}
+
+void RawFileTileConsumer::consumeTile(uint x, uint y, const osg::Image& tile) {
+    size_t size = (size_t) tile.s() * _pixel_size;
+    for (int row = 0; row < tile.t(); ++row) {
+        off_t offset = (off_t) ((y + row) * _row_size + (size_t) x * _pixel_size);
+        if (pwrite(_fd, tile.data(0, row), size, offset) != (ssize_t) size)
+            throw std::runtime_error("RawFileTileConsumer: write failed on " + _path);
+    }
+}
+
+void RawFileTileConsumer::end() {
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+////////////////////////////////
+////TiledCaptureTool METHODS
+////////////////////////////////
+
+TiledCaptureTool::TiledCaptureTool( uint width, uint height,
+                                    uint tileWidth, uint tileHeight)
+    : _width(width), _height(height),
+      _tile_width(std::min(width, tileWidth)),
+      _tile_height(std::min(height, tileHeight)),
+      _capture(std::min(width, tileWidth), std::min(height, tileHeight)) {
+
+    if (!width || !height || !tileWidth || !tileHeight)
+        throw std::invalid_argument("TiledCaptureTool: empty image or tile");
+
+    setProjectionMatrixAsPerspective(30, (double) width / height);
+}
+
+void TiledCaptureTool::setProjectionMatrixAsPerspective(double fovY,
+                                                        double aspectRatio,
+                                                        double near,
+                                                        double far) {
+    _projection = osg::Matrix::perspective(fovY, aspectRatio, near, far);
+}
+
+void TiledCaptureTool::grab(osg::ref_ptr<osg::Node> node, TileConsumer& consumer) {
+    double left, right, bottom, top, near, far;
+    bool perspective = _projection.getFrustum(left, right, bottom, top, near, far);
+    if (!perspective && !_projection.getOrtho(left, right, bottom, top, near, far))
+        throw std::invalid_argument("TiledCaptureTool: unsupported projection");
+
+    // size of a pixel on the near plane
+    double pixelWidth = (right - left) / _width;
+    double pixelHeight = (top - bottom) / _height;
+
+    for (uint y = 0; y < _height; y += _tile_height) {
+        for (uint x = 0; x < _width; x += _tile_width) {
+
+            // sub-frustum of the full tile, even if it overlaps the border
+            double tileLeft = left + x * pixelWidth;
+            double tileBottom = bottom + y * pixelHeight;
+            double tileRight = tileLeft + _tile_width * pixelWidth;
+            double tileTop = tileBottom + _tile_height * pixelHeight;
+            if (perspective)
+                _capture.setProjectionMatrix(osg::Matrix::frustum(tileLeft, tileRight, tileBottom, tileTop, near, far));
+            else
+                _capture.setProjectionMatrix(osg::Matrix::ortho(tileLeft, tileRight, tileBottom, tileTop, near, far));
+
+            osg::ref_ptr<osg::Image> image = _capture.grabImage(node);
+            if (!x && !y)
+                consumer.begin(_width, _height, image->getPixelFormat(), image->getDataType());
+
+            // crops the tile on the image borders, without copy
+            uint width = std::min(_tile_width, _width - x);
+            uint height = std::min(_tile_height, _height - y);
+            osg::ref_ptr<osg::Image> tile = new osg::Image();
+            tile->setImage( width, height, 1,
+                            image->getInternalTextureFormat(),
+                            image->getPixelFormat(), image->getDataType(),
+                            image->data(), osg::Image::NO_DELETE,
+                            image->getPacking(), image->s());
+            consumer.consumeTile(x, y, *tile);
+        }
+    }
+    consumer.end();
+}
+
+osg::ref_ptr<osg::Image> TiledCaptureTool::grabImage(osg::ref_ptr<osg::Node> node) {
+    ImageTileConsumer consumer;
+    grab(node, consumer);
+    return consumer.getImage();
+}
+
+} /* namespace normal_depth_map */
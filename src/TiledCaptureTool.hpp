@@ -0,0 +1,137 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_TILEDCAPTURETOOL_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_TILEDCAPTURETOOL_HPP_
+
+#include <string>
+
+#include <osg/Image>
+#include <osg/Node>
+#include <osg/ref_ptr>
+
+#include "ImageViewerCaptureTool.hpp"
+
+namespace normal_depth_map {
+
+/**
+ * @brief Receives the tiles of a TiledCaptureTool capture
+ *
+ *  The tiles come in sequence, rows of tiles from the bottom of the image.
+ *  The tile image is only valid during the consumeTile call.
+ */
+class TileConsumer {
+public:
+    virtual ~TileConsumer() {}
+
+    // called before the first tile, with the full image layout
+    virtual void begin(uint width, uint height, GLenum pixelFormat, GLenum dataType) {}
+
+    /**
+     *  @param x, y: position of the tile bottom left pixel in the full image
+     *  @param tile: tile pixels, cropped on the image borders
+     */
+    virtual void consumeTile(uint x, uint y, const osg::Image& tile) = 0;
+
+    // called after the last tile
+    virtual void end() {}
+};
+
+/**
+ * @brief Stitches the tiles in one image
+ */
+class ImageTileConsumer : public TileConsumer {
+public:
+    void begin(uint width, uint height, GLenum pixelFormat, GLenum dataType);
+    void consumeTile(uint x, uint y, const osg::Image& tile);
+
+    osg::ref_ptr<osg::Image> getImage() const { return _image; }
+
+private:
+    osg::ref_ptr<osg::Image> _image;
+};
+
+/**
+ * @brief Writes the tiles in a raw file, without keeping the full image
+ *
+ *  The file has the full image rows, tightly packed and bottom-up (as
+ *  osg::Image), without header.
+ */
+class RawFileTileConsumer : public TileConsumer {
+public:
+    RawFileTileConsumer(const std::string& path);
+    ~RawFileTileConsumer();
+
+    void begin(uint width, uint height, GLenum pixelFormat, GLenum dataType);
+    void consumeTile(uint x, uint y, const osg::Image& tile);
+    void end();
+
+private:
+    std::string _path;
+    int _fd;
+    size_t _row_size;
+    uint _pixel_size;
+};
+
+/**
+ * @brief Captures images larger than the maximum viewport, tile by tile
+ *
+ *  The projection of the full image is split in sub-frusta of the tile
+ *  size, rendered in sequence by one ImageViewerCaptureTool, so the GL
+ *  memory and the memory of the tool are bounded by the tile size. The
+ *  normal depth map values do not depend on the frustum, so the tiles
+ *  stitch without seams.
+ */
+class TiledCaptureTool {
+public:
+
+    /**
+     *  @param width, height: full image size
+     *  @param tileWidth, tileHeight: rendered tile size
+     */
+    TiledCaptureTool(   uint width, uint height,
+                        uint tileWidth = 1024, uint tileHeight = 1024);
+
+    /**
+     * @brief Renders all the tiles and gives them to a consumer
+     *
+     *  @param node: node with the main scene
+     *  @param consumer: receives the tiles
+     */
+    void grab(osg::ref_ptr<osg::Node> node, TileConsumer& consumer);
+
+    /**
+     * @brief Renders all the tiles and stitches them in one image
+     */
+    osg::ref_ptr<osg::Image> grabImage(osg::ref_ptr<osg::Node> node);
+
+    // projection of the full image (perspective or orthographic)
+    void setProjectionMatrix(const osg::Matrix& matrix) { _projection = matrix; };
+    osg::Matrix getProjectionMatrix() const { return _projection; };
+
+    void setProjectionMatrixAsPerspective(  double fovY, double aspectRatio,
+                                            double near = 0.1,
+                                            double far = 1000);
+
+    void setCameraPosition( const osg::Vec3d& eye, const osg::Vec3d& center,
+                            const osg::Vec3d& up)
+      { _capture.setCameraPosition(eye, center, up); };
+
+    void setViewMatrix(osg::Matrix matrix) { _capture.setViewMatrix(matrix); };
+    osg::Matrix getViewMatrix() { return _capture.getViewMatrix(); };
+
+    void setBackgroundColor(osg::Vec4d color) { _capture.setBackgroundColor(color); };
+
+    uint getNumTilesX() const { return (_width + _tile_width - 1) / _tile_width; };
+    uint getNumTilesY() const { return (_height + _tile_height - 1) / _tile_height; };
+
+private:
+    uint _width;
+    uint _height;
+    uint _tile_width;
+    uint _tile_height;
+    osg::Matrix _projection;
+
+    ImageViewerCaptureTool _capture;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_TILEDCAPTURETOOL_HPP_ */
@@ -1,19 +1,26 @@
 // C++ includes
 #include "Tools.hpp"
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <sys/types.h>
 
 namespace normal_depth_map {
 
-double underwaterSignalAttenuation( const double frequency,
-                                    const double temperature,
-                                    const double depth,
-                                    const double salinity,
-                                    const double acidity) {
+namespace {
+
+// dB to Pa: -log(10^(-a/20)) = a * ln(10) / 20, and dB/km to dB/m
+const double DB_KM_TO_PA_M = M_LN10 / 20.0 / 1000.0;
+
+inline double attenuationKernel(double frequency, double temperature,
+                                double depth, double salinity,
+                                double acidity) {
 
     double frequency2 = frequency * frequency;
 
     // borid acid and magnesium sulphate relaxation frequencies (in kHz)
-    double f1 = 0.78 * pow(salinity / 35, 0.5) * exp(temperature / 26);
+    double f1 = 0.78 * sqrt(salinity / 35) * exp(temperature / 26);
     double f2 = 42 * exp(temperature / 17);
 
     // borid acid contribution
@@ -26,17 +33,209 @@ double underwaterSignalAttenuation( const double frequency,
     // freshwater contribution
     double freshwater = 0.00049 * frequency2 * exp(-(temperature / 27 + depth / 17000));
 
-    // absorptium attenuation coefficient in dB/km
-    double attenuation = borid + magnesium + freshwater;
+    // absorptium attenuation coefficient from dB/km to Pa/m
+    return (borid + magnesium + freshwater) * DB_KM_TO_PA_M;
+}
+
+// elements of the batch kernel processed together, in one GCC vector
+const size_t ATTENUATION_LANES = 2;
+
+typedef double LaneDouble __attribute__((vector_size(ATTENUATION_LANES * sizeof(double))));
+typedef long long LaneBits __attribute__((vector_size(ATTENUATION_LANES * sizeof(double))));
+
+// exp of each lane, without branches nor calls: exp(x) = 2^n * exp(r)
+// with n = round(x / ln2) and |r| <= ln2 / 2; exp(r) is its Taylor
+// polynomial of degree 12, well within the bound of the batch version
+// (see Tools.hpp). The input is clamped to the normal doubles.
+inline LaneDouble laneExp(LaneDouble x) {
+    // adding 1.5 * 2^52 rounds to an integer kept in the low mantissa bits
+    const double ROUND = 6755399441055744.0;
+    const double LN2_HIGH = 6.93147180369123816490e-01;
+    const double LN2_LOW = 1.90821492927058770002e-10;
+
+    LaneDouble low = x * 0 - 708.0, high = x * 0 + 709.0;
+    x = x < low ? low : x;
+    x = x > high ? high : x;
+
+    LaneDouble shifted = x * M_LOG2E + ROUND;
+    LaneDouble n = shifted - ROUND;
+    LaneDouble r = x - n * LN2_HIGH - n * LN2_LOW;
 
-    // convert dB/km to dB/m
-    attenuation = attenuation / 1000.0;
+    // Estrin scheme: short dependency chains
+    LaneDouble r2 = r * r;
+    LaneDouble r4 = r2 * r2;
+    LaneDouble r8 = r4 * r4;
+    LaneDouble p01 = 1.0 + r;
+    LaneDouble p23 = 0.5 + r * (1.0 / 6);
+    LaneDouble p45 = 1.0 / 24 + r * (1.0 / 120);
+    LaneDouble p67 = 1.0 / 720 + r * (1.0 / 5040);
+    LaneDouble p89 = 1.0 / 40320 + r * (1.0 / 362880);
+    LaneDouble p1011 = 1.0 / 3628800 + r * (1.0 / 39916800);
+    LaneDouble p0_3 = p01 + r2 * p23;
+    LaneDouble p4_7 = p45 + r2 * p67;
+    LaneDouble p8_11 = p89 + r2 * p1011;
+    LaneDouble p8_12 = p8_11 + r4 * (1.0 / 479001600);
+    LaneDouble p = (p0_3 + r4 * p4_7) + r8 * p8_12;
 
-    // convert dB/m to Pa/m
-    attenuation = pow(10, -attenuation / 20);
-    attenuation = -log(attenuation);
+    // 2^n added to the exponent bits
+    LaneDouble roundVector = x * 0 + ROUND;
+    LaneBits exponent = ((LaneBits) shifted - (LaneBits) roundVector) << 52;
+    return (LaneDouble) ((LaneBits) p + exponent);
+}
+
+// sqrt of each lane as x / sqrt(x): Newton iterations of the inverse
+// square root from a bit level guess (error under 4%, squared at each
+// iteration), without divisions; 0 for the non positive lanes
+inline LaneDouble laneSqrt(LaneDouble x) {
+    LaneDouble zero = x * 0;
+    LaneDouble positive = x > zero ? x : zero + 1;
+    LaneDouble y = (LaneDouble) (0x5FE6EB50C7B537A9LL - ((LaneBits) positive >> 1));
+    for (uint i = 0; i < 4; ++i)
+        y = y * (1.5 - 0.5 * positive * y * y);
+    return x > zero ? positive * y : zero;
+}
+
+// attenuationKernel over the lanes
+inline LaneDouble laneAttenuationKernel(LaneDouble frequency, LaneDouble temperature,
+                                        LaneDouble depth, LaneDouble salinity,
+                                        LaneDouble acidity) {
+
+    // the divisions by constants become products, as the vector division
+    // is slow
+    LaneDouble frequency2 = frequency * frequency;
+    LaneDouble salinityRatio = salinity * (1.0 / 35);
+    LaneDouble f1 = 0.78 * laneSqrt(salinityRatio) * laneExp(temperature * (1.0 / 26));
+    LaneDouble f2 = 42 * laneExp(temperature * (1.0 / 17));
+    LaneDouble borid = 0.106 * ((f1 * frequency2) / (frequency2 + f1 * f1)) * laneExp((acidity - 8) * (1 / 0.56));
+    LaneDouble magnesium = 0.52 * (1 + temperature * (1.0 / 43)) * salinityRatio
+                        * ((f2 * frequency2) / (frequency2 + f2 * f2)) * laneExp(depth * (-1.0 / 6000));
+    LaneDouble freshwater = 0.00049 * frequency2 * laneExp(-(temperature * (1.0 / 27) + depth * (1.0 / 17000)));
+    return (borid + magnesium + freshwater) * DB_KM_TO_PA_M;
+}
+
+inline LaneDouble loadLanes(const double *values) {
+    LaneDouble lanes;
+    memcpy(&lanes, values, sizeof(lanes));
+    return lanes;
+}
+
+}
+
+double underwaterSignalAttenuation( const double frequency,
+                                    const double temperature,
+                                    const double depth,
+                                    const double salinity,
+                                    const double acidity) {
+
+    return attenuationKernel(frequency, temperature, depth, salinity, acidity);
+}
+
+void underwaterSignalAttenuation(   const double * __restrict__ frequency,
+                                    const double * __restrict__ temperature,
+                                    const double * __restrict__ depth,
+                                    const double * __restrict__ salinity,
+                                    const double * __restrict__ acidity,
+                                    double * __restrict__ attenuation,
+                                    size_t count) {
+
+    size_t i = 0;
+    for (; i + ATTENUATION_LANES <= count; i += ATTENUATION_LANES) {
+        LaneDouble lanes = laneAttenuationKernel(loadLanes(frequency + i),
+                                                 loadLanes(temperature + i),
+                                                 loadLanes(depth + i),
+                                                 loadLanes(salinity + i),
+                                                 loadLanes(acidity + i));
+        memcpy(attenuation + i, &lanes, sizeof(lanes));
+    }
+
+    for (; i < count; ++i)
+        attenuation[i] = attenuationKernel( frequency[i], temperature[i],
+                                            depth[i], salinity[i], acidity[i]);
+}
+
+double underwaterSoundSpeed( const double temperature,
+                             const double depth,
+                             const double salinity) {
+
+    double t = temperature, d = depth, s = salinity - 35;
+    return 1448.96 + 4.591 * t - 5.304e-2 * t * t + 2.374e-4 * t * t * t
+            + 1.340 * s + 1.630e-2 * d + 1.675e-7 * d * d
+            - 1.025e-2 * t * s - 7.139e-13 * t * d * d * d;
+}
+
+////////////////////////////////
+////AttenuationTable METHODS
+////////////////////////////////
+
+AttenuationTable::AttenuationTable( double temperature, double salinity,
+                                    double acidity,
+                                    double minDepth, double maxDepth,
+                                    size_t depthSamples,
+                                    double minFrequency, double maxFrequency,
+                                    size_t frequencySamples)
+    : _minDepth(minDepth), _minFrequency(minFrequency),
+      _depthSamples(depthSamples), _frequencySamples(frequencySamples),
+      _maxRelativeError(0) {
+
+    if (depthSamples < 2 || frequencySamples < 2)
+        throw std::invalid_argument("AttenuationTable: at least 2 samples per axis");
+    if (!(maxDepth > minDepth) || !(maxFrequency > minFrequency))
+        throw std::invalid_argument("AttenuationTable: empty range");
+
+    double depthStep = (maxDepth - minDepth) / (depthSamples - 1);
+    double frequencyStep = (maxFrequency - minFrequency) / (frequencySamples - 1);
+    _depthScale = 1.0 / depthStep;
+    _frequencyScale = 1.0 / frequencyStep;
+
+    _values.resize(depthSamples * frequencySamples);
+    for (size_t d = 0; d < depthSamples; ++d)
+        for (size_t f = 0; f < frequencySamples; ++f)
+            _values[d * frequencySamples + f] = attenuationKernel(
+                                                minFrequency + f * frequencyStep,
+                                                temperature,
+                                                minDepth + d * depthStep,
+                                                salinity, acidity);
+
+    // measures the interpolation error inside each cell
+    const uint subSamples = 8;
+    for (size_t d = 0; d + 1 < depthSamples; ++d) {
+        for (size_t f = 0; f + 1 < frequencySamples; ++f) {
+            for (uint i = 1; i <= subSamples; ++i) {
+                for (uint j = 1; j <= subSamples; ++j) {
+                    double depth = minDepth + (d + i / (subSamples + 1.0)) * depthStep;
+                    double frequency = minFrequency + (f + j / (subSamples + 1.0)) * frequencyStep;
+                    double exact = attenuationKernel(frequency, temperature, depth, salinity, acidity);
+                    if (exact > 0)
+                        _maxRelativeError = std::max(_maxRelativeError,
+                                fabs(lookup(frequency, depth) - exact) / exact);
+                }
+            }
+        }
+    }
+}
+
+double AttenuationTable::lookup(double frequency, double depth) const {
+    double y = std::min(std::max((depth - _minDepth) * _depthScale, 0.0),
+                        (double) (_depthSamples - 1));
+    double x = std::min(std::max((frequency - _minFrequency) * _frequencyScale, 0.0),
+                        (double) (_frequencySamples - 1));
+
+    size_t y0 = std::min((size_t) y, _depthSamples - 2);
+    size_t x0 = std::min((size_t) x, _frequencySamples - 2);
+    double wy = y - y0;
+    double wx = x - x0;
+
+    const double *row0 = &_values[y0 * _frequencySamples + x0];
+    const double *row1 = row0 + _frequencySamples;
+    double top = row0[0] + wx * (row0[1] - row0[0]);
+    double bottom = row1[0] + wx * (row1[1] - row1[0]);
+    return top + wy * (bottom - top);
+}
 
-    return attenuation;
+void AttenuationTable::lookup(  const double *frequency, const double *depth,
+                                double *attenuation, size_t count) const {
+    for (size_t i = 0; i < count; ++i)
+        attenuation[i] = lookup(frequency[i], depth[i]);
 }
 
 }
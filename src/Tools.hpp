@@ -1,6 +1,9 @@
 #ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_TOOLS_HPP_
 #define SIMULATION_NORMAL_DEPTH_MAP_SRC_TOOLS_HPP_
 
+#include <cstddef>
+#include <vector>
+
 namespace normal_depth_map {
 
   /**
@@ -24,6 +27,102 @@ namespace normal_depth_map {
                                       const double depth,
                                       const double salinity,
                                       const double acidity);
+
+  /**
+   * @brief compute Underwater Signal Attenuation coefficients of many inputs
+   *
+   *  Same formula of the scalar version, over arrays (structure of arrays
+   *  layout). The inputs are processed by pairs in vector registers, with
+   *  a polynomial exp and a Newton sqrt (relative error under 1e-11 from
+   *  the scalar version), and the remainder by the scalar formula. The
+   *  arrays must not overlap the output.
+   *
+   *  @param frequency: sound frequencies in kHz.
+   *  @param temperature: water temperatures in Celsius degrees.
+   *  @param depth: distances from water surface in meters.
+   *  @param salinity: salinities in ppt.
+   *  @param acidity: pH values.
+   *  @param attenuation: receives the coefficients
+   *  @param count: number of elements of each array
+   */
+
+  void underwaterSignalAttenuation( const double *frequency,
+                                    const double *temperature,
+                                    const double *depth,
+                                    const double *salinity,
+                                    const double *acidity,
+                                    double *attenuation,
+                                    size_t count);
+
+  /**
+   * @brief compute the speed of sound in sea water
+   *
+   *  This method is based on paper "Nine-term equation for sound speed in
+   *  the oceans" (Mackenzie, 1981), valid for temperatures from -2 to 30
+   *  Celsius degrees, salinities from 25 to 40 ppt and depths up to 8000 m.
+   *
+   *  @param double temperature: water temperature in Celsius degrees.
+   *  @param double depth: distance from water surface in meters.
+   *  @param double salinity: amount of salt dissolved in a body of water in ppt.
+   *
+   *  @return double sound speed in m/s
+   */
+
+  double underwaterSoundSpeed(const double temperature,
+                              const double depth,
+                              const double salinity);
+
+  /**
+   * @brief Precomputed underwater attenuation over depth and frequency
+   *
+   *  For fixed water properties (temperature, salinity and pH), it samples
+   *  underwaterSignalAttenuation on a regular depth x frequency grid and
+   *  interpolates bilinearly. Inputs out of the grid are clamped to its
+   *  borders.
+   *
+   *  The relative error against the exact formula is measured when the
+   *  table is built, on a 8 x 8 sub-grid of each cell, and returned by
+   *  getMaxRelativeError(); points between the sub-grid may exceed it by a
+   *  few percent of its value. The attenuation is smooth (quadratic in the
+   *  frequency at most), so the error decreases with the square of the
+   *  sampling step; e.g. 64 x 64 samples over 1-100 m and 100-1000 kHz
+   *  give about 0.1%.
+   */
+  class AttenuationTable {
+  public:
+
+    /**
+     *  @param temperature: water temperature in Celsius degrees.
+     *  @param salinity: salinity in ppt.
+     *  @param acidity: pH value.
+     *  @param minDepth, maxDepth: depth range in meters.
+     *  @param depthSamples: number of depth samples (at least 2).
+     *  @param minFrequency, maxFrequency: frequency range in kHz.
+     *  @param frequencySamples: number of frequency samples (at least 2).
+     */
+    AttenuationTable( double temperature, double salinity, double acidity,
+                      double minDepth, double maxDepth, size_t depthSamples,
+                      double minFrequency, double maxFrequency,
+                      size_t frequencySamples);
+
+    // interpolated attenuation coefficient
+    double lookup(double frequency, double depth) const;
+
+    // interpolated attenuation coefficients of many inputs
+    void lookup(const double *frequency, const double *depth,
+                double *attenuation, size_t count) const;
+
+    double getMaxRelativeError() const { return _maxRelativeError; }
+
+  private:
+    double _minDepth, _depthScale;
+    double _minFrequency, _frequencyScale;
+    size_t _depthSamples, _frequencySamples;
+
+    // row major, one row per depth
+    std::vector<double> _values;
+    double _maxRelativeError;
+  };
 }
 
 #endif
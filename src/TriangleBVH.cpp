@@ -0,0 +1,427 @@
+#include "TriangleBVH.hpp"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace normal_depth_map {
+
+namespace {
+
+// deeper nodes are leaves, whatever their size
+const uint MAX_DEPTH = 64;
+
+float halfArea(const float *min, const float *max) {
+    float x = max[0] - min[0], y = max[1] - min[1], z = max[2] - min[2];
+    return x * y + y * z + z * x;
+}
+
+void growBounds(float *min, float *max, const osg::Vec3f& point) {
+    for (uint i = 0; i < 3; ++i) {
+        min[i] = std::min(min[i], point[i]);
+        max[i] = std::max(max[i], point[i]);
+    }
+}
+
+void emptyBounds(float *min, float *max) {
+    for (uint i = 0; i < 3; ++i) {
+        min[i] = FLT_MAX;
+        max[i] = -FLT_MAX;
+    }
+}
+
+// bin of a centroid on the split axis
+struct CentroidBin {
+    CentroidBin(const std::vector<osg::Vec3f>& centroids, uint axis,
+                float min, float scale)
+        : centroids(centroids), axis(axis), min(min), scale(scale) {}
+
+    uint operator()(uint triangle) const {
+        uint bin = (centroids[triangle][axis] - min) * scale;
+        return std::min(bin, TriangleBVH::NUM_BINS - 1);
+    }
+
+    const std::vector<osg::Vec3f>& centroids;
+    uint axis;
+    float min;
+    float scale;
+};
+
+struct LeftOfSplit {
+    LeftOfSplit(const CentroidBin& bin, uint split) : bin(bin), split(split) {}
+    bool operator()(uint triangle) const { return bin(triangle) <= split; }
+
+    CentroidBin bin;
+    uint split;
+};
+
+}
+
+////////////////////////////////
+////RayPacket METHODS
+////////////////////////////////
+
+RayPacket::RayPacket() {
+    for (uint i = 0; i < SIZE; ++i) {
+        ox[i] = oy[i] = oz[i] = 0;
+        dx[i] = dy[i] = 0;
+        dz[i] = -1;
+        t[i] = -1;  // inactive lane
+        triangle[i] = -1;
+        u[i] = v[i] = 0;
+    }
+}
+
+void RayPacket::setRay( uint lane, const osg::Vec3f& origin,
+                        const osg::Vec3f& direction, float maxDistance) {
+    ox[lane] = origin.x();
+    oy[lane] = origin.y();
+    oz[lane] = origin.z();
+    dx[lane] = direction.x();
+    dy[lane] = direction.y();
+    dz[lane] = direction.z();
+    t[lane] = maxDistance;
+    triangle[lane] = -1;
+}
+
+////////////////////////////////
+////TriangleBVH METHODS
+////////////////////////////////
+
+TriangleBVH::TriangleBVH() : _depth(0) {}
+
+void TriangleBVH::clear() {
+    _triangles.clear();
+    _sources.clear();
+    _nodes.clear();
+    _v0.clear();
+    _edge1.clear();
+    _edge2.clear();
+    _depth = 0;
+}
+
+void TriangleBVH::addTriangle(  const osg::Vec3f& v0, const osg::Vec3f& v1,
+                                const osg::Vec3f& v2, const osg::Vec3f& n0,
+                                const osg::Vec3f& n1, const osg::Vec3f& n2,
+                                float reflectance, uint objectId) {
+    Triangle triangle;
+    triangle.vertex[0] = v0;
+    triangle.vertex[1] = v1;
+    triangle.vertex[2] = v2;
+    triangle.normal[0] = n0;
+    triangle.normal[1] = n1;
+    triangle.normal[2] = n2;
+    triangle.reflectance = reflectance;
+    triangle.objectId = objectId;
+    _sources.push_back(_triangles.size());
+    _triangles.push_back(triangle);
+}
+
+void TriangleBVH::addTriangle(  const osg::Vec3f& v0, const osg::Vec3f& v1,
+                                const osg::Vec3f& v2,
+                                float reflectance, uint objectId) {
+    osg::Vec3f normal = (v1 - v0) ^ (v2 - v0);
+    normal.normalize();
+    addTriangle(v0, v1, v2, normal, normal, normal, reflectance, objectId);
+}
+
+void TriangleBVH::build() {
+    uint count = _triangles.size();
+    _nodes.clear();
+    _depth = 0;
+
+    _indexes.resize(count);
+    _centroids.resize(count);
+    for (uint i = 0; i < count; ++i) {
+        _indexes[i] = i;
+        const Triangle& triangle = _triangles[i];
+        _centroids[i] = (triangle.vertex[0] + triangle.vertex[1] + triangle.vertex[2]) / 3.0f;
+    }
+
+    if (count) {
+        _nodes.reserve(2 * count);
+        _nodes.push_back(Node());
+        buildNode(0, 0, count, 1);
+    }
+
+    // triangles in leaf order
+    std::vector<Triangle> triangles(count);
+    std::vector<uint> sources(count);
+    for (uint i = 0; i < count; ++i) {
+        triangles[i] = _triangles[_indexes[i]];
+        sources[i] = _sources[_indexes[i]];
+    }
+    _triangles.swap(triangles);
+    _sources.swap(sources);
+
+    _v0.resize(count);
+    _edge1.resize(count);
+    _edge2.resize(count);
+    for (uint i = 0; i < count; ++i) {
+        _v0[i] = _triangles[i].vertex[0];
+        _edge1[i] = _triangles[i].vertex[1] - _triangles[i].vertex[0];
+        _edge2[i] = _triangles[i].vertex[2] - _triangles[i].vertex[0];
+    }
+
+    std::vector<uint>().swap(_indexes);
+    std::vector<osg::Vec3f>().swap(_centroids);
+}
+
+void TriangleBVH::computeBounds(Node& node, uint first, uint count) const {
+    emptyBounds(node.min, node.max);
+    for (uint i = first; i < first + count; ++i)
+        for (uint j = 0; j < 3; ++j)
+            growBounds(node.min, node.max, _triangles[_indexes[i]].vertex[j]);
+}
+
+void TriangleBVH::buildNode(uint index, uint first, uint count, uint depth) {
+    _depth = std::max(_depth, depth);
+
+    Node node;
+    computeBounds(node, first, count);
+    node.first = first;
+    node.count = count;
+    node.axis = 0;
+
+    if (count <= 2 || depth >= MAX_DEPTH) {
+        _nodes[index] = node;
+        return;
+    }
+
+    float centroidMin[3], centroidMax[3];
+    emptyBounds(centroidMin, centroidMax);
+    for (uint i = first; i < first + count; ++i)
+        growBounds(centroidMin, centroidMax, _centroids[_indexes[i]]);
+
+    // best split of the binned surface area heuristic, relative to the
+    // cost of a leaf (one per triangle)
+    float bestCost = FLT_MAX;
+    uint bestAxis = 0, bestSplit = 0;
+    float nodeArea = std::max(halfArea(node.min, node.max), FLT_MIN);
+
+    for (uint axis = 0; axis < 3; ++axis) {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        if (!(extent > 0))
+            continue;
+
+        CentroidBin bin(_centroids, axis, centroidMin[axis], NUM_BINS / extent);
+        uint binCount[NUM_BINS] = {0};
+        float binMin[NUM_BINS][3], binMax[NUM_BINS][3];
+        for (uint b = 0; b < NUM_BINS; ++b)
+            emptyBounds(binMin[b], binMax[b]);
+
+        for (uint i = first; i < first + count; ++i) {
+            uint triangle = _indexes[i], b = bin(triangle);
+            ++binCount[b];
+            for (uint j = 0; j < 3; ++j)
+                growBounds(binMin[b], binMax[b], _triangles[triangle].vertex[j]);
+        }
+
+        // areas and counts on the left of each split, then sweep from the right
+        float leftArea[NUM_BINS];
+        uint leftCount[NUM_BINS];
+        float min[3], max[3];
+        emptyBounds(min, max);
+        uint sum = 0;
+        for (uint b = 0; b < NUM_BINS - 1; ++b) {
+            sum += binCount[b];
+            if (binCount[b]) {
+                growBounds(min, max, osg::Vec3f(binMin[b][0], binMin[b][1], binMin[b][2]));
+                growBounds(min, max, osg::Vec3f(binMax[b][0], binMax[b][1], binMax[b][2]));
+            }
+            leftCount[b] = sum;
+            leftArea[b] = sum ? halfArea(min, max) : 0;
+        }
+
+        emptyBounds(min, max);
+        sum = 0;
+        for (uint b = NUM_BINS - 1; b > 0; --b) {
+            sum += binCount[b];
+            if (binCount[b]) {
+                growBounds(min, max, osg::Vec3f(binMin[b][0], binMin[b][1], binMin[b][2]));
+                growBounds(min, max, osg::Vec3f(binMax[b][0], binMax[b][1], binMax[b][2]));
+            }
+            uint split = b - 1;
+            if (!sum || !leftCount[split])
+                continue;
+
+            float cost = 1 + (leftCount[split] * leftArea[split] + sum * halfArea(min, max)) / nodeArea;
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    if (bestCost >= count && count <= MAX_LEAF_SIZE) {
+        _nodes[index] = node;
+        return;
+    }
+
+    uint middle = first + count / 2;
+    if (bestCost < FLT_MAX) {
+        CentroidBin bin(_centroids, bestAxis, centroidMin[bestAxis],
+                        NUM_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]));
+        middle = std::partition(_indexes.begin() + first,
+                                _indexes.begin() + first + count,
+                                LeftOfSplit(bin, bestSplit)) - _indexes.begin();
+    }
+
+    // same centroids: splits by index
+    if (middle == first || middle == first + count)
+        middle = first + count / 2;
+
+    uint left = _nodes.size();
+    _nodes.push_back(Node());
+    _nodes.push_back(Node());
+
+    node.first = left;
+    node.count = 0;
+    node.axis = bestAxis;
+    _nodes[index] = node;
+
+    buildNode(left, first, middle - first, depth + 1);
+    buildNode(left + 1, middle, first + count - middle, depth + 1);
+}
+
+void TriangleBVH::setTriangle(  uint index, const osg::Vec3f *vertexes,
+                                const osg::Vec3f *normals) {
+    Triangle& triangle = _triangles[index];
+    for (uint i = 0; i < 3; ++i) {
+        triangle.vertex[i] = vertexes[i];
+        triangle.normal[i] = normals[i];
+    }
+    _v0[index] = vertexes[0];
+    _edge1[index] = vertexes[1] - vertexes[0];
+    _edge2[index] = vertexes[2] - vertexes[0];
+}
+
+void TriangleBVH::refit() {
+    // the children are always after their parent
+    for (uint i = _nodes.size(); i-- > 0;) {
+        Node& node = _nodes[i];
+        emptyBounds(node.min, node.max);
+
+        if (node.count) {
+            for (uint j = node.first; j < node.first + node.count; ++j)
+                for (uint k = 0; k < 3; ++k)
+                    growBounds(node.min, node.max, _triangles[j].vertex[k]);
+            continue;
+        }
+
+        for (uint j = node.first; j < node.first + 2; ++j) {
+            growBounds(node.min, node.max, osg::Vec3f(_nodes[j].min[0], _nodes[j].min[1], _nodes[j].min[2]));
+            growBounds(node.min, node.max, osg::Vec3f(_nodes[j].max[0], _nodes[j].max[1], _nodes[j].max[2]));
+        }
+    }
+}
+
+double TriangleBVH::getTotalArea() const {
+    double area = 0;
+    for (uint i = 0; i < _nodes.size(); ++i)
+        area += halfArea(_nodes[i].min, _nodes[i].max);
+    return area;
+}
+
+void TriangleBVH::intersect(RayPacket& packet) const {
+    if (_nodes.empty())
+        return;
+
+    const uint size = RayPacket::SIZE;
+    float ix[size], iy[size], iz[size];
+    for (uint i = 0; i < size; ++i) {
+        ix[i] = 1.0f / packet.dx[i];
+        iy[i] = 1.0f / packet.dy[i];
+        iz[i] = 1.0f / packet.dz[i];
+    }
+
+    // children are visited near first, by the direction of the first lane
+    uint negative[3] = {packet.dx[0] < 0, packet.dy[0] < 0, packet.dz[0] < 0};
+
+    uint stack[MAX_DEPTH * 2];
+    uint stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize) {
+        const Node& node = _nodes[stack[--stackSize]];
+
+        // slab test of all lanes, against the nearest hit so far
+        int hit = 0;
+        for (uint i = 0; i < size; ++i) {
+            float x0 = (node.min[0] - packet.ox[i]) * ix[i];
+            float x1 = (node.max[0] - packet.ox[i]) * ix[i];
+            float y0 = (node.min[1] - packet.oy[i]) * iy[i];
+            float y1 = (node.max[1] - packet.oy[i]) * iy[i];
+            float z0 = (node.min[2] - packet.oz[i]) * iz[i];
+            float z1 = (node.max[2] - packet.oz[i]) * iz[i];
+            float tNear = std::max(std::max(std::min(x0, x1), std::min(y0, y1)),
+                                  std::max(std::min(z0, z1), 0.0f));
+            float tFar = std::min(std::min(std::max(x0, x1), std::max(y0, y1)),
+                                 std::min(std::max(z0, z1), packet.t[i]));
+            hit |= tNear <= tFar;
+        }
+        if (!hit)
+            continue;
+
+        if (node.count == 0) {
+            uint nearChild = node.first + negative[node.axis];
+            stack[stackSize++] = node.first + !negative[node.axis];
+            stack[stackSize++] = nearChild;
+            continue;
+        }
+
+        // Moller-Trumbore test of all lanes, two-sided as the rasterizer
+        for (uint j = node.first; j < node.first + node.count; ++j) {
+            const osg::Vec3f& v0 = _v0[j];
+            const osg::Vec3f& e1 = _edge1[j];
+            const osg::Vec3f& e2 = _edge2[j];
+
+            for (uint i = 0; i < size; ++i) {
+                float px = packet.dy[i] * e2.z() - packet.dz[i] * e2.y();
+                float py = packet.dz[i] * e2.x() - packet.dx[i] * e2.z();
+                float pz = packet.dx[i] * e2.y() - packet.dy[i] * e2.x();
+                float det = e1.x() * px + e1.y() * py + e1.z() * pz;
+                float inverse = 1.0f / det;
+
+                float tx = packet.ox[i] - v0.x();
+                float ty = packet.oy[i] - v0.y();
+                float tz = packet.oz[i] - v0.z();
+                float u = (tx * px + ty * py + tz * pz) * inverse;
+
+                float qx = ty * e1.z() - tz * e1.y();
+                float qy = tz * e1.x() - tx * e1.z();
+                float qz = tx * e1.y() - ty * e1.x();
+                float v = (packet.dx[i] * qx + packet.dy[i] * qy + packet.dz[i] * qz) * inverse;
+                float t = (e2.x() * qx + e2.y() * qy + e2.z() * qz) * inverse;
+
+                bool closer = u >= 0 && v >= 0 && u + v <= 1 && t > 0 && t < packet.t[i];
+                packet.t[i] = closer ? t : packet.t[i];
+                packet.u[i] = closer ? u : packet.u[i];
+                packet.v[i] = closer ? v : packet.v[i];
+                packet.triangle[i] = closer ? (int) j : packet.triangle[i];
+            }
+        }
+    }
+}
+
+int TriangleBVH::intersect( const osg::Vec3f& origin, const osg::Vec3f& direction,
+                            float maxDistance, float& distance,
+                            float& u, float& v) const {
+    RayPacket packet;
+    packet.setRay(0, origin, direction, maxDistance);
+    intersect(packet);
+
+    distance = packet.t[0];
+    u = packet.u[0];
+    v = packet.v[0];
+    return packet.triangle[0];
+}
+
+osg::Vec3f TriangleBVH::getNormal(uint triangle, float u, float v) const {
+    const osg::Vec3f *normal = _triangles[triangle].normal;
+    osg::Vec3f result = normal[0] * (1 - u - v) + normal[1] * u + normal[2] * v;
+    result.normalize();
+    return result;
+}
+
+} /* namespace normal_depth_map */
@@ -0,0 +1,169 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_TRIANGLEBVH_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_TRIANGLEBVH_HPP_
+
+#include <vector>
+#include <sys/types.h>
+
+#include <osg/Vec3f>
+
+namespace normal_depth_map {
+
+/**
+ * @brief Group of rays traced together through the BVH
+ *
+ *  The rays are stored by component (structure of arrays) and every lane
+ *  loop has a fixed trip count, so the compiler vectorizes the box and
+ *  triangle tests. The rays of a packet should be coherent (e.g. a block of
+ *  neighbour pixels) to share the traversal.
+ *
+ *  @param t: on input the maximum distance, on output the distance of the
+ *   nearest hit (unchanged on a miss)
+ *  @param triangle: index of the hit triangle, or -1
+ *  @param u, v: barycentric coordinates of the hit on the triangle
+ */
+struct RayPacket {
+    static const uint SIZE = 8;
+
+    RayPacket();
+
+    // sets a lane, the direction does not need to be normalized
+    void setRay(uint lane, const osg::Vec3f& origin, const osg::Vec3f& direction,
+                float maxDistance);
+
+    float ox[SIZE], oy[SIZE], oz[SIZE];
+    float dx[SIZE], dy[SIZE], dz[SIZE];
+    float t[SIZE];
+    int triangle[SIZE];
+    float u[SIZE], v[SIZE];
+};
+
+/**
+ * @brief Bounding volume hierarchy of triangles, for CPU ray casting
+ *
+ *  It is built top-down with the surface area heuristic, evaluated on a
+ *  fixed number of bins of the triangle centroids on each axis. The nodes
+ *  are stored depth-first in one array, the two children of a node side by
+ *  side, and the triangles are reordered by leaf.
+ */
+class TriangleBVH {
+public:
+
+    // triangle with its vertex normals and the material of the shader
+    struct Triangle {
+        osg::Vec3f vertex[3];
+        osg::Vec3f normal[3];
+        float reflectance;
+        uint objectId;
+    };
+
+    struct Node {
+        float min[3];
+        float max[3];
+        uint first;     // first triangle of a leaf, or left child
+        uint count;     // number of triangles, 0 on inner nodes
+        uint axis;      // split axis of inner nodes
+    };
+
+    static const uint NUM_BINS = 16;
+    static const uint MAX_LEAF_SIZE = 8;
+
+    TriangleBVH();
+
+    void clear();
+
+    /**
+     * @brief Adds a triangle, used on the next build
+     *
+     *  @param reflectance: as the reflectance uniform of the shader (0 keeps
+     *   the normal)
+     */
+    void addTriangle(   const osg::Vec3f& v0, const osg::Vec3f& v1, const osg::Vec3f& v2,
+                        const osg::Vec3f& n0, const osg::Vec3f& n1, const osg::Vec3f& n2,
+                        float reflectance = 0, uint objectId = 0);
+
+    // adds a triangle with its face normal on the three vertices
+    void addTriangle(   const osg::Vec3f& v0, const osg::Vec3f& v1, const osg::Vec3f& v2,
+                        float reflectance = 0, uint objectId = 0);
+
+    /**
+     * @brief Builds the hierarchy of the added triangles
+     *
+     *  The triangle indexes change after the build.
+     */
+    void build();
+
+    /**
+     * @brief Moves a triangle, without changing the hierarchy
+     *
+     *  The bounds are only updated by refit().
+     *
+     *  @param index: triangle index after the build
+     */
+    void setTriangle(   uint index, const osg::Vec3f *vertexes,
+                        const osg::Vec3f *normals);
+
+    /**
+     * @brief Updates the node bounds to the current triangles, bottom-up
+     *
+     *  It is much faster than a build, but the hierarchy gets worse when
+     *  the triangles move far from their place at the build (see
+     *  getTotalArea).
+     */
+    void refit();
+
+    /**
+     * @brief Sum of the node surfaces, the traversal cost of the hierarchy
+     *  up to a constant
+     */
+    double getTotalArea() const;
+
+    /**
+     * @brief Finds the nearest hit of each ray of the packet
+     */
+    void intersect(RayPacket& packet) const;
+
+    /**
+     * @brief Finds the nearest hit of one ray
+     *
+     *  @return the triangle index, or -1 if there is no hit before maxDistance
+     */
+    int intersect(  const osg::Vec3f& origin, const osg::Vec3f& direction,
+                    float maxDistance, float& distance, float& u, float& v) const;
+
+    // normal interpolated on a hit, normalized
+    osg::Vec3f getNormal(uint triangle, float u, float v) const;
+
+    const Triangle& getTriangle(uint index) const { return _triangles[index]; }
+
+    // order of addTriangle of a triangle, which does not change on builds
+    uint getSourceIndex(uint index) const { return _sources[index]; }
+
+    uint getNumTriangles() const { return _triangles.size(); }
+    uint getNumNodes() const { return _nodes.size(); }
+    uint getDepth() const { return _depth; }
+
+    const Node& getNode(uint index) const { return _nodes[index]; }
+
+private:
+    void buildNode(uint index, uint first, uint count, uint depth);
+    void computeBounds(Node& node, uint first, uint count) const;
+
+    std::vector<Triangle> _triangles;
+    std::vector<uint> _sources;
+    std::vector<Node> _nodes;
+
+    // build data, by triangle
+    std::vector<uint> _indexes;
+    std::vector<osg::Vec3f> _centroids;
+
+    // triangles in the edge form of the intersection test
+    std::vector<osg::Vec3f> _v0;
+    std::vector<osg::Vec3f> _edge1;
+    std::vector<osg::Vec3f> _edge2;
+
+    uint _depth;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_TRIANGLEBVH_HPP_ */
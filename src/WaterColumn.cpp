@@ -0,0 +1,120 @@
+#include "WaterColumn.hpp"
+
+#include "Tools.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace normal_depth_map {
+
+namespace {
+
+// trapezoidal rule, on steps per meter
+double integrateAttenuation(const WaterColumnProfile& profile, double frequency,
+                            double from, double to, double steps) {
+    uint count = std::max(1.0, ceil(fabs(to - from) * steps));
+    double step = (to - from) / count, sum = 0;
+    double previous = profile.getAttenuation(frequency, from);
+    for (uint i = 1; i <= count; ++i) {
+        double value = profile.getAttenuation(frequency, from + i * step);
+        sum += 0.5 * step * (previous + value);
+        previous = value;
+    }
+    return sum;
+}
+
+}
+
+WaterSample::WaterSample()
+    : depth(0), temperature(20), salinity(35), acidity(8.1) {}
+
+WaterSample::WaterSample(double depth, double temperature, double salinity, double acidity)
+    : depth(depth), temperature(temperature), salinity(salinity), acidity(acidity) {}
+
+WaterColumnProfile::WaterColumnProfile(const std::vector<WaterSample>& samples)
+    : _samples(samples) {
+
+    if (samples.empty())
+        throw std::invalid_argument("WaterColumnProfile: needs at least one sample");
+    for (uint i = 1; i < samples.size(); ++i)
+        if (!(samples[i].depth > samples[i - 1].depth))
+            throw std::invalid_argument("WaterColumnProfile: the samples must be sorted by depth");
+}
+
+WaterSample WaterColumnProfile::getSample(double depth) const {
+    if (depth <= _samples.front().depth)
+        return _samples.front();
+    if (depth >= _samples.back().depth)
+        return _samples.back();
+
+    uint i = 1;
+    while (_samples[i].depth < depth)
+        ++i;
+
+    const WaterSample& above = _samples[i - 1];
+    const WaterSample& below = _samples[i];
+    double weight = (depth - above.depth) / (below.depth - above.depth);
+    return WaterSample(depth,
+                       above.temperature + weight * (below.temperature - above.temperature),
+                       above.salinity + weight * (below.salinity - above.salinity),
+                       above.acidity + weight * (below.acidity - above.acidity));
+}
+
+double WaterColumnProfile::getAttenuation(double frequency, double depth) const {
+    WaterSample sample = getSample(depth);
+    return underwaterSignalAttenuation(frequency, sample.temperature, std::max(depth, 0.0),
+                                       sample.salinity, sample.acidity);
+}
+
+double WaterColumnProfile::getSoundSpeed(double depth) const {
+    WaterSample sample = getSample(depth);
+    return underwaterSoundSpeed(sample.temperature, std::max(depth, 0.0), sample.salinity);
+}
+
+double WaterColumnProfile::getCumulativeAttenuation(double frequency, double depth,
+                                                    double steps) const {
+    if (!(depth > 0))
+        return 0;
+    return integrateAttenuation(*this, frequency, 0, depth, steps);
+}
+
+double WaterColumnProfile::getPathAttenuation(double frequency, double depth0,
+                                              double depth1) const {
+    depth0 = std::max(depth0, 0.0);
+    depth1 = std::max(depth1, 0.0);
+    if (fabs(depth1 - depth0) < 1e-6)
+        return getAttenuation(frequency, depth0);
+
+    return integrateAttenuation(*this, frequency, depth0, depth1, 4) / (depth1 - depth0);
+}
+
+void WaterColumnProfile::sampleAttenuation( double frequency, double maxDepth,
+                                            uint depthSamples,
+                                            std::vector<double>& attenuation,
+                                            std::vector<double>& cumulative) const {
+    if (depthSamples < 2 || !(maxDepth > 0))
+        throw std::invalid_argument("WaterColumnProfile: needs 2 depth samples and a positive depth");
+
+    double depthStep = maxDepth / (depthSamples - 1);
+    uint subSteps = std::max(1.0, ceil(depthStep * 4));
+    double subStep = depthStep / subSteps;
+
+    attenuation.resize(depthSamples);
+    cumulative.resize(depthSamples);
+    attenuation[0] = getAttenuation(frequency, 0);
+    cumulative[0] = 0;
+
+    for (uint i = 1; i < depthSamples; ++i) {
+        double sum = 0, previous = attenuation[i - 1];
+        for (uint j = 1; j <= subSteps; ++j) {
+            double value = getAttenuation(frequency, (i - 1) * depthStep + j * subStep);
+            sum += 0.5 * subStep * (previous + value);
+            previous = value;
+        }
+        attenuation[i] = previous;
+        cumulative[i] = cumulative[i - 1] + sum;
+    }
+}
+
+} /* namespace normal_depth_map */
@@ -0,0 +1,87 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_WATERCOLUMN_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_WATERCOLUMN_HPP_
+
+#include <vector>
+#include <sys/types.h>
+
+namespace normal_depth_map {
+
+/**
+ * @brief Water properties measured at one depth (e.g. a CTD cast sample)
+ */
+struct WaterSample {
+    WaterSample();
+    WaterSample(double depth, double temperature, double salinity, double acidity);
+
+    double depth;           // meters below the surface
+    double temperature;     // Celsius degrees
+    double salinity;        // ppt
+    double acidity;         // pH
+};
+
+/**
+ * @brief Water properties varying with the depth
+ *
+ *  The samples are interpolated linearly between their depths, and kept
+ *  constant above the first one and below the last one. The attenuation
+ *  and the sound speed come from underwaterSignalAttenuation and
+ *  underwaterSoundSpeed.
+ *
+ *  For a straight path, the attenuation only depends on the depths of its
+ *  ends: the integral of the coefficient along the path is the range times
+ *  the mean coefficient between the two depths, which comes from the
+ *  cumulative attenuation from the surface (see
+ *  NormalDepthMap::setWaterColumn).
+ */
+class WaterColumnProfile {
+public:
+
+    /**
+     *  @param samples: sorted by increasing depth; it throws
+     *   std::invalid_argument if empty or unsorted.
+     */
+    WaterColumnProfile(const std::vector<WaterSample>& samples);
+
+    // properties interpolated at a depth
+    WaterSample getSample(double depth) const;
+
+    // attenuation coefficient, in Pa/m, of a frequency in kHz
+    double getAttenuation(double frequency, double depth) const;
+
+    // sound speed, in m/s
+    double getSoundSpeed(double depth) const;
+
+    /**
+     * @brief Integral of the attenuation coefficient from the surface to a
+     *  depth, in Pa
+     *
+     *  @param steps: integration steps per meter
+     */
+    double getCumulativeAttenuation(double frequency, double depth, double steps = 4) const;
+
+    /**
+     * @brief Mean attenuation coefficient of a straight path between two
+     *  depths
+     */
+    double getPathAttenuation(double frequency, double depth0, double depth1) const;
+
+    /**
+     * @brief Samples the attenuation and its cumulative integral on a
+     *  regular depth grid
+     *
+     *  @param depthSamples: number of depths, from 0 to maxDepth
+     *  @param attenuation, cumulative: receive depthSamples values each
+     */
+    void sampleAttenuation( double frequency, double maxDepth, uint depthSamples,
+                            std::vector<double>& attenuation,
+                            std::vector<double>& cumulative) const;
+
+    const std::vector<WaterSample>& getSamples() const { return _samples; }
+
+private:
+    std::vector<WaterSample> _samples;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_WATERCOLUMN_HPP_ */
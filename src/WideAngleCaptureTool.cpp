@@ -0,0 +1,159 @@
+#include "WideAngleCaptureTool.hpp"
+
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/Program>
+#include <osg/Shader>
+#include <osgDB/FileUtils>
+
+#include <cmath>
+#include <stdexcept>
+
+namespace normal_depth_map {
+
+#define SHADER_PATH_SCREEN_QUAD_VERT "normal_depth_map/shaders/screenQuad.vert"
+#define SHADER_PATH_RESAMPLE_FRAG "normal_depth_map/shaders/wideAngleResample.frag"
+
+WideAngleCaptureTool::WideAngleCaptureTool( double fovX, double fovY,
+                                            uint width, uint height,
+                                            uint numFaces)
+    : _fov_x(fovX) {
+
+    if (!width || !height)
+        throw std::invalid_argument("WideAngleCaptureTool: empty output");
+    if (!(fovX > 0 && fovX <= 2 * M_PI) || !(fovY > 0 && fovY < M_PI))
+        throw std::invalid_argument("WideAngleCaptureTool: invalid field of view");
+
+    if (!numFaces)
+        numFaces = ceil(fovX / (M_PI * 0.5) - 1e-9);
+
+    // a face must stay far from 180 degrees
+    double faceFov = fovX / numFaces;
+    if (faceFov > M_PI * 0.75)
+        throw std::invalid_argument("WideAngleCaptureTool: too few faces");
+
+    // face apertures: the corners of a face reach the top elevation
+    double tanHalfX = tan(faceFov * 0.5);
+    double tanHalfY = tan(fovY * 0.5) / cos(faceFov * 0.5);
+
+    // the face pixels at the center are at least as small as the beams
+    _face_width = ceil((double) width / numFaces * tanHalfX / (faceFov * 0.5));
+    _face_height = ceil(height * 2 * tanHalfY / fovY);
+
+    // hidden viewer: the cameras render in textures, the window is not used
+    _viewer = new osgViewer::Viewer;
+    _viewer->setThreadingModel(osgViewer::Viewer::SingleThreaded);
+
+    osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits;
+    traits->width = 1;
+    traits->height = 1;
+    traits->pbuffer = true;
+    traits->readDISPLAY();
+
+    osg::ref_ptr<osg::GraphicsContext> gfxc = osg::GraphicsContext::createGraphicsContext(traits.get());
+    osg::ref_ptr<osg::Camera> camera = _viewer->getCamera();
+    camera->setGraphicsContext(gfxc);
+    camera->setViewport(new osg::Viewport(0, 0, 1, 1));
+    camera->setClearMask(0);
+
+    _scene = new osg::Group();
+    osg::ref_ptr<osg::Group> root = new osg::Group();
+
+    _faces = new osg::Texture2DArray();
+    _faces->setTextureSize(_face_width, _face_height, numFaces);
+    _faces->setInternalFormat(GL_RGBA32F_ARB);
+    _faces->setSourceFormat(GL_RGBA);
+    _faces->setSourceType(GL_FLOAT);
+    _faces->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+    _faces->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+    _faces->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    _faces->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+
+    // one camera per face, each one with its own frustum culling
+    double near = 0.1;
+    for (uint i = 0; i < numFaces; ++i) {
+        osg::ref_ptr<osg::Camera> face = new osg::Camera();
+        face->setReferenceFrame(osg::Transform::ABSOLUTE_RF);
+        face->setRenderOrder(osg::Camera::PRE_RENDER, 0);
+        face->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+        face->attach(osg::Camera::COLOR_BUFFER0, _faces.get(), 0, i);
+        face->setViewport(0, 0, _face_width, _face_height);
+        face->setClearColor(osg::Vec4(0, 0, 0, 0));
+        face->setClearMask(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        face->setComputeNearFarMode(osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR);
+        face->setProjectionMatrixAsFrustum( -near * tanHalfX, near * tanHalfX,
+                                            -near * tanHalfY, near * tanHalfY,
+                                            near, 1000);
+        face->addChild(_scene);
+        root->addChild(face);
+        _face_cameras.push_back(face);
+    }
+
+    // equiangular resample, read back in the output image
+    _image = new osg::Image();
+    _image->allocateImage(width, height, 1, GL_RGB, GL_FLOAT);
+    _image->setInternalTextureFormat(GL_RGB32F_ARB);
+
+    osg::ref_ptr<osg::Camera> resample = new osg::Camera();
+    resample->setReferenceFrame(osg::Transform::ABSOLUTE_RF);
+    resample->setRenderOrder(osg::Camera::PRE_RENDER, 1);
+    resample->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+    resample->attach(osg::Camera::COLOR_BUFFER0, _image.get());
+    resample->setViewport(0, 0, width, height);
+    resample->setProjectionMatrix(osg::Matrix::identity());
+    resample->setViewMatrix(osg::Matrix::identity());
+    resample->setClearMask(0);
+
+    osg::ref_ptr<osg::Geode> quad = new osg::Geode();
+    quad->addDrawable(osg::createTexturedQuadGeometry(  osg::Vec3(-1, -1, 0),
+                                                        osg::Vec3(2, 0, 0),
+                                                        osg::Vec3(0, 2, 0)));
+    resample->addChild(quad);
+
+    osg::ref_ptr<osg::Program> program = new osg::Program();
+    program->addShader(osg::Shader::readShaderFile(osg::Shader::VERTEX, osgDB::findDataFile(SHADER_PATH_SCREEN_QUAD_VERT)));
+    program->addShader(osg::Shader::readShaderFile(osg::Shader::FRAGMENT, osgDB::findDataFile(SHADER_PATH_RESAMPLE_FRAG)));
+
+    osg::ref_ptr<osg::StateSet> ss = quad->getOrCreateStateSet();
+    ss->setAttribute(program);
+    ss->setMode(GL_DEPTH_TEST, osg::StateAttribute::OFF);
+    ss->setTextureAttribute(0, _faces);
+    ss->addUniform(new osg::Uniform("faces", 0));
+    ss->addUniform(new osg::Uniform("numFaces", (int) numFaces));
+    ss->addUniform(new osg::Uniform("fovX", (float) fovX));
+    ss->addUniform(new osg::Uniform("fovY", (float) fovY));
+    ss->addUniform(new osg::Uniform("faceTanHalf", osg::Vec2f(tanHalfX, tanHalfY)));
+    ss->addUniform(new osg::Uniform("outputSize", osg::Vec2f(width, height)));
+    root->addChild(resample);
+
+    _viewer->setSceneData(root);
+}
+
+WideAngleCaptureTool::~WideAngleCaptureTool() {}
+
+osg::ref_ptr<osg::Image> WideAngleCaptureTool::grabImage(osg::ref_ptr<osg::Node> node) {
+    if (_scene->getNumChildren() != 1 || _scene->getChild(0) != node.get()) {
+        _scene->removeChildren(0, _scene->getNumChildren());
+        _scene->addChild(node);
+    }
+
+    // the faces turn around the vertical axis of the view
+    uint numFaces = _face_cameras.size();
+    double faceFov = _fov_x / numFaces;
+    for (uint i = 0; i < numFaces; ++i) {
+        double azimuth = -0.5 * _fov_x + (i + 0.5) * faceFov;
+        _face_cameras[i]->setViewMatrix(_view_matrix * osg::Matrix::rotate(azimuth, osg::Vec3d(0, 1, 0)));
+    }
+
+    // single threaded: the image is read back when frame returns
+    _viewer->frame();
+    return _image;
+}
+
+void WideAngleCaptureTool::setCameraPosition(   const osg::Vec3d& eye,
+                                                const osg::Vec3d& center,
+                                                const osg::Vec3d& up) {
+    _view_matrix.makeLookAt(eye, center, up);
+}
+
+} /* namespace normal_depth_map */
@@ -0,0 +1,80 @@
+#ifndef SIMULATION_NORMAL_DEPTH_MAP_SRC_WIDEANGLECAPTURETOOL_HPP_
+#define SIMULATION_NORMAL_DEPTH_MAP_SRC_WIDEANGLECAPTURETOOL_HPP_
+
+#include <vector>
+
+#include <osg/Camera>
+#include <osg/Image>
+#include <osg/Node>
+#include <osg/Texture2DArray>
+#include <osg/ref_ptr>
+#include <osgViewer/Viewer>
+
+namespace normal_depth_map {
+
+/**
+ * @brief Captures wide fields of view, up to 360 degrees, with an
+ *  equiangular beam layout
+ *
+ *  A single perspective projection can not go near 180 degrees, and its
+ *  resolution per beam decreases from the center to the borders. This tool
+ *  renders the scene in several narrower faces side by side in azimuth
+ *  (each one culls the scene with its own frustum), and resamples them on
+ *  the GPU so each column of the output is one azimuth and each row one
+ *  elevation, with constant angular steps.
+ *
+ *  The output has the same channels as ImageViewerCaptureTool::grabImage
+ *  (GL_RGB, GL_FLOAT). The scene must be a NormalDepthMap node.
+ */
+class WideAngleCaptureTool {
+public:
+
+    /**
+     * @brief Creates the face cameras and the resample pass
+     *
+     *  @param fovX: horizontal aperture (in radians, up to 2 * PI)
+     *  @param fovY: vertical aperture (in radians, below PI)
+     *  @param width: number of beams (output columns)
+     *  @param height: number of output rows
+     *  @param numFaces: number of faces; 0 uses one face per 90 degrees
+     */
+    WideAngleCaptureTool(   double fovX, double fovY, uint width, uint height,
+                            uint numFaces = 0);
+    ~WideAngleCaptureTool();
+
+    /**
+     * @brief Renders the faces and returns the equiangular image
+     *
+     *  @param node: normal depth map node with the scene
+     */
+    osg::ref_ptr<osg::Image> grabImage(osg::ref_ptr<osg::Node> node);
+
+    // center of the field of view, as ImageViewerCaptureTool
+    void setCameraPosition( const osg::Vec3d& eye, const osg::Vec3d& center,
+                            const osg::Vec3d& up);
+
+    void setViewMatrix(const osg::Matrix& matrix) { _view_matrix = matrix; };
+    osg::Matrix getViewMatrix() const { return _view_matrix; };
+
+    uint getNumFaces() const { return _face_cameras.size(); };
+
+    // face resolution chosen to keep the beam resolution
+    uint getFaceWidth() const { return _face_width; };
+    uint getFaceHeight() const { return _face_height; };
+
+private:
+    double _fov_x;
+    uint _face_width;
+    uint _face_height;
+    osg::Matrix _view_matrix;
+
+    osg::ref_ptr<osgViewer::Viewer> _viewer;
+    osg::ref_ptr<osg::Group> _scene;
+    std::vector<osg::ref_ptr<osg::Camera> > _face_cameras;
+    osg::ref_ptr<osg::Texture2DArray> _faces;
+    osg::ref_ptr<osg::Image> _image;
+};
+
+} /* namespace normal_depth_map */
+
+#endif /* SIMULATION_NORMAL_DEPTH_MAP_SRC_WIDEANGLECAPTURETOOL_HPP_ */
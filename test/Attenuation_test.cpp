@@ -1,5 +1,7 @@
 // C++ includes
 #include <iostream>
+#include <stdexcept>
+#include <vector>
 
 // Rock includes
 #include <normal_depth_map/Tools.hpp>
@@ -24,6 +26,82 @@ BOOST_AUTO_TEST_CASE(attenuationCalculation_testCase){
     BOOST_CHECK_CLOSE(attenuationCoeff, 0.0247, 3);
 }
 
+BOOST_AUTO_TEST_CASE(attenuationBatch_testCase){
+    // sweep over the sensor frequencies and the vehicle depths
+    std::vector<double> frequency, temperature, depth, salinity, acidity;
+    for (uint i = 0; i < 1000; ++i) {
+        frequency.push_back(10 + i);
+        temperature.push_back(5 + (i % 25));
+        depth.push_back(i * 5.0);
+        salinity.push_back(i % 40);
+        acidity.push_back(7.5 + (i % 10) * 0.1);
+    }
+
+    std::vector<double> attenuation(frequency.size());
+    underwaterSignalAttenuation(&frequency[0], &temperature[0], &depth[0],
+                                &salinity[0], &acidity[0], &attenuation[0],
+                                attenuation.size());
+
+    for (uint i = 0; i < attenuation.size(); ++i) {
+        double expected = underwaterSignalAttenuation(frequency[i], temperature[i], depth[i], salinity[i], acidity[i]);
+        BOOST_CHECK_CLOSE(attenuation[i], expected, 1e-9);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(attenuationBatchRange_testCase){
+    std::vector<double> frequency, temperature, depth, salinity, acidity;
+    for (uint i = 0; i < (1 << 18); ++i) {
+        frequency.push_back(1 + i % 2000);
+        temperature.push_back(-2.0 + i % 33);
+        depth.push_back(i % 8000);
+        salinity.push_back(i % 41);
+        acidity.push_back(7 + (i % 15) * 0.1);
+    }
+    std::vector<double> batch(frequency.size());
+
+    // the vector lanes over the whole range of the inputs (the speed is
+    // measured by the benchmark target)
+    underwaterSignalAttenuation(&frequency[0], &temperature[0], &depth[0],
+                                &salinity[0], &acidity[0], &batch[0],
+                                batch.size());
+    for (uint i = 0; i < batch.size(); i += 97) {
+        double expected = underwaterSignalAttenuation(frequency[i], temperature[i], depth[i], salinity[i], acidity[i]);
+        BOOST_CHECK_CLOSE(batch[i], expected, 1e-9);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(attenuationTable_testCase){
+    double temperature = 20.0;  // celsius degrees
+    double salinity = 35;       // ppt
+    double acidity = 8.1;       // pH
+
+    AttenuationTable table(temperature, salinity, acidity, 1, 100, 64, 100, 1000, 64);
+    BOOST_CHECK_LT(table.getMaxRelativeError(), 0.01);
+
+    // exact on the grid nodes
+    BOOST_CHECK_CLOSE(table.lookup(100, 1), underwaterSignalAttenuation(100, temperature, 1, salinity, acidity), 1e-9);
+    BOOST_CHECK_CLOSE(table.lookup(1000, 100), underwaterSignalAttenuation(1000, temperature, 100, salinity, acidity), 1e-9);
+
+    // clamped out of the grid
+    BOOST_CHECK_CLOSE(table.lookup(2000, 500), table.lookup(1000, 100), 1e-9);
+
+    // inside the measured bound (with a small margin between sub-samples)
+    std::vector<double> frequency, depth;
+    for (uint i = 0; i < 997; ++i) {
+        frequency.push_back(100 + (i * 7919 % 997) * 900.0 / 997);
+        depth.push_back(1 + i * 99.0 / 997);
+    }
+    std::vector<double> attenuation(frequency.size());
+    table.lookup(&frequency[0], &depth[0], &attenuation[0], attenuation.size());
+
+    for (uint i = 0; i < attenuation.size(); ++i) {
+        double exact = underwaterSignalAttenuation(frequency[i], temperature, depth[i], salinity, acidity);
+        BOOST_CHECK_LE(fabs(attenuation[i] - exact) / exact, table.getMaxRelativeError() * 1.1);
+    }
+
+    BOOST_CHECK_THROW(AttenuationTable(temperature, salinity, acidity, 1, 100, 1, 100, 1000, 64), std::invalid_argument);
+}
+
 void getReferencePoints(std::vector<cv::Mat>& referencePoints) {
     cv::Mat view1 = cv::Mat::zeros(cv::Size(4,4), CV_32FC1);
     view1.at<float>(0,0) = 0.1019;
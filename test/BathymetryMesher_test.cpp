@@ -0,0 +1,184 @@
+// C++ includes
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+// Rock includes
+#include <normal_depth_map/BathymetryMesher.hpp>
+
+// OSG includes
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/Math>
+
+#define BOOST_TEST_MODULE "BathymetryMesher_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_BathymetryMesher)
+
+float seabed(uint x, uint y) {
+    return -30 + 5 * sin(x * 0.05) * cos(y * 0.07) + 0.3 * sin(x * 0.9 + y * 1.3);
+}
+
+// seabed of 257x257 samples, without data at (100, 100)
+osg::ref_ptr<BathymetryGrid> makeGrid() {
+    osg::ref_ptr<BathymetryGrid> grid = new BathymetryGrid(257, 257, 1);
+    for (uint y = 0; y < 257; ++y)
+        for (uint x = 0; x < 257; ++x)
+            grid->setElevation(x, y, seabed(x, y));
+    grid->setElevation(100, 100, NAN);
+    return grid;
+}
+
+// triangles of a geometry, as vertex indexes
+std::vector<uint> getTriangles(osg::Geometry *geometry) {
+    std::vector<uint> triangles;
+    if (!geometry->getNumPrimitiveSets())
+        return triangles;
+
+    osg::DrawElementsUInt *elements = dynamic_cast<osg::DrawElementsUInt*>(geometry->getPrimitiveSet(0));
+    if (elements->getMode() == GL_TRIANGLES)
+        return std::vector<uint>(elements->begin(), elements->end());
+
+    for (uint i = 0; i + 2 < elements->size(); ++i) {
+        uint a = (*elements)[i], b = (*elements)[i + 1], c = (*elements)[i + 2];
+        if (a == b || b == c || a == c)
+            continue;
+        if (i % 2)
+            std::swap(a, b);
+        triangles.push_back(a);
+        triangles.push_back(b);
+        triangles.push_back(c);
+    }
+    return triangles;
+}
+
+// covered area, and the largest distance from the samples to the mesh
+void checkMesh(osg::Geometry *geometry, const BathymetrySource& source,
+               double& area, double& maxError) {
+    const osg::Vec3Array *vertexes = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+    std::vector<uint> triangles = getTriangles(geometry);
+    area = maxError = 0;
+
+    for (uint t = 0; t < triangles.size(); t += 3) {
+        osg::Vec3 a = (*vertexes)[triangles[t]];
+        osg::Vec3 b = (*vertexes)[triangles[t + 1]];
+        osg::Vec3 c = (*vertexes)[triangles[t + 2]];
+
+        // counterclockwise seen from above
+        double doubleArea = (b.x() - a.x()) * (c.y() - a.y()) - (b.y() - a.y()) * (c.x() - a.x());
+        BOOST_REQUIRE_GT(doubleArea, 0);
+        area += doubleArea / 2;
+
+        int minX = std::min(a.x(), std::min(b.x(), c.x())), maxX = std::max(a.x(), std::max(b.x(), c.x()));
+        int minY = std::min(a.y(), std::min(b.y(), c.y())), maxY = std::max(a.y(), std::max(b.y(), c.y()));
+        for (int y = minY; y <= maxY; ++y) {
+            for (int x = minX; x <= maxX; ++x) {
+                double wa = ((b.x() - x) * (c.y() - y) - (b.y() - y) * (c.x() - x)) / doubleArea;
+                double wb = ((c.x() - x) * (a.y() - y) - (c.y() - y) * (a.x() - x)) / doubleArea;
+                double wc = 1 - wa - wb;
+                if (wa < -1e-6 || wb < -1e-6 || wc < -1e-6)
+                    continue;
+
+                double z = wa * a.z() + wb * b.z() + wc * c.z();
+                maxError = std::max(maxError, fabs(z - source.getElevation(x, y)));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mappedBathymetry_TestCase) {
+    osg::ref_ptr<BathymetryGrid> grid = makeGrid();
+    std::string path = "/tmp/BathymetryMesher_test.raw";
+
+    // 4 bytes of header, and -9999 for no data
+    FILE *file = fopen(path.c_str(), "wb");
+    BOOST_REQUIRE(file);
+    int header = 7;
+    fwrite(&header, sizeof(header), 1, file);
+    for (uint y = 0; y < 257; ++y) {
+        for (uint x = 0; x < 257; ++x) {
+            float value = osg::isNaN(grid->getElevation(x, y)) ? -9999 : grid->getElevation(x, y);
+            fwrite(&value, sizeof(value), 1, file);
+        }
+    }
+    fclose(file);
+
+    osg::ref_ptr<MappedBathymetry> mapped = new MappedBathymetry(path, 257, 257, 1, 4, -9999);
+    BOOST_CHECK_EQUAL(mapped->getElevation(3, 200), grid->getElevation(3, 200));
+    BOOST_CHECK_EQUAL(mapped->getElevation(256, 256), grid->getElevation(256, 256));
+    BOOST_CHECK(osg::isNaN(mapped->getElevation(100, 100)));
+
+    BOOST_CHECK_THROW(MappedBathymetry(path, 257, 258, 1, 4), std::runtime_error);
+    BOOST_CHECK_THROW(MappedBathymetry("/nonexistent.raw", 257, 257, 1), std::runtime_error);
+    remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(fullResolutionStrip_TestCase) {
+    osg::ref_ptr<BathymetryGrid> grid = makeGrid();
+    BathymetryMesher mesher(grid);
+    osg::ref_ptr<osg::Geometry> geometry = mesher.createGeometry(0, 0, 256, 256);
+
+    BOOST_REQUIRE_EQUAL(geometry->getNumPrimitiveSets(), 1);
+    BOOST_CHECK_EQUAL(geometry->getPrimitiveSet(0)->getMode(), GL_TRIANGLE_STRIP);
+    BOOST_CHECK_EQUAL(geometry->getVertexArray()->getNumElements(), 257 * 257);
+    BOOST_CHECK_EQUAL(geometry->getNormalArray()->getNumElements(), 257 * 257);
+
+    // two triangles per cell, but the four cells around the sample without data
+    double area, maxError;
+    checkMesh(geometry, *grid, area, maxError);
+    BOOST_CHECK_EQUAL(getTriangles(geometry).size(), 3 * 2 * (256 * 256 - 4));
+    BOOST_CHECK_CLOSE(area, 256 * 256 - 4, 1e-3);
+    BOOST_CHECK_SMALL(maxError, 1e-4);
+}
+
+BOOST_AUTO_TEST_CASE(boundedDecimation_TestCase) {
+    osg::ref_ptr<BathymetryGrid> grid = makeGrid();
+    BathymetryMesher mesher(grid);
+    mesher.setMaxError(0.5);
+    osg::ref_ptr<osg::Geometry> geometry = mesher.createGeometry(0, 0, 256, 256);
+
+    BOOST_REQUIRE_EQUAL(geometry->getNumPrimitiveSets(), 1);
+    BOOST_CHECK_EQUAL(geometry->getPrimitiveSet(0)->getMode(), GL_TRIANGLES);
+    BOOST_CHECK_LT(geometry->getVertexArray()->getNumElements(), 257 * 257 / 4);
+
+    double area, maxError;
+    checkMesh(geometry, *grid, area, maxError);
+    BOOST_CHECK_CLOSE(area, 256 * 256 - 4, 1e-3);
+    BOOST_CHECK_LE(maxError, 0.5 + 1e-4);
+
+    // all border samples are kept, for the neighbour regions
+    const osg::Vec3Array *vertexes = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+    uint borderSamples = 0;
+    for (uint i = 0; i < vertexes->size(); ++i) {
+        osg::Vec3 vertex = (*vertexes)[i];
+        if (vertex.x() == 0 || vertex.y() == 0 || vertex.x() == 256 || vertex.y() == 256)
+            ++borderSamples;
+    }
+    BOOST_CHECK_EQUAL(borderSamples, 4 * 256);
+}
+
+BOOST_AUTO_TEST_CASE(parallelScene_TestCase) {
+    osg::ref_ptr<BathymetryGrid> grid = makeGrid();
+    ThreadPool single(1), pool(4);
+
+    BathymetryMesher serial(grid, &single), parallel(grid, &pool);
+    serial.setMaxError(0.2);
+    parallel.setMaxError(0.2);
+
+    // the same tiles whatever the number of threads
+    osg::ref_ptr<osg::Group> first = serial.createScene(64);
+    osg::ref_ptr<osg::Group> second = parallel.createScene(64);
+    BOOST_REQUIRE_EQUAL(first->getNumChildren(), 16);
+    BOOST_REQUIRE_EQUAL(second->getNumChildren(), 16);
+
+    for (uint i = 0; i < 16; ++i) {
+        osg::Geometry *a = first->getChild(i)->asGroup()->getChild(0)->asGeode()->getDrawable(0)->asGeometry();
+        osg::Geometry *b = second->getChild(i)->asGroup()->getChild(0)->asGeode()->getDrawable(0)->asGeometry();
+        BOOST_CHECK(getTriangles(a) == getTriangles(b));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,79 @@
+// C++ includes
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+// Rock includes
+#include <normal_depth_map/ImageViewerCaptureTool.hpp>
+#include <normal_depth_map/NormalDepthMap.hpp>
+
+// OSG includes
+#include <osg/Geode>
+#include <osg/ShapeDrawable>
+
+#define BOOST_TEST_MODULE "BeamPattern_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_BeamPattern)
+
+// column of the pixel nearest to a horizontal angle
+uint pixelColumn(double angle, double fovX, uint width) {
+    return floor(0.5 * width * (1 + tan(angle) / tan(fovX * 0.5)));
+}
+
+BOOST_AUTO_TEST_CASE(beamPattern_TestCase) {
+    double fovX = M_PI / 3, fovY = M_PI / 3;
+    float limitHorizontal = M_PI / 12, limitVertical = M_PI / 6;
+
+    // wall 10 m in front of the sonar
+    osg::ref_ptr<osg::Geode> wall = new osg::Geode();
+    wall->addDrawable(new osg::ShapeDrawable(new osg::Box(osg::Vec3(0, 0, -10.5), 100, 100, 1)));
+
+    NormalDepthMap normalDepthMap(50, limitHorizontal, limitVertical);
+    normalDepthMap.addNodeChild(wall);
+
+    ImageViewerCaptureTool capture(fovY, fovX, 200);
+    capture.setCameraPosition(osg::Vec3d(), osg::Vec3d(0, 0, -1), osg::Vec3d(0, 1, 0));
+    osg::ref_ptr<osg::Image> image = capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+    osg::ref_ptr<osg::Image> plain = new osg::Image(*image, osg::CopyOp::DEEP_COPY_ALL);
+
+    // gain falling linearly to 0.5 at the horizontal limits
+    uint horizontalSamples = 65, verticalSamples = 2;
+    std::vector<float> gains;
+    for (uint v = 0; v < verticalSamples; ++v)
+        for (uint h = 0; h < horizontalSamples; ++h)
+            gains.push_back(1 - 0.5 * fabs(h / 32.0 - 1));
+
+    BOOST_CHECK_THROW(normalDepthMap.setBeamPattern(gains, 64, 2), std::invalid_argument);
+    normalDepthMap.setBeamPattern(gains, horizontalSamples, verticalSamples);
+    BOOST_CHECK(normalDepthMap.hasBeamPattern());
+    image = capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+
+    uint width = image->s(), row = image->t() / 2;
+    double angles[] = {0, limitHorizontal * 0.5, -limitHorizontal * 0.8};
+    for (uint i = 0; i < 3; ++i) {
+        uint column = pixelColumn(angles[i], fovX, width);
+        double angle = atan(((column + 0.5) / width * 2 - 1) * tan(fovX * 0.5));
+        float *weighted = (float*) image->data(column, row);
+        float *unweighted = (float*) plain->data(column, row);
+        BOOST_CHECK_GT(unweighted[2], 0);
+        BOOST_CHECK_CLOSE(weighted[2] / unweighted[2], 1 - 0.5 * fabs(angle) / limitHorizontal, 1);
+    }
+
+    // out of the limits: no echo, but still a depth
+    uint column = pixelColumn(limitHorizontal * 1.5, fovX, width);
+    float *outside = (float*) image->data(column, row);
+    BOOST_CHECK_GT(((float*) plain->data(column, row))[2], 0);
+    BOOST_CHECK_EQUAL(outside[2], 0);
+    BOOST_CHECK_GT(outside[1], 0);
+
+    normalDepthMap.clearBeamPattern();
+    BOOST_CHECK(!normalDepthMap.hasBeamPattern());
+    image = capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+    BOOST_CHECK_GT(((float*) image->data(column, row))[2], 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,77 @@
+// C++ includes
+#include <iostream>
+#include <vector>
+
+// Rock includes
+#include <normal_depth_map/BeamResolutionCaptureTool.hpp>
+#include <normal_depth_map/NormalDepthMap.hpp>
+
+// OSG includes
+#include <osg/Geode>
+#include <osg/MatrixTransform>
+#include <osg/ShapeDrawable>
+
+#define BOOST_TEST_MODULE "BeamResolutionCaptureTool_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_BeamResolutionCaptureTool)
+
+// number of rows where the beams around a column see an object
+uint rowsWithEcho(osg::ref_ptr<osg::Image> image, uint column) {
+    uint rows = 0;
+    for (int y = 0; y < image->t(); ++y) {
+        bool echo = false;
+        for (uint x = column - 1; x <= column + 1; ++x)
+            echo |= ((float*) image->data(x, y))[1] > 0;
+        rows += echo;
+    }
+    return rows;
+}
+
+BOOST_AUTO_TEST_CASE(thinObjectSupersampling_TestCase) {
+    // vertical rope, thinner than a beam
+    osg::ref_ptr<osg::Geode> rope = new osg::Geode();
+    rope->addDrawable(new osg::ShapeDrawable(new osg::Cylinder(osg::Vec3(0.013, 0, -10), 0.01, 20)));
+    osg::ref_ptr<osg::MatrixTransform> vertical = new osg::MatrixTransform(osg::Matrix::rotate(M_PI / 2, osg::Vec3(1, 0, 0)));
+    vertical->addChild(rope);
+
+    NormalDepthMap normalDepthMap(20, M_PI / 6, M_PI / 6);
+    normalDepthMap.addNodeChild(vertical);
+
+    uint beams = 64, rows = 64;
+    BeamResolutionCaptureTool aliased(M_PI / 6, M_PI / 6, beams, rows, 1);
+    BeamResolutionCaptureTool supersampled(M_PI / 6, M_PI / 6, beams, rows, 8);
+    aliased.setCameraPosition(osg::Vec3d(0, 0, 0), osg::Vec3d(0, 0, -1), osg::Vec3d(0, 1, 0));
+    supersampled.setCameraPosition(osg::Vec3d(0, 0, 0), osg::Vec3d(0, 0, -1), osg::Vec3d(0, 1, 0));
+    BOOST_CHECK_EQUAL(supersampled.getFactor(), 8);
+
+    // the output stays at the beam resolution
+    osg::ref_ptr<osg::Image> image = supersampled.grabImage(normalDepthMap.getNormalDepthMapNode());
+    BOOST_CHECK_EQUAL(image->s(), beams);
+    BOOST_CHECK_EQUAL(image->t(), rows);
+
+    // the supersampled rope is seen on every row; without supersampling it
+    // falls between the pixel centers of the middle beams and is missed
+    BOOST_CHECK_EQUAL(rowsWithEcho(image, beams / 2), rows);
+    BOOST_CHECK_EQUAL(rowsWithEcho(aliased.grabImage(normalDepthMap.getNormalDepthMapNode()), beams / 2), 0);
+
+    // the mean is below the max on partially covered beams
+    supersampled.setFilters(MIN_FILTER, MAX_FILTER);
+    image = supersampled.grabImage(normalDepthMap.getNormalDepthMapNode());
+    std::vector<float> maximum;
+    for (int x = 0; x < image->s(); ++x)
+        maximum.push_back(((float*) image->data(x, rows / 2))[2]);
+
+    supersampled.setFilters(MIN_FILTER, MEAN_FILTER);
+    image = supersampled.grabImage(normalDepthMap.getNormalDepthMapNode());
+    for (int x = 0; x < image->s(); ++x) {
+        float *pixel = (float*) image->data(x, rows / 2);
+        BOOST_CHECK_LE(pixel[2], maximum[x] + 1e-6);
+        if (pixel[1] > 0)
+            BOOST_CHECK_CLOSE(pixel[1] * 20, 10 - 0.01, 1);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,81 @@
+// C++ includes
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+// Rock includes
+#include <normal_depth_map/CaptureStats.hpp>
+
+#define BOOST_TEST_MODULE "CaptureStats_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_CaptureStats)
+
+FrameTimings makeTimings(unsigned int frameNumber, double total) {
+    FrameTimings timings;
+    timings.frameNumber = frameNumber;
+    timings.begin[TOTAL_STAGE] = frameNumber * 0.02;
+    timings.duration[TOTAL_STAGE] = total;
+    timings.begin[CULL_STAGE] = frameNumber * 0.02 + 0.001;
+    timings.duration[CULL_STAGE] = total * 0.25;
+    return timings;
+}
+
+BOOST_AUTO_TEST_CASE(rollingWindow_TestCase) {
+    CaptureStats stats(100);
+    BOOST_CHECK_EQUAL(stats.size(), 0);
+    BOOST_CHECK_THROW(stats.last(), std::out_of_range);
+    BOOST_CHECK_EQUAL(stats.percentile(TOTAL_STAGE, 0.5), -1);
+
+    // the first 50 frames leave the window
+    for (uint i = 1; i <= 150; ++i)
+        stats.add(makeTimings(i, i <= 50 ? 1000.0 : i - 50));
+
+    BOOST_CHECK_EQUAL(stats.size(), 100);
+    BOOST_CHECK_EQUAL(stats.last().frameNumber, 150);
+    BOOST_CHECK(!stats.find(50));
+    BOOST_CHECK(stats.find(51));
+
+    BOOST_CHECK_CLOSE(stats.percentile(TOTAL_STAGE, 0), 1, 1e-9);
+    BOOST_CHECK_CLOSE(stats.percentile(TOTAL_STAGE, 1), 100, 1e-9);
+    BOOST_CHECK_CLOSE(stats.percentile(TOTAL_STAGE, 0.5), 51, 1e-9);
+    BOOST_CHECK_CLOSE(stats.percentile(TOTAL_STAGE, 0.99), 99, 1e-9);
+    BOOST_CHECK_CLOSE(stats.mean(TOTAL_STAGE), 50.5, 1e-9);
+
+    // unknown stages are ignored
+    BOOST_CHECK_EQUAL(stats.percentile(GPU_STAGE, 0.5), -1);
+    BOOST_CHECK_EQUAL(stats.mean(GPU_STAGE), -1);
+
+    stats.clear();
+    BOOST_CHECK_EQUAL(stats.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(chromeTrace_TestCase) {
+    CaptureStats stats(4);
+    stats.add(makeTimings(1, 10));
+    stats.add(makeTimings(2, 12));
+
+    std::string path = "/tmp/capture_stats_trace.json";
+    BOOST_CHECK(stats.writeChromeTrace(path));
+
+    std::ifstream file(path.c_str());
+    std::stringstream content;
+    content << file.rdbuf();
+    std::string trace = content.str();
+
+    // two stages per frame, as complete events in microseconds
+    uint events = 0;
+    for (size_t pos = trace.find("\"ph\":\"X\""); pos != std::string::npos;
+         pos = trace.find("\"ph\":\"X\"", pos + 1))
+        ++events;
+    BOOST_CHECK_EQUAL(events, 4);
+    BOOST_CHECK(trace.find("\"name\":\"cull\"") != std::string::npos);
+    BOOST_CHECK(trace.find("\"ts\":40000,\"dur\":12000") != std::string::npos);
+    unlink(path.c_str());
+
+    BOOST_CHECK(!stats.writeChromeTrace("/nonexistent/trace.json"));
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,114 @@
+// C++ includes
+#include <cmath>
+#include <iostream>
+
+// Rock includes
+#include <normal_depth_map/BathymetryMesher.hpp>
+#include <normal_depth_map/ClipmapTerrain.hpp>
+#include <normal_depth_map/ImageViewerCaptureTool.hpp>
+#include <normal_depth_map/NormalDepthMap.hpp>
+
+#define BOOST_TEST_MODULE "ClipmapTerrain_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_ClipmapTerrain)
+
+// sloped and rippled seabed around 20 m depth, 128 m side
+osg::ref_ptr<BathymetryGrid> makeSeabed() {
+    osg::ref_ptr<BathymetryGrid> grid = new BathymetryGrid(257, 257, 0.5);
+    for (uint y = 0; y < 257; ++y)
+        for (uint x = 0; x < 257; ++x)
+            grid->setElevation(x, y, -20 + 0.02 * x + 0.4 * sin(x * 0.3) * cos(y * 0.2));
+    return grid;
+}
+
+BOOST_AUTO_TEST_CASE(levelLayout_TestCase) {
+    osg::ref_ptr<BathymetryGrid> grid = new BathymetryGrid(1025, 1025, 1, -20);
+    ClipmapTerrain terrain(grid, 100, 64);
+    BOOST_CHECK_EQUAL(terrain.getNumLevels(), 3);
+    BOOST_CHECK_EQUAL(terrain.getSpacing(2), 4);
+
+    terrain.setSonarPosition(osg::Vec3d(500.7, 300.2, -10));
+    for (uint level = 0; level < terrain.getNumLevels(); ++level) {
+        osg::Vec2d min, max;
+        terrain.getLevelExtent(level, min, max);
+
+        // around the sonar, with a border on the vertexes of the next level
+        float spacing = terrain.getSpacing(level);
+        BOOST_CHECK_LT(min.x(), 500.7 - 30 * spacing);
+        BOOST_CHECK_GT(max.y(), 300.2 + 30 * spacing);
+        BOOST_CHECK_SMALL(fmod(min.x(), 2 * spacing), 1e-6);
+        BOOST_CHECK_SMALL(fmod(max.y(), 2 * spacing), 1e-6);
+
+        // inside the next level
+        if (level + 1 < terrain.getNumLevels()) {
+            osg::Vec2d nextMin, nextMax;
+            terrain.getLevelExtent(level + 1, nextMin, nextMax);
+            BOOST_CHECK_GT(min.x(), nextMin.x());
+            BOOST_CHECK_GT(min.y(), nextMin.y());
+            BOOST_CHECK_LT(max.x(), nextMax.x());
+            BOOST_CHECK_LT(max.y(), nextMax.y());
+        }
+    }
+
+    osg::Vec2d min, max;
+    terrain.getLevelExtent(terrain.getNumLevels() - 1, min, max);
+    BOOST_CHECK_LT(min.x(), 500.7 - 100);
+    BOOST_CHECK_GT(max.x(), 500.7 + 100);
+
+    terrain.setMaxRange(20);
+    BOOST_CHECK_EQUAL(terrain.getNumLevels(), 1);
+
+    BOOST_CHECK_THROW(ClipmapTerrain(grid, 100, 66), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(sameOutputsAsMesh_TestCase) {
+    float maxRange = 30;
+    osg::ref_ptr<BathymetryGrid> grid = makeSeabed();
+
+    NormalDepthMap meshMap(maxRange, M_PI / 6, M_PI / 6);
+    meshMap.addNodeChild(BathymetryMesher(grid).createScene(64));
+
+    ClipmapTerrain terrain(grid, maxRange, 64);
+    NormalDepthMap clipmapMap(maxRange, M_PI / 6, M_PI / 6);
+    clipmapMap.addNodeChild(terrain.getNode());
+
+    // 8 m above the seabed, looking forward and down, so the far pixels
+    // see the coarser levels
+    osg::Vec3d position(64, 64, -12);
+    terrain.setSonarPosition(position);
+
+    ImageViewerCaptureTool meshCapture(M_PI / 3, M_PI / 3, 200);
+    ImageViewerCaptureTool clipmapCapture(M_PI / 3, M_PI / 3, 200);
+    osg::Vec3d center = position + osg::Vec3d(1, 0, -0.5);
+    meshCapture.setCameraPosition(position, center, osg::Vec3d(0, 0, 1));
+    clipmapCapture.setCameraPosition(position, center, osg::Vec3d(0, 0, 1));
+
+    osg::ref_ptr<osg::Image> meshImage = meshCapture.grabImage(meshMap.getNormalDepthMapNode());
+    osg::ref_ptr<osg::Image> clipmapImage = clipmapCapture.grabImage(clipmapMap.getNormalDepthMapNode());
+
+    // the finest level covers the center of the view
+    uint seabedPixels = 0, differentPixels = 0;
+    for (int y = 0; y < meshImage->t(); ++y) {
+        for (int x = 0; x < meshImage->s(); ++x) {
+            float *mesh = (float*) meshImage->data(x, y);
+            float *clipmap = (float*) clipmapImage->data(x, y);
+            if (mesh[1] > 0)
+                ++seabedPixels;
+
+            if (mesh[1] * maxRange < 10) {
+                BOOST_CHECK_SMALL(mesh[1] - clipmap[1], 1e-3f);
+                BOOST_CHECK_SMALL(mesh[2] - clipmap[2], 1e-3f);
+            } else if (fabs(mesh[1] - clipmap[1]) > 0.01) {
+                ++differentPixels;
+            }
+        }
+    }
+
+    BOOST_CHECK_GT(seabedPixels, 0);
+    BOOST_CHECK_LT(differentPixels, seabedPixels / 100 + 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
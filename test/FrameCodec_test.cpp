@@ -0,0 +1,159 @@
+// C++ includes
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <unistd.h>
+
+// Rock includes
+#include <normal_depth_map/FrameCodec.hpp>
+#include <normal_depth_map/FrameRecorder.hpp>
+#include <normal_depth_map/ThreadPool.hpp>
+
+#define BOOST_TEST_MODULE "FrameCodec_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_FrameCodec)
+
+// synthetic normal depth map: black background with a lit sphere
+osg::ref_ptr<osg::Image> makeSphereImage(uint width, uint height, GLenum pixelFormat) {
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(width, height, 1, pixelFormat, GL_FLOAT);
+    uint components = osg::Image::computeNumComponents(pixelFormat);
+    float radius = std::min(width, height) * 0.35;
+
+    for (uint y = 0; y < height; ++y) {
+        float *row = (float*) image->data(0, y);
+        for (uint x = 0; x < width; ++x) {
+            float *pixel = row + x * components;
+            for (uint c = 0; c < components; ++c)
+                pixel[c] = 0;
+
+            float dx = (x - width * 0.5) / radius, dy = (y - height * 0.5) / radius;
+            float r2 = dx * dx + dy * dy;
+            if (r2 > 1)
+                continue;
+
+            float nz = sqrt(1 - r2);
+            pixel[1] = 0.4 - 0.1 * nz;
+            pixel[2] = nz;
+            if (components == 4)
+                pixel[3] = 1;
+        }
+    }
+    return image;
+}
+
+float maxDifference(const osg::Image& a, const osg::Image& b) {
+    const float *pa = (const float*) a.data(), *pb = (const float*) b.data();
+    uint size = a.getTotalSizeInBytes() / sizeof(float);
+    float difference = 0;
+    for (uint i = 0; i < size; ++i)
+        difference = std::max(difference, std::abs(pa[i] - pb[i]));
+    return difference;
+}
+
+BOOST_AUTO_TEST_CASE(losslessCodec_testCase) {
+    ThreadPool pool(4);
+    osg::ref_ptr<osg::Image> image = makeSphereImage(300, 200, GL_RGB);
+
+    // a few special values
+    float *data = (float*) image->data();
+    data[0] = -0.0f;
+    data[5] = -123.5f;
+    data[8] = 1e30f;
+
+    FrameCodec codec(0, 64, &pool);
+    std::vector<unsigned char> encoded;
+    codec.encode(*image, encoded);
+    BOOST_CHECK_LT(encoded.size(), image->getTotalSizeInBytes() / 2);
+
+    osg::ref_ptr<osg::Image> decoded = codec.decode(&encoded[0], encoded.size(), GL_RGB);
+    BOOST_REQUIRE_EQUAL(decoded->getTotalSizeInBytes(), image->getTotalSizeInBytes());
+    BOOST_CHECK_EQUAL(memcmp(decoded->data(), image->data(), image->getTotalSizeInBytes()), 0);
+
+    // the result does not depend on the number of threads
+    ThreadPool single(1);
+    std::vector<unsigned char> encodedSingle;
+    FrameCodec(0, 64, &single).encode(*image, encodedSingle);
+    BOOST_CHECK(encoded == encodedSingle);
+}
+
+BOOST_AUTO_TEST_CASE(nestedParallelFor_testCase) {
+    struct InnerTask : public ParallelTask {
+        InnerTask(OpenThreads::Atomic& count) : count(count) {}
+        void run(uint index) { ++count; }
+        OpenThreads::Atomic& count;
+    };
+
+    // each outer index runs an inner loop on the same pool
+    struct OuterTask : public ParallelTask {
+        OuterTask(ThreadPool& pool) : pool(pool) {}
+        void run(uint index) {
+            InnerTask inner(count);
+            pool.parallelFor(10, inner);
+            pool.parallelForStealing(10, inner);
+        }
+        ThreadPool& pool;
+        OpenThreads::Atomic count;
+    };
+
+    ThreadPool pool(4);
+    OuterTask task(pool);
+    pool.parallelFor(50, task);
+    BOOST_CHECK_EQUAL((uint) task.count, 1000u);
+}
+
+BOOST_AUTO_TEST_CASE(errorBoundedCodec_testCase) {
+    osg::ref_ptr<osg::Image> image = makeSphereImage(640, 480, GL_RGBA);
+
+    float bounds[] = {1e-5, 1e-4, 1e-3};
+    size_t previousSize = image->getTotalSizeInBytes();
+    for (uint i = 0; i < 3; ++i) {
+        FrameCodec codec(bounds[i], 32);
+        std::vector<unsigned char> encoded;
+        codec.encode(*image, encoded);
+        osg::ref_ptr<osg::Image> decoded = codec.decode(&encoded[0], encoded.size(), GL_RGBA);
+
+        BOOST_CHECK_LE(maxDifference(*image, *decoded), bounds[i] + 1e-7);
+        BOOST_CHECK_LT(encoded.size(), previousSize);
+        previousSize = encoded.size();
+    }
+
+    // at least an order of magnitude smaller than the raw frame
+    BOOST_CHECK_LT(previousSize * 10, image->getTotalSizeInBytes());
+
+    // corrupted data is detected
+    FrameCodec codec(1e-3);
+    std::vector<unsigned char> encoded;
+    codec.encode(*image, encoded);
+    encoded.resize(encoded.size() / 2);
+    BOOST_CHECK_THROW(codec.decode(&encoded[0], encoded.size(), GL_RGBA), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(compressedRecording_testCase) {
+    std::string path = "/tmp/normal_depth_map_compressed_test.ndm";
+    FrameCodec codec(1e-4);
+    {
+        FrameRecorder recorder(path, 320, 240);
+        recorder.setCodec(&codec);
+        for (uint i = 1; i <= 5; ++i) {
+            Frame frame;
+            frame.sequence = i;
+            frame.image = makeSphereImage(320, 240, GL_RGB);
+            recorder.record(frame);
+        }
+    }
+
+    FrameRecordReader reader(path);
+    BOOST_REQUIRE_EQUAL(reader.getNumFrames(), 5u);
+    BOOST_CHECK_EQUAL(reader.getFrameHeader(3).encoding, 1u);
+
+    Frame frame = reader.getFrame(3);
+    BOOST_CHECK_EQUAL(frame.sequence, 4u);
+    BOOST_CHECK_LE(maxDifference(*frame.image, *makeSphereImage(320, 240, GL_RGB)), 1e-4 + 1e-7);
+    unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,125 @@
+// C++ includes
+#include <iostream>
+#include <cstdio>
+#include <unistd.h>
+
+// Rock includes
+#include <normal_depth_map/FrameRecorder.hpp>
+
+#define BOOST_TEST_MODULE "FrameRecorder_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_FrameRecorder)
+
+// build a frame where all values are derived from the sequence number
+Frame makeFrame(uint sequence, uint width, uint height, GLenum dataType) {
+    Frame frame;
+    frame.sequence = sequence;
+    frame.timestamp = sequence * 0.05;
+    frame.cameraPose = osg::Matrixd::translate(osg::Vec3d(sequence, 0, -5));
+    frame.parameters.maxRange = 10 + sequence;
+    frame.parameters.attenuationCoeff = 0.01 * sequence;
+    frame.parameters.drawNormal = sequence % 2;
+    frame.parameters.version = sequence / 2;
+
+    frame.image = new osg::Image();
+    frame.image->allocateImage(width, height, 1, GL_RGB, dataType);
+    uint size = frame.image->getTotalSizeInBytes();
+    for (uint i = 0; i < size; ++i)
+        frame.image->data()[i] = (sequence + i) % 251;
+    return frame;
+}
+
+void checkFrame(const FrameRecordReader& reader, uint index, uint sequence) {
+    Frame frame = reader.getFrame(index);
+    BOOST_CHECK_EQUAL(frame.sequence, sequence);
+    BOOST_CHECK_CLOSE(frame.timestamp, sequence * 0.05, 1e-6);
+    BOOST_CHECK_EQUAL(frame.cameraPose.getTrans().x(), sequence);
+    BOOST_CHECK_CLOSE(frame.parameters.maxRange, 10.0f + sequence, 1e-4);
+    BOOST_CHECK_EQUAL(frame.parameters.drawNormal, (bool) (sequence % 2));
+    BOOST_CHECK_EQUAL(frame.parameters.version, sequence / 2);
+
+    uint size = frame.image->getTotalSizeInBytes();
+    uint errors = 0;
+    for (uint i = 0; i < size; ++i)
+        errors += frame.image->data()[i] != (sequence + i) % 251;
+    BOOST_CHECK_EQUAL(errors, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(randomAccess_testCase) {
+    std::string path = "/tmp/normal_depth_map_recording_test.ndm";
+    uint numFrames = 50;
+
+    // float and reduced precision layouts
+    GLenum dataTypes[] = {GL_FLOAT, GL_HALF_FLOAT};
+    for (uint t = 0; t < 2; ++t) {
+        {
+            FrameRecorder recorder(path, 33, 17, GL_RGB, dataTypes[t]);
+            for (uint i = 1; i <= numFrames; ++i)
+                recorder.record(makeFrame(i, 33, 17, dataTypes[t]));
+            BOOST_CHECK_EQUAL(recorder.getNumFrames(), numFrames);
+            BOOST_CHECK_THROW(recorder.record(makeFrame(0, 32, 17, dataTypes[t])), std::invalid_argument);
+        }
+
+        FrameRecordReader reader(path);
+        BOOST_REQUIRE_EQUAL(reader.getNumFrames(), numFrames);
+        BOOST_CHECK_EQUAL(reader.getHeader().dataType, dataTypes[t]);
+
+        uint indexes[] = {49, 0, 25, 7, 48, 1};
+        for (uint i = 0; i < 6; ++i)
+            checkFrame(reader, indexes[i], indexes[i] + 1);
+
+        BOOST_CHECK_THROW(reader.getFrame(numFrames), std::out_of_range);
+    }
+    unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(unfinishedRecording_testCase) {
+    std::string path = "/tmp/normal_depth_map_recording_unfinished.ndm";
+    uint numFrames = 10;
+    {
+        FrameRecorder recorder(path, 20, 10);
+        for (uint i = 1; i <= numFrames; ++i)
+            recorder.record(makeFrame(i, 20, 10, GL_FLOAT));
+    }
+
+    // drop the index and part of the last frame, like an interrupted run
+    FILE *file = fopen(path.c_str(), "rb");
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    BOOST_REQUIRE(truncate(path.c_str(), size - numFrames * sizeof(unsigned long long) - 100) == 0);
+
+    FrameRecordReader reader(path);
+    BOOST_REQUIRE_EQUAL(reader.getNumFrames(), numFrames - 1);
+    checkFrame(reader, 0, 1);
+    checkFrame(reader, numFrames - 2, numFrames - 1);
+    unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(corruptIndex_testCase) {
+    std::string path = "/tmp/normal_depth_map_recording_corrupt.ndm";
+    uint numFrames = 3;
+    {
+        FrameRecorder recorder(path, 20, 10);
+        for (uint i = 1; i <= numFrames; ++i)
+            recorder.record(makeFrame(i, 20, 10, GL_FLOAT));
+    }
+
+    // the first index entry points past the end of the file
+    FILE *file = fopen(path.c_str(), "r+b");
+    BOOST_REQUIRE(file);
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    unsigned long long offset = size;
+    fseek(file, size - 16 - numFrames * sizeof(unsigned long long), SEEK_SET);
+    fwrite(&offset, sizeof(offset), 1, file);
+    fclose(file);
+
+    BOOST_CHECK_THROW(FrameRecordReader reader(path), std::runtime_error);
+    unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,125 @@
+// C++ includes
+#include <iostream>
+#include <cstring>
+
+// Rock includes
+#include <normal_depth_map/FrameRing.hpp>
+
+// Boost includes
+#include <boost/thread.hpp>
+
+#define BOOST_TEST_MODULE "FrameRing_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_FrameRing)
+
+// fill all image values with the frame sequence
+void writeFrame(FrameRing& ring, Frame *frame, float maxRange) {
+    float *data = (float*) frame->image->data();
+    uint size = frame->image->s() * frame->image->t() * 3;
+    float value = ring.lastSequence() + 1;
+    for (uint i = 0; i < size; ++i)
+        data[i] = value;
+    frame->parameters.maxRange = maxRange;
+}
+
+BOOST_AUTO_TEST_CASE(leaseAndRecycle_testCase) {
+    FrameRing ring(3, 4, 4);
+    BOOST_CHECK(!ring.acquireLatest().valid());
+
+    // publish the first frame and keep a lease on it
+    Frame *frame = ring.beginWrite();
+    BOOST_REQUIRE(frame);
+    writeFrame(ring, frame, 10);
+    BOOST_CHECK_EQUAL(ring.commitWrite(), 1u);
+
+    FrameLease first = ring.acquireLatest();
+    BOOST_REQUIRE(first.valid());
+    BOOST_CHECK_EQUAL(first->sequence, 1u);
+    BOOST_CHECK_EQUAL(first->parameters.maxRange, 10);
+
+    // the leased frame is never overwritten
+    for (uint i = 0; i < 10; ++i) {
+        frame = ring.beginWrite();
+        BOOST_REQUIRE(frame);
+        BOOST_CHECK(frame != &(*first));
+        writeFrame(ring, frame, 20);
+        ring.commitWrite();
+    }
+    BOOST_CHECK_EQUAL(first->sequence, 1u);
+    BOOST_CHECK_EQUAL(((float*) first->image->data())[0], 1);
+    BOOST_CHECK_EQUAL(ring.acquireLatest()->sequence, 11u);
+
+    // old frames are not available anymore, the leased one still is
+    BOOST_CHECK(!ring.acquire(2).valid());
+    BOOST_CHECK(ring.acquire(1).valid());
+
+    // with all frames leased the producer has no free slot
+    FrameLease second = ring.acquireLatest();
+    frame = ring.beginWrite();
+    BOOST_REQUIRE(frame);
+    ring.commitWrite();
+    FrameLease third = ring.acquireLatest();
+    BOOST_CHECK(!ring.beginWrite());
+
+    // releasing a lease recycles the slot
+    first.release();
+    BOOST_CHECK(ring.beginWrite());
+    ring.abortWrite();
+}
+
+// consumer that checks the consistency of each leased frame, until the
+// thread is interrupted
+struct FrameConsumer {
+    FrameConsumer(FrameRing *ring, uint *errors)
+        : ring(ring), errors(errors) {}
+
+    void operator()() {
+        while (true) {
+            boost::this_thread::interruption_point();
+            FrameLease lease = ring->acquireLatest();
+            if (!lease.valid())
+                continue;
+
+            const float *data = (const float*) lease->image->data();
+            uint size = lease->image->s() * lease->image->t() * 3;
+            for (uint i = 0; i < size; ++i) {
+                if (data[i] != (float) lease->sequence) {
+                    ++(*errors);
+                    break;
+                }
+            }
+        }
+    }
+
+    FrameRing *ring;
+    uint *errors;
+};
+
+BOOST_AUTO_TEST_CASE(concurrentConsumers_testCase) {
+    FrameRing ring(4, 64, 64);
+    uint errors[3] = {0, 0, 0};
+
+    boost::thread_group consumers;
+    for (uint i = 0; i < 3; ++i)
+        consumers.create_thread(FrameConsumer(&ring, &errors[i]));
+
+    uint published = 0;
+    while (published < 2000) {
+        Frame *frame = ring.beginWrite();
+        if (!frame)
+            continue;
+        writeFrame(ring, frame, 50);
+        ring.commitWrite();
+        ++published;
+    }
+
+    consumers.interrupt_all();
+    consumers.join_all();
+    BOOST_CHECK_EQUAL(errors[0] + errors[1] + errors[2], 0u);
+    BOOST_CHECK_EQUAL(ring.lastSequence(), 2000u);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
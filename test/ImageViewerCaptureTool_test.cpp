@@ -123,4 +123,64 @@ BOOST_AUTO_TEST_CASE(testImageCaptureDefineFoV_TestCase) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(captureInCallerBuffer_TestCase) {
+    osg::ref_ptr<osg::Geode> scene = new osg::Geode();
+    std::vector<osg::Vec3d> eyes, centers, ups;
+    std::vector<osg::Vec4d> backgrounds;
+    std::vector<std::vector<cv::Point> > setPoints;
+    std::vector<std::vector<cv::Point3i> > setValues;
+    viewPointsFromScene(scene, &eyes, &centers, &ups, &backgrounds, &setPoints, &setValues);
+
+    ImageViewerCaptureTool capture(500, 500);
+    capture.setBackgroundColor(backgrounds[0]);
+    capture.setCameraPosition(eyes[0], centers[0], ups[0]);
+
+    // reference image from the internal buffer
+    osg::ref_ptr<osg::Image> osgImage = capture.grabImage(scene);
+    cv::Mat reference = cv::Mat(osgImage->t(), osgImage->s(), CV_32FC3, osgImage->data()).clone();
+
+    // caller memory with a padded row stride, as a cv::Mat region of interest
+    cv::Mat padded = cv::Mat::zeros(500, 520, CV_32FC3);
+    cv::Mat roi = padded(cv::Rect(0, 0, 500, 500));
+    capture.setCaptureBuffer(CaptureBuffer(roi.data, roi.cols, roi.rows, GL_RGB, GL_FLOAT, roi.step));
+
+    osg::ref_ptr<osg::Image> external = capture.grabImage(scene);
+    BOOST_CHECK_EQUAL(external->data(), roi.data);
+    cv::Mat diff = cv::abs(roi - reference);
+    BOOST_CHECK_EQUAL(cv::countNonZero(diff.reshape(1)), 0);
+    BOOST_CHECK_EQUAL(cv::countNonZero(padded(cv::Rect(500, 0, 20, 500)).reshape(1)), 0);
+
+    // back to the internal buffer
+    capture.releaseCaptureBuffer();
+    osgImage = capture.grabImage(scene);
+    BOOST_CHECK(osgImage->data() != roi.data);
+
+    // wrong size is rejected
+    BOOST_CHECK_THROW(capture.setCaptureBuffer(CaptureBuffer(padded.data, 520, 500)), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(captureStats_TestCase) {
+    osg::ref_ptr<osg::Geode> scene = new osg::Geode();
+    scene->addDrawable(new osg::ShapeDrawable(new osg::Sphere(osg::Vec3(), 1)));
+
+    ImageViewerCaptureTool capture(200, 200);
+    capture.setCameraPosition(osg::Vec3d(0, 0, 5), osg::Vec3d(0, 0, 0), osg::Vec3d(0, 1, 0));
+
+    // disabled by default
+    capture.grabImage(scene);
+    BOOST_CHECK(!capture.isStatsEnabled());
+    BOOST_CHECK_EQUAL(capture.getStats().size(), 0);
+
+    capture.setStatsEnabled(true, 8);
+    for (uint i = 0; i < 10; ++i)
+        capture.grabImage(scene);
+
+    const CaptureStats& stats = capture.getStats();
+    BOOST_CHECK_EQUAL(stats.size(), 8);
+    BOOST_CHECK_GE(stats.last().duration[READBACK_STAGE], 0);
+    BOOST_CHECK_GE(stats.last().duration[TOTAL_STAGE], stats.last().duration[READBACK_STAGE]);
+    BOOST_CHECK_GE(stats.percentile(TOTAL_STAGE, 0.99), stats.percentile(TOTAL_STAGE, 0.5));
+    BOOST_CHECK_GE(stats.last().drawCalls, 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -218,4 +218,96 @@ BOOST_AUTO_TEST_CASE(depthValueRadialVariation_testCase) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(multiFrequencyIntensities_testCase) {
+    osg::ref_ptr<osg::Geode> scene = new osg::Geode();
+    scene->addDrawable(new osg::ShapeDrawable(new osg::Sphere(osg::Vec3(0, 0, -10), 3)));
+
+    double maxRange = 20;
+    NormalDepthMap normalDepthMap(maxRange, M_PI / 6, M_PI / 6);
+    normalDepthMap.addNodeChild(scene);
+
+    std::vector<float> coefficients;
+    coefficients.push_back(0);
+    coefficients.push_back(0.01);
+    coefficients.push_back(0.02);
+    coefficients.push_back(0.05);
+    coefficients.push_back(0.1);
+    normalDepthMap.setAttenuationCoefficients(coefficients);
+    BOOST_CHECK_EQUAL(normalDepthMap.getNumIntensityOutputs(), 2);
+    BOOST_CHECK(normalDepthMap.getAttenuationCoefficients() == coefficients);
+    BOOST_CHECK_THROW(normalDepthMap.setAttenuationCoefficients(std::vector<float>(9, 0.1)), std::invalid_argument);
+
+    ImageViewerCaptureTool capture(M_PI / 6, M_PI / 6, 200);
+    capture.setBackgroundColor(osg::Vec4d(0, 0, 0, 0));
+    std::vector<osg::ref_ptr<osg::Image> > outputs;
+    for (uint i = 0; i < normalDepthMap.getNumIntensityOutputs(); ++i)
+        outputs.push_back(capture.attachOutput(NormalDepthMap::INTENSITY_OUTPUT_LOCATION + i));
+    BOOST_CHECK_THROW(capture.attachOutput(0), std::invalid_argument);
+
+    // one pass gives all the intensities
+    osg::ref_ptr<osg::Image> osgImage = capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+    BOOST_CHECK_EQUAL(capture.getOutput(NormalDepthMap::INTENSITY_OUTPUT_LOCATION), outputs[0]);
+
+    uint x = osgImage->s() / 2, y = osgImage->t() / 2;
+    float *pixel = (float*) osgImage->data(x, y);
+    float intensity = pixel[2];
+    float range = pixel[1] * maxRange;
+    BOOST_CHECK_CLOSE(range, 7.0, 1);
+
+    for (uint i = 0; i < coefficients.size(); ++i) {
+        float *values = (float*) outputs[i / 4]->data(x, y);
+        BOOST_CHECK_CLOSE(values[i % 4], intensity * exp(-2 * coefficients[i] * range), 0.1);
+    }
+
+    // unused channels stay empty
+    BOOST_CHECK_EQUAL(((float*) outputs[1]->data(x, y))[1], 0);
+}
+
+BOOST_AUTO_TEST_CASE(groundTruthOutputs_testCase) {
+    osg::ref_ptr<osg::Geode> left = new osg::Geode();
+    left->addDrawable(new osg::ShapeDrawable(new osg::Sphere(osg::Vec3(-2, 0, -10), 1)));
+    osg::ref_ptr<osg::Geode> right = new osg::Geode();
+    right->addDrawable(new osg::ShapeDrawable(new osg::Sphere(osg::Vec3(2, 0, -10), 1)));
+
+    NormalDepthMap::setObjectId(left, 7);
+    NormalDepthMap::setObjectId(right, 9);
+    BOOST_CHECK_EQUAL(NormalDepthMap::getObjectId(left), 7);
+    BOOST_CHECK_EQUAL(NormalDepthMap::getObjectId(new osg::Geode()), 0);
+
+    NormalDepthMap normalDepthMap(20, M_PI / 6, M_PI / 6);
+    normalDepthMap.addNodeChild(left);
+    normalDepthMap.addNodeChild(right);
+
+    ImageViewerCaptureTool capture(M_PI / 3, M_PI / 3, 300);
+    capture.setBackgroundColor(osg::Vec4d(0, 0, 0, 0));
+    capture.setCameraPosition(osg::Vec3d(0, 0, 0), osg::Vec3d(0, 0, -1), osg::Vec3d(0, 1, 0));
+    osg::ref_ptr<osg::Image> position = capture.attachOutput(NormalDepthMap::POSITION_OUTPUT_LOCATION);
+    osg::ref_ptr<osg::Image> label = capture.attachOutput(NormalDepthMap::LABEL_OUTPUT_LOCATION);
+    capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+
+    // project the sphere centers, and read the outputs there
+    osg::Matrixd viewProjection = capture.getViewMatrix() * capture.getProjectionMatrix();
+    osg::Vec3d centers[] = {osg::Vec3d(-2, 0, -10), osg::Vec3d(2, 0, -10)};
+    uint ids[] = {7, 9};
+    for (uint i = 0; i < 2; ++i) {
+        osg::Vec3d ndc = centers[i] * viewProjection;
+        uint x = (ndc.x() + 1) * 0.5 * label->s();
+        uint y = (ndc.y() + 1) * 0.5 * label->t();
+
+        float *labels = (float*) label->data(x, y);
+        BOOST_CHECK_EQUAL(labels[0], ids[i]);
+        BOOST_CHECK_LT(labels[1], M_PI / 4);
+        BOOST_CHECK_EQUAL(labels[3], 1);
+
+        float *xyz = (float*) position->data(x, y);
+        BOOST_CHECK_CLOSE(xyz[0], centers[i].x(), 20);
+        BOOST_CHECK_CLOSE(xyz[2], -9.0, 5);
+    }
+
+    // background
+    float *corner = (float*) label->data(0, 0);
+    BOOST_CHECK_EQUAL(corner[0], 0);
+    BOOST_CHECK_EQUAL(corner[3], 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
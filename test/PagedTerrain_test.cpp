@@ -0,0 +1,114 @@
+// C++ includes
+#include <iostream>
+
+// Rock includes
+#include <normal_depth_map/ImageViewerCaptureTool.hpp>
+#include <normal_depth_map/NormalDepthMap.hpp>
+#include <normal_depth_map/PagedTerrain.hpp>
+
+// OSG includes
+#include <osg/PagedLOD>
+#include <OpenThreads/Thread>
+#include <osgDB/ReadFile>
+
+#define BOOST_TEST_MODULE "PagedTerrain_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_PagedTerrain)
+
+// flat seabed at 20 m depth, 2 km side
+osg::ref_ptr<BathymetryGrid> makeSeabed() {
+    return new BathymetryGrid(1025, 1025, 2, -20);
+}
+
+BOOST_AUTO_TEST_CASE(quadtreeLayout_TestCase) {
+    PagedTerrain terrain(makeSeabed(), 50, 64);
+    BOOST_CHECK_EQUAL(terrain.getNumTilesX(), 16);
+    BOOST_CHECK_EQUAL(terrain.getNumTilesY(), 16);
+    BOOST_CHECK_EQUAL(terrain.getNumLevels(), 4);
+    BOOST_CHECK_LT(terrain.getMaxResidentTiles(), 16 * 16);
+    BOOST_CHECK_EQUAL(terrain.getNumResidentTiles(), 0);
+
+    // the root loads the four quadrants of the map
+    osg::ref_ptr<osg::PagedLOD> root = dynamic_cast<osg::PagedLOD*>(terrain.getNode()->getChild(0));
+    BOOST_REQUIRE(root.valid());
+    osg::ref_ptr<osgDB::Options> options = dynamic_cast<osgDB::Options*>(root->getDatabaseOptions());
+    osg::ref_ptr<osg::Group> quadrants = dynamic_cast<osg::Group*>(
+        osgDB::readNodeFile(root->getFileName(0), options.get()));
+    BOOST_REQUIRE(quadrants.valid());
+    BOOST_CHECK_EQUAL(quadrants->getNumChildren(), 4);
+}
+
+BOOST_AUTO_TEST_CASE(headingPrefetch_TestCase) {
+    // 2x2 tiles, the quadrants are the tiles
+    PagedTerrain terrain(new BathymetryGrid(257, 257, 2, -20), 50, 128);
+    BOOST_CHECK_EQUAL(terrain.getNumLevels(), 1);
+
+    osg::ref_ptr<osg::PagedLOD> root = dynamic_cast<osg::PagedLOD*>(terrain.getNode()->getChild(0));
+    osg::ref_ptr<osg::Group> tiles = dynamic_cast<osg::Group*>(osgDB::readNodeFile(
+        root->getFileName(0), dynamic_cast<osgDB::Options*>(root->getDatabaseOptions())));
+    BOOST_REQUIRE(tiles.valid());
+
+    // the tiles ahead get the prefetch distance
+    terrain.setVehiclePose(osg::Vec3d(256, 256, -10), osg::Vec3d(1, 0, 0));
+    osg::PagedLOD *west = dynamic_cast<osg::PagedLOD*>(tiles->getChild(0));
+    osg::PagedLOD *east = dynamic_cast<osg::PagedLOD*>(tiles->getChild(1));
+    BOOST_CHECK_CLOSE(east->getMaxRange(0) - west->getMaxRange(0), 50 * M_SQRT1_2, 1);
+
+    terrain.setVehiclePose(osg::Vec3d(256, 256, -10), osg::Vec3d(-1, 0, 0));
+    BOOST_CHECK_CLOSE(west->getMaxRange(0) - east->getMaxRange(0), 50 * M_SQRT1_2, 1);
+}
+
+BOOST_AUTO_TEST_CASE(tileBound_TestCase) {
+    // a peak between the samples of the quadtree root
+    osg::ref_ptr<BathymetryGrid> seabed = new BathymetryGrid(257, 257, 2, -20);
+    seabed->setElevation(5, 5, 30);
+    PagedTerrain terrain(seabed, 50, 128);
+
+    osg::ref_ptr<osg::PagedLOD> root = dynamic_cast<osg::PagedLOD*>(terrain.getNode()->getChild(0));
+    BOOST_CHECK_CLOSE(root->getCenter().z(), -20, 1e-3);
+    osg::ref_ptr<osg::Group> tiles = dynamic_cast<osg::Group*>(osgDB::readNodeFile(
+        root->getFileName(0), dynamic_cast<osgDB::Options*>(root->getDatabaseOptions())));
+    BOOST_REQUIRE(tiles.valid());
+
+    // the tile bound holds the peak, and its load range does not change
+    // with the relief
+    osg::PagedLOD *peak = dynamic_cast<osg::PagedLOD*>(tiles->getChild(0));
+    osg::PagedLOD *flat = dynamic_cast<osg::PagedLOD*>(tiles->getChild(1));
+    BOOST_CHECK_CLOSE(peak->getCenter().z(), 5, 1e-3);
+    BOOST_CHECK_GE(peak->getCenter().z() + peak->getRadius(), 30);
+
+    terrain.setVehiclePose(osg::Vec3d(256, 128, -7.5), osg::Vec3d());
+    BOOST_CHECK_CLOSE(peak->getMaxRange(0), flat->getMaxRange(0), 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(streamingAroundTheSonar_TestCase) {
+    float maxRange = 50;
+    PagedTerrain terrain(makeSeabed(), maxRange, 64);
+
+    NormalDepthMap normalDepthMap(maxRange, M_PI / 6, M_PI / 6);
+    normalDepthMap.addNodeChild(terrain.getNode());
+
+    ImageViewerCaptureTool capture(M_PI / 6, M_PI / 6, 100);
+    terrain.configureViewer(*capture.getViewer());
+
+    // 10 m above the seabed, looking down
+    osg::Vec3d position(300, 300, -10);
+    capture.setCameraPosition(position, position - osg::Vec3d(0, 0, 1), osg::Vec3d(0, 1, 0));
+    terrain.setVehiclePose(position, osg::Vec3d(1, 0, 0));
+
+    // the tiles come in asynchronously
+    float depth = 0;
+    for (uint i = 0; i < 500 && !(depth > 0); ++i) {
+        osg::ref_ptr<osg::Image> image = capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+        depth = ((float*) image->data(image->s() / 2, image->t() / 2))[1];
+        OpenThreads::Thread::microSleep(10000);
+    }
+    BOOST_CHECK_CLOSE(depth * maxRange, 10, 2);
+    BOOST_CHECK_GT(terrain.getNumResidentTiles(), 0);
+    BOOST_CHECK_LE(terrain.getNumResidentTiles(), terrain.getMaxResidentTiles());
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,160 @@
+// C++ includes
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+// Rock includes
+#include <normal_depth_map/FrameRing.hpp>
+#include <normal_depth_map/ImageViewerCaptureTool.hpp>
+#include <normal_depth_map/NormalDepthMap.hpp>
+
+// OSG includes
+#include <osg/Geode>
+#include <osg/NodeCallback>
+#include <osg/ShapeDrawable>
+
+// Boost includes
+#include <boost/thread.hpp>
+
+#define BOOST_TEST_MODULE "ParameterSnapshot_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_ParameterSnapshot)
+
+// wall 10 m in front of the sonar
+osg::ref_ptr<osg::Geode> makeWall() {
+    osg::ref_ptr<osg::Geode> wall = new osg::Geode();
+    wall->addDrawable(new osg::ShapeDrawable(new osg::Box(osg::Vec3(0, 0, -10.5), 100, 100, 1)));
+    return wall;
+}
+
+// consistent parameter set of a step: all values change together
+NormalDepthMapParameters makeParameters(uint step) {
+    NormalDepthMapParameters parameters;
+    parameters.maxRange = 11 + step % 50;
+    parameters.attenuationCoeff = (step % 50) * 0.01;
+    parameters.maxVerticalAngle = 0.1 + (step % 50) * 0.001;
+    return parameters;
+}
+
+bool isConsistent(const NormalDepthMapParameters& parameters) {
+    float step = parameters.maxRange - 11;
+    return fabs(parameters.attenuationCoeff - step * 0.01) < 1e-5
+        && fabs(parameters.maxVerticalAngle - (0.1 + step * 0.001)) < 1e-5;
+}
+
+// publishes until the thread is interrupted
+struct Publisher {
+    Publisher(NormalDepthMap *map) : map(map) {}
+
+    void operator()() {
+        for (uint step = 0; ; ++step) {
+            boost::this_thread::interruption_point();
+            map->publishParameters(makeParameters(step));
+        }
+    }
+
+    NormalDepthMap *map;
+};
+
+BOOST_AUTO_TEST_CASE(appliedOnFrame_testCase) {
+    NormalDepthMap normalDepthMap(50, M_PI / 6, M_PI / 6);
+    normalDepthMap.addNodeChild(makeWall());
+    ImageViewerCaptureTool capture(M_PI / 6, M_PI / 6, 100);
+    capture.setCameraPosition(osg::Vec3d(), osg::Vec3d(0, 0, -1), osg::Vec3d(0, 1, 0));
+
+    NormalDepthMapParameters rendered;
+    BOOST_CHECK_EQUAL(normalDepthMap.getAppliedVersion(), 0u);
+    BOOST_CHECK(!NormalDepthMap::getRenderedParameters(normalDepthMap.getNormalDepthMapNode(), rendered));
+
+    // not applied before the next frame
+    NormalDepthMapParameters parameters;
+    parameters.maxRange = 20;
+    BOOST_CHECK_EQUAL(normalDepthMap.publishParameters(parameters), 1u);
+    BOOST_CHECK_EQUAL(normalDepthMap.getMaxRange(), 50);
+
+    osg::ref_ptr<osg::Image> image = capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+    float *center = (float*) image->data(image->s() / 2, image->t() / 2);
+    BOOST_CHECK_EQUAL(normalDepthMap.getMaxRange(), 20);
+    BOOST_CHECK_EQUAL(normalDepthMap.getAppliedVersion(), 1u);
+    BOOST_CHECK_CLOSE(center[1], 10.0 / 20, 0.1);
+
+    // the latest snapshot of a frame wins
+    parameters.maxRange = 30;
+    normalDepthMap.publishParameters(parameters);
+    parameters.maxRange = 40;
+    BOOST_CHECK_EQUAL(normalDepthMap.publishParameters(parameters), 3u);
+
+    image = capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+    center = (float*) image->data(image->s() / 2, image->t() / 2);
+    BOOST_CHECK_CLOSE(center[1], 10.0 / 40, 0.1);
+    BOOST_CHECK(NormalDepthMap::getRenderedParameters(normalDepthMap.getNormalDepthMapNode(), rendered));
+    BOOST_CHECK_EQUAL(rendered.version, 3u);
+    BOOST_CHECK_EQUAL(rendered.maxRange, 40);
+    BOOST_CHECK_EQUAL(normalDepthMap.getParameters().version, 3u);
+}
+
+BOOST_AUTO_TEST_CASE(setterVersion_testCase) {
+    NormalDepthMap normalDepthMap(50, M_PI / 6, M_PI / 6);
+    normalDepthMap.addNodeChild(makeWall());
+    ImageViewerCaptureTool capture(M_PI / 6, M_PI / 6, 100);
+    capture.setCameraPosition(osg::Vec3d(), osg::Vec3d(0, 0, -1), osg::Vec3d(0, 1, 0));
+
+    NormalDepthMapParameters parameters;
+    parameters.maxRange = 20;
+    unsigned long long published = normalDepthMap.publishParameters(parameters);
+
+    // the setters out of the snapshot change the version at once
+    normalDepthMap.setAttenuationCoefficients(std::vector<float>(2, 0.1));
+    unsigned long long changed = normalDepthMap.getAppliedVersion();
+    BOOST_CHECK_GT(changed, published);
+    BOOST_CHECK_EQUAL(normalDepthMap.getParameters().version, changed);
+
+    // then the older snapshot makes a new state
+    capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+    BOOST_CHECK_EQUAL(normalDepthMap.getMaxRange(), 20);
+    BOOST_CHECK_GT(normalDepthMap.getAppliedVersion(), changed);
+
+    // nested with the update callbacks of the caller, lost if replaced
+    normalDepthMap.getNormalDepthMapNode()->addUpdateCallback(new osg::NodeCallback());
+    BOOST_CHECK_GT(normalDepthMap.publishParameters(parameters), changed);
+    normalDepthMap.getNormalDepthMapNode()->setUpdateCallback(0);
+    BOOST_CHECK_THROW(normalDepthMap.publishParameters(parameters), std::runtime_error);
+    BOOST_CHECK_EQUAL(normalDepthMap.getAppliedVersion(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(concurrentPublisher_testCase) {
+    NormalDepthMap normalDepthMap(50, M_PI / 6, M_PI / 6);
+    normalDepthMap.addNodeChild(makeWall());
+    ImageViewerCaptureTool capture(M_PI / 6, M_PI / 6, 100);
+    capture.setCameraPosition(osg::Vec3d(), osg::Vec3d(0, 0, -1), osg::Vec3d(0, 1, 0));
+    osg::ref_ptr<osg::Image> image = capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+    FrameRing ring(4, image->s(), image->t());
+
+    boost::thread publisher(Publisher(&normalDepthMap));
+
+    // each frame is tagged with the snapshot it was rendered with
+    unsigned long long lastVersion = 0;
+    uint inconsistent = 0;
+    for (uint i = 0; i < 200; ++i) {
+        unsigned long long sequence = capture.grabFrame(normalDepthMap.getNormalDepthMapNode(), ring);
+        FrameLease frame = ring.acquire(sequence);
+        BOOST_REQUIRE(frame.valid());
+
+        const NormalDepthMapParameters& parameters = frame->parameters;
+        float *center = (float*) frame->image->data(frame->image->s() / 2, frame->image->t() / 2);
+        if (!isConsistent(parameters) || fabs(center[1] * parameters.maxRange - 10) > 0.01)
+            ++inconsistent;
+        BOOST_CHECK_GE(parameters.version, lastVersion);
+        lastVersion = parameters.version;
+    }
+
+    publisher.interrupt();
+    publisher.join();
+    BOOST_CHECK_EQUAL(inconsistent, 0u);
+    BOOST_CHECK_GT(lastVersion, 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,232 @@
+// C++ includes
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+#include <iostream>
+
+// Rock includes
+#include <normal_depth_map/ImageViewerCaptureTool.hpp>
+#include <normal_depth_map/NormalDepthMap.hpp>
+#include <normal_depth_map/RayCastCaptureTool.hpp>
+#include <normal_depth_map/ThreadPool.hpp>
+#include <normal_depth_map/TriangleBVH.hpp>
+
+// OSG includes
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/MatrixTransform>
+#include <osg/ShapeDrawable>
+
+#define BOOST_TEST_MODULE "RayCastCaptureTool_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_RayCastCaptureTool)
+
+float randomValue(float min, float max) {
+    return min + (max - min) * rand() / RAND_MAX;
+}
+
+BOOST_AUTO_TEST_CASE(bvhMatchesBruteForce_TestCase) {
+    srand(7);
+    TriangleBVH bvh;
+    for (uint i = 0; i < 5000; ++i) {
+        osg::Vec3f v0(randomValue(-10, 10), randomValue(-10, 10), randomValue(-10, 10));
+        osg::Vec3f v1 = v0 + osg::Vec3f(randomValue(0, 1), randomValue(0, 1), randomValue(0, 1));
+        osg::Vec3f v2 = v0 + osg::Vec3f(randomValue(0, 1), randomValue(0, 1), randomValue(0, 1));
+        bvh.addTriangle(v0, v1, v2);
+    }
+    bvh.build();
+    BOOST_CHECK_EQUAL(bvh.getNumTriangles(), 5000);
+    BOOST_CHECK_LT(bvh.getDepth(), 40);
+
+    for (uint i = 0; i < 500; ++i) {
+        osg::Vec3f origin(randomValue(-15, 15), randomValue(-15, 15), -20);
+        osg::Vec3f direction(randomValue(-0.5, 0.5), randomValue(-0.5, 0.5), 1);
+
+        // nearest hit over all triangles
+        float nearest = 100;
+        int expected = -1;
+        for (uint j = 0; j < bvh.getNumTriangles(); ++j) {
+            const TriangleBVH::Triangle& triangle = bvh.getTriangle(j);
+            osg::Vec3f e1 = triangle.vertex[1] - triangle.vertex[0];
+            osg::Vec3f e2 = triangle.vertex[2] - triangle.vertex[0];
+            osg::Vec3f p = direction ^ e2, s = origin - triangle.vertex[0], q = s ^ e1;
+            float inverse = 1 / (e1 * p);
+            float u = (s * p) * inverse, v = (direction * q) * inverse, t = (e2 * q) * inverse;
+            if (u >= 0 && v >= 0 && u + v <= 1 && t > 0 && t < nearest) {
+                nearest = t;
+                expected = j;
+            }
+        }
+
+        float distance, u, v;
+        int hit = bvh.intersect(origin, direction, 100, distance, u, v);
+        BOOST_CHECK_EQUAL(hit, expected);
+        if (hit >= 0)
+            BOOST_CHECK_CLOSE(distance, nearest, 1e-3);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stealingCoversAllIndexes_TestCase) {
+    struct CountTask : public ParallelTask {
+        CountTask() : counts(1000, 0) {}
+        void run(uint index) { ++counts[index]; }
+        std::vector<int> counts;
+    };
+
+    ThreadPool pool(4);
+    for (uint i = 0; i < 20; ++i) {
+        CountTask task;
+        pool.parallelForStealing(task.counts.size(), task);
+        BOOST_CHECK_EQUAL((uint) std::count(task.counts.begin(), task.counts.end(), 1), task.counts.size());
+    }
+}
+
+// tilted quad with per vertex normals and a reflectance
+osg::ref_ptr<osg::Geode> makeQuad(float reflectance) {
+    osg::ref_ptr<osg::Vec3Array> vertexes = new osg::Vec3Array();
+    vertexes->push_back(osg::Vec3(-6, -3, -12));
+    vertexes->push_back(osg::Vec3(0, -3, -8));
+    vertexes->push_back(osg::Vec3(0, 3, -8));
+    vertexes->push_back(osg::Vec3(-6, 3, -12));
+
+    osg::Vec3 normal = (vertexes->at(1) - vertexes->at(0)) ^ (vertexes->at(3) - vertexes->at(0));
+    normal.normalize();
+    osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array(4, &normal);
+
+    osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry();
+    geometry->setVertexArray(vertexes);
+    geometry->setNormalArray(normals);
+    geometry->setNormalBinding(osg::Geometry::BIND_PER_VERTEX);
+    geometry->addPrimitiveSet(new osg::DrawArrays(GL_QUADS, 0, 4));
+
+    osg::ref_ptr<osg::Geode> geode = new osg::Geode();
+    geode->addDrawable(geometry);
+    geode->getOrCreateStateSet()->addUniform(new osg::Uniform("reflectance", reflectance));
+    return geode;
+}
+
+BOOST_AUTO_TEST_CASE(agreesWithOpenGL_TestCase) {
+    osg::ref_ptr<osg::Group> scene = new osg::Group();
+    scene->addChild(makeQuad(0.6));
+
+    osg::ref_ptr<osg::Geode> box = new osg::Geode();
+    box->addDrawable(new osg::ShapeDrawable(new osg::Box(osg::Vec3(0, 0, 0), 2)));
+    osg::ref_ptr<osg::MatrixTransform> transform = new osg::MatrixTransform(
+        osg::Matrix::rotate(0.5, osg::Vec3(0, 1, 0)) * osg::Matrix::translate(2, 0.5, -9));
+    transform->addChild(box);
+    scene->addChild(transform);
+
+    NormalDepthMap normalDepthMap(20, M_PI / 6, M_PI / 6, 0.02);
+    normalDepthMap.addNodeChild(scene);
+
+    uint width = 320, height = 240;
+    osg::Matrix projection = osg::Matrix::perspective(45, (double) width / height, 0.1, 1000);
+
+    ImageViewerCaptureTool gl(width, height);
+    gl.setProjectionMatrix(projection);
+    gl.setCameraPosition(osg::Vec3d(0, 0, 0), osg::Vec3d(0, 0, -1), osg::Vec3d(0, 1, 0));
+    osg::ref_ptr<osg::Image> reference = gl.grabImage(normalDepthMap.getNormalDepthMapNode());
+
+    RayCastCaptureTool cpu(width, height);
+    cpu.setParameters(normalDepthMap.getParameters());
+    cpu.setProjectionMatrix(projection);
+    cpu.setCameraPosition(osg::Vec3d(0, 0, 0), osg::Vec3d(0, 0, -1), osg::Vec3d(0, 1, 0));
+    osg::ref_ptr<osg::Image> image = cpu.grabImage(scene);
+    BOOST_CHECK_EQUAL(image->s(), width);
+    BOOST_CHECK_EQUAL(image->t(), height);
+    BOOST_CHECK_GT(cpu.getBVH().getNumTriangles(), 12);
+
+    // within the window quantization, except on the silhouettes
+    uint objects = 0, mismatches = 0;
+    for (uint y = 0; y < height; ++y) {
+        for (uint x = 0; x < width; ++x) {
+            float *a = (float*) image->data(x, y);
+            float *b = (float*) reference->data(x, y);
+            objects += a[1] > 0;
+            if (fabs(a[1] - b[1]) > 0.006 || fabs(a[2] - b[2]) > 0.006)
+                ++mismatches;
+        }
+    }
+    BOOST_CHECK_GT(objects, width * height / 10);
+    BOOST_CHECK_LT(mismatches, objects / 50);
+}
+
+BOOST_AUTO_TEST_CASE(multiFrequencyAgreesWithOpenGL_TestCase) {
+    osg::ref_ptr<osg::Group> scene = new osg::Group();
+    scene->addChild(makeQuad(0.6));
+    NormalDepthMap::setObjectId(scene, 7);
+
+    // two intensity targets
+    std::vector<float> coefficients;
+    for (uint i = 0; i < 6; ++i)
+        coefficients.push_back(0.01 + 0.03 * i);
+
+    NormalDepthMap normalDepthMap(20, M_PI / 6, M_PI / 6, 0.02);
+    normalDepthMap.addNodeChild(scene);
+    normalDepthMap.setAttenuationCoefficients(coefficients);
+
+    uint width = 320, height = 240;
+    osg::Matrix projection = osg::Matrix::perspective(45, (double) width / height, 0.1, 1000);
+
+    ImageViewerCaptureTool gl(width, height);
+    gl.setProjectionMatrix(projection);
+    gl.setCameraPosition(osg::Vec3d(0, 0, 0), osg::Vec3d(0, 0, -1), osg::Vec3d(0, 1, 0));
+
+    RayCastCaptureTool cpu(width, height);
+    cpu.setNormalDepthMap(normalDepthMap);
+    cpu.setProjectionMatrix(projection);
+    cpu.setCameraPosition(osg::Vec3d(0, 0, 0), osg::Vec3d(0, 0, -1), osg::Vec3d(0, 1, 0));
+    BOOST_CHECK_EQUAL(cpu.getAttenuationCoefficients().size(), coefficients.size());
+
+    std::vector<uint> locations;
+    locations.push_back(NormalDepthMap::INTENSITY_OUTPUT_LOCATION);
+    locations.push_back(NormalDepthMap::INTENSITY_OUTPUT_LOCATION + 1);
+    locations.push_back(NormalDepthMap::LABEL_OUTPUT_LOCATION);
+    for (uint i = 0; i < locations.size(); ++i) {
+        gl.attachOutput(locations[i]);
+        cpu.attachOutput(locations[i]);
+    }
+
+    gl.grabImage(normalDepthMap.getNormalDepthMapNode());
+    cpu.grabImage(scene);
+
+    // float targets on both sides: only the rounding and the silhouettes
+    for (uint i = 0; i < locations.size(); ++i) {
+        osg::ref_ptr<osg::Image> reference = gl.getOutput(locations[i]);
+        osg::ref_ptr<osg::Image> image = cpu.getOutput(locations[i]);
+
+        uint objects = 0, mismatches = 0;
+        for (uint y = 0; y < height; ++y) {
+            for (uint x = 0; x < width; ++x) {
+                float *a = (float*) image->data(x, y);
+                float *b = (float*) reference->data(x, y);
+                objects += a[0] > 0;
+                for (uint c = 0; c < 4; ++c) {
+                    if (fabs(a[c] - b[c]) > 1e-3) {
+                        ++mismatches;
+                        break;
+                    }
+                }
+            }
+        }
+        BOOST_CHECK_GT(objects, width * height / 10);
+        BOOST_CHECK_LT(mismatches, objects / 50);
+    }
+
+    // the highest coefficient has the weakest intensity
+    float *center = (float*) cpu.getOutput(NormalDepthMap::INTENSITY_OUTPUT_LOCATION + 1)->data(width / 4, height / 2);
+    float *label = (float*) cpu.getOutput(NormalDepthMap::LABEL_OUTPUT_LOCATION)->data(width / 4, height / 2);
+    BOOST_CHECK_GT(center[0], center[1]);
+    BOOST_CHECK_EQUAL(label[0], 7);
+
+    // the shader terms not cast on the CPU
+    normalDepthMap.setBeamPattern(std::vector<float>(4, 1), 2, 2);
+    BOOST_CHECK_THROW(cpu.setNormalDepthMap(normalDepthMap), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
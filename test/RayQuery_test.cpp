@@ -0,0 +1,83 @@
+// C++ includes
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// Rock includes
+#include <normal_depth_map/NormalDepthMap.hpp>
+#include <normal_depth_map/RayQuery.hpp>
+
+// OSG includes
+#include <osg/Geode>
+#include <osg/MatrixTransform>
+#include <osg/ShapeDrawable>
+
+#define BOOST_TEST_MODULE "RayQuery_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_RayQuery)
+
+BOOST_AUTO_TEST_CASE(altimeterOverMovingObject_TestCase) {
+    // seabed 10 m below the sensor, with a material
+    osg::ref_ptr<osg::Geode> seabed = new osg::Geode();
+    seabed->addDrawable(new osg::ShapeDrawable(new osg::Box(osg::Vec3(0, 0, -10.5), 100, 100, 1)));
+    seabed->getOrCreateStateSet()->addUniform(new osg::Uniform("reflectance", 0.4f));
+
+    // 2 m box, moved by a transform
+    osg::ref_ptr<osg::Geode> box = new osg::Geode();
+    box->addDrawable(new osg::ShapeDrawable(new osg::Box(osg::Vec3(0, 0, 0), 2)));
+    osg::ref_ptr<osg::MatrixTransform> transform = new osg::MatrixTransform(osg::Matrix::translate(20, 0, -5));
+    transform->addChild(box);
+    NormalDepthMap::setObjectId(transform, 7);
+
+    osg::ref_ptr<osg::Group> scene = new osg::Group();
+    scene->addChild(seabed);
+    scene->addChild(transform);
+
+    RayQuery query;
+    query.setScene(scene);
+    BOOST_CHECK_EQUAL(query.getNumBuilds(), 1);
+    BOOST_CHECK(!query.update());
+
+    // altimeter and a slanted beam
+    std::vector<SensorRay> rays;
+    rays.push_back(SensorRay(osg::Vec3f(0, 0, 0), osg::Vec3f(0, 0, -1), 50));
+    rays.push_back(SensorRay(osg::Vec3f(0, 0, 0), osg::Vec3f(1, 0, -1), 50));
+    rays.push_back(SensorRay(osg::Vec3f(0, 0, 0), osg::Vec3f(0, 0, 1), 50));
+
+    std::vector<RayHit> hits;
+    query.query(rays, hits);
+    BOOST_REQUIRE_EQUAL(hits.size(), rays.size());
+    BOOST_CHECK_CLOSE(hits[0].range, 10, 1e-3);
+    BOOST_CHECK_SMALL(hits[0].incidence, 1e-3f);
+    BOOST_CHECK_CLOSE(hits[0].reflectance, 0.4, 1e-3);
+    BOOST_CHECK_EQUAL(hits[0].objectId, 0);
+    BOOST_CHECK_CLOSE(hits[1].range, 10 * sqrt(2), 1e-3);
+    BOOST_CHECK_CLOSE(hits[1].incidence, M_PI / 4, 1e-2);
+    BOOST_CHECK_LT(hits[2].range, 0);
+
+    // the box comes under the sensor: refit, not rebuilt
+    transform->setMatrix(osg::Matrix::translate(0, 0, -5));
+    BOOST_CHECK(query.update());
+    RayHit hit = query.query(rays[0]);
+    BOOST_CHECK_CLOSE(hit.range, 4, 1e-3);
+    BOOST_CHECK_EQUAL(hit.objectId, 7);
+    BOOST_CHECK_EQUAL(query.getNumBuilds(), 1);
+
+    // large batches give the same hits as the single queries
+    std::vector<SensorRay> beams;
+    for (uint i = 0; i < 4000; ++i) {
+        float angle = i * 2 * M_PI / 4000;
+        beams.push_back(SensorRay(osg::Vec3f(0, 0, 0), osg::Vec3f(cos(angle), sin(angle), -2), 50));
+    }
+    query.query(beams, hits);
+    for (uint i = 0; i < beams.size(); i += 97) {
+        RayHit single = query.query(beams[i]);
+        BOOST_CHECK_EQUAL(hits[i].range, single.range);
+        BOOST_CHECK_EQUAL(hits[i].objectId, single.objectId);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
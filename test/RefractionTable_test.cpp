@@ -0,0 +1,116 @@
+// C++ includes
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Rock includes
+#include <normal_depth_map/ImageViewerCaptureTool.hpp>
+#include <normal_depth_map/NormalDepthMap.hpp>
+#include <normal_depth_map/RefractionTable.hpp>
+
+// OSG includes
+#include <osg/Geode>
+#include <osg/ShapeDrawable>
+
+#define BOOST_TEST_MODULE "RefractionTable_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_RefractionTable)
+
+// warm surface layer over a cold and fresher deep layer
+WaterColumnProfile makeLayeredProfile() {
+    std::vector<WaterSample> samples;
+    samples.push_back(WaterSample(0, 25, 36, 8.1));
+    samples.push_back(WaterSample(8, 25, 36, 8.1));
+    samples.push_back(WaterSample(12, 4, 30, 7.8));
+    samples.push_back(WaterSample(100, 4, 30, 7.8));
+    return WaterColumnProfile(samples);
+}
+
+// apparent range of a vertical ray, by direct integration of the travel time
+double verticalApparentRange(const WaterColumnProfile& profile, double sonarDepth, double range) {
+    double time = 0, step = 1e-3;
+    for (double depth = sonarDepth + 0.5 * step; depth < sonarDepth + range; depth += step)
+        time += step / profile.getSoundSpeed(depth);
+    return time * profile.getSoundSpeed(sonarDepth);
+}
+
+BOOST_AUTO_TEST_CASE(uniformWater_TestCase) {
+    std::vector<WaterSample> samples(1, WaterSample(0, 10, 35, 8));
+    RefractionTable table(WaterColumnProfile(samples), 5, 50, 128, 128);
+
+    // almost straight rays, the speed only changes with the pressure
+    double angles[] = {0, 0.2, 0.7, 1.5};
+    for (uint i = 0; i < 4; ++i) {
+        double apparentRange, apparentAngle;
+        BOOST_CHECK(table.correct(angles[i], 30, apparentRange, apparentAngle));
+        BOOST_CHECK_CLOSE(apparentRange, 30, 0.1);
+        BOOST_CHECK_SMALL(apparentAngle - angles[i], 1e-3);
+    }
+
+    // above the surface
+    double apparentRange, apparentAngle;
+    BOOST_CHECK(!table.correct(-0.3, 30, apparentRange, apparentAngle));
+    BOOST_CHECK(!table.correct(0.3, 60, apparentRange, apparentAngle));
+
+    BOOST_CHECK_THROW(RefractionTable(WaterColumnProfile(samples), 5, 0), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(layeredWater_TestCase) {
+    WaterColumnProfile profile = makeLayeredProfile();
+    RefractionTable table(profile, 5, 50);
+
+    // vertical rays do not bend, only their travel time changes
+    double apparentRange, apparentAngle;
+    BOOST_CHECK(table.correct(M_PI_2, 10, apparentRange, apparentAngle));
+    BOOST_CHECK_CLOSE(apparentRange, verticalApparentRange(profile, 5, 10), 0.01);
+    BOOST_CHECK_CLOSE(apparentAngle, M_PI_2, 1e-3);
+
+    // the rays bend down into the slower water, so a point under the
+    // thermocline is reached by a shallower ray, later than in a straight line
+    BOOST_CHECK(table.correct(0.7, 30, apparentRange, apparentAngle));
+    BOOST_CHECK_LT(apparentAngle, 0.69);
+    BOOST_CHECK_GT(apparentRange, 30.5);
+
+    // same table on any number of threads
+    ThreadPool pool(1);
+    RefractionTable serial(profile, 5, 50, 256, 256, &pool);
+    osg::ref_ptr<osg::Image> image = table.createImage();
+    osg::ref_ptr<osg::Image> serialImage = serial.createImage();
+    BOOST_CHECK_EQUAL(memcmp(image->data(), serialImage->data(), image->getTotalSizeInBytes()), 0);
+}
+
+BOOST_AUTO_TEST_CASE(shaderRefraction_TestCase) {
+    WaterColumnProfile profile = makeLayeredProfile();
+    float maxRange = 50;
+
+    // seabed 10 m under the sonar, at 15 m depth
+    osg::ref_ptr<osg::Geode> seabed = new osg::Geode();
+    seabed->addDrawable(new osg::ShapeDrawable(new osg::Box(osg::Vec3(0, 0, -15.5), 100, 100, 1)));
+
+    NormalDepthMap normalDepthMap(maxRange, M_PI / 6, M_PI / 6);
+    normalDepthMap.addNodeChild(seabed);
+    RefractionTable table(profile, 5, maxRange);
+    normalDepthMap.setRefractionTable(table);
+    BOOST_CHECK(normalDepthMap.hasRefractionTable());
+
+    ImageViewerCaptureTool capture(M_PI / 6, M_PI / 6, 100);
+    osg::Vec3d position(0, 0, -5);
+    capture.setCameraPosition(position, position - osg::Vec3d(0, 0, 1), osg::Vec3d(0, 1, 0));
+
+    osg::ref_ptr<osg::Image> image = capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+    float *center = (float*) image->data(image->s() / 2, image->t() / 2);
+    double expected = verticalApparentRange(profile, 5, 10);
+    BOOST_CHECK_CLOSE(center[1] * maxRange, expected, 0.1);
+
+    normalDepthMap.clearRefractionTable();
+    BOOST_CHECK(!normalDepthMap.hasRefractionTable());
+    image = capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+    center = (float*) image->data(image->s() / 2, image->t() / 2);
+    BOOST_CHECK_CLOSE(center[1] * maxRange, 10, 0.1);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
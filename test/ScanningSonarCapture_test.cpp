@@ -0,0 +1,63 @@
+// C++ includes
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+
+// Rock includes
+#include <normal_depth_map/NormalDepthMap.hpp>
+#include <normal_depth_map/ScanningSonarCapture.hpp>
+
+// OSG includes
+#include <osg/Geode>
+#include <osg/ShapeDrawable>
+
+#define BOOST_TEST_MODULE "ScanningSonarCapture_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_ScanningSonarCapture)
+
+BOOST_AUTO_TEST_CASE(fullTurnScan_TestCase) {
+    // a wall in front of the head at angle 0, 9 meters away
+    osg::ref_ptr<osg::Geode> scene = new osg::Geode();
+    scene->addDrawable(new osg::ShapeDrawable(new osg::Box(osg::Vec3(10, 0, 0), 2)));
+
+    double maxRange = 20;
+    NormalDepthMap normalDepthMap(maxRange, M_PI / 6, M_PI / 6);
+    normalDepthMap.addNodeChild(scene);
+
+    uint numSteps = 360, numBins = 100;
+    ScanningSonarCapture sonar(2 * M_PI / 180, 20 * M_PI / 180, numSteps, numBins);
+    sonar.setSonarPose(osg::Vec3d(0, 0, 0), osg::Vec3d(1, 0, 0), osg::Vec3d(0, 0, 1));
+
+    // the beam is rendered narrow
+    osg::ref_ptr<osg::Image> beam = sonar.getCaptureTool().grabImage(normalDepthMap.getNormalDepthMapNode());
+    BOOST_CHECK_LT(beam->s(), beam->t());
+
+    BOOST_CHECK_EQUAL(sonar.getStep(0), 0);
+    BOOST_CHECK_EQUAL(sonar.getStep(-M_PI / 2), 270);
+    BOOST_CHECK_EQUAL(sonar.getStep(2 * M_PI), 0);
+
+    for (uint i = 0; i < numSteps; ++i)
+        BOOST_CHECK_EQUAL(sonar.scan(normalDepthMap.getNormalDepthMapNode(), i * 2 * M_PI / numSteps), i);
+
+    // echo at 9 meters in front of the head
+    const float *front = sonar.getBeam(0);
+    uint peak = std::max_element(front, front + numBins) - front;
+    BOOST_CHECK_CLOSE(peak * maxRange / numBins, 9.0, 5);
+    BOOST_CHECK_GT(front[peak], 0);
+
+    // nothing behind and on the sides
+    const uint emptySteps[] = {90, 180, 270};
+    for (uint i = 0; i < 3; ++i) {
+        const float *beamBins = sonar.getBeam(emptySteps[i]);
+        BOOST_CHECK_EQUAL(std::accumulate(beamBins, beamBins + numBins, 0.0f), 0);
+    }
+
+    sonar.clear();
+    BOOST_CHECK_EQUAL(std::accumulate(sonar.getBeam(0), sonar.getBeam(0) + numBins, 0.0f), 0);
+    BOOST_CHECK_THROW(sonar.getBeam(numSteps), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,155 @@
+// C++ includes
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Rock includes
+#include <normal_depth_map/SharedFrameTransport.hpp>
+
+#define BOOST_TEST_MODULE "SharedFrameTransport_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_SharedFrameTransport)
+
+// fill all values of the frame with the given value
+void fillFrame(const CaptureBuffer& buffer, float value) {
+    for (uint row = 0; row < buffer.height; ++row) {
+        float *data = (float*) ((unsigned char*) buffer.data + row * buffer.effectiveRowStride());
+        for (uint i = 0; i < buffer.width * 3; ++i)
+            data[i] = value;
+    }
+}
+
+// check the frame values against its sequence number
+bool checkFrame(const SharedFrameView& view) {
+    for (uint row = 0; row < view.header->height; ++row) {
+        const float *data = (const float*) (view.data + row * view.header->rowStride);
+        for (uint i = 0; i < view.header->width * 3; ++i)
+            if (data[i] != (float) view.header->sequence)
+                return false;
+    }
+    return view.header->maxRange == 30;
+}
+
+// subscriber side, running in another process
+int readFrames(const std::string& name, unsigned long long lastSequence) {
+    SharedFrameSubscriber subscriber(name);
+    unsigned long long previous = 0;
+    uint received = 0;
+
+    while (previous < lastSequence) {
+        SharedFrameView view;
+        if (!subscriber.latest(view) || view.header->sequence == previous)
+            continue;
+
+        bool consistent = checkFrame(view);
+
+        // discard the frames overwritten while they were checked
+        if (!subscriber.isValid(view))
+            continue;
+
+        if (!consistent || view.header->sequence < previous)
+            return 1;
+
+        previous = view.header->sequence;
+        ++received;
+    }
+    return received > 0 ? 0 : 2;
+}
+
+BOOST_AUTO_TEST_CASE(singleProcess_testCase) {
+    // left by an interrupted run
+    shm_unlink("/normal_depth_map_test_single");
+    SharedFramePublisher publisher("/normal_depth_map_test_single", 16, 8, 3);
+    SharedFrameSubscriber subscriber("/normal_depth_map_test_single");
+    BOOST_CHECK_EQUAL(subscriber.width(), 16u);
+    BOOST_CHECK_EQUAL(subscriber.height(), 8u);
+
+    SharedFrameView view;
+    BOOST_CHECK(!subscriber.latest(view));
+
+    NormalDepthMapParameters parameters;
+    parameters.maxRange = 30;
+    for (uint i = 1; i <= 5; ++i) {
+        fillFrame(publisher.beginFrame(), i);
+        BOOST_CHECK_EQUAL(publisher.commitFrame(i * 0.1, osg::Matrixd::identity(), parameters), i);
+    }
+
+    BOOST_REQUIRE(subscriber.latest(view));
+    BOOST_CHECK_EQUAL(view.header->sequence, 5u);
+    BOOST_CHECK(checkFrame(view));
+    BOOST_CHECK(subscriber.isValid(view));
+
+    // the oldest frames left the ring
+    BOOST_CHECK(subscriber.get(3, view));
+    BOOST_CHECK(!subscriber.get(2, view));
+
+    // a rewritten slot invalidates the views taken before
+    subscriber.get(3, view);
+    for (uint i = 6; i <= 7; ++i) {
+        fillFrame(publisher.beginFrame(), i);
+        publisher.commitFrame(i * 0.1, osg::Matrixd::identity(), parameters);
+    }
+    BOOST_CHECK(!subscriber.isValid(view));
+
+    // an aborted frame unlocks its slot for the next one
+    publisher.beginFrame();
+    publisher.abortFrame();
+    BOOST_CHECK(!subscriber.get(5, view));
+    BOOST_CHECK(subscriber.get(6, view));
+    BOOST_CHECK_EQUAL(publisher.commitFrame(0.8, osg::Matrixd::identity(), parameters), 0u);
+    fillFrame(publisher.beginFrame(), 8);
+    BOOST_CHECK_EQUAL(publisher.commitFrame(0.8, osg::Matrixd::identity(), parameters), 8u);
+    BOOST_CHECK(subscriber.latest(view));
+    BOOST_CHECK(checkFrame(view));
+
+    BOOST_CHECK_THROW(SharedFrameSubscriber("/normal_depth_map_test_missing"), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(invalidObjects_testCase) {
+    std::string name = "/normal_depth_map_test_invalid";
+    shm_unlink(name.c_str());
+    SharedFramePublisher publisher(name, 16, 8, 3);
+
+    // a second publisher does not take over the ring
+    BOOST_CHECK_THROW(SharedFramePublisher(name, 16, 8, 3), std::runtime_error);
+    BOOST_CHECK_NO_THROW(SharedFrameSubscriber subscriber(name));
+
+    // a valid header over an object too small for its slots
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    BOOST_REQUIRE(fd >= 0);
+    BOOST_REQUIRE_EQUAL(ftruncate(fd, 128), 0);
+    close(fd);
+    BOOST_CHECK_THROW(SharedFrameSubscriber subscriber(name), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(twoProcesses_testCase) {
+    std::string name = "/normal_depth_map_test_processes";
+    unsigned long long lastSequence = 500;
+    shm_unlink(name.c_str());
+    SharedFramePublisher publisher(name, 128, 64, 4);
+
+    pid_t child = fork();
+    BOOST_REQUIRE(child >= 0);
+    if (child == 0)
+        _exit(readFrames(name, lastSequence));
+
+    NormalDepthMapParameters parameters;
+    parameters.maxRange = 30;
+    for (unsigned long long i = 1; i <= lastSequence; ++i) {
+        fillFrame(publisher.beginFrame(), i);
+        publisher.commitFrame(i * 0.1, osg::Matrixd::identity(), parameters);
+        usleep(100);
+    }
+
+    int status = -1;
+    waitpid(child, &status, 0);
+    BOOST_REQUIRE(WIFEXITED(status));
+    BOOST_CHECK_EQUAL(WEXITSTATUS(status), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,69 @@
+// C++ includes
+#include <iostream>
+#include <numeric>
+
+// Rock includes
+#include <normal_depth_map/NormalDepthMap.hpp>
+#include <normal_depth_map/SideScanWaterfall.hpp>
+
+// OSG includes
+#include <osg/Geode>
+#include <osg/ShapeDrawable>
+
+#define BOOST_TEST_MODULE "SideScanWaterfall_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_SideScanWaterfall)
+
+float lineSum(osg::ref_ptr<osg::Image> image, uint row, uint begin, uint end) {
+    const float *line = (const float*) image->data(0, row);
+    return std::accumulate(line + begin, line + end, 0.0f);
+}
+
+BOOST_AUTO_TEST_CASE(waterfallRing_TestCase) {
+    // flat seafloor 10 meters below the vehicle
+    osg::ref_ptr<osg::Geode> seafloor = new osg::Geode();
+    seafloor->addDrawable(new osg::ShapeDrawable(new osg::Box(osg::Vec3(0, 0, -11), 200, 200, 2)));
+
+    NormalDepthMap normalDepthMap(50, M_PI / 6, M_PI / 6);
+    normalDepthMap.addNodeChild(seafloor);
+
+    uint numBins = 100, numLines = 8;
+    SideScanWaterfall sidescan(80 * M_PI / 180, 2 * M_PI / 180, 30 * M_PI / 180, numBins, numLines);
+
+    // nothing to read before the first ping
+    BOOST_CHECK_EQUAL(sidescan.readNewLines()->t(), 0);
+
+    for (uint i = 0; i < 5; ++i)
+        BOOST_CHECK_EQUAL(sidescan.ping(normalDepthMap.getNormalDepthMapNode(), osg::Vec3d(i, 0, 0), osg::Quat()), i);
+
+    osg::ref_ptr<osg::Image> lines = sidescan.readNewLines();
+    BOOST_CHECK_EQUAL(lines->s(), 2 * numBins);
+    BOOST_CHECK_EQUAL(lines->t(), 5);
+    BOOST_CHECK_EQUAL(sidescan.readNewLines()->t(), 0);
+
+    // both sides see the seafloor, symmetrically, and nothing before it
+    float port = lineSum(lines, 4, 0, numBins);
+    float starboard = lineSum(lines, 4, numBins, 2 * numBins);
+    BOOST_CHECK_GT(port, 0);
+    BOOST_CHECK_CLOSE(port, starboard, 1);
+    BOOST_CHECK_EQUAL(lineSum(lines, 4, numBins, numBins + numBins / 5), 0);
+
+    // the ring keeps the last lines only
+    for (uint i = 5; i < 12; ++i)
+        sidescan.ping(normalDepthMap.getNormalDepthMapNode(), osg::Vec3d(i, 0, 0), osg::Quat());
+
+    lines = sidescan.readNewLines();
+    BOOST_CHECK_EQUAL(lines->t(), numLines);
+    BOOST_CHECK_EQUAL(sidescan.getNumPings(), 12);
+
+    osg::ref_ptr<osg::Image> waterfall = sidescan.readWaterfall();
+    BOOST_CHECK_EQUAL(waterfall->t(), numLines);
+    for (uint i = 0; i < numLines; ++i)
+        BOOST_CHECK_CLOSE(lineSum(waterfall, (4 + i) % numLines, 0, 2 * numBins),
+                          lineSum(lines, i, 0, 2 * numBins), 1e-3);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
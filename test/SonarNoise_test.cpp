@@ -0,0 +1,113 @@
+// C++ includes
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+// Rock includes
+#include <normal_depth_map/SonarNoise.hpp>
+
+#define BOOST_TEST_MODULE "SonarNoise_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_SonarNoise)
+
+// frame with the same intensity and depth on the objects, and one
+// background pixel out of ten
+osg::ref_ptr<osg::Image> makeFrame(uint width, uint height, float intensity, float depth) {
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(width, height, 1, GL_RGB, GL_FLOAT);
+    float *pixels = (float*) image->data();
+    for (uint i = 0; i < width * height; ++i) {
+        bool background = (i % 10 == 0);
+        pixels[3 * i] = 0;
+        pixels[3 * i + 1] = background ? 0 : depth;
+        pixels[3 * i + 2] = background ? 0 : intensity;
+    }
+    return image;
+}
+
+// mean and standard deviation of the object intensities
+void intensityStatistics(const osg::Image& image, double& mean, double& deviation) {
+    const float *pixels = (const float*) image.data();
+    double sum = 0, squares = 0;
+    uint count = 0;
+    for (int i = 0; i < image.s() * image.t(); ++i) {
+        if (i % 10 == 0) {
+            BOOST_REQUIRE_EQUAL(pixels[3 * i + 2], 0);
+            continue;
+        }
+        sum += pixels[3 * i + 2];
+        squares += pixels[3 * i + 2] * pixels[3 * i + 2];
+        ++count;
+    }
+    mean = sum / count;
+    deviation = sqrt(squares / count - mean * mean);
+}
+
+BOOST_AUTO_TEST_CASE(philox_TestCase) {
+    // known answers of the Random123 reference implementation
+    uint32_t counter[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+    uint32_t key[2] = {0xa4093822, 0x299f31d0};
+    uint32_t output[4];
+    SonarNoise::philox(counter, key, output);
+    BOOST_CHECK_EQUAL(output[0], 0xd16cfe09);
+    BOOST_CHECK_EQUAL(output[1], 0x94fdcceb);
+    BOOST_CHECK_EQUAL(output[2], 0x5001e420);
+    BOOST_CHECK_EQUAL(output[3], 0x24126ea1);
+
+    uint32_t zeros[4] = {0, 0, 0, 0};
+    SonarNoise::philox(zeros, zeros, output);
+    BOOST_CHECK_EQUAL(output[0], 0x6627e8d5);
+    BOOST_CHECK_EQUAL(output[3], 0x9b00dbd8);
+}
+
+BOOST_AUTO_TEST_CASE(reproducible_TestCase) {
+    ThreadPool pool(1);
+    SonarNoise serial(42, &pool);
+    SonarNoise parallel(42);
+
+    osg::ref_ptr<osg::Image> first = makeFrame(333, 200, 0.4, 0.5);
+    osg::ref_ptr<osg::Image> second = makeFrame(333, 200, 0.4, 0.5);
+    serial.apply(*first, 7);
+    parallel.apply(*second, 7);
+    BOOST_CHECK_EQUAL(memcmp(first->data(), second->data(), first->getTotalSizeInBytes()), 0);
+
+    // another frame gets another noise
+    osg::ref_ptr<osg::Image> next = makeFrame(333, 200, 0.4, 0.5);
+    parallel.apply(*next, 8);
+    BOOST_CHECK_NE(memcmp(first->data(), next->data(), first->getTotalSizeInBytes()), 0);
+
+    osg::ref_ptr<osg::Image> bytes = new osg::Image();
+    bytes->allocateImage(4, 4, 1, GL_RGB, GL_UNSIGNED_BYTE);
+    BOOST_CHECK_THROW(parallel.apply(*bytes, 1), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(distributions_TestCase) {
+    double mean, deviation;
+
+    // unit mean Rayleigh speckle: standard deviation sqrt(4 / PI - 1)
+    SonarNoise speckle(1);
+    osg::ref_ptr<osg::Image> image = makeFrame(512, 512, 0.25, 0.5);
+    speckle.apply(*image, 1);
+    intensityStatistics(*image, mean, deviation);
+    BOOST_CHECK_CLOSE(mean, 0.25, 1);
+    BOOST_CHECK_CLOSE(deviation, 0.25 * sqrt(4 / M_PI - 1), 2);
+
+    // gaussian noise growing with the range
+    SonarNoise gain(1);
+    gain.setSpeckle(0);
+    gain.setGainNoise(0.1);
+    gain.setGainExponent(1);
+    image = makeFrame(512, 512, 0.5, 0.5);
+    gain.apply(*image, 1);
+    intensityStatistics(*image, mean, deviation);
+    BOOST_CHECK_CLOSE(mean, 0.5, 0.5);
+    BOOST_CHECK_CLOSE(deviation, 0.05, 2);
+
+    BOOST_CHECK_THROW(gain.setSpeckle(2), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,80 @@
+// C++ includes
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// Rock includes
+#include <normal_depth_map/ImageViewerCaptureTool.hpp>
+#include <normal_depth_map/NormalDepthMap.hpp>
+#include <normal_depth_map/TiledCaptureTool.hpp>
+
+// OSG includes
+#include <osg/Geode>
+#include <osg/ShapeDrawable>
+
+#define BOOST_TEST_MODULE "TiledCaptureTool_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_TiledCaptureTool)
+
+BOOST_AUTO_TEST_CASE(tilesMatchSinglePass_TestCase) {
+    osg::ref_ptr<osg::Geode> scene = new osg::Geode();
+    scene->addDrawable(new osg::ShapeDrawable(new osg::Sphere(osg::Vec3(1, 0.5, -10), 3)));
+
+    NormalDepthMap normalDepthMap(20, M_PI / 6, M_PI / 6);
+    normalDepthMap.addNodeChild(scene);
+
+    // tiles that do not divide the image, to have cropped border tiles
+    uint width = 300, height = 200;
+    osg::Matrix projection = osg::Matrix::perspective(30, (double) width / height, 0.1, 1000);
+
+    TiledCaptureTool tiled(width, height, 128, 96);
+    tiled.setProjectionMatrix(projection);
+    tiled.setCameraPosition(osg::Vec3d(0, 0, 0), osg::Vec3d(0, 0, -1), osg::Vec3d(0, 1, 0));
+    BOOST_CHECK_EQUAL(tiled.getNumTilesX(), 3);
+    BOOST_CHECK_EQUAL(tiled.getNumTilesY(), 3);
+
+    ImageViewerCaptureTool single(width, height);
+    single.setProjectionMatrix(projection);
+    single.setCameraPosition(osg::Vec3d(0, 0, 0), osg::Vec3d(0, 0, -1), osg::Vec3d(0, 1, 0));
+
+    osg::ref_ptr<osg::Image> stitched = tiled.grabImage(normalDepthMap.getNormalDepthMapNode());
+    osg::ref_ptr<osg::Image> reference = single.grabImage(normalDepthMap.getNormalDepthMapNode());
+    BOOST_CHECK_EQUAL(stitched->s(), width);
+    BOOST_CHECK_EQUAL(stitched->t(), height);
+
+    // same pixels, up to the rasterization of the tile edges
+    uint mismatches = 0, echoes = 0;
+    for (uint y = 0; y < height; ++y) {
+        for (uint x = 0; x < width; ++x) {
+            float *a = (float*) stitched->data(x, y);
+            float *b = (float*) reference->data(x, y);
+            echoes += b[1] > 0;
+            if (fabs(a[1] - b[1]) > 1e-3 || fabs(a[2] - b[2]) > 1e-2)
+                ++mismatches;
+        }
+    }
+    BOOST_CHECK_GT(echoes, 0);
+    BOOST_CHECK_LE(mismatches, width + height);
+
+    // the raw file has the stitched rows
+    std::string path = "/tmp/TiledCaptureTool_test.raw";
+    RawFileTileConsumer file(path);
+    tiled.grab(normalDepthMap.getNormalDepthMapNode(), file);
+
+    size_t rowSize = width * stitched->getPixelSizeInBits() / 8;
+    std::vector<char> row(rowSize);
+    std::ifstream input(path.c_str(), std::ios::binary);
+    input.seekg(rowSize * (height / 2));
+    input.read(&row[0], rowSize);
+    BOOST_CHECK(input.good());
+    BOOST_CHECK_EQUAL(memcmp(&row[0], stitched->data(0, height / 2), rowSize), 0);
+    remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END();
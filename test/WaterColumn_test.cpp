@@ -0,0 +1,170 @@
+// C++ includes
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+// Rock includes
+#include <normal_depth_map/ImageViewerCaptureTool.hpp>
+#include <normal_depth_map/NormalDepthMap.hpp>
+#include <normal_depth_map/Tools.hpp>
+#include <normal_depth_map/WaterColumn.hpp>
+
+// OSG includes
+#include <osg/Geode>
+#include <osg/ShapeDrawable>
+
+#define BOOST_TEST_MODULE "WaterColumn_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_WaterColumn)
+
+// warm surface layer over a cold and fresher deep layer
+WaterColumnProfile makeLayeredProfile() {
+    std::vector<WaterSample> samples;
+    samples.push_back(WaterSample(0, 25, 36, 8.1));
+    samples.push_back(WaterSample(8, 25, 36, 8.1));
+    samples.push_back(WaterSample(12, 4, 30, 7.8));
+    samples.push_back(WaterSample(100, 4, 30, 7.8));
+    return WaterColumnProfile(samples);
+}
+
+BOOST_AUTO_TEST_CASE(soundSpeed_TestCase) {
+    // check value of the Mackenzie equation
+    BOOST_CHECK_CLOSE(underwaterSoundSpeed(25, 1000, 35), 1550.744, 1e-3);
+
+    WaterColumnProfile profile = makeLayeredProfile();
+    BOOST_CHECK_CLOSE(profile.getSoundSpeed(4), underwaterSoundSpeed(25, 4, 36), 1e-6);
+    BOOST_CHECK_CLOSE(profile.getSoundSpeed(50), underwaterSoundSpeed(4, 50, 30), 1e-6);
+    BOOST_CHECK_GT(profile.getSoundSpeed(4), profile.getSoundSpeed(50));
+}
+
+BOOST_AUTO_TEST_CASE(profileInterpolation_TestCase) {
+    WaterColumnProfile profile = makeLayeredProfile();
+    WaterSample middle = profile.getSample(10);
+    BOOST_CHECK_CLOSE(middle.temperature, 14.5, 1e-6);
+    BOOST_CHECK_CLOSE(middle.salinity, 33, 1e-6);
+    BOOST_CHECK_EQUAL(profile.getSample(500).temperature, 4);
+
+    std::vector<WaterSample> unsorted;
+    unsorted.push_back(WaterSample(10, 20, 35, 8));
+    unsorted.push_back(WaterSample(5, 20, 35, 8));
+    BOOST_CHECK_THROW(WaterColumnProfile profile(unsorted), std::invalid_argument);
+    BOOST_CHECK_THROW(WaterColumnProfile profile(std::vector<WaterSample>()), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(cumulativeAttenuation_TestCase) {
+    WaterColumnProfile profile = makeLayeredProfile();
+    double frequency = 700;
+
+    // the mean over a layer is its coefficient
+    BOOST_CHECK_CLOSE(profile.getPathAttenuation(frequency, 1, 7),
+                      underwaterSignalAttenuation(frequency, 25, 4, 36, 8.1), 1);
+
+    // the sampled integral matches the direct one
+    std::vector<double> attenuation, cumulative;
+    profile.sampleAttenuation(frequency, 50, 101, attenuation, cumulative);
+    BOOST_CHECK_EQUAL(cumulative.size(), 101);
+    BOOST_CHECK_CLOSE(cumulative[30], profile.getCumulativeAttenuation(frequency, 15), 0.1);
+    BOOST_CHECK_CLOSE(attenuation[30], profile.getAttenuation(frequency, 15), 1e-6);
+
+    double mean = (cumulative[30] - cumulative[10]) / 10;
+    BOOST_CHECK_CLOSE(mean, profile.getPathAttenuation(frequency, 5, 15), 0.1);
+    BOOST_CHECK_CLOSE(profile.getPathAttenuation(frequency, 15, 5),
+                      profile.getPathAttenuation(frequency, 5, 15), 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(clearWaterColumn_TestCase) {
+    NormalDepthMap normalDepthMap(50, M_PI / 6, M_PI / 6);
+    std::vector<float> coefficients(2, 0.05);
+    normalDepthMap.setAttenuationCoefficients(coefficients);
+
+    // the frequencies replace the coefficients until the column is cleared
+    std::vector<double> frequencies(3, 300);
+    normalDepthMap.setWaterColumn(makeLayeredProfile(), 700, 50, frequencies);
+    normalDepthMap.setWaterColumn(makeLayeredProfile(), 700, 50, frequencies);
+    BOOST_CHECK_EQUAL(normalDepthMap.getAttenuationCoefficients().size(), 3);
+
+    normalDepthMap.clearWaterColumn();
+    BOOST_CHECK(!normalDepthMap.hasWaterColumn());
+    BOOST_CHECK(normalDepthMap.getAttenuationCoefficients() == coefficients);
+}
+
+// ratio of the two multi-frequency intensities at the center of the seabed
+double intensityRatio(NormalDepthMap& normalDepthMap, double& range) {
+    ImageViewerCaptureTool capture(M_PI / 6, M_PI / 6, 100);
+    osg::Vec3d position(0, 0, -5);
+    capture.setCameraPosition(position, position - osg::Vec3d(0, 0, 1), osg::Vec3d(0, 1, 0));
+    osg::ref_ptr<osg::Image> output = capture.attachOutput(NormalDepthMap::INTENSITY_OUTPUT_LOCATION);
+
+    osg::ref_ptr<osg::Image> image = capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+    range = ((float*) image->data(image->s() / 2, image->t() / 2))[1] * 50;
+    float *values = (float*) output->data(output->s() / 2, output->t() / 2);
+    return values[1] / values[0];
+}
+
+BOOST_AUTO_TEST_CASE(waterColumnFrequencies_TestCase) {
+    osg::ref_ptr<osg::Geode> seabed = new osg::Geode();
+    seabed->addDrawable(new osg::ShapeDrawable(new osg::Box(osg::Vec3(0, 0, -15.5), 100, 100, 1)));
+    std::vector<float> coefficients;
+    coefficients.push_back(0.01);
+    coefficients.push_back(0.05);
+
+    // a water column without frequencies keeps the coefficients
+    NormalDepthMap before(50, M_PI / 6, M_PI / 6);
+    before.addNodeChild(seabed);
+    before.setAttenuationCoefficients(coefficients);
+    before.setWaterColumn(makeLayeredProfile(), 700, 50);
+    double range;
+    double ratio = intensityRatio(before, range);
+    BOOST_CHECK_CLOSE(range, 10, 1);
+    BOOST_CHECK_CLOSE(ratio, exp(-2 * 0.04 * range), 0.5);
+
+    // the coefficients set after replace the water column frequencies,
+    // and stay when it is cleared
+    NormalDepthMap after(50, M_PI / 6, M_PI / 6);
+    after.addNodeChild(seabed);
+    after.setWaterColumn(makeLayeredProfile(), 700, 50, std::vector<double>(1, 300));
+    after.setAttenuationCoefficients(coefficients);
+    BOOST_CHECK(after.hasWaterColumn());
+    ratio = intensityRatio(after, range);
+    BOOST_CHECK_CLOSE(ratio, exp(-2 * 0.04 * range), 0.5);
+
+    after.clearWaterColumn();
+    BOOST_CHECK(after.getAttenuationCoefficients() == coefficients);
+}
+
+BOOST_AUTO_TEST_CASE(shaderWaterColumn_TestCase) {
+    WaterColumnProfile profile = makeLayeredProfile();
+    double frequency = 700;
+
+    // seabed 10 m under the sonar, at 15 m depth
+    osg::ref_ptr<osg::Geode> seabed = new osg::Geode();
+    seabed->addDrawable(new osg::ShapeDrawable(new osg::Box(osg::Vec3(0, 0, -15.5), 100, 100, 1)));
+
+    NormalDepthMap normalDepthMap(50, M_PI / 6, M_PI / 6);
+    normalDepthMap.addNodeChild(seabed);
+    normalDepthMap.setWaterColumn(profile, frequency, 50);
+    BOOST_CHECK(normalDepthMap.hasWaterColumn());
+
+    ImageViewerCaptureTool capture(M_PI / 6, M_PI / 6, 100);
+    osg::Vec3d position(0, 0, -5);
+    capture.setCameraPosition(position, position - osg::Vec3d(0, 0, 1), osg::Vec3d(0, 1, 0));
+
+    osg::ref_ptr<osg::Image> image = capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+    float *center = (float*) image->data(image->s() / 2, image->t() / 2);
+    double expected = exp(-2 * profile.getPathAttenuation(frequency, 5, 15) * 10);
+    BOOST_CHECK_CLOSE(center[2], expected, 1);
+
+    // the same as the constant coefficient of the sonar depth only if the
+    // water is uniform
+    normalDepthMap.clearWaterColumn();
+    normalDepthMap.setAttenuationCoefficient(profile.getAttenuation(frequency, 5));
+    image = capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+    center = (float*) image->data(image->s() / 2, image->t() / 2);
+    BOOST_CHECK_GT(fabs(center[2] - expected), 0.01);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
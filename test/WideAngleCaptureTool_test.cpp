@@ -0,0 +1,60 @@
+// C++ includes
+#include <algorithm>
+#include <iostream>
+
+// Rock includes
+#include <normal_depth_map/NormalDepthMap.hpp>
+#include <normal_depth_map/WideAngleCaptureTool.hpp>
+
+// OSG includes
+#include <osg/Geode>
+#include <osg/ShapeDrawable>
+
+#define BOOST_TEST_MODULE "WideAngleCaptureTool_test"
+#include <boost/test/unit_test.hpp>
+
+using namespace normal_depth_map;
+
+BOOST_AUTO_TEST_SUITE(test_WideAngleCaptureTool)
+
+BOOST_AUTO_TEST_CASE(fullTurnEquiangular_TestCase) {
+    // spheres around the eye, every 45 degrees, at the same distance
+    osg::ref_ptr<osg::Geode> scene = new osg::Geode();
+    double distance = 10, radius = 1, maxRange = 20;
+    for (uint i = 0; i < 8; ++i) {
+        double azimuth = i * M_PI / 4;
+        osg::Vec3 center(distance * sin(azimuth), 0, -distance * cos(azimuth));
+        scene->addDrawable(new osg::ShapeDrawable(new osg::Sphere(center, radius)));
+    }
+
+    NormalDepthMap normalDepthMap(maxRange, M_PI / 6, M_PI / 6);
+    normalDepthMap.addNodeChild(scene);
+
+    uint width = 360, height = 60;
+    WideAngleCaptureTool capture(2 * M_PI, M_PI / 3, width, height);
+    capture.setCameraPosition(osg::Vec3d(0, 0, 0), osg::Vec3d(0, 0, -1), osg::Vec3d(0, 1, 0));
+    BOOST_CHECK_EQUAL(capture.getNumFaces(), 4);
+    BOOST_CHECK_GE(capture.getFaceWidth(), width / 4);
+
+    osg::ref_ptr<osg::Image> image = capture.grabImage(normalDepthMap.getNormalDepthMapNode());
+    BOOST_CHECK_EQUAL(image->s(), width);
+    BOOST_CHECK_EQUAL(image->t(), height);
+
+    // same depth in front of each sphere, whatever the face, and nothing
+    // between the spheres
+    for (uint i = 0; i < 8; ++i) {
+        double azimuth = i * M_PI / 4;
+        if (azimuth > M_PI)
+            azimuth -= 2 * M_PI;
+        uint column = std::min((uint) ((azimuth / (2 * M_PI) + 0.5) * width), width - 1);
+
+        float *pixel = (float*) image->data(column, height / 2);
+        BOOST_CHECK_CLOSE(pixel[1] * maxRange, distance - radius, 1);
+        BOOST_CHECK_GT(pixel[2], 0.9);
+
+        float *between = (float*) image->data((column + width / 16) % width, height / 2);
+        BOOST_CHECK_EQUAL(between[1], 0);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();